@@ -52,6 +52,9 @@ public:
     CGSize                   drawableSize() const;
     void                     setDrawableSize(CGSize drawableSize);
 
+    NS::UInteger             maximumDrawableCount() const;
+    void                     setMaximumDrawableCount(NS::UInteger maximumDrawableCount);
+
     class MetalDrawable*     nextDrawable();
 };
 } // namespace CA
@@ -124,6 +127,21 @@ _CA_INLINE void CA::MetalLayer::setDrawableSize(CGSize drawableSize)
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+_CA_INLINE NS::UInteger CA::MetalLayer::maximumDrawableCount() const
+{
+    return Object::sendMessage<NS::UInteger>(this, _CA_PRIVATE_SEL(maximumDrawableCount));
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+_CA_INLINE void CA::MetalLayer::setMaximumDrawableCount(NS::UInteger maximumDrawableCount)
+{
+    return Object::sendMessage<void>(this, _CA_PRIVATE_SEL(setMaximumDrawableCount_),
+        maximumDrawableCount);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 _CA_INLINE CA::MetalDrawable* CA::MetalLayer::nextDrawable()
 {
     return Object::sendMessage<MetalDrawable*>(this,
@@ -111,6 +111,8 @@ namespace Private
             "framebufferOnly");
         _CA_PRIVATE_DEF_SEL(layer,
             "layer");
+        _CA_PRIVATE_DEF_SEL(maximumDrawableCount,
+            "maximumDrawableCount");
         _CA_PRIVATE_DEF_SEL(nextDrawable,
             "nextDrawable");
         _CA_PRIVATE_DEF_SEL(pixelFormat,
@@ -121,6 +123,8 @@ namespace Private
             "setDrawableSize:");
         _CA_PRIVATE_DEF_SEL(setFramebufferOnly_,
             "setFramebufferOnly:");
+        _CA_PRIVATE_DEF_SEL(setMaximumDrawableCount_,
+            "setMaximumDrawableCount:");
         _CA_PRIVATE_DEF_SEL(setPixelFormat_,
             "setPixelFormat:");
         _CA_PRIVATE_DEF_SEL(texture,
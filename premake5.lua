@@ -7,7 +7,7 @@ workspace "MetalRenderer"
 
     filter "configurations:Debug"
         symbols "On"
-        defines { "DEBUG" }
+        defines { "DEBUG", "TRACK_ALLOCATIONS" }
         optimize "Off"
     filter "configurations:Release"
         symbols "Off"
@@ -23,7 +23,7 @@ project "MetalRenderer"
     kind "ConsoleApp"
     language "C++"
     -- compileas "Objective-C++"
-    cppdialect "C++17"
+    cppdialect "C++20"
     files { "src/**.h", "src/**.cpp", "src/**.c", "src/**.m", "src/**.mm", "lib/**" }
     includedirs { "lib/metalcpp", "lib", "lib/imgui" }
     -- /opt/homebrew/Cellar/sdl2/2.30.7
@@ -33,11 +33,45 @@ project "MetalRenderer"
 
     includedirs { "src/**" }
 
-    links { "Foundation.framework", "QuartzCore.framework", "Metal.framework" }
-    linkoptions { "-framework Foundation", "-framework QuartzCore", "-framework Metal" }
+    links { "Foundation.framework", "QuartzCore.framework", "Metal.framework", "MetalFX.framework" }
+    linkoptions { "-framework Foundation", "-framework QuartzCore", "-framework Metal", "-framework MetalFX" }
 
     filter "platforms:x86_64"
         architecture "x86_64"
     filter "platforms:arm64"
         architecture "ARM64"
     filter {}
+
+-- Checks and benchmarks, most for the parts that need no GPU so they also build on Linux:
+-- ./bin/Release/Tests [--bench] [filter]
+project "Tests"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++20"
+    files { "tests/**.hpp", "tests/**.cpp" }
+    files { "src/JobSystem/**.cpp", "src/Task/**.cpp", "src/FrameArena/**.cpp", "src/AllocationCounter/**.cpp" }
+    files { "src/Scene/**.cpp", "src/View/**.cpp", "src/ViewCuller/**.cpp", "src/TLSFAllocator/**.cpp" }
+    files { "src/LightClusters/**.cpp", "src/ShadowCascades/**.cpp", "src/ResolutionController/**.cpp" }
+    files { "src/RedrawTracker/**.cpp", "src/FramePacer/**.cpp" }
+    includedirs { "tests", "src/**" }
+
+    -- Every configuration, the arena tests count heap allocations
+    defines { "TRACK_ALLOCATIONS" }
+    includedirs { "/opt/homebrew/Cellar/glm/1.0.1/include" }
+
+    filter "system:linux"
+        links { "pthread" }
+
+    -- Checks in tests/Metal build against the whole engine, so only where it does
+    filter "system:not macosx"
+        removefiles { "tests/Metal/**" }
+    filter "system:macosx"
+        files { "src/**.cpp", "src/**.mm", "lib/**" }
+        removefiles { "src/main.cpp" }
+        includedirs { "lib/metalcpp", "lib", "lib/imgui" }
+        includedirs { "/opt/homebrew/Cellar/sdl2/2.30.7/include", "/opt/homebrew/Cellar/sdl2/2.30.7/include/SDL2", "/opt/homebrew/Cellar/sdl2_image/2.8.2_2/include", "/opt/homebrew/Cellar/freetype/2.13.3/include/freetype2" }
+        libdirs { "/opt/homebrew/Cellar/sdl2/2.30.7/lib", "/opt/homebrew/Cellar/sdl2_image/2.8.2_2/lib", "/opt/homebrew/Cellar/glm/1.0.1/lib", "/opt/homebrew/Cellar/freetype/2.13.3/lib" }
+        links { "SDL2", "SDL2_image", "glm", "freetype" }
+        links { "Foundation.framework", "QuartzCore.framework", "Metal.framework", "MetalFX.framework" }
+        linkoptions { "-framework Foundation", "-framework QuartzCore", "-framework Metal", "-framework MetalFX" }
+    filter {}
@@ -0,0 +1,13 @@
+#include <metal_stdlib>
+using namespace metal;
+
+// One triangle over the whole viewport at the far plane. With depth testing off and writes on,
+// it clears a view's rectangle part way through a pass.
+vertex float4 clear_VertexShader(uint vertexID [[vertex_id]]) {
+    float2 corner = float2((vertexID << 1) & 2, vertexID & 2);
+    return float4(corner * 2.0 - 1.0, 1.0, 1.0);
+}
+
+fragment float4 clear_FragmentShader(constant float4& color [[buffer(0)]]) {
+    return color;
+}
@@ -7,12 +7,33 @@ struct VertexData {
     float2 texcoord;
 };
 
-struct TransformationData {
-    float4x4 modelMatrix;
+struct ViewData {
     float4x4 viewMatrix;
     float4x4 projectionMatrix;
+    float4x4 viewProjectionMatrix;
+    float4 cameraPosition;
+    float4 frustumPlanes[6];
 };
 
+// One per entity, persistent in the scene buffer. The world matrix is affine, only its top
+// three rows are stored, next to the rows of its inverse transpose for normals.
+struct ObjectData {
+    float4 worldRows[3];
+    float4 normalRows[3];
+    packed_float3 boundsMin;
+    uint entity;
+    packed_float3 boundsMax;
+    uint flags;
+};
+
+static float3 transformPoint(const device ObjectData& object, float4 position) {
+    return float3(dot(object.worldRows[0], position), dot(object.worldRows[1], position), dot(object.worldRows[2], position));
+}
+
+static float3 transformNormal(const device ObjectData& object, float3 normal) {
+    return float3(dot(object.normalRows[0].xyz, normal), dot(object.normalRows[1].xyz, normal), dot(object.normalRows[2].xyz, normal));
+}
+
 struct LightData {
     float3 ambientColor;
     float3 lightPosition;
@@ -24,68 +45,219 @@ struct MaterialData {
     float3 diffuse;
     float3 specular;
     float shininess;
+    uint diffuseTexture;
+    uint features;
 };
 
+// Variant specialization, one per ShaderFeatures bit in PipelineManager.hpp. Every variant sets
+// all of them; the generic one reads the material features from the table instead.
+constant bool featureDiffuseMap [[function_constant(0)]];
+constant bool featureNormalMap [[function_constant(1)]];
+constant bool featureUnlit [[function_constant(2)]];
+constant bool featureAlphaTest [[function_constant(3)]];
+constant bool featureDebugNormals [[function_constant(4)]];
+constant bool featureGeneric [[function_constant(5)]];
+
+constant uint MaterialUnlit = 1 << 2;
+constant uint MaterialAlphaTest = 1 << 3;
+
+// Cut-outs keep the texels at least this opaque
+constant float AlphaCutoff = 0.5;
+
+// Sun falloff, gentle enough to reach across the scene
+constant float ConstantAttenuation = 1.0;
+constant float LinearAttenuation = 0.001;
+constant float QuadraticAttenuation = 0.0001;
+constant float AmbientStrength = 0.3;
+
+// One entry of the texture table, written from the CPU as the texture's resource id
+struct TextureSlot {
+    texture2d<float> texture;
+};
+
+constant uint NoTexture = 0xffffffff;
+
+// World space, reaches nothing past its radius
+struct PointLight {
+    packed_float3 position;
+    float radius;
+    packed_float3 color;
+    float padding;
+};
+
+// A cluster's lights, a range of the cluster index list
+struct ClusterRange {
+    uint offset;
+    uint count;
+};
+
+struct ClusterParams {
+    uint tilesX;
+    uint tilesY;
+    uint slices;
+    uint lightCount;
+    float sliceScale;
+    float sliceBias;
+    float2 screenSize;
+    float2 screenOrigin;
+};
+
+struct ShadowData {
+    float4x4 viewProjection[4];
+    float4 splitFar;
+    float4 texelSize;
+    float4x4 cascadeView;
+};
+
+// Lit fraction of the sun's light, from the first cascade that reaches this depth. Depth is
+// measured from the view the cascades were fitted to, which other views share.
+static float sunShadow(depth2d_array<float> shadowMap, sampler shadowSampler, constant ShadowData& shadows,
+                       float3 worldPos, float3 normal) {
+    float viewDepth = -(shadows.cascadeView * float4(worldPos, 1.0)).z;
+    if (viewDepth > shadows.splitFar[3]) {
+        return 1.0;
+    }
+
+    uint cascade = 0;
+    while (cascade < 3 && viewDepth > shadows.splitFar[cascade]) {
+        cascade++;
+    }
+
+    // Pushed off the surface by a texel or so, or it shadows itself
+    float4 lightPos = shadows.viewProjection[cascade] * float4(worldPos + normal * shadows.texelSize[cascade] * 1.5, 1.0);
+    float2 uv = lightPos.xy * float2(0.5, -0.5) + 0.5;
+
+    // Seen from another view, a point can be at a cascade's depth yet beside its box
+    if (any(uv != saturate(uv))) {
+        return 1.0;
+    }
+    return shadowMap.sample_compare(shadowSampler, uv, cascade, lightPos.z);
+}
+
+// Screen tiles from the top left, then exponential depth slices, as LightClusters builds them
+static uint clusterOf(constant ClusterParams& clusters, float2 pixel, float viewDepth) {
+    float slice = clamp(log(max(viewDepth, 1e-4)) * clusters.sliceScale - clusters.sliceBias, 0.0, float(clusters.slices - 1));
+    uint2 tile = min(uint2(max(pixel - clusters.screenOrigin, 0.0) / clusters.screenSize * float2(clusters.tilesX, clusters.tilesY)),
+                     uint2(clusters.tilesX - 1, clusters.tilesY - 1));
+    return (uint(slice) * clusters.tilesY + tile.y) * clusters.tilesX + tile.x;
+}
+
 struct VertexOut {
     float4 position [[position]];
     float3 normal;
     float2 texcoord;
     float3 fragPos;
+    uint materialId [[flat]];
 };
 
 vertex VertexOut geometry_VertexShader(
     uint vertexID [[vertex_id]],
+    uint instanceID [[instance_id]],
     constant VertexData* vertexData [[buffer(0)]],
-    constant TransformationData& trans [[buffer(1)]]
+    constant ViewData& view [[buffer(1)]],
+    const device ObjectData* objects [[buffer(4)]],
+    constant uint& objectIndex [[buffer(5)]]
 ) {
     VertexOut out;
     float4 position = vertexData[vertexID].position;
     float3 normal = vertexData[vertexID].normal;
+    const device ObjectData& object = objects[objectIndex];
 
-    float4 worldPosition = trans.modelMatrix * position;
-    out.position = trans.projectionMatrix * trans.viewMatrix * worldPosition;
+    float4 worldPosition = float4(transformPoint(object, position), 1.0);
+    out.position = view.viewProjectionMatrix * worldPosition;
     out.fragPos = worldPosition.xyz;
-    out.normal = normalize((trans.modelMatrix * float4(normal, 0.0)).xyz);
+    out.normal = normalize(transformNormal(object, normal));
     out.texcoord = vertexData[vertexID].texcoord;
+
+    // Draws pass their material id as the base instance
+    out.materialId = instanceID;
     return out;
 }
 
 fragment float4 geometry_FragmentShader(
     VertexOut in [[stage_in]],
     constant LightData& lightData [[buffer(1)]],
-    constant MaterialData& material [[buffer(2)]],
-    texture2d<float> diffuseTexture [[texture(0)]],
-    sampler textureSampler [[sampler(0)]]
+    constant MaterialData* materials [[buffer(2)]],
+    const device TextureSlot* textures [[buffer(3)]],
+    constant ViewData& view [[buffer(4)]],
+    const device PointLight* pointLights [[buffer(5)]],
+    const device ClusterRange* clusterRanges [[buffer(6)]],
+    const device uint* clusterIndices [[buffer(7)]],
+    constant ClusterParams& clusters [[buffer(8)]],
+    constant ShadowData& shadows [[buffer(9)]],
+    depth2d_array<float> shadowMap [[texture(0)]],
+    sampler textureSampler [[sampler(0)]],
+    sampler shadowSampler [[sampler(1)]]
 ) {
     float3 normal = normalize(in.normal);
+    if (featureDebugNormals) {
+        return float4(normal, 1.0);
+    }
+
+    MaterialData material = materials[in.materialId];
+
+    // Constants in every variant but the generic one, so the others drop what they do not use.
+    // The table still says when a map's texture is not resident. No model loads normal maps yet,
+    // featureNormalMap is never set.
+    bool hasDiffuseMap = (featureGeneric || featureDiffuseMap) && material.diffuseTexture != NoTexture;
+    bool unlit = featureGeneric ? (material.features & MaterialUnlit) != 0 : featureUnlit;
+    bool alphaTest = featureGeneric ? (material.features & MaterialAlphaTest) != 0 : featureAlphaTest;
+
+    float3 diffuseColor = material.diffuse;
+    if (hasDiffuseMap) {
+        float4 texColor = textures[material.diffuseTexture].texture.sample(textureSampler, in.texcoord);
+        if (alphaTest && texColor.a < AlphaCutoff) {
+            discard_fragment();
+        }
+        diffuseColor *= texColor.rgb;
+    }
+
+    if (unlit) {
+        return float4(min(diffuseColor, float3(1.0)), 1.0);
+    }
+
+    float viewDepth = -(view.viewMatrix * float4(in.fragPos, 1.0)).z;
+    float shadow = sunShadow(shadowMap, shadowSampler, shadows, in.fragPos, normal);
 
     float3 lightDir = lightData.lightPosition - in.fragPos;
     float distance = length(lightDir);
     lightDir = normalize(lightDir);
 
-    float constantAttenuation = 1.0;
-    float linearAttenuation = 0.001;  // Reduce this to make light falloff less drastic
-    float quadraticAttenuation = 0.0001;  // Lower this even more for smooth falloff
-    float attenuation = 1.0 / (constantAttenuation + linearAttenuation * distance + quadraticAttenuation * (distance * distance));
+    float attenuation = 1.0 / (ConstantAttenuation + LinearAttenuation * distance + QuadraticAttenuation * (distance * distance));
 
     // Ambient component
-    float ambientStrength = 0.3;
-    float3 ambient = lightData.ambientColor * material.ambient * ambientStrength;
+    float3 ambient = lightData.ambientColor * material.ambient * AmbientStrength;
 
     // Diffuse component
     float NdotL = max(dot(normal, lightDir), 0.0);
-    float3 diffuseColor = material.diffuse;
-    if (diffuseTexture.get_width() > 0) {
-        float4 texColor = diffuseTexture.sample(textureSampler, in.texcoord);
-        diffuseColor *= texColor.rgb;
-    }
-    float3 diffuse = lightData.lightColor * diffuseColor * NdotL * attenuation;
+    float3 diffuse = lightData.lightColor * diffuseColor * NdotL * attenuation * shadow;
 
     // Specular component
-    float3 viewDir = normalize(-in.fragPos);
+    float3 viewDir = normalize(view.cameraPosition.xyz - in.fragPos);
     float3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    float3 specular = lightData.lightColor * material.specular * spec * attenuation;
+    float3 specular = lightData.lightColor * material.specular * spec * attenuation * shadow;
+
+    // Point lights, only those listed for this fragment's cluster. Clusters are built for the
+    // main view; other views get no lights rather than another view's lists.
+    ClusterRange range = {0, 0};
+    if (clusters.lightCount > 0) {
+        range = clusterRanges[clusterOf(clusters, in.position.xy, viewDepth)];
+    }
+    for (uint i = 0; i < range.count; ++i) {
+        PointLight light = pointLights[clusterIndices[range.offset + i]];
+        float3 toLight = float3(light.position) - in.fragPos;
+        float distanceSquared = dot(toLight, toLight);
+
+        // Smooth window to zero at the radius, so the cluster bounds cut nothing visible
+        float falloff = saturate(1.0 - distanceSquared / (light.radius * light.radius));
+        falloff *= falloff;
+
+        float3 pointDir = toLight * rsqrt(max(distanceSquared, 1e-4));
+        float pointSpec = pow(max(dot(viewDir, reflect(-pointDir, normal)), 0.0), material.shininess);
+        diffuse += float3(light.color) * diffuseColor * max(dot(normal, pointDir), 0.0) * falloff;
+        specular += float3(light.color) * material.specular * pointSpec * falloff;
+    }
 
     // Combine components
     float3 finalColor = ambient + diffuse + specular;
@@ -0,0 +1,38 @@
+#include <metal_stdlib>
+using namespace metal;
+
+struct VertexData {
+    float4 position;
+    float3 normal;
+    float2 texcoord;
+};
+
+struct ObjectData {
+    float4 worldRows[3];
+    float4 normalRows[3];
+    packed_float3 boundsMin;
+    uint entity;
+    packed_float3 boundsMax;
+    uint flags;
+};
+
+struct ShadowVertexOut {
+    float4 position [[position]];
+};
+
+// Depth only, into one cascade of the shadow map
+vertex ShadowVertexOut shadow_VertexShader(
+    uint vertexID [[vertex_id]],
+    constant VertexData* vertexData [[buffer(0)]],
+    constant float4x4& lightViewProjection [[buffer(1)]],
+    const device ObjectData* objects [[buffer(4)]],
+    constant uint& objectIndex [[buffer(5)]]
+) {
+    const device ObjectData& object = objects[objectIndex];
+    float4 position = vertexData[vertexID].position;
+    float3 worldPosition = float3(dot(object.worldRows[0], position), dot(object.worldRows[1], position), dot(object.worldRows[2], position));
+
+    ShadowVertexOut out;
+    out.position = lightViewProjection * float4(worldPosition, 1.0);
+    return out;
+}
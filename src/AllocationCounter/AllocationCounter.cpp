@@ -0,0 +1,64 @@
+#include "AllocationCounter.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocationCount{0};
+
+bool AllocationCounter::isEnabled()
+{
+#ifdef TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t AllocationCounter::getCount()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+void *AllocationCounter::imguiAlloc(size_t size, void *)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size);
+}
+
+void AllocationCounter::imguiFree(void *pointer, void *)
+{
+    std::free(pointer);
+}
+
+#ifdef TRACK_ALLOCATIONS
+
+void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return ::operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+    return ::operator new(size, tag);
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+void operator delete[](void *pointer, size_t) noexcept { std::free(pointer); }
+
+#endif
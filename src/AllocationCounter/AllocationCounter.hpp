@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Process-wide count of heap allocations made through operator new and the ImGui
+// allocator. Only active in builds with TRACK_ALLOCATIONS defined.
+class AllocationCounter
+{
+public:
+    static bool isEnabled();
+    static uint64_t getCount();
+
+    static void *imguiAlloc(size_t size, void *userData);
+    static void imguiFree(void *pointer, void *userData);
+};
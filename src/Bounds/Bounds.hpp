@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cfloat>
+
+// Axis-aligned box, empty until something is added to it
+struct Bounds
+{
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool isEmpty() const { return min.x > max.x; }
+
+    void add(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void add(const Bounds &other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    // Box around the transformed box, from the center and the absolute rotation-scale part
+    Bounds transformed(const glm::mat4 &matrix) const
+    {
+        if (isEmpty())
+            return *this;
+
+        glm::vec3 center = (min + max) * 0.5f;
+        glm::vec3 extent = (max - min) * 0.5f;
+
+        glm::vec3 worldCenter = glm::vec3(matrix * glm::vec4(center, 1.0f));
+        glm::vec3 worldExtent = glm::abs(glm::vec3(matrix[0])) * extent.x +
+                                glm::abs(glm::vec3(matrix[1])) * extent.y +
+                                glm::abs(glm::vec3(matrix[2])) * extent.z;
+
+        return {worldCenter - worldExtent, worldCenter + worldExtent};
+    }
+};
+
+// Six planes facing inwards, extracted from a view-projection matrix (Gribb/Hartmann)
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        glm::mat4 m = glm::transpose(viewProjection);
+        planes[0] = m[3] + m[0];
+        planes[1] = m[3] - m[0];
+        planes[2] = m[3] + m[1];
+        planes[3] = m[3] - m[1];
+        planes[4] = m[3] + m[2];
+        planes[5] = m[3] - m[2];
+    }
+
+    // Conservative: only rejects boxes entirely behind one plane
+    bool intersects(const Bounds &bounds) const
+    {
+        for (const glm::vec4 &plane : planes)
+        {
+            glm::vec3 positive(plane.x >= 0.0f ? bounds.max.x : bounds.min.x,
+                               plane.y >= 0.0f ? bounds.max.y : bounds.min.y,
+                               plane.z >= 0.0f ? bounds.max.z : bounds.min.z);
+
+            if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
@@ -1,15 +1,33 @@
 #include "Engine.hpp"
 #include "ImGuiHandler.hpp"
+#include "FrameArena.hpp"
+#include <glm/gtc/matrix_transform.hpp>
 
-Engine::Engine(const std::string &title)
-    : window(nullptr, SDL_DestroyWindow)
+Engine::Engine(const std::string &title, const std::string &scenePath, const std::string &worldPath)
+    : scenePath(scenePath), window(nullptr, SDL_DestroyWindow)
 {
+    // Constructed on the main thread, which is what pins SDL and Metal work here
+    jobSystem = std::make_unique<JobSystem>();
+    uploadStage = std::make_unique<UploadStage>(*jobSystem);
+    scene = std::make_unique<Scene>();
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
     {
         std::cerr << "SDL_Init Error: " << SDL_GetError() << std::endl;
         return;
     }
 
+    wakeupEvent = SDL_RegisterEvents(1);
+    if (wakeupEvent != (Uint32)-1)
+    {
+        Uint32 type = wakeupEvent;
+        jobSystem->setMainThreadWakeup([type]()
+                                       {
+            SDL_Event event = {};
+            event.type = type;
+            SDL_PushEvent(&event); });
+    }
+
     window.reset(SDL_CreateWindow(title.c_str(),
                                   SDL_WINDOWPOS_CENTERED,
                                   SDL_WINDOWPOS_CENTERED,
@@ -33,6 +51,12 @@ Engine::Engine(const std::string &title)
     // Initialize Renderer
     renderer = std::make_unique<Renderer>(metalView, this);
 
+    if (!worldPath.empty())
+    {
+        worldStreamer = std::make_unique<WorldStreamer>(worldPath, *jobSystem, *uploadStage, renderer->getResources(), *scene,
+                                                        renderer->getPipelineManager(), renderer->getDevice());
+    }
+
     // Initialize ImGui Handler
     imguiHandler = std::make_unique<ImGuiHandler>(window.get(), renderer->getDevice());
     imguiHandler->engine = this;
@@ -45,17 +69,37 @@ Engine::Engine(const std::string &title)
 
 Engine::~Engine()
 {
+    // Workers may still queue main thread work, which must not reach SDL after it quits
+    jobSystem->setMainThreadWakeup(nullptr);
+
+    // The render thread encodes ImGui draw data, stop it before anything it uses goes away
+    if (renderer)
+        renderer->stopRenderThread();
+
+    if (worldStreamer)
+    {
+        printf("World streaming: peak %.1f MB resident, %zu stalled frames\n",
+               worldStreamer->getPeakResidentBytes() / (1024.0 * 1024.0), worldStreamer->getStallCount());
+    }
+
     if (metalView)
         SDL_Metal_DestroyView(metalView);
 
     SDL_Quit();
 }
 
-void Engine::processEvents(float deltaTime)
+bool Engine::processEvents()
 {
+    bool input = false;
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
+        // Main thread work was pumped already, whatever it changed is tracked on its own
+        if (event.type == wakeupEvent)
+            continue;
+
+        input = true;
+
         imguiHandler->processEvent(&event);
 
         if (event.type == SDL_QUIT)
@@ -76,6 +120,11 @@ void Engine::processEvents(float deltaTime)
         }
     }
 
+    return input;
+}
+
+void Engine::sampleInput(float deltaTime)
+{
     if (!imguiHandler->wantsMouseCapture())
     {
         int mouseX, mouseY;
@@ -88,6 +137,8 @@ void Engine::processEvents(float deltaTime)
         const Uint8 *state = SDL_GetKeyboardState(NULL);
         camera.ProcessKeyboardInput(state, deltaTime);
     }
+
+    renderer->getFramePacer().markInputSampled();
 }
 
 void Engine::update(float deltaTime)
@@ -97,7 +148,97 @@ void Engine::update(float deltaTime)
 
 void Engine::draw()
 {
-    renderer->render(camera, *imguiHandler);
+    buildViews();
+    renderer->submitFrame(*scene, views, *imguiHandler);
+}
+
+void Engine::buildViews()
+{
+    views.clear();
+
+    View main;
+    main.viewMatrix = camera.GetViewMatrix();
+    main.position = camera.GetPosition();
+    main.fovY = glm::radians(camera.GetFOV());
+    main.nearPlane = camera.GetNearPlane();
+    main.farPlane = camera.GetFarPlane();
+
+    if (viewLayout == ViewLayout::Single)
+    {
+        views.push_back(main);
+        return;
+    }
+
+    // Straight down on the camera, turned so its heading points up the view
+    glm::vec3 heading = camera.GetFront();
+    heading.y = 0.0f;
+    heading = glm::length(heading) > 1e-4f ? glm::normalize(heading) : glm::vec3(0.0f, 0.0f, -1.0f);
+
+    View overhead = main;
+    overhead.position = main.position + glm::vec3(0.0f, OverheadHeight, 0.0f);
+    overhead.viewMatrix = glm::lookAt(overhead.position, main.position, heading);
+
+    if (viewLayout == ViewLayout::SplitScreen)
+    {
+        main.viewport = glm::vec4(0.0f, 0.0f, 0.5f, 1.0f);
+        overhead.viewport = glm::vec4(0.5f, 0.0f, 0.5f, 1.0f);
+        views.push_back(main);
+        views.push_back(overhead);
+        return;
+    }
+
+    overhead.viewport = glm::vec4(0.7f, 0.05f, 0.25f, 0.25f);
+    views.push_back(main);
+    views.push_back(overhead);
+
+    if (!scene->isValid(inspectedEntity))
+        return;
+
+    const Bounds &bounds = scene->getWorldBounds()[scene->indexOf(inspectedEntity)];
+    if (bounds.isEmpty())
+        return;
+
+    // From a fixed angle, far enough back for the bounding sphere to fill the field of view
+    glm::vec3 centre = (bounds.min + bounds.max) * 0.5f;
+    float radius = std::max(glm::length(bounds.max - bounds.min) * 0.5f, 0.1f);
+    float distance = radius / std::sin(main.fovY * 0.5f);
+
+    View inspect = main;
+    inspect.viewport = glm::vec4(0.7f, 0.35f, 0.25f, 0.25f);
+    inspect.position = centre + glm::normalize(glm::vec3(1.0f, 0.6f, 1.0f)) * distance;
+    inspect.viewMatrix = glm::lookAt(inspect.position, centre, glm::vec3(0.0f, 1.0f, 0.0f));
+    inspect.nearPlane = std::max(distance - radius, 0.01f) * 0.5f;
+    inspect.farPlane = distance + radius * 2.0f;
+    views.push_back(inspect);
+}
+
+FrameState Engine::captureFrameState(bool input)
+{
+    FrameState state;
+    state.viewMatrix = camera.GetViewMatrix();
+    state.fov = camera.GetFOV();
+    state.nearPlane = camera.GetNearPlane();
+    state.farPlane = camera.GetFarPlane();
+    state.drawableSize = renderer->dimensions();
+    state.sceneVersion = scene->getVersion();
+
+    const LightData &light = renderer->lightData;
+    state.ambientColor = glm::vec3(light.ambientColor.x, light.ambientColor.y, light.ambientColor.z);
+    state.lightColor = glm::vec3(light.lightColor.x, light.lightColor.y, light.lightColor.z);
+
+    state.streaming = renderer->getTextureStreamer().getPendingCount() > 0 ||
+                      renderer->getPipelineManager().getPendingCount() > 0 ||
+                      (worldStreamer && worldStreamer->getLoadingCount() > 0);
+    state.input = input;
+    return state;
+}
+
+void Engine::waitForEvents()
+{
+    // Leaves the event queued, the next processEvents handles it
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_WaitEventTimeout(nullptr, IdleTimeoutMs);
+    redrawTracker.addIdleTime((double)(SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency());
 }
 
 void Engine::Run()
@@ -112,12 +253,17 @@ void Engine::Run()
 
     while (running)
     {
+        // Frame rate limit, and in low latency mode a held drawable, before anything is read
+        renderer->getFramePacer().beginFrame();
+
         LAST = NOW;
         NOW = SDL_GetPerformanceCounter();
         deltaTime = (double)((NOW - LAST) / (double)SDL_GetPerformanceFrequency());
         accumulator += deltaTime;
 
-        processEvents(static_cast<float>(deltaTime));
+        jobSystem->pumpMainThread();
+
+        bool input = processEvents();
 
         while (accumulator >= fixedTimeStep)
         {
@@ -125,6 +271,24 @@ void Engine::Run()
             accumulator -= fixedTimeStep;
         }
 
-        draw();
+        sampleInput(static_cast<float>(deltaTime));
+
+        if (worldStreamer)
+            worldStreamer->update(camera.GetPosition(), static_cast<float>(deltaTime));
+
+        if (redrawTracker.needsFrame(captureFrameState(input)))
+        {
+            draw();
+        }
+        else
+        {
+            waitForEvents();
+
+            // Time spent waiting is not simulated, the next delta starts from the wake up
+            NOW = SDL_GetPerformanceCounter();
+        }
+
+        // Main thread transient data (UI labels, scratch arrays) dies with the frame
+        FrameArena::local().reset();
     }
 }
@@ -6,13 +6,30 @@
 #include <SDL2/SDL_metal.h>
 #include "Renderer.hpp"
 #include "Camera.hpp"
+#include "JobSystem.hpp"
+#include "Task.hpp"
+#include "Scene.hpp"
+#include "WorldStreamer.hpp"
+#include "RedrawTracker.hpp"
 
 class ImGuiHandler;
 
+// How the frame is split between views, the main camera's always first
+enum class ViewLayout
+{
+    Single,
+
+    // Overhead and inspection insets over the main view
+    PictureInPicture,
+
+    // Main view on the left half, overhead on the right
+    SplitScreen
+};
+
 class Engine
 {
 public:
-    Engine(const std::string &title);
+    Engine(const std::string &title, const std::string &scenePath, const std::string &worldPath = "");
     ~Engine();
 
     void Run();
@@ -20,17 +37,60 @@ public:
     Renderer *getRenderer() { return renderer.get(); }
     ImGuiHandler *getImGuiHandler() { return imguiHandler.get(); }
     Camera *getCamera() { return &camera; }
+    JobSystem *getJobSystem() { return jobSystem.get(); }
+    UploadStage *getUploadStage() { return uploadStage.get(); }
+    Scene *getScene() { return scene.get(); }
+    WorldStreamer *getWorldStreamer() { return worldStreamer.get(); }
+    const std::string &getScenePath() const { return scenePath; }
+    RedrawTracker &getRedrawTracker() { return redrawTracker; }
+
+    ViewLayout getViewLayout() const { return viewLayout; }
+    void setViewLayout(ViewLayout layout) { viewLayout = layout; }
+
+    // Shown in the inspection inset while picture in picture is on
+    Entity getInspectedEntity() const { return inspectedEntity; }
+    void setInspectedEntity(Entity entity) { inspectedEntity = entity; }
 
 private:
-    void processEvents(float deltaTime);
+    // An idle wait gives up after this long, in case something changed without an event
+    static constexpr int IdleTimeoutMs = 500;
+
+    // Height of the overhead view above the camera
+    static constexpr float OverheadHeight = 40.0f;
+
+    // Returns true when any event was handled
+    bool processEvents();
+
+    // Mouse and keyboard state into the camera, as late as possible before the frame is built
+    void sampleInput(float deltaTime);
     void update(float deltaTime);
     void draw();
+    FrameState captureFrameState(bool input);
+    void waitForEvents();
+
+    // The camera's view, then whatever the layout adds
+    void buildViews();
 
     bool running = false;
+    std::string scenePath;
     std::unique_ptr<SDL_Window, void (*)(SDL_Window *)> window;
     SDL_MetalView metalView = nullptr;
 
+    // Pushed when another thread queues main thread work, so an idle wait returns to pump it
+    Uint32 wakeupEvent = 0;
+
+    // Declared first so workers outlive everything that may schedule onto them
+    std::unique_ptr<JobSystem> jobSystem;
+    std::unique_ptr<UploadStage> uploadStage;
+    std::unique_ptr<Scene> scene;
     std::unique_ptr<Renderer> renderer;
+    // After the renderer, whose resource manager its in-flight loads use
+    std::unique_ptr<WorldStreamer> worldStreamer;
     std::unique_ptr<ImGuiHandler> imguiHandler;
     Camera camera;
+    RedrawTracker redrawTracker;
+
+    ViewLayout viewLayout = ViewLayout::Single;
+    Entity inspectedEntity;
+    std::vector<View> views;
 };
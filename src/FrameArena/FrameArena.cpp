@@ -0,0 +1,110 @@
+#include "FrameArena.hpp"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+FrameArena::FrameArena(size_t blockSize)
+    : blockSize(blockSize)
+{
+    // Blocks come from malloc so growing the arena never shows up as operator new traffic
+    addBlock(blockSize);
+}
+
+FrameArena::~FrameArena()
+{
+    for (Block &block : blocks)
+        std::free(block.data);
+}
+
+void FrameArena::addBlock(size_t minimumSize)
+{
+    size_t size = std::max(blockSize, minimumSize);
+    char *data = static_cast<char *>(std::malloc(size));
+    if (!data)
+        throw std::bad_alloc();
+
+    blocks.push_back({data, size});
+}
+
+void *FrameArena::allocate(size_t size, size_t alignment)
+{
+    while (true)
+    {
+        Block &block = blocks[currentBlock];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+        uintptr_t aligned = (base + offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+        size_t end = static_cast<size_t>(aligned - base) + size;
+
+        if (end <= block.size)
+        {
+            bytesUsed += end - offset;
+            peakBytesUsed = std::max(peakBytesUsed, bytesUsed);
+            offset = end;
+            return reinterpret_cast<void *>(aligned);
+        }
+
+        // Move on to the next block, reusing ones kept from a rewound Scope
+        if (currentBlock + 1 >= blocks.size())
+            addBlock(size + alignment);
+
+        ++currentBlock;
+        offset = 0;
+    }
+}
+
+const char *FrameArena::format(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+
+    int length = std::vsnprintf(nullptr, 0, fmt, args);
+    va_end(args);
+
+    if (length < 0)
+    {
+        va_end(argsCopy);
+        return "";
+    }
+
+    char *buffer = static_cast<char *>(allocate(static_cast<size_t>(length) + 1, 1));
+    std::vsnprintf(buffer, static_cast<size_t>(length) + 1, fmt, argsCopy);
+    va_end(argsCopy);
+
+    return buffer;
+}
+
+void FrameArena::reset()
+{
+    if (blocks.size() > 1)
+    {
+        size_t total = getCapacity();
+        for (Block &block : blocks)
+            std::free(block.data);
+        blocks.clear();
+
+        blockSize = std::max(blockSize, total);
+        addBlock(blockSize);
+    }
+
+    currentBlock = 0;
+    offset = 0;
+    bytesUsed = 0;
+}
+
+size_t FrameArena::getCapacity() const
+{
+    size_t total = 0;
+    for (const Block &block : blocks)
+        total += block.size;
+    return total;
+}
+
+FrameArena &FrameArena::local()
+{
+    static thread_local FrameArena arena;
+    return arena;
+}
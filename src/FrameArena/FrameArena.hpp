@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bump allocator for data that only lives until the end of the current frame. Each thread
+// gets its own arena through local(); the owning thread resets it at its frame boundary.
+// Memory is never returned piecemeal, deallocate is a no-op.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t blockSize = 256 * 1024);
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T *allocateArray(size_t count) { return static_cast<T *>(allocate(sizeof(T) * count, alignof(T))); }
+
+    // printf into the arena, the result is valid until the next reset
+    const char *format(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    // Drops everything; if the frame overflowed into extra blocks they are merged so the next one fits in one
+    void reset();
+
+    size_t getBytesUsed() const { return bytesUsed; }
+    size_t getPeakBytesUsed() const { return peakBytesUsed; }
+    size_t getCapacity() const;
+    size_t getBlockCount() const { return blocks.size(); }
+
+    static FrameArena &local();
+
+    // Rewinds the arena on destruction. Job workers have no frame boundary of their own,
+    // so jobs that want scratch memory wrap it in a Scope.
+    class Scope
+    {
+    public:
+        explicit Scope(FrameArena &arena = FrameArena::local())
+            : arena(arena), block(arena.currentBlock), offset(arena.offset), bytesUsed(arena.bytesUsed) {}
+        ~Scope()
+        {
+            arena.currentBlock = block;
+            arena.offset = offset;
+            arena.bytesUsed = bytesUsed;
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        FrameArena &arena;
+        size_t block;
+        size_t offset;
+        size_t bytesUsed;
+    };
+
+private:
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+
+    void addBlock(size_t minimumSize);
+
+    std::vector<Block> blocks;
+    size_t blockSize;
+    size_t currentBlock = 0;
+    size_t offset = 0;
+    size_t bytesUsed = 0;
+    size_t peakBytesUsed = 0;
+};
+
+// STL adaptor, defaults to the calling thread's arena
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    ArenaAllocator() noexcept : arena(&FrameArena::local()) {}
+    explicit ArenaAllocator(FrameArena &arena) noexcept : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena(other.arena) {}
+
+    T *allocate(size_t count) { return arena->allocateArray<T>(count); }
+    void deallocate(T *, size_t) noexcept {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const noexcept { return arena == other.arena; }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const noexcept { return arena != other.arena; }
+
+    FrameArena *arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+// Shorthand for FrameArena::local().format
+#define arenaFormat(...) FrameArena::local().format(__VA_ARGS__)
@@ -0,0 +1,106 @@
+#include "FramePacer.hpp"
+#include <algorithm>
+#include <thread>
+
+void FramePacer::setMaxFramesInFlight(uint32_t count)
+{
+    maxFramesInFlight.store(std::clamp(count, 2u, 3u), std::memory_order_relaxed);
+}
+
+void FramePacer::beginFrame()
+{
+    auto start = Clock::now();
+    limitFrameRate();
+    auto limited = Clock::now();
+
+    if (isLowLatency())
+        waitForDrawable();
+
+    auto ready = Clock::now();
+    limiterMs.store(std::chrono::duration<float, std::milli>(limited - start).count(), std::memory_order_relaxed);
+    drawableWaitMs.store(std::chrono::duration<float, std::milli>(ready - limited).count(), std::memory_order_relaxed);
+}
+
+void FramePacer::markInputSampled()
+{
+    inputTime = std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+void FramePacer::limitFrameRate()
+{
+    float fps = getTargetFps();
+    if (fps <= 0.0f)
+    {
+        nextFrameStart = {};
+        return;
+    }
+
+    auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    auto now = Clock::now();
+
+    // Starting out, or more than a frame behind: the schedule restarts instead of rushing to catch up
+    if (nextFrameStart == Clock::time_point{} || now - nextFrameStart > period)
+        nextFrameStart = now;
+
+    if (nextFrameStart - now > SpinMargin)
+        std::this_thread::sleep_until(nextFrameStart - SpinMargin);
+
+    while (Clock::now() < nextFrameStart)
+        std::this_thread::yield();
+
+    nextFrameStart += period;
+}
+
+void FramePacer::waitForDrawable()
+{
+    std::unique_lock<std::mutex> lock(drawableMutex);
+    drawableCondition.wait_for(lock, DrawableTimeout, [this]()
+                               { return drawableHeld; });
+}
+
+void FramePacer::frameSubmitted()
+{
+    std::lock_guard<std::mutex> lock(drawableMutex);
+    drawableHeld = false;
+}
+
+void FramePacer::drawableReady()
+{
+    {
+        std::lock_guard<std::mutex> lock(drawableMutex);
+        drawableHeld = true;
+    }
+    drawableCondition.notify_one();
+}
+
+void FramePacer::addPresented(double frameInputTime, double presentTime)
+{
+    // Dropped frames report no present time
+    if (frameInputTime <= 0.0 || presentTime <= frameInputTime)
+        return;
+
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    latencies[latencyNext] = static_cast<float>((presentTime - frameInputTime) * 1000.0);
+    latencyNext = (latencyNext + 1) % LatencyWindow;
+    latencyCount = std::min(latencyCount + 1, LatencyWindow);
+}
+
+float FramePacer::getLatencyMs()
+{
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    if (latencyCount == 0)
+        return 0.0f;
+
+    float sum = 0.0f;
+    for (uint32_t i = 0; i < latencyCount; ++i)
+    {
+        sum += latencies[i];
+    }
+    return sum / float(latencyCount);
+}
+
+float FramePacer::getMaxLatencyMs()
+{
+    std::lock_guard<std::mutex> lock(latencyMutex);
+    return latencyCount ? *std::max_element(latencies.begin(), latencies.begin() + latencyCount) : 0.0f;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Paces the main thread against the render thread and the display.
+//
+// Throughput mode lets the main thread build the next frame while the render thread waits for
+// a drawable, so input is read a frame or more before the drawable it ends up in exists. Low
+// latency mode turns that around: the render thread takes the next drawable first and the main
+// thread only reads input once one is held, so a frame's input is as fresh as the display
+// allows. Either way an optional target frame rate spaces frame starts by sleeping until
+// shortly before the deadline and yielding the rest, as a plain sleep overshoots.
+//
+// Latency is estimated per frame from the moment input was read to the drawable's present time.
+// Both use the host clock that steady_clock and Core Animation share on macOS.
+//
+// No GPU types, the renderer feeds it drawable and present events.
+class FramePacer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr uint32_t LatencyWindow = 60;
+
+    // The main thread gives up waiting for a drawable after this long and builds the frame anyway
+    static constexpr std::chrono::milliseconds DrawableTimeout{100};
+
+    // How long before a frame deadline the limiter stops sleeping and starts yielding
+    static constexpr std::chrono::microseconds SpinMargin{1500};
+
+    // Settings, any thread
+    void setLowLatency(bool value) { lowLatency.store(value, std::memory_order_relaxed); }
+    bool isLowLatency() const { return lowLatency.load(std::memory_order_relaxed); }
+
+    // Frames started per second, 0 leaves it to the display
+    void setTargetFps(float value) { targetFps.store(value > 0.0f ? value : 0.0f, std::memory_order_relaxed); }
+    float getTargetFps() const { return targetFps.load(std::memory_order_relaxed); }
+
+    // Drawables the layer hands out before nextDrawable blocks, 2 or 3
+    void setMaxFramesInFlight(uint32_t count);
+    uint32_t getMaxFramesInFlight() const { return maxFramesInFlight.load(std::memory_order_relaxed); }
+
+    // Main thread, at the top of the frame: waits for the frame rate limit and, in low latency
+    // mode, for a held drawable
+    void beginFrame();
+
+    // Main thread, as the camera reads mouse and keyboard state for the frame
+    void markInputSampled();
+    double getInputTime() const { return inputTime; }
+
+    // Main thread, as the frame goes to the render thread: the held drawable is spoken for
+    void frameSubmitted();
+
+    // Render thread, once it holds the drawable for the next frame
+    void drawableReady();
+
+    // Any thread, when a frame whose input was read at frameInputTime reached the display
+    void addPresented(double frameInputTime, double presentTime);
+
+    // Input to present over the last LatencyWindow frames
+    float getLatencyMs();
+    float getMaxLatencyMs();
+
+    // Main thread time spent in the limiter and waiting for a drawable in the last beginFrame
+    float getLimiterMs() const { return limiterMs.load(std::memory_order_relaxed); }
+    float getDrawableWaitMs() const { return drawableWaitMs.load(std::memory_order_relaxed); }
+
+private:
+    void limitFrameRate();
+    void waitForDrawable();
+
+    std::atomic<bool> lowLatency{false};
+    std::atomic<float> targetFps{0.0f};
+    std::atomic<uint32_t> maxFramesInFlight{3};
+
+    // Main thread
+    Clock::time_point nextFrameStart;
+    double inputTime = 0.0;
+
+    std::mutex drawableMutex;
+    std::condition_variable drawableCondition;
+    bool drawableHeld = false;
+
+    std::mutex latencyMutex;
+    std::array<float, LatencyWindow> latencies{};
+    uint32_t latencyCount = 0;
+    uint32_t latencyNext = 0;
+
+    std::atomic<float> limiterMs{0.0f};
+    std::atomic<float> drawableWaitMs{0.0f};
+};
@@ -0,0 +1,280 @@
+#include "GeometryBuffer.hpp"
+#include "Mesh.hpp"
+#include "ResourcePool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+GeometryBuffer::GeometryBuffer(MTL::Device *device)
+    : device(device)
+{
+}
+
+GeometryBuffer::~GeometryBuffer()
+{
+    for (Page &page : pages)
+    {
+        if (page.vertexBuffer)
+            page.vertexBuffer->release();
+        if (page.indexBuffer)
+            page.indexBuffer->release();
+    }
+}
+
+GeometryAllocation GeometryBuffer::allocate(const VertexData *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount)
+{
+    GeometryAllocation allocation;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        allocation = allocateLocked(vertexCount, indexCount);
+    }
+
+    // The ranges are ours alone, the copy needs no lock
+    memcpy(const_cast<VertexData *>(getVertices(allocation)), vertices, size_t(vertexCount) * sizeof(VertexData));
+    memcpy(const_cast<uint32_t *>(getIndices(allocation)), indices, size_t(indexCount) * sizeof(uint32_t));
+    return allocation;
+}
+
+GeometryAllocation GeometryBuffer::allocateLocked(uint32_t vertexCount, uint32_t indexCount, bool newPage)
+{
+    // Zero sized ranges still need a page to point at
+    vertexCount = std::max(vertexCount, 1u);
+    indexCount = std::max(indexCount, 1u);
+
+    for (uint32_t i = 0; i < MaxPages; ++i)
+    {
+        Page &page = pages[i];
+        if (!page.vertexBuffer || page.evacuating)
+            continue;
+
+        GeometryAllocation allocation;
+        allocation.vertices = page.vertices.allocate(vertexCount);
+        if (!allocation.vertices.isValid())
+            continue;
+
+        allocation.indices = page.indices.allocate(indexCount);
+        if (!allocation.indices.isValid())
+        {
+            page.vertices.free(allocation.vertices);
+            continue;
+        }
+
+        allocation.page = i;
+        return allocation;
+    }
+
+    if (!newPage)
+        return {};
+
+    for (uint32_t i = 0; i < MaxPages; ++i)
+    {
+        Page &page = pages[i];
+        if (page.vertexBuffer)
+            continue;
+
+        // Oversized meshes get a page of their own, large enough for the allocator to fit them whole
+        uint32_t pageVertices = std::max(TLSFAllocator::capacityFor(vertexCount), PageVertexCount);
+        uint32_t pageIndices = std::max(TLSFAllocator::capacityFor(indexCount), PageIndexCount);
+        // Null when the GPU is out of memory, or without a device at all
+        page.vertexBuffer = device ? device->newBuffer(size_t(pageVertices) * sizeof(VertexData), MTL::ResourceStorageModeShared) : nullptr;
+        page.indexBuffer = device ? device->newBuffer(size_t(pageIndices) * sizeof(uint32_t), MTL::ResourceStorageModeShared) : nullptr;
+        if (!page.vertexBuffer || !page.indexBuffer)
+        {
+            if (page.vertexBuffer)
+                page.vertexBuffer->release();
+            if (page.indexBuffer)
+                page.indexBuffer->release();
+            page = Page();
+            throw std::runtime_error("Geometry buffer cannot allocate a page");
+        }
+        page.vertices = TLSFAllocator(pageVertices);
+        page.indices = TLSFAllocator(pageIndices);
+        page.evacuating = false;
+
+        GeometryAllocation allocation;
+        allocation.page = i;
+        allocation.vertices = page.vertices.allocate(vertexCount);
+        allocation.indices = page.indices.allocate(indexCount);
+        if (!allocation.vertices.isValid() || !allocation.indices.isValid())
+        {
+            page.vertexBuffer->release();
+            page.indexBuffer->release();
+            page = Page();
+            throw std::runtime_error("Geometry buffer cannot fit a mesh of " + std::to_string(vertexCount) + " vertices");
+        }
+        return allocation;
+    }
+
+    throw std::runtime_error("Geometry buffer is out of pages");
+}
+
+void GeometryBuffer::free(const GeometryAllocation &allocation)
+{
+    if (!allocation.isValid())
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    freeLocked(allocation);
+}
+
+void GeometryBuffer::freeLocked(const GeometryAllocation &allocation)
+{
+    Page &page = pages[allocation.page];
+    page.vertices.free(allocation.vertices);
+    page.indices.free(allocation.indices);
+}
+
+const VertexData *GeometryBuffer::getVertices(const GeometryAllocation &allocation) const
+{
+    return static_cast<const VertexData *>(pages[allocation.page].vertexBuffer->contents()) + allocation.vertices.offset;
+}
+
+const uint32_t *GeometryBuffer::getIndices(const GeometryAllocation &allocation) const
+{
+    return static_cast<const uint32_t *>(pages[allocation.page].indexBuffer->contents()) + allocation.indices.offset;
+}
+
+size_t GeometryBuffer::pageUsedBytes(const Page &page) const
+{
+    return size_t(page.vertices.getUsed()) * sizeof(VertexData) + size_t(page.indices.getUsed()) * sizeof(uint32_t);
+}
+
+size_t GeometryBuffer::pageCapacityBytes(const Page &page) const
+{
+    return size_t(page.vertices.getCapacity()) * sizeof(VertexData) + size_t(page.indices.getCapacity()) * sizeof(uint32_t);
+}
+
+void GeometryBuffer::collect(uint64_t completedFrame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    movedBytes = 0;
+
+    auto firstPending = std::partition(retired.begin(), retired.end(), [completedFrame](const Retired &entry)
+                                       { return entry.frame <= completedFrame; });
+    for (auto it = retired.begin(); it != firstPending; ++it)
+    {
+        freeLocked(it->allocation);
+    }
+    retired.erase(retired.begin(), firstPending);
+
+    // Nothing can reference an emptied page: its meshes moved out and their old ranges were
+    // only just freed, after the GPU finished with them
+    for (Page &page : pages)
+    {
+        if (!page.evacuating || page.vertices.getAllocationCount() > 0 || page.indices.getAllocationCount() > 0)
+            continue;
+
+        page.vertexBuffer->release();
+        page.indexBuffer->release();
+        page = Page();
+    }
+}
+
+void GeometryBuffer::chooseEvacuation()
+{
+    Page *sparsest = nullptr;
+    size_t pageCount = 0;
+    for (Page &page : pages)
+    {
+        if (!page.vertexBuffer)
+            continue;
+        if (page.evacuating)
+            return;
+
+        pageCount++;
+        if (!sparsest || pageUsedBytes(page) * pageCapacityBytes(*sparsest) < pageUsedBytes(*sparsest) * pageCapacityBytes(page))
+            sparsest = &page;
+    }
+
+    if (pageCount < 2 || pageUsedBytes(*sparsest) >= MinUtilization * pageCapacityBytes(*sparsest))
+        return;
+
+    // Only worth starting if the rest of the pages can take everything in it
+    uint32_t freeVertices = 0;
+    uint32_t freeIndices = 0;
+    for (Page &page : pages)
+    {
+        if (page.vertexBuffer && &page != sparsest)
+        {
+            freeVertices += page.vertices.getLargestFree();
+            freeIndices += page.indices.getLargestFree();
+        }
+    }
+    if (freeVertices >= sparsest->vertices.getUsed() && freeIndices >= sparsest->indices.getUsed())
+        sparsest->evacuating = true;
+}
+
+bool GeometryBuffer::needsDefragment()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    chooseEvacuation();
+    return std::any_of(pages.begin(), pages.end(), [](const Page &page)
+                       { return page.evacuating; });
+}
+
+void GeometryBuffer::defragment(ResourcePool<Mesh> &meshes, uint64_t frame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (Mesh &mesh : meshes)
+    {
+        GeometryAllocation from = mesh.getGeometry();
+        if (!from.isValid() || !pages[from.page].evacuating)
+            continue;
+
+        // Moving into a fresh page would defeat the purpose, wait for room instead
+        GeometryAllocation to = allocateLocked(from.vertices.size, from.indices.size, false);
+        if (!to.isValid())
+            break;
+
+        size_t vertexBytes = size_t(from.vertices.size) * sizeof(VertexData);
+        size_t indexBytes = size_t(from.indices.size) * sizeof(uint32_t);
+        memcpy(const_cast<VertexData *>(getVertices(to)), getVertices(from), vertexBytes);
+        memcpy(const_cast<uint32_t *>(getIndices(to)), getIndices(from), indexBytes);
+
+        mesh.setGeometry(to);
+        retired.push_back({from, frame});
+
+        movedBytes += vertexBytes + indexBytes;
+        if (movedBytes >= MoveBudget)
+            break;
+    }
+}
+
+GeometryBuffer::Stats GeometryBuffer::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Stats stats;
+    size_t freeBytes = 0;
+    for (const Page &page : pages)
+    {
+        if (!page.vertexBuffer)
+            continue;
+
+        stats.pageCount++;
+        stats.capacityBytes += pageCapacityBytes(page);
+        stats.usedBytes += pageUsedBytes(page);
+        freeBytes += size_t(page.vertices.getFree()) * sizeof(VertexData) + size_t(page.indices.getFree()) * sizeof(uint32_t);
+        stats.largestFreeBytes = std::max({stats.largestFreeBytes, size_t(page.vertices.getLargestFree()) * sizeof(VertexData),
+                                           size_t(page.indices.getLargestFree()) * sizeof(uint32_t)});
+    }
+
+    if (freeBytes > 0)
+    {
+        // Each allocator's fragmentation, weighted by the free bytes it holds
+        float weighted = 0.0f;
+        for (const Page &page : pages)
+        {
+            if (!page.vertexBuffer)
+                continue;
+
+            weighted += page.vertices.getFragmentation() * page.vertices.getFree() * sizeof(VertexData) +
+                        page.indices.getFragmentation() * page.indices.getFree() * sizeof(uint32_t);
+        }
+        stats.fragmentation = weighted / freeBytes;
+    }
+    stats.movedBytes = movedBytes;
+    return stats;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <Metal/Metal.hpp>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "TLSFAllocator.hpp"
+#include "VertexData.hpp"
+
+class Mesh;
+template <typename T>
+class ResourcePool;
+
+// Where a mesh's vertices and indices live: a page of the geometry buffer and a range of
+// each of its two buffers, in vertices and indices
+struct GeometryAllocation
+{
+    static constexpr uint32_t InvalidPage = ~0u;
+
+    uint32_t page = InvalidPage;
+    TLSFAllocator::Allocation vertices;
+    TLSFAllocator::Allocation indices;
+
+    bool isValid() const { return page != InvalidPage; }
+};
+
+// Every mesh's geometry, sub-allocated out of a few large pages. A page is one vertex buffer
+// and one index buffer, each managed by a TLSF allocator. Meshes draw with a base vertex and
+// an index buffer offset, so draws from the same page share one vertex buffer binding.
+//
+// Pages never grow or move while in use. When a page falls below MinUtilization the meshes in
+// it are moved into the others a little each frame, and it is released once empty. The ranges
+// they leave are freed only after the GPU has completed the frame they were moved in.
+//
+// Threading: allocate and free may be called from any thread. collect and defragment are
+// main thread only; defragment rewrites meshes in the pool, so the caller holds its lock.
+class GeometryBuffer
+{
+public:
+    static constexpr uint32_t MaxPages = 16;
+
+    // 48 MB of vertices and 16 MB of indices, larger meshes get a page to themselves
+    static constexpr uint32_t PageVertexCount = 1u << 20;
+    static constexpr uint32_t PageIndexCount = 1u << 22;
+
+    static constexpr float MinUtilization = 0.5f;
+
+    // Bytes moved per frame while defragmenting
+    static constexpr size_t MoveBudget = 8u << 20;
+
+    struct Stats
+    {
+        size_t pageCount = 0;
+        size_t capacityBytes = 0;
+        size_t usedBytes = 0;
+        size_t largestFreeBytes = 0;
+        float fragmentation = 0.0f;
+        size_t movedBytes = 0;
+    };
+
+    explicit GeometryBuffer(MTL::Device *device);
+    GeometryBuffer(const GeometryBuffer &) = delete;
+    GeometryBuffer &operator=(const GeometryBuffer &) = delete;
+    ~GeometryBuffer();
+
+    // Any thread: finds room and copies the data in. Throws when every page is taken.
+    GeometryAllocation allocate(const VertexData *vertices, uint32_t vertexCount, const uint32_t *indices, uint32_t indexCount);
+
+    // Any thread, once the GPU can no longer read the range
+    void free(const GeometryAllocation &allocation);
+
+    MTL::Buffer *getVertexBuffer(const GeometryAllocation &allocation) const { return pages[allocation.page].vertexBuffer; }
+    MTL::Buffer *getIndexBuffer(const GeometryAllocation &allocation) const { return pages[allocation.page].indexBuffer; }
+    const VertexData *getVertices(const GeometryAllocation &allocation) const;
+    const uint32_t *getIndices(const GeometryAllocation &allocation) const;
+
+    // Main thread, at the start of a frame: frees ranges the GPU has finished with and
+    // releases pages that have been emptied
+    void collect(uint64_t completedFrame);
+
+    // Main thread: whether defragment has anything to do, so the pool lock can be skipped
+    bool needsDefragment();
+
+    // Main thread, with the mesh pool locked: moves meshes out of sparse pages, up to
+    // MoveBudget bytes. frame is the frame being built, the last that may read the old ranges.
+    void defragment(ResourcePool<Mesh> &meshes, uint64_t frame);
+
+    Stats getStats();
+
+private:
+    struct Page
+    {
+        MTL::Buffer *vertexBuffer = nullptr;
+        MTL::Buffer *indexBuffer = nullptr;
+        TLSFAllocator vertices;
+        TLSFAllocator indices;
+
+        // Takes no new allocations, its meshes are being moved out
+        bool evacuating = false;
+    };
+
+    struct Retired
+    {
+        GeometryAllocation allocation;
+        uint64_t frame;
+    };
+
+    // Caller holds mutex. Without newPage, invalid when the existing pages are full.
+    GeometryAllocation allocateLocked(uint32_t vertexCount, uint32_t indexCount, bool newPage = true);
+    void freeLocked(const GeometryAllocation &allocation);
+    void chooseEvacuation();
+    size_t pageUsedBytes(const Page &page) const;
+    size_t pageCapacityBytes(const Page &page) const;
+
+    MTL::Device *device;
+    std::mutex mutex;
+
+    std::array<Page, MaxPages> pages;
+    std::vector<Retired> retired;
+    size_t movedBytes = 0;
+};
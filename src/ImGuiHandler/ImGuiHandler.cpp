@@ -1,13 +1,20 @@
 #include "ImGuiHandler.hpp"
 #include "Engine.hpp"
 #include "Camera.hpp"
-#include "Renderable.hpp"
+#include "FrameArena.hpp"
+#include "AllocationCounter.hpp"
 #include <string>
 
 ImGuiHandler::ImGuiHandler(SDL_Window *window, MTL::Device *device)
     : window(window)
 {
     IMGUI_CHECKVERSION();
+
+    if (AllocationCounter::isEnabled())
+    {
+        ImGui::SetAllocatorFunctions(AllocationCounter::imguiAlloc, AllocationCounter::imguiFree);
+    }
+
     ImGui::CreateContext();
     ImGuiIO &io = ImGui::GetIO();
     (void)io;
@@ -18,6 +25,9 @@ ImGuiHandler::ImGuiHandler(SDL_Window *window, MTL::Device *device)
 
     ImGui_ImplMetal_Init(device);
     ImGui_ImplSDL2_InitForMetal(window);
+
+    // Build the font atlas here, the render thread's NewFrame must not touch shared IO state
+    ImGui_ImplMetal_CreateDeviceObjects(device);
 }
 
 ImGuiHandler::~ImGuiHandler()
@@ -32,25 +42,79 @@ void ImGuiHandler::processEvent(SDL_Event *event)
     ImGui_ImplSDL2_ProcessEvent(event);
 }
 
-void ImGuiHandler::render(MTL::CommandBuffer *commandBuffer, MTL::RenderPassDescriptor *renderPassDescriptor)
+template <typename T>
+static void copyInto(ImVector<T> &destination, const ImVector<T> &source)
+{
+    // resize keeps capacity, unlike ImVector's assignment which frees first
+    destination.resize(source.Size);
+    if (source.Size > 0)
+    {
+        memcpy(destination.Data, source.Data, source.size_in_bytes());
+    }
+}
+
+void ImGuiFrame::capture(const ImDrawData *source)
+{
+    drawData.Valid = source->Valid;
+    drawData.DisplayPos = source->DisplayPos;
+    drawData.DisplaySize = source->DisplaySize;
+    drawData.FramebufferScale = source->FramebufferScale;
+    drawData.CmdListsCount = source->CmdListsCount;
+    drawData.TotalIdxCount = source->TotalIdxCount;
+    drawData.TotalVtxCount = source->TotalVtxCount;
+    drawData.CmdLists.resize(0);
+
+    for (int i = 0; i < source->CmdLists.Size; ++i)
+    {
+        const ImDrawList *sourceList = source->CmdLists[i];
+
+        if (i >= drawLists.Size)
+        {
+            drawLists.push_back(IM_NEW(ImDrawList)(sourceList->_Data));
+        }
+
+        ImDrawList *drawList = drawLists[i];
+        copyInto(drawList->CmdBuffer, sourceList->CmdBuffer);
+        copyInto(drawList->IdxBuffer, sourceList->IdxBuffer);
+        copyInto(drawList->VtxBuffer, sourceList->VtxBuffer);
+        drawList->Flags = sourceList->Flags;
+
+        drawData.CmdLists.push_back(drawList);
+    }
+}
+
+void ImGuiFrame::clear()
+{
+    for (ImDrawList *drawList : drawLists)
+    {
+        IM_DELETE(drawList);
+    }
+    drawLists.clear();
+    drawData.Clear();
+}
+
+void ImGuiHandler::buildFrame(ImGuiFrame &frame)
 {
-    // Pass the correct renderPassDescriptor to ImGui
-    ImGui_ImplMetal_NewFrame(renderPassDescriptor);
     ImGui_ImplSDL2_NewFrame();
     ImGui::NewFrame();
 
     drawInterface();
 
     ImGui::Render();
-    ImDrawData *drawData = ImGui::GetDrawData();
+    frame.capture(ImGui::GetDrawData());
+}
 
-    // Create a new render command encoder for ImGui
+void ImGuiHandler::render(MTL::CommandBuffer *commandBuffer, MTL::RenderPassDescriptor *renderPassDescriptor, ImGuiFrame &frame)
+{
+    // Pass the correct renderPassDescriptor to ImGui
+    ImGui_ImplMetal_NewFrame(renderPassDescriptor);
+
+    // Create a new render command encoder for ImGui, owned by the render thread's autorelease pool
     MTL::RenderCommandEncoder *imguiRenderCommandEncoder = commandBuffer->renderCommandEncoder(renderPassDescriptor);
 
-    ImGui_ImplMetal_RenderDrawData(drawData, commandBuffer, imguiRenderCommandEncoder);
+    ImGui_ImplMetal_RenderDrawData(&frame.drawData, commandBuffer, imguiRenderCommandEncoder);
 
     imguiRenderCommandEncoder->endEncoding();
-    imguiRenderCommandEncoder->release();
 }
 
 glm::vec3 Start = {0.0f, 0.0f, 0.0f};
@@ -61,7 +125,7 @@ glm::vec3 intersection = {0.0f, 0.0f, 0.0f};
 void ImGuiHandler::drawInterface()
 {
     // Obtain references to required engine components
-    auto &renderables = engine->getRenderer()->getRenderables();
+    Scene &scene = *engine->getScene();
     auto *camera = engine->getCamera();
     auto aspectRatio = engine->getRenderer()->aspectRatio();
 
@@ -80,18 +144,18 @@ void ImGuiHandler::drawInterface()
     {
         ImGui::Begin("Renderables");
 
-        int index = 0;
-
-        for (auto &renderable : renderables)
+        for (uint32_t index = 0; index < scene.size(); ++index)
         {
-            std::string renderableName = renderable->name + " (" + std::to_string(index) + ")";
+            Entity entity = scene.entityAt(index);
+            const char *renderableName = arenaFormat("%s (%u)", scene.getName(entity).c_str(), index);
 
-            if (ImGui::CollapsingHeader(renderableName.c_str()))
+            if (ImGui::CollapsingHeader(renderableName))
             {
                 glm::vec4 viewport = engine->getRenderer()->viewport();
+                glm::vec3 worldPosition = scene.getWorldPosition(entity);
 
                 glm::vec2 screenPos = engine->getRenderer()->WorldToScreen(
-                    renderable->getPosition(),
+                    worldPosition,
                     camera->GetProjectionMatrix(aspectRatio),
                     camera->GetViewMatrix(),
                     viewport);
@@ -109,35 +173,39 @@ void ImGuiHandler::drawInterface()
 
                     drawList->AddText(ImVec2(screenPos.x, screenPos.y),
                                       IM_COL32(255, 255, 255, 255),
-                                      renderableName.c_str());
+                                      renderableName);
                 }
 
                 ImGui::Text("Position: (%.2f, %.2f, %.2f)",
-                            renderable->getPosition().x,
-                            renderable->getPosition().y,
-                            renderable->getPosition().z);
+                            worldPosition.x, worldPosition.y, worldPosition.z);
                 ImGui::Text("Status: %s",
                             isInFrontOfCamera ? "In front of the camera"
                                               : "Behind the camera or invalid");
 
-                if (ImGui::Button(("Teleport##" + std::to_string(index)).c_str()))
+                if (ImGui::Button(arenaFormat("Teleport##%u", index)))
+                {
+                    camera->Teleport(worldPosition);
+                }
+                ImGui::SameLine();
+                if (ImGui::Button(arenaFormat("Look At##%u", index)))
                 {
-                    camera->Teleport(renderable->getPosition());
+                    camera->LookAt(worldPosition);
                 }
                 ImGui::SameLine();
-                if (ImGui::Button(("Look At##" + std::to_string(index)).c_str()))
+                if (ImGui::Button(arenaFormat("Inspect##%u", index)))
                 {
-                    camera->LookAt(renderable->getPosition());
+                    // Shown in the picture in picture inset
+                    engine->setInspectedEntity(entity);
+                    engine->setViewLayout(ViewLayout::PictureInPicture);
                 }
 
-                glm::vec3 position = renderable->getPosition();
+                glm::vec3 position = scene.getPosition(entity);
                 float pos[3] = {position.x, position.y, position.z};
-                if (ImGui::DragFloat3(("Position##" + std::to_string(index)).c_str(), pos, 0.1f))
+                if (ImGui::DragFloat3(arenaFormat("Position##%u", index), pos, 0.1f))
                 {
-                    renderable->setPosition(glm::vec3(pos[0], pos[1], pos[2]));
+                    scene.setPosition(entity, glm::vec3(pos[0], pos[1], pos[2]));
                 }
             }
-            index++;
         }
 
         ImGui::End();
@@ -173,6 +241,158 @@ void ImGuiHandler::drawInterface()
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("Job System");
+
+        JobSystem *jobSystem = engine->getJobSystem();
+        JobSystemStats stats = jobSystem->getStats();
+
+        ImGui::Text("Workers: %u", stats.workerCount);
+        ImGui::Text("Jobs Executed: %llu", static_cast<unsigned long long>(stats.jobsExecuted));
+        ImGui::Text("Main Thread Jobs: %llu", static_cast<unsigned long long>(stats.mainThreadJobs));
+        ImGui::Text("Steals: %llu (failed %llu)", static_cast<unsigned long long>(stats.steals), static_cast<unsigned long long>(stats.failedSteals));
+        ImGui::Text("Worker Idle Time: %.2fs", stats.idleSeconds);
+
+        if (ImGui::Button("Reset##JobStats"))
+        {
+            jobSystem->resetStats();
+        }
+
+        ImGui::End();
+    }
+
+    {
+        ImGui::Begin("Frame Timing");
+
+        Renderer *renderer = engine->getRenderer();
+        ImGui::Text("Frame: %.2f ms (%.0f FPS)", io.DeltaTime * 1000.0f, io.Framerate);
+
+        RedrawTracker &redraw = engine->getRedrawTracker();
+        bool onDemand = redraw.isEnabled();
+        if (ImGui::Checkbox("Render On Demand", &onDemand))
+        {
+            redraw.setEnabled(onDemand);
+        }
+        ImGui::Text("Frames: %llu drawn, %llu idle (%.1fs waiting)", static_cast<unsigned long long>(redraw.getActiveFrames()),
+                    static_cast<unsigned long long>(redraw.getIdleFrames()), redraw.getIdleSeconds());
+
+        FramePacer &pacer = renderer->getFramePacer();
+        bool lowLatency = pacer.isLowLatency();
+        if (ImGui::Checkbox("Low Latency", &lowLatency))
+        {
+            pacer.setLowLatency(lowLatency);
+        }
+        int framesInFlight = static_cast<int>(pacer.getMaxFramesInFlight());
+        if (ImGui::SliderInt("Frames In Flight", &framesInFlight, 2, 3))
+        {
+            pacer.setMaxFramesInFlight(static_cast<uint32_t>(framesInFlight));
+        }
+        int targetFps = static_cast<int>(pacer.getTargetFps());
+        if (ImGui::SliderInt("Target FPS (0 = display)", &targetFps, 0, 240))
+        {
+            pacer.setTargetFps(static_cast<float>(targetFps));
+        }
+        ImGui::Text("Latency: %.1f ms (max %.1f) input to present, limiter %.2f ms, drawable wait %.2f ms",
+                    pacer.getLatencyMs(), pacer.getMaxLatencyMs(), pacer.getLimiterMs(), pacer.getDrawableWaitMs());
+        ImGui::Text("Snapshot Build: %.2f ms", renderer->getSnapshotMs());
+        ImGui::Text("Handoff Wait: %.2f ms", renderer->getPublishWaitMs());
+        ImGui::Text("Render Thread: %.2f ms", renderer->getRenderThreadMs());
+        ImGui::Text("Transforms: %.2f ms, Culling: %.2f ms", renderer->getTransformMs(), renderer->getCullMs());
+        ImGui::Text("Visible: %zu / %zu entities", renderer->getVisibleCount(), scene.size());
+
+        int layout = static_cast<int>(engine->getViewLayout());
+        if (ImGui::Combo("View Layout", &layout, "Single\0Picture In Picture\0Split Screen\0"))
+        {
+            engine->setViewLayout(static_cast<ViewLayout>(layout));
+        }
+        for (uint32_t v = 0; v < renderer->getViewCount(); ++v)
+        {
+            ImGui::Text("View %u: %zu entities", v, renderer->getViewVisibleCount(v));
+        }
+        ImGui::Text("Hierarchy: %zu levels, %zu updated", scene.getLevelCount(), scene.getUpdatedCount());
+        ImGui::Text("Draws: %u, state calls %u issued, %u elided", renderer->getDrawCalls(),
+                    renderer->getStateCallsIssued(), renderer->getStateCallsElided());
+
+        FrameArena &arena = FrameArena::local();
+        ImGui::Text("Frame Arena: %zu / %zu KB", arena.getBytesUsed() / 1024, arena.getCapacity() / 1024);
+
+        if (AllocationCounter::isEnabled())
+        {
+            static uint64_t lastAllocationCount = 0;
+            uint64_t allocationCount = AllocationCounter::getCount();
+            ImGui::Text("Heap Allocations: %llu / frame", static_cast<unsigned long long>(allocationCount - lastAllocationCount));
+            lastAllocationCount = allocationCount;
+        }
+        else
+        {
+            ImGui::Text("Heap Allocations: build with TRACK_ALLOCATIONS");
+        }
+
+        ResourceManager &resources = renderer->getResources();
+        ImGui::Text("Pools: %zu textures, %zu materials, %zu meshes, %zu models",
+                    resources.getTextures().size(), resources.getMaterials().size(),
+                    resources.getMeshes().size(), resources.getModels().size());
+        ImGui::Text("Awaiting GPU retire: %zu", resources.getRetiredCount());
+
+        GeometryBuffer::Stats geometry = resources.getGeometry().getStats();
+        ImGui::Text("Geometry: %zu / %zu MB in %zu pages, %.0f%% fragmented, %zu KB moved",
+                    geometry.usedBytes >> 20, geometry.capacityBytes >> 20, geometry.pageCount,
+                    geometry.fragmentation * 100.0f, geometry.movedBytes >> 10);
+
+        TextureStreamer &textureStreamer = renderer->getTextureStreamer();
+        ImGui::Text("Textures: %zu / %zu MB, %zu streaming, %zu waiting", textureStreamer.getResidentBytes() >> 20,
+                    textureStreamer.getBudget() >> 20, textureStreamer.getPendingCount(), textureStreamer.getWaitingCount());
+
+        ImGui::Text("Material Table: %zu bytes uploaded", renderer->getMaterialTable().getUploadedBytes());
+
+        SceneBuffer &sceneBuffer = renderer->getSceneBuffer();
+        ImGui::Text("Scene Buffer: %zu records, %zu updated, %zu bytes uploaded in %zu copies", sceneBuffer.getRecordCount(),
+                    scene.getUpdatedCount(), sceneBuffer.getUploadedBytes(), sceneBuffer.getCopyCount());
+
+        StaticBatcher &staticBatcher = renderer->getStaticBatcher();
+        ImGui::Text("Static: %zu batches (%zu visible), %zu entities, built %zu times, last in %.1f ms", staticBatcher.getBatchCount(),
+                    renderer->getVisibleStaticBatchCount(), staticBatcher.getEntityCount(), staticBatcher.getBuildCount(),
+                    staticBatcher.getBuildMs());
+
+        PipelineManager &pipelineManager = renderer->getPipelineManager();
+        ImGui::Text("Pipelines: %u / %zu compiled, %u compiling, %.1f ms compiling in total", pipelineManager.getCompiledCount(),
+                    pipelineManager.getPipelineCount(), pipelineManager.getPendingCount(), pipelineManager.getCompileMs());
+
+        const LightClusters &lightClusters = renderer->getLightClusters();
+        ImGui::Text("Lights: %zu, %zu cluster entries, %u max per cluster, %zu dropped, %.2f ms", lightClusters.getLightCount(),
+                    lightClusters.getIndices().size(), lightClusters.getMaxClusterLights(), lightClusters.getDroppedCount(),
+                    lightClusters.getBuildMs());
+
+        const ShadowCascades &shadowCascades = renderer->getShadowCascades();
+        ImGui::Text("Shadows: casters %zu / %zu / %zu / %zu, %u draws, culled in %.2f ms", shadowCascades.getCascade(0).casters.size(),
+                    shadowCascades.getCascade(1).casters.size(), shadowCascades.getCascade(2).casters.size(),
+                    shadowCascades.getCascade(3).casters.size(), renderer->getShadowDrawCalls(), shadowCascades.getCullMs());
+
+        bool dynamicResolution = renderer->getDynamicResolution();
+        if (ImGui::Checkbox("Dynamic Resolution", &dynamicResolution))
+        {
+            renderer->setDynamicResolution(dynamicResolution);
+        }
+        ImGui::Text("Resolution: %.2fx (%u x %u), GPU p90 %.2f ms", renderer->getRenderScale(), renderer->getRenderWidth(),
+                    renderer->getRenderHeight(), renderer->getGpuPercentileMs());
+
+        int textureBudget = static_cast<int>(textureStreamer.getBudget() >> 20);
+        if (ImGui::SliderInt("Texture Budget (MB)", &textureBudget, 16, 2048))
+        {
+            textureStreamer.setBudget(size_t(textureBudget) << 20);
+        }
+
+        if (WorldStreamer *streamer = engine->getWorldStreamer())
+        {
+            ImGui::Text("World: %zu / %zu cells resident, %zu loading, %zu stalled frames",
+                        streamer->getResidentCount(), streamer->getCellCount(), streamer->getLoadingCount(), streamer->getStallCount());
+            ImGui::Text("World Memory: %zu / %zu MB (peak %zu MB)", streamer->getResidentBytes() >> 20,
+                        streamer->getMemoryBudget() >> 20, streamer->getPeakResidentBytes() >> 20);
+        }
+
+        ImGui::End();
+    }
+
     {
         glm::vec4 viewport = engine->getRenderer()->viewport();
         ImGui::Begin("Ray Tracing");
@@ -8,6 +8,22 @@
 
 class Engine;
 
+// Owned copy of one frame's draw lists, so the render thread can encode it while the
+// main thread is already building the next UI frame. The copies are reused frame to frame.
+struct ImGuiFrame
+{
+    ImGuiFrame() = default;
+    ImGuiFrame(const ImGuiFrame &) = delete;
+    ImGuiFrame &operator=(const ImGuiFrame &) = delete;
+    ~ImGuiFrame() { clear(); }
+
+    void capture(const ImDrawData *source);
+    void clear();
+
+    ImDrawData drawData;
+    ImVector<ImDrawList *> drawLists;
+};
+
 class ImGuiHandler
 {
 public:
@@ -16,7 +32,11 @@ public:
 
     void processEvent(SDL_Event *event);
 
-    void render(MTL::CommandBuffer *commandBuffer, MTL::RenderPassDescriptor *renderPassDescriptor);
+    // Main thread: runs the UI and captures its draw data
+    void buildFrame(ImGuiFrame &frame);
+
+    // Render thread: encodes a captured frame
+    void render(MTL::CommandBuffer *commandBuffer, MTL::RenderPassDescriptor *renderPassDescriptor, ImGuiFrame &frame);
 
     bool wantsMouseCapture() const;
     bool wantsKeyboardCapture() const;
@@ -0,0 +1,464 @@
+#include "JobSystem.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+static thread_local JobSystem *currentJobSystem = nullptr;
+static thread_local int currentWorkerIndex = -1;
+static thread_local uint32_t stealSeed = 0x9e3779b9u;
+
+WorkStealingQueue::Array::Array(size_t capacity)
+    : capacity(capacity), mask(capacity - 1), slots(new std::atomic<Job *>[capacity])
+{
+}
+
+WorkStealingQueue::WorkStealingQueue(size_t capacity)
+{
+    // Capacity must be a power of two for the index mask
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    arrays.push_back(std::make_unique<Array>(size));
+    array.store(arrays.back().get(), std::memory_order_relaxed);
+}
+
+WorkStealingQueue::~WorkStealingQueue()
+{
+}
+
+void WorkStealingQueue::push(Job *job)
+{
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Array *a = array.load(std::memory_order_relaxed);
+
+    if (b - t > static_cast<int64_t>(a->capacity) - 1)
+    {
+        auto grown = std::make_unique<Array>(a->capacity * 2);
+        for (int64_t i = t; i < b; ++i)
+            grown->put(i, a->get(i));
+
+        a = grown.get();
+        arrays.push_back(std::move(grown));
+        array.store(a, std::memory_order_release);
+    }
+
+    a->put(b, job);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+Job *WorkStealingQueue::pop()
+{
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Array *a = array.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    Job *job = nullptr;
+    if (t <= b)
+    {
+        job = a->get(b);
+        if (t == b)
+        {
+            // Last element, race against thieves for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                job = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+    }
+    else
+    {
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    return job;
+}
+
+Job *WorkStealingQueue::steal()
+{
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if (t >= b)
+        return nullptr;
+
+    Array *a = array.load(std::memory_order_acquire);
+    Job *job = a->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+
+    return job;
+}
+
+bool WorkStealingQueue::empty() const
+{
+    return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+}
+
+JobSystem::JobSystem(unsigned workerCount)
+    : mainThreadId(std::this_thread::get_id())
+{
+    if (workerCount == 0)
+    {
+        unsigned cores = std::thread::hardware_concurrency();
+        workerCount = cores > 1 ? cores - 1 : 1;
+    }
+
+    workers.reserve(workerCount);
+    for (unsigned i = 0; i < workerCount; ++i)
+        workers.push_back(std::make_unique<Worker>());
+
+    // Start threads only once every deque exists, workers steal from each other immediately
+    for (unsigned i = 0; i < workerCount; ++i)
+        workers[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+
+    printf("Job system started with %u workers\n", workerCount);
+}
+
+JobSystem::~JobSystem()
+{
+    // Under the lock, so a worker between checking its wait predicate and sleeping cannot miss it
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running.store(false, std::memory_order_release);
+    }
+    sleepCondition.notify_all();
+
+    for (auto &worker : workers)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+
+    // Anything still queued never ran, drop it
+    for (auto &worker : workers)
+    {
+        while (Job *job = worker->queue.pop())
+            delete job;
+    }
+    for (Job *job : injectQueue)
+        delete job;
+    for (Job *job : mainThreadQueue)
+        delete job;
+}
+
+void JobSystem::schedule(JobFunction function, JobCounter *counter)
+{
+    if (counter)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+
+    submit(new Job{std::move(function), counter});
+}
+
+void JobSystem::scheduleAfter(JobCounter &dependency, JobFunction function, JobCounter *counter)
+{
+    if (counter)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+
+    Job *job = new Job{std::move(function), counter};
+
+    {
+        // finish() drops the counter to zero under the same lock, so this cannot miss the release
+        std::lock_guard<std::mutex> lock(dependency.continuationMutex);
+        if (!dependency.isDone())
+        {
+            dependency.continuations.push_back(job);
+            return;
+        }
+    }
+
+    submit(job);
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+    int workerIndex = currentJobSystem == this ? currentWorkerIndex : -1;
+    bool onMainThread = isMainThread();
+
+    while (!counter.isDone())
+    {
+        if (onMainThread)
+            pumpMainThread();
+
+        if (Job *job = findJob(workerIndex))
+            execute(job);
+        else
+            std::this_thread::yield();
+    }
+
+    std::lock_guard<std::mutex> lock(counter.continuationMutex);
+}
+
+void JobSystem::parallelFor(size_t count, const std::function<void(size_t, size_t)> &function, size_t minGrainSize)
+{
+    if (count == 0)
+        return;
+
+    // Aim for a few ranges per thread so stealing can even out uneven work
+    size_t threads = workers.size() + 1;
+    size_t grain = std::max<size_t>(std::max<size_t>(minGrainSize, 1), count / (threads * 4));
+
+    if (count <= grain)
+    {
+        function(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    splitRange(0, count, grain, function, counter);
+    wait(counter);
+}
+
+void JobSystem::splitRange(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &function, JobCounter &counter)
+{
+    // Hand off the upper half and keep splitting the lower one, thieves take the big pieces first
+    while (end - begin > grain)
+    {
+        size_t mid = begin + (end - begin) / 2;
+        schedule([this, mid, end, grain, &function, &counter]()
+                 { splitRange(mid, end, grain, function, counter); },
+                 &counter);
+        end = mid;
+    }
+
+    function(begin, end);
+}
+
+void JobSystem::runOnMainThread(JobFunction function, JobCounter *counter)
+{
+    if (counter)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mainThreadMutex);
+    mainThreadQueue.push_back(new Job{std::move(function), counter});
+    if (mainThreadQueue.size() == 1 && mainThreadWakeup)
+        mainThreadWakeup();
+}
+
+void JobSystem::setMainThreadWakeup(std::function<void()> wakeup)
+{
+    std::lock_guard<std::mutex> lock(mainThreadMutex);
+    mainThreadWakeup = std::move(wakeup);
+}
+
+void JobSystem::pumpMainThread()
+{
+    if (!isMainThread())
+    {
+        std::cerr << "JobSystem::pumpMainThread called off the main thread" << std::endl;
+        return;
+    }
+
+    std::deque<Job *> jobs;
+    {
+        std::lock_guard<std::mutex> lock(mainThreadMutex);
+        jobs.swap(mainThreadQueue);
+    }
+
+    for (Job *job : jobs)
+    {
+        execute(job);
+        mainThreadJobs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+JobSystemStats JobSystem::getStats() const
+{
+    JobSystemStats stats;
+    stats.workerCount = getWorkerCount();
+    stats.mainThreadJobs = mainThreadJobs.load(std::memory_order_relaxed);
+    stats.steals = externalSteals.load(std::memory_order_relaxed);
+    stats.jobsExecuted = externalJobs.load(std::memory_order_relaxed);
+
+    uint64_t idleNanoseconds = 0;
+    for (const auto &worker : workers)
+    {
+        stats.jobsExecuted += worker->executed.load(std::memory_order_relaxed);
+        stats.steals += worker->steals.load(std::memory_order_relaxed);
+        stats.failedSteals += worker->failedSteals.load(std::memory_order_relaxed);
+        idleNanoseconds += worker->idleNanoseconds.load(std::memory_order_relaxed);
+    }
+    stats.idleSeconds = static_cast<double>(idleNanoseconds) / 1e9;
+
+    return stats;
+}
+
+void JobSystem::resetStats()
+{
+    mainThreadJobs.store(0, std::memory_order_relaxed);
+    externalSteals.store(0, std::memory_order_relaxed);
+    externalJobs.store(0, std::memory_order_relaxed);
+
+    for (auto &worker : workers)
+    {
+        worker->executed.store(0, std::memory_order_relaxed);
+        worker->steals.store(0, std::memory_order_relaxed);
+        worker->failedSteals.store(0, std::memory_order_relaxed);
+        worker->idleNanoseconds.store(0, std::memory_order_relaxed);
+    }
+}
+
+void JobSystem::workerLoop(unsigned index)
+{
+    currentJobSystem = this;
+    currentWorkerIndex = static_cast<int>(index);
+    stealSeed ^= (index + 1) * 0x85ebca6bu;
+
+    Worker &worker = *workers[index];
+    int spins = 0;
+
+    while (running.load(std::memory_order_acquire))
+    {
+        if (Job *job = findJob(static_cast<int>(index)))
+        {
+            execute(job);
+            spins = 0;
+            continue;
+        }
+
+        if (++spins < 64)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // A job submitted after this read moves the epoch, so one missed by the last look
+        // below keeps the worker awake instead of leaving it asleep next to queued work
+        uint64_t epoch = wakeEpoch.load(std::memory_order_seq_cst);
+        if (Job *job = findJob(static_cast<int>(index)))
+        {
+            execute(job);
+            spins = 0;
+            continue;
+        }
+
+        auto idleStart = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+            sleepCondition.wait(lock, [this, epoch]()
+                                { return wakeEpoch.load(std::memory_order_seq_cst) != epoch ||
+                                         !running.load(std::memory_order_acquire); });
+            sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+        }
+        auto idle = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - idleStart);
+        worker.idleNanoseconds.fetch_add(static_cast<uint64_t>(idle.count()), std::memory_order_relaxed);
+        spins = 0;
+    }
+
+    currentJobSystem = nullptr;
+    currentWorkerIndex = -1;
+}
+
+void JobSystem::submit(Job *job)
+{
+    if (currentJobSystem == this && currentWorkerIndex >= 0)
+    {
+        workers[currentWorkerIndex]->queue.push(job);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(injectMutex);
+        injectQueue.push_back(job);
+    }
+
+    // Either this sees the sleeper's increment or the sleeper's predicate sees the new epoch.
+    // A sleeper holds the lock from checking the epoch until it waits, so the notify cannot
+    // land in between.
+    wakeEpoch.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_one();
+    }
+}
+
+void JobSystem::execute(Job *job)
+{
+    job->function();
+    finish(job->counter);
+    delete job;
+
+    if (currentJobSystem == this && currentWorkerIndex >= 0)
+        workers[currentWorkerIndex]->executed.fetch_add(1, std::memory_order_relaxed);
+    else
+        externalJobs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JobSystem::finish(JobCounter *counter)
+{
+    if (!counter)
+        return;
+
+    // Decrement under the lock: wait() takes it once before returning, so the counter
+    // cannot be destroyed while we are still touching it
+    std::vector<Job *> released;
+    {
+        std::lock_guard<std::mutex> lock(counter->continuationMutex);
+        if (counter->value.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        released.swap(counter->continuations);
+    }
+
+    for (Job *job : released)
+        submit(job);
+}
+
+Job *JobSystem::findJob(int workerIndex)
+{
+    if (workerIndex >= 0)
+    {
+        if (Job *job = workers[workerIndex]->queue.pop())
+            return job;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(injectMutex);
+        if (!injectQueue.empty())
+        {
+            Job *job = injectQueue.front();
+            injectQueue.pop_front();
+            return job;
+        }
+    }
+
+    return stealJob(workerIndex);
+}
+
+Job *JobSystem::stealJob(int workerIndex)
+{
+    size_t count = workers.size();
+    if (count == 0)
+        return nullptr;
+
+    // xorshift victim selection so thieves do not all hammer worker 0
+    stealSeed ^= stealSeed << 13;
+    stealSeed ^= stealSeed >> 17;
+    stealSeed ^= stealSeed << 5;
+    size_t start = stealSeed % count;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t victim = (start + i) % count;
+        if (static_cast<int>(victim) == workerIndex)
+            continue;
+
+        if (Job *job = workers[victim]->queue.steal())
+        {
+            if (workerIndex >= 0)
+                workers[workerIndex]->steals.fetch_add(1, std::memory_order_relaxed);
+            else
+                externalSteals.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+    }
+
+    if (workerIndex >= 0)
+        workers[workerIndex]->failedSteals.fetch_add(1, std::memory_order_relaxed);
+
+    return nullptr;
+}
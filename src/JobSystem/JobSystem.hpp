@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using JobFunction = std::function<void()>;
+
+struct Job;
+
+// Tracks outstanding jobs. Every job scheduled against a counter increments it
+// and decrements it once finished, so waiting on a counter waits on a group.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    int get() const { return value.load(std::memory_order_acquire); }
+    bool isDone() const { return get() == 0; }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> value{0};
+
+    // Jobs scheduled with scheduleAfter, released once value reaches zero
+    std::mutex continuationMutex;
+    std::vector<Job *> continuations;
+};
+
+struct Job
+{
+    JobFunction function;
+    JobCounter *counter = nullptr;
+};
+
+// Chase-Lev work-stealing deque. push/pop are owner-only and operate on the
+// bottom, steal may be called from any thread and takes from the top.
+class WorkStealingQueue
+{
+public:
+    explicit WorkStealingQueue(size_t capacity = 1024);
+    ~WorkStealingQueue();
+
+    void push(Job *job);
+    Job *pop();
+    Job *steal();
+
+    bool empty() const;
+
+private:
+    struct Array
+    {
+        explicit Array(size_t capacity);
+
+        size_t capacity;
+        size_t mask;
+        std::unique_ptr<std::atomic<Job *>[]> slots;
+
+        Job *get(int64_t index) const { return slots[index & mask].load(std::memory_order_relaxed); }
+        void put(int64_t index, Job *job) { slots[index & mask].store(job, std::memory_order_relaxed); }
+    };
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    alignas(64) std::atomic<Array *> array;
+
+    // Grown-out arrays stay alive until the queue dies, a thief may still be reading them
+    std::vector<std::unique_ptr<Array>> arrays;
+};
+
+struct JobSystemStats
+{
+    unsigned workerCount = 0;
+    uint64_t jobsExecuted = 0;
+    uint64_t steals = 0;
+    uint64_t failedSteals = 0;
+    uint64_t mainThreadJobs = 0;
+    double idleSeconds = 0.0;
+};
+
+class JobSystem
+{
+public:
+    // workerCount == 0 picks one worker per core, minus the main thread which helps while waiting
+    explicit JobSystem(unsigned workerCount = 0);
+    ~JobSystem();
+
+    void schedule(JobFunction function, JobCounter *counter = nullptr);
+    void scheduleAfter(JobCounter &dependency, JobFunction function, JobCounter *counter = nullptr);
+
+    // Holds a counter open for work that completes outside a job, e.g. a suspended coroutine
+    void retain(JobCounter &counter) { counter.value.fetch_add(1, std::memory_order_relaxed); }
+    void release(JobCounter &counter) { finish(&counter); }
+
+    // Executes other jobs (and main thread work, if called there) until the counter drains
+    void wait(JobCounter &counter);
+
+    // Calls function(begin, end) over [0, count). Ranges are split lazily down to a grain
+    // derived from count and worker count, so idle workers steal the larger halves.
+    void parallelFor(size_t count, const std::function<void(size_t, size_t)> &function, size_t minGrainSize = 1);
+
+    // SDL and Metal presentation calls must happen on the thread that created the engine
+    void runOnMainThread(JobFunction function, JobCounter *counter = nullptr);
+    void pumpMainThread();
+
+    // Called from whichever thread queues main thread work into an empty queue, so a main
+    // thread blocked waiting for events can wake up and pump it
+    void setMainThreadWakeup(std::function<void()> wakeup);
+    bool isMainThread() const { return std::this_thread::get_id() == mainThreadId; }
+
+    unsigned getWorkerCount() const { return static_cast<unsigned>(workers.size()); }
+    JobSystemStats getStats() const;
+    void resetStats();
+
+private:
+    struct Worker
+    {
+        std::thread thread;
+        WorkStealingQueue queue;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> failedSteals{0};
+        std::atomic<uint64_t> idleNanoseconds{0};
+    };
+
+    void workerLoop(unsigned index);
+    void submit(Job *job);
+    void execute(Job *job);
+    void finish(JobCounter *counter);
+    Job *findJob(int workerIndex);
+    Job *stealJob(int workerIndex);
+    void splitRange(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &function, JobCounter &counter);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // Jobs submitted from threads that do not own a deque
+    std::mutex injectMutex;
+    std::deque<Job *> injectQueue;
+
+    std::mutex mainThreadMutex;
+    std::deque<Job *> mainThreadQueue;
+    std::function<void()> mainThreadWakeup;
+    std::atomic<uint64_t> mainThreadJobs{0};
+    std::atomic<uint64_t> externalSteals{0};
+
+    // Jobs run by threads that wait without being workers, the main thread among them
+    std::atomic<uint64_t> externalJobs{0};
+
+    // Idle workers sleep until submit moves the epoch past the value they last looked at
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+    std::atomic<int> sleepingWorkers{0};
+    std::atomic<uint64_t> wakeEpoch{0};
+
+    std::atomic<bool> running{true};
+    std::thread::id mainThreadId;
+};
@@ -0,0 +1,60 @@
+#include "LightBuffer.hpp"
+#include "ResourceManager.hpp"
+#include <algorithm>
+#include <cstring>
+
+static NS::UInteger alignSection(NS::UInteger offset)
+{
+    return (offset + LightBuffer::SectionAlignment - 1) & ~(LightBuffer::SectionAlignment - 1);
+}
+
+LightBuffer::LightBuffer(MTL::Device *device, ResourceManager &resources)
+    : device(device), resources(resources)
+{
+}
+
+LightBuffer::~LightBuffer()
+{
+    for (MTL::Buffer *buffer : buffers)
+    {
+        if (buffer)
+            buffer->release();
+    }
+}
+
+LightListView LightBuffer::update(const std::vector<PointLight> &lights, const LightClusters &clusters, uint64_t frameIndex)
+{
+    const std::vector<ClusterRange> &ranges = clusters.getRanges();
+    const std::vector<uint32_t> &indices = clusters.getIndices();
+
+    // Empty sections still get an element, a binding needs somewhere to point
+    NS::UInteger lightBytes = std::max<size_t>(lights.size(), 1) * sizeof(PointLight);
+    NS::UInteger rangeBytes = ranges.size() * sizeof(ClusterRange);
+    NS::UInteger indexBytes = std::max<size_t>(indices.size(), 1) * sizeof(uint32_t);
+
+    LightListView view;
+    view.lightsOffset = 0;
+    view.rangesOffset = alignSection(view.lightsOffset + lightBytes);
+    view.indicesOffset = alignSection(view.rangesOffset + rangeBytes);
+    NS::UInteger size = view.indicesOffset + indexBytes;
+
+    MTL::Buffer *&buffer = buffers[frameIndex % FrameCount];
+    if (!buffer || buffer->length() < size)
+    {
+        // The frame that last used this copy has completed, but keep the deferral uniform
+        if (buffer)
+            resources.releaseLater(buffer);
+
+        size_t capacity = std::max<size_t>(size + size / 2, 64 * 1024);
+        buffer = device->newBuffer(capacity, MTL::ResourceStorageModeShared);
+    }
+
+    char *contents = static_cast<char *>(buffer->contents());
+    memcpy(contents + view.lightsOffset, lights.data(), lights.size() * sizeof(PointLight));
+    memcpy(contents + view.rangesOffset, ranges.data(), rangeBytes);
+    memcpy(contents + view.indicesOffset, indices.data(), indices.size() * sizeof(uint32_t));
+    uploadedBytes = lights.size() * sizeof(PointLight) + rangeBytes + indices.size() * sizeof(uint32_t);
+
+    view.buffer = buffer;
+    return view;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Metal/Metal.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "LightClusters.hpp"
+#include "MaterialTable.hpp"
+
+class ResourceManager;
+
+// Where this frame's lights, cluster ranges and cluster light indices sit in one buffer
+struct LightListView
+{
+    MTL::Buffer *buffer = nullptr;
+    NS::UInteger lightsOffset = 0;
+    NS::UInteger rangesOffset = 0;
+    NS::UInteger indicesOffset = 0;
+};
+
+// The point lights and their cluster lists on the GPU. Everything changes every frame, so each
+// frame in flight has its own buffer and update() rewrites all of it.
+class LightBuffer
+{
+public:
+    static constexpr uint32_t FrameCount = MaterialTable::FrameCount;
+
+    // Sections start on this boundary so each can be bound at its offset
+    static constexpr NS::UInteger SectionAlignment = 256;
+
+    LightBuffer(MTL::Device *device, ResourceManager &resources);
+    LightBuffer(const LightBuffer &) = delete;
+    LightBuffer &operator=(const LightBuffer &) = delete;
+    ~LightBuffer();
+
+    // Main thread, after MaterialTable::update has waited for this frame's copies to be free
+    LightListView update(const std::vector<PointLight> &lights, const LightClusters &clusters, uint64_t frameIndex);
+
+    size_t getUploadedBytes() const { return uploadedBytes; }
+
+private:
+    MTL::Device *device;
+    ResourceManager &resources;
+
+    std::array<MTL::Buffer *, FrameCount> buffers = {};
+    size_t uploadedBytes = 0;
+};
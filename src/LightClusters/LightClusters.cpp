@@ -0,0 +1,216 @@
+#include "LightClusters.hpp"
+#include "JobSystem.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+uint32_t LightClusters::sliceOf(float viewDepth, float nearPlane, float farPlane)
+{
+    if (viewDepth <= nearPlane)
+        return 0;
+
+    float slice = std::log(viewDepth / nearPlane) / std::log(farPlane / nearPlane) * float(Slices);
+    return std::min(static_cast<uint32_t>(slice), Slices - 1);
+}
+
+ClusterParams LightClusters::getParams(glm::vec2 screenSize) const
+{
+    float logRange = std::log(projection.farPlane / projection.nearPlane);
+
+    ClusterParams params;
+    params.tilesX = TilesX;
+    params.tilesY = TilesY;
+    params.slices = Slices;
+    params.lightCount = static_cast<uint32_t>(lightCount);
+    params.sliceScale = float(Slices) / logRange;
+    params.sliceBias = float(Slices) * std::log(projection.nearPlane) / logRange;
+    params.screenSize = screenSize;
+    params.screenOrigin = glm::vec2(0.0f);
+    return params;
+}
+
+void LightClusters::buildClusterBounds()
+{
+    for (uint32_t slice = 0; slice <= Slices; ++slice)
+    {
+        sliceDepths[slice] = projection.nearPlane * std::pow(projection.farPlane / projection.nearPlane, float(slice) / float(Slices));
+    }
+
+    float tanY = std::tan(projection.fovY * 0.5f);
+    float tanX = tanY * projection.aspect;
+
+    for (uint32_t slice = 0; slice < Slices; ++slice)
+    {
+        float nearDepth = sliceDepths[slice];
+        float farDepth = sliceDepths[slice + 1];
+
+        for (uint32_t y = 0; y < TilesY; ++y)
+        {
+            // Rows count down from the top of the screen, as fragment coordinates do
+            float top = 1.0f - 2.0f * float(y) / float(TilesY);
+            float bottom = 1.0f - 2.0f * float(y + 1) / float(TilesY);
+
+            for (uint32_t x = 0; x < TilesX; ++x)
+            {
+                float left = -1.0f + 2.0f * float(x) / float(TilesX);
+                float right = -1.0f + 2.0f * float(x + 1) / float(TilesX);
+
+                // The tile's frustum widens with depth, the box takes the wider end of each side
+                uint32_t cluster = clusterIndex(x, y, slice);
+                clusterMin[cluster] = glm::vec3(std::min(left * nearDepth, left * farDepth) * tanX,
+                                                std::min(bottom * nearDepth, bottom * farDepth) * tanY,
+                                                -farDepth);
+                clusterMax[cluster] = glm::vec3(std::max(right * nearDepth, right * farDepth) * tanX,
+                                                std::max(top * nearDepth, top * farDepth) * tanY,
+                                                -nearDepth);
+            }
+        }
+    }
+}
+
+void LightClusters::assignSlice(uint32_t slice)
+{
+    SliceWork &slab = work[slice];
+    slab.lights.clear();
+    slab.indices.clear();
+    slab.counts.fill(0);
+    slab.dropped = 0;
+
+    float nearDepth = sliceDepths[slice];
+    float farDepth = sliceDepths[slice + 1];
+    for (uint32_t i = 0; i < viewLights.size(); ++i)
+    {
+        const glm::vec4 &light = viewLights[i];
+        float depth = -light.z;
+        if (depth + light.w >= nearDepth && depth - light.w <= farDepth)
+            slab.lights.push_back(i);
+    }
+
+    for (uint32_t y = 0; y < TilesY; ++y)
+    {
+        // The row's box is its outermost tiles' boxes joined, lights missing it skip 16 tests
+        glm::vec3 rowMin = clusterMin[clusterIndex(0, y, slice)];
+        glm::vec3 rowMax = clusterMax[clusterIndex(TilesX - 1, y, slice)];
+        rowMin.y = std::min(rowMin.y, clusterMin[clusterIndex(TilesX - 1, y, slice)].y);
+        rowMax.y = std::max(rowMax.y, clusterMax[clusterIndex(0, y, slice)].y);
+
+        slab.x.clear();
+        slab.y.clear();
+        slab.z.clear();
+        slab.radiusSquared.clear();
+        slab.rowLights.clear();
+        for (uint32_t light : slab.lights)
+        {
+            glm::vec4 sphere = viewLights[light];
+            float dx = std::max(std::max(rowMin.x - sphere.x, sphere.x - rowMax.x), 0.0f);
+            float dy = std::max(std::max(rowMin.y - sphere.y, sphere.y - rowMax.y), 0.0f);
+            float dz = std::max(std::max(rowMin.z - sphere.z, sphere.z - rowMax.z), 0.0f);
+            if (dx * dx + dy * dy + dz * dz > sphere.w * sphere.w)
+                continue;
+
+            slab.x.push_back(sphere.x);
+            slab.y.push_back(sphere.y);
+            slab.z.push_back(sphere.z);
+            slab.radiusSquared.push_back(sphere.w * sphere.w);
+            slab.rowLights.push_back(light);
+        }
+
+        // Pad to whole groups of four with lights no box can reach
+        while (slab.x.size() % 4 != 0)
+        {
+            slab.x.push_back(0.0f);
+            slab.y.push_back(0.0f);
+            slab.z.push_back(0.0f);
+            slab.radiusSquared.push_back(-1.0f);
+        }
+
+        const float *lx = slab.x.data();
+        const float *ly = slab.y.data();
+        const float *lz = slab.z.data();
+        const float *lr = slab.radiusSquared.data();
+        size_t candidates = slab.x.size();
+
+        for (uint32_t x = 0; x < TilesX; ++x)
+        {
+            uint32_t cluster = clusterIndex(x, y, slice);
+            glm::vec3 boxMin = clusterMin[cluster];
+            glm::vec3 boxMax = clusterMax[cluster];
+
+            uint32_t count = 0;
+            for (size_t i = 0; i < candidates; i += 4)
+            {
+                // Branch free so the four lanes become one vector operation
+                uint32_t mask = 0;
+                for (uint32_t lane = 0; lane < 4; ++lane)
+                {
+                    float dx = std::max(std::max(boxMin.x - lx[i + lane], lx[i + lane] - boxMax.x), 0.0f);
+                    float dy = std::max(std::max(boxMin.y - ly[i + lane], ly[i + lane] - boxMax.y), 0.0f);
+                    float dz = std::max(std::max(boxMin.z - lz[i + lane], lz[i + lane] - boxMax.z), 0.0f);
+                    mask |= uint32_t(dx * dx + dy * dy + dz * dz <= lr[i + lane]) << lane;
+                }
+
+                while (mask)
+                {
+                    uint32_t lane = __builtin_ctz(mask);
+                    mask &= mask - 1;
+
+                    if (count == MaxLightsPerCluster)
+                    {
+                        slab.dropped++;
+                        continue;
+                    }
+                    slab.indices.push_back(slab.rowLights[i + lane]);
+                    count++;
+                }
+            }
+            slab.counts[y * TilesX + x] = count;
+        }
+    }
+}
+
+void LightClusters::build(const std::vector<PointLight> &lights, const glm::mat4 &view, const Projection &newProjection, JobSystem &jobSystem)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (!(newProjection == projection))
+    {
+        projection = newProjection;
+        buildClusterBounds();
+    }
+
+    lightCount = lights.size();
+    viewLights.resize(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i)
+    {
+        viewLights[i] = glm::vec4(glm::vec3(view * glm::vec4(lights[i].position, 1.0f)), lights[i].radius);
+    }
+
+    jobSystem.parallelFor(Slices, [this](size_t begin, size_t end)
+                          {
+        for (size_t slice = begin; slice < end; ++slice)
+        {
+            assignSlice(static_cast<uint32_t>(slice));
+        } });
+
+    // Slices wrote their lists in cluster order, laying them end to end gives the final list
+    ranges.resize(ClusterCount);
+    indices.clear();
+    maxClusterLights = 0;
+    droppedCount = 0;
+    for (uint32_t slice = 0; slice < Slices; ++slice)
+    {
+        const SliceWork &slab = work[slice];
+        uint32_t offset = static_cast<uint32_t>(indices.size());
+        for (uint32_t tile = 0; tile < TilesX * TilesY; ++tile)
+        {
+            uint32_t count = slab.counts[tile];
+            ranges[slice * TilesX * TilesY + tile] = {offset, count};
+            offset += count;
+            maxClusterLights = std::max(maxClusterLights, count);
+        }
+        indices.insert(indices.end(), slab.indices.begin(), slab.indices.end());
+        droppedCount += slab.dropped;
+    }
+
+    buildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+class JobSystem;
+
+// Matches PointLight in geometry.metal. Positions are in world space, the light reaches
+// nothing past its radius.
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    float padding;
+};
+
+// Where a cluster's lights start in the index list and how many there are
+struct ClusterRange
+{
+    uint32_t offset;
+    uint32_t count;
+};
+
+// Matches ClusterParams in geometry.metal, what a fragment needs to find its cluster
+struct ClusterParams
+{
+    uint32_t tilesX;
+    uint32_t tilesY;
+    uint32_t slices;
+    uint32_t lightCount;
+
+    // slice = log(viewDepth) * sliceScale - sliceBias
+    float sliceScale;
+    float sliceBias;
+
+    // The view's rectangle in the render target, in pixels
+    glm::vec2 screenSize;
+    glm::vec2 screenOrigin;
+};
+
+// Assigns point lights to the clusters of a view-space froxel grid: screen tiles split into
+// depth slices, exponentially spaced so near slices stay thin. Each cluster ends up with a
+// range of a compact index list, and a fragment loops over its cluster's lights only.
+//
+// Cluster bounds are view-space boxes, rebuilt when the projection changes. Slices are
+// assigned in parallel: each narrows the lights down to those overlapping its depth range,
+// then per row of tiles, then tests them against the row's clusters four at a time as sphere
+// against box.
+//
+// No GPU types, the assignment runs and can be checked anywhere glm does.
+class LightClusters
+{
+public:
+    static constexpr uint32_t TilesX = 16;
+    static constexpr uint32_t TilesY = 9;
+    static constexpr uint32_t Slices = 24;
+    static constexpr uint32_t ClusterCount = TilesX * TilesY * Slices;
+
+    // Bounds the work per fragment, lights past this in one cluster are dropped
+    static constexpr uint32_t MaxLightsPerCluster = 64;
+
+    struct Projection
+    {
+        float fovY = 0.0f;
+        float aspect = 0.0f;
+        float nearPlane = 0.0f;
+        float farPlane = 0.0f;
+
+        bool operator==(const Projection &other) const = default;
+    };
+
+    // Clusters are numbered slice major, then rows from the top of the screen, then columns
+    static uint32_t clusterIndex(uint32_t x, uint32_t y, uint32_t slice) { return (slice * TilesY + y) * TilesX + x; }
+    static uint32_t sliceOf(float viewDepth, float nearPlane, float farPlane);
+
+    // lights are in world space, view transforms them into the camera's
+    void build(const std::vector<PointLight> &lights, const glm::mat4 &view, const Projection &projection, JobSystem &jobSystem);
+
+    const std::vector<ClusterRange> &getRanges() const { return ranges; }
+    const std::vector<uint32_t> &getIndices() const { return indices; }
+    ClusterParams getParams(glm::vec2 screenSize) const;
+
+    // View-space box of a cluster for the current projection
+    glm::vec3 getClusterMin(uint32_t cluster) const { return clusterMin[cluster]; }
+    glm::vec3 getClusterMax(uint32_t cluster) const { return clusterMax[cluster]; }
+
+    size_t getLightCount() const { return lightCount; }
+    uint32_t getMaxClusterLights() const { return maxClusterLights; }
+    size_t getDroppedCount() const { return droppedCount; }
+    float getBuildMs() const { return buildMs; }
+
+private:
+    struct SliceWork
+    {
+        // Lights overlapping the slice's depth range
+        std::vector<uint32_t> lights;
+
+        // Those also overlapping the current row, laid out for four-wide tests
+        std::vector<float> x, y, z, radiusSquared;
+        std::vector<uint32_t> rowLights;
+
+        std::array<uint32_t, TilesX * TilesY> counts;
+        std::vector<uint32_t> indices;
+        uint32_t dropped = 0;
+    };
+
+    void buildClusterBounds();
+    void assignSlice(uint32_t slice);
+
+    Projection projection;
+    std::array<glm::vec3, ClusterCount> clusterMin;
+    std::array<glm::vec3, ClusterCount> clusterMax;
+    std::array<float, Slices + 1> sliceDepths;
+
+    // Light centres in view space and radii
+    std::vector<glm::vec4> viewLights;
+
+    std::array<SliceWork, Slices> work;
+    std::vector<ClusterRange> ranges;
+    std::vector<uint32_t> indices;
+
+    size_t lightCount = 0;
+    uint32_t maxClusterLights = 0;
+    size_t droppedCount = 0;
+    float buildMs = 0.0f;
+};
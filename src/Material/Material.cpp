@@ -1,82 +1,90 @@
 #include "Material.hpp"
 #include "Texture.hpp"
+#include "ResourceManager.hpp"
+#include <algorithm>
 #include <iostream>
-#include <fstream>
-#include <filesystem>
 
-Material::Material(MTL::Device *device, const tinyobj::material_t &mat_data, const std::string &baseDir)
-    : device(device), diffuseTexture(nullptr), materialBuffer(nullptr)
+Material::Material(const tinyobj::material_t &mat_data, TextureHandle diffuseMap)
+    : diffuseMap(diffuseMap)
 {
-    ambient = simd::float3{mat_data.ambient[0], mat_data.ambient[1], mat_data.ambient[2]};
+    setProperties(mat_data);
+}
 
-    if (ambient[0] == 0.0f && ambient[1] == 0.0f && ambient[2] == 0.0f)
+Task<std::optional<ImageData>> Material::decodeDiffuseAsync(JobSystem &jobSystem, tinyobj::material_t mat_data, std::string baseDir)
+{
+    if (mat_data.diffuse_texname.empty())
+        co_return std::nullopt;
+
+    std::string texturePath = baseDir + mat_data.diffuse_texname;
+    auto bytes = co_await readFileAsync(jobSystem, texturePath);
+    if (!bytes)
     {
-        ambient = simd::float3{0.2f, 0.2f, 0.2f};
+        std::cerr << "Texture file not found: " << texturePath << std::endl;
+        co_return std::nullopt;
     }
 
-    diffuse = simd::float3{mat_data.diffuse[0], mat_data.diffuse[1], mat_data.diffuse[2]};
-    specular = simd::float3{mat_data.specular[0], mat_data.specular[1], mat_data.specular[2]};
-    shininess = mat_data.shininess;
+    ImageData image;
+    if (!Texture::decode(bytes->data(), bytes->size(), texturePath, image))
+        co_return std::nullopt;
 
-    createBuffer();
-
-    if (!mat_data.diffuse_texname.empty())
-    {
-        loadTexture(mat_data.diffuse_texname, baseDir);
-    }
+    co_return image;
 }
 
-Material::~Material()
+Task<MaterialHandle> Material::loadAsync(JobSystem &jobSystem, UploadStage &uploadStage, ResourceManager &resources, MTL::Device *device,
+                                         tinyobj::material_t mat_data, std::string baseDir, std::optional<ImageData> diffuseImage)
 {
-    if (diffuseTexture)
-        diffuseTexture->release();
-    if (materialBuffer)
-        materialBuffer->release();
-}
+    std::optional<Texture> texture;
 
-void Material::createBuffer()
-{
-    struct MaterialData
+    if (diffuseImage)
     {
-        simd::float3 ambient;
-        simd::float3 diffuse;
-        simd::float3 specular;
-        float shininess;
-    } __attribute__((aligned(16)));
-
-    MaterialData matData;
-    matData.ambient = ambient;
-    matData.diffuse = diffuse;
-    matData.specular = specular;
-    matData.shininess = shininess;
-
-    materialBuffer = device->newBuffer(&matData, sizeof(MaterialData), MTL::ResourceStorageModeShared);
-}
+        co_await resumeOnWorker(jobSystem);
 
-void Material::bind(MTL::RenderCommandEncoder *encoder)
-{
-    encoder->setFragmentBuffer(materialBuffer, 0, 2);
+        std::vector<ImageData> mips;
+        Texture::generateMips(std::move(*diffuseImage), mips);
+
+        uint32_t residentMip = 0;
+        while (residentMip + 1 < mips.size() &&
+               std::max(mips[residentMip].width, mips[residentMip].height) > Texture::StreamingBaseSize)
+        {
+            residentMip++;
+        }
+
+        co_await resumeOnUploadStage(uploadStage);
+        texture.emplace(mips, residentMip, baseDir + mat_data.diffuse_texname, device);
+    }
 
-    if (diffuseTexture)
+    // Pools are only mutated on the main thread
+    co_await resumeOnMainThread(jobSystem);
+
+    TextureHandle diffuseMap;
+    if (texture && texture->getMTLTexture())
     {
-        encoder->setFragmentTexture(diffuseTexture, 0);
+        diffuseMap = resources.getTextures().create(std::move(*texture));
     }
+
+    co_return resources.getMaterials().create(mat_data, diffuseMap);
 }
 
-void Material::loadTexture(const std::string &textureFilename, const std::string &baseDir)
+void Material::setProperties(const tinyobj::material_t &mat_data)
 {
-    std::string texturePath = baseDir + textureFilename;
-    if (std::filesystem::exists(texturePath))
-    {
-        texture = std::make_shared<Texture>(texturePath.c_str(), device);
-        if (texture->getMTLTexture())
-        {
-            diffuseTexture = texture->getMTLTexture();
-            diffuseTexture->retain();
-        }
-    }
-    else
+    ambient = simd::float3{mat_data.ambient[0], mat_data.ambient[1], mat_data.ambient[2]};
+
+    if (ambient[0] == 0.0f && ambient[1] == 0.0f && ambient[2] == 0.0f)
     {
-        std::cerr << "Texture file not found: " << texturePath << std::endl;
+        ambient = simd::float3{0.2f, 0.2f, 0.2f};
     }
+
+    diffuse = simd::float3{mat_data.diffuse[0], mat_data.diffuse[1], mat_data.diffuse[2]};
+    specular = simd::float3{mat_data.specular[0], mat_data.specular[1], mat_data.specular[2]};
+    shininess = mat_data.shininess;
+
+    // Illumination model 0 is a flat colour. Cut-outs take their alpha from the diffuse map, a
+    // separate map_d is not loaded. Nothing loads normal maps yet.
+    features = 0;
+    if (diffuseMap)
+        features |= FeatureDiffuseMap;
+    if (mat_data.illum == 0)
+        features |= FeatureUnlit;
+    if (diffuseMap && !mat_data.alpha_texname.empty())
+        features |= FeatureAlphaTest;
 }
@@ -2,32 +2,50 @@
 
 #include <Metal/Metal.hpp>
 #include <simd/simd.h>
+#include <optional>
 #include <string>
 #include "tiny_obj_loader.h"
 #include "Texture.hpp"
+#include "Task.hpp"
+#include "PipelineManager.hpp"
 
+class ResourceManager;
+class Material;
+
+using MaterialHandle = Handle<Material>;
+
+// Properties only, the GPU copy lives in the MaterialTable at this material's pool slot
 class Material
 {
 public:
-    Material(MTL::Device *device, const tinyobj::material_t &mat_data, const std::string &baseDir);
-    ~Material();
+    Material(const tinyobj::material_t &mat_data, TextureHandle diffuseMap = {});
+    Material(Material &&other) noexcept = default;
+    Material &operator=(Material &&other) noexcept = default;
+    Material(const Material &) = delete;
+    Material &operator=(const Material &) = delete;
+
+    // Reads and decodes the diffuse texture on workers, nullopt when there is none or it failed
+    static Task<std::optional<ImageData>> decodeDiffuseAsync(JobSystem &jobSystem, tinyobj::material_t mat_data, std::string baseDir);
+
+    // Creates the decoded diffuse texture with only its low mips on the upload stage (the texture
+    // streamer brings in the rest) and registers both in the resource pools on the main thread
+    static Task<MaterialHandle> loadAsync(JobSystem &jobSystem, UploadStage &uploadStage, ResourceManager &resources, MTL::Device *device,
+                                          tinyobj::material_t mat_data, std::string baseDir, std::optional<ImageData> diffuseImage);
 
     simd::float3 ambient;
     simd::float3 diffuse;
     simd::float3 specular;
     float shininess;
 
-    void bind(MTL::RenderCommandEncoder *encoder);
+    // Resolved by the MaterialTable every frame, streaming swaps the texture behind the handle
+    TextureHandle getDiffuseMap() const { return diffuseMap; }
 
-    MTL::Buffer *getMaterialBuffer() const { return materialBuffer; }
-    MTL::Texture *getDiffuseTexture() const { return diffuseTexture; }
+    // The MaterialFeatureBits of ShaderFeatures, picks the shader variant its meshes draw with
+    uint32_t getFeatures() const { return features; }
 
 private:
-    MTL::Device *device;
-    MTL::Buffer *materialBuffer;
-    MTL::Texture *diffuseTexture;
-    std::shared_ptr<Texture> texture;
+    TextureHandle diffuseMap;
+    uint32_t features = 0;
 
-    void createBuffer();
-    void loadTexture(const std::string &textureFilename, const std::string &baseDir);
+    void setProperties(const tinyobj::material_t &mat_data);
 };
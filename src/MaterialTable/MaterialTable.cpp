@@ -0,0 +1,140 @@
+#include "MaterialTable.hpp"
+#include "ResourceManager.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+static bool equal(simd::float3 a, simd::float3 b)
+{
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool sameRecord(const MaterialData &a, const MaterialData &b)
+{
+    return equal(a.ambient, b.ambient) && equal(a.diffuse, b.diffuse) && equal(a.specular, b.specular) &&
+           a.shininess == b.shininess && a.diffuseTexture == b.diffuseTexture &&
+           a.features == b.features;
+}
+
+void MaterialTable::DirtyRange::add(uint32_t index)
+{
+    if (begin == end)
+    {
+        begin = index;
+        end = index + 1;
+    }
+    else
+    {
+        begin = std::min(begin, index);
+        end = std::max(end, index + 1);
+    }
+}
+
+MaterialTable::MaterialTable(MTL::Device *device, ResourceManager &resources)
+    : device(device), resources(resources)
+{
+    grow(materialShadow, 0, &Copy::materials, &Copy::dirtyMaterials);
+    grow(textureShadow, 0, &Copy::textures, &Copy::dirtyTextures);
+}
+
+MaterialTable::~MaterialTable()
+{
+    for (Copy &copy : copies)
+    {
+        copy.materials->release();
+        copy.textures->release();
+    }
+}
+
+template <typename T>
+void MaterialTable::grow(std::vector<T> &shadow, size_t count, MTL::Buffer *Copy::*buffer, DirtyRange Copy::*dirty)
+{
+    if (count <= shadow.size() && copies[0].*buffer)
+        return;
+
+    size_t capacity = std::max<size_t>({count, shadow.size() * 2, 64});
+    shadow.resize(capacity);
+
+    // Frames already built still bind the old copies
+    for (Copy &copy : copies)
+    {
+        if (copy.*buffer)
+            resources.releaseLater(copy.*buffer);
+
+        copy.*buffer = device->newBuffer(capacity * sizeof(T), MTL::ResourceStorageModeShared);
+        copy.*dirty = {0, static_cast<uint32_t>(capacity)};
+    }
+}
+
+template <typename T>
+size_t MaterialTable::upload(const std::vector<T> &shadow, MTL::Buffer *target, DirtyRange &dirty)
+{
+    if (dirty.begin == dirty.end)
+        return 0;
+
+    size_t bytes = size_t(dirty.end - dirty.begin) * sizeof(T);
+    memcpy(static_cast<T *>(target->contents()) + dirty.begin, shadow.data() + dirty.begin, bytes);
+    dirty = {};
+    return bytes;
+}
+
+void MaterialTable::update(uint64_t frameIndex)
+{
+    // The copy written now was last bound FrameCount frames ago. The drawable limit keeps the GPU
+    // from falling that far behind, this only guards against it.
+    while (resources.getCompletedFrame() + FrameCount < frameIndex)
+    {
+        std::this_thread::yield();
+    }
+
+    ResourcePool<Texture> &textures = resources.getTextures();
+    ResourcePool<Material> &materials = resources.getMaterials();
+    grow(textureShadow, textures.getSlotCount(), &Copy::textures, &Copy::dirtyTextures);
+    grow(materialShadow, materials.getSlotCount(), &Copy::materials, &Copy::dirtyMaterials);
+
+    residentTextures.clear();
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        MTL::Texture *texture = textures.begin()[i].getMTLTexture();
+        if (!texture)
+            continue;
+
+        residentTextures.push_back(texture);
+
+        // Streaming swaps the Metal texture behind a slot, which changes its id
+        uint32_t slot = textures.handleAt(i).index();
+        MTL::ResourceID id = texture->gpuResourceID();
+        if (memcmp(&textureShadow[slot], &id, sizeof(id)) != 0)
+        {
+            textureShadow[slot] = id;
+            for (Copy &copy : copies)
+                copy.dirtyTextures.add(slot);
+        }
+    }
+
+    for (size_t i = 0; i < materials.size(); ++i)
+    {
+        const Material &material = materials.begin()[i];
+        const Texture *diffuse = textures.get(material.getDiffuseMap());
+
+        MaterialData record;
+        record.ambient = material.ambient;
+        record.diffuse = material.diffuse;
+        record.specular = material.specular;
+        record.shininess = material.shininess;
+        record.diffuseTexture = diffuse && diffuse->getMTLTexture() ? material.getDiffuseMap().index() : NoTexture;
+        record.features = material.getFeatures();
+
+        uint32_t slot = materials.handleAt(i).index();
+        if (!sameRecord(materialShadow[slot], record))
+        {
+            materialShadow[slot] = record;
+            for (Copy &copy : copies)
+                copy.dirtyMaterials.add(slot);
+        }
+    }
+
+    Copy &copy = copies[frameIndex % FrameCount];
+    uploadedBytes = upload(materialShadow, copy.materials, copy.dirtyMaterials) +
+                    upload(textureShadow, copy.textures, copy.dirtyTextures);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Metal/Metal.hpp>
+#include <simd/simd.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+class ResourceManager;
+
+// Matches MaterialData in geometry.metal
+struct MaterialData
+{
+    simd::float3 ambient;
+    simd::float3 diffuse;
+    simd::float3 specular;
+    float shininess;
+
+    // Slot in the texture table, NoTexture when there is none
+    uint32_t diffuseTexture;
+
+    // Material::getFeatures, read by the generic shader variant only
+    uint32_t features;
+} __attribute__((aligned(16)));
+
+// GPU copies of every material's properties and of every texture's resource id, both indexed
+// by pool slot. Draws pick their material by id, so the table and the textures are bound once
+// per pass instead of once per draw.
+//
+// Each frame in flight has its own copy of both tables. update() compares the pools against a
+// CPU shadow and marks the records that changed as a dirty range on every copy, so a copy only
+// has the changes made since it was last written uploaded into it.
+class MaterialTable
+{
+public:
+    static constexpr uint32_t NoTexture = ~0u;
+
+    // Three drawables on the GPU, one snapshot being encoded, one waiting and one being built
+    static constexpr uint32_t FrameCount = 6;
+
+    MaterialTable(MTL::Device *device, ResourceManager &resources);
+    MaterialTable(const MaterialTable &) = delete;
+    MaterialTable &operator=(const MaterialTable &) = delete;
+    ~MaterialTable();
+
+    // Main thread, after anything this frame that changes materials or swaps textures
+    void update(uint64_t frameIndex);
+
+    MTL::Buffer *getMaterialBuffer(uint64_t frameIndex) const { return copies[frameIndex % FrameCount].materials; }
+    MTL::Buffer *getTextureBuffer(uint64_t frameIndex) const { return copies[frameIndex % FrameCount].textures; }
+
+    // Textures the tables reference, for the pass to make resident with useResources
+    const std::vector<MTL::Resource *> &getResidentTextures() const { return residentTextures; }
+
+    // Bytes written into the frame's copy by the last update
+    size_t getUploadedBytes() const { return uploadedBytes; }
+
+private:
+    struct DirtyRange
+    {
+        uint32_t begin = 0;
+        uint32_t end = 0;
+
+        void add(uint32_t index);
+    };
+
+    struct Copy
+    {
+        MTL::Buffer *materials = nullptr;
+        MTL::Buffer *textures = nullptr;
+        DirtyRange dirtyMaterials;
+        DirtyRange dirtyTextures;
+    };
+
+    template <typename T>
+    void grow(std::vector<T> &shadow, size_t count, MTL::Buffer *Copy::*buffer, DirtyRange Copy::*dirty);
+
+    template <typename T>
+    size_t upload(const std::vector<T> &shadow, MTL::Buffer *target, DirtyRange &dirty);
+
+    MTL::Device *device;
+    ResourceManager &resources;
+
+    std::vector<MaterialData> materialShadow;
+    std::vector<MTL::ResourceID> textureShadow;
+    std::array<Copy, FrameCount> copies;
+
+    std::vector<MTL::Resource *> residentTextures;
+    size_t uploadedBytes = 0;
+};
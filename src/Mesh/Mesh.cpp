@@ -1,67 +1,77 @@
 #include "Mesh.hpp"
+#include <utility>
 
-Mesh::Mesh(MTL::Device *device,
+Mesh::Mesh(GeometryBuffer &geometry,
            const std::vector<VertexData> &vertices,
            const std::vector<uint32_t> &indices,
-           std::shared_ptr<Material> material)
-    : device(device), material(material), indexCount(static_cast<uint32_t>(indices.size()))
+           MaterialHandle material)
+    : geometry(&geometry), vertexCount(static_cast<uint32_t>(vertices.size())),
+      indexCount(static_cast<uint32_t>(indices.size())), material(material)
 {
-    size_t vertexBufferSize = sizeof(VertexData) * vertices.size();
-    vertexBuffer = device->newBuffer(vertices.data(), vertexBufferSize, MTL::ResourceStorageModeShared);
-
-    size_t indexBufferSize = sizeof(uint32_t) * indices.size();
-    indexBuffer = device->newBuffer(indices.data(), indexBufferSize, MTL::ResourceStorageModeShared);
+    allocation = geometry.allocate(vertices.data(), vertexCount, indices.data(), indexCount);
 }
 
-Mesh::~Mesh()
+Mesh::Mesh(Mesh &&other) noexcept
+    : geometry(std::exchange(other.geometry, nullptr)),
+      allocation(std::exchange(other.allocation, {})),
+      vertexCount(other.vertexCount), indexCount(other.indexCount), material(other.material)
 {
-    if (vertexBuffer)
-        vertexBuffer->release();
-    if (indexBuffer)
-        indexBuffer->release();
 }
 
-void Mesh::draw(MTL::RenderCommandEncoder *encoder)
+Mesh &Mesh::operator=(Mesh &&other) noexcept
 {
-    encoder->setVertexBuffer(vertexBuffer, 0, 0);
-
-    // Set transform buffer is already set by Renderable
-
-    encoder->setFragmentBuffer(material->getMaterialBuffer(), 0, 2);
-
-    if (material->getDiffuseTexture())
+    if (this != &other)
     {
-        encoder->setFragmentTexture(material->getDiffuseTexture(), 0);
+        if (geometry)
+            geometry->free(allocation);
+
+        geometry = std::exchange(other.geometry, nullptr);
+        allocation = std::exchange(other.allocation, {});
+        vertexCount = other.vertexCount;
+        indexCount = other.indexCount;
+        material = other.material;
     }
+    return *this;
+}
 
-    MTL::SamplerDescriptor *samplerDesc = MTL::SamplerDescriptor::alloc()->init();
-    samplerDesc->setMinFilter(MTL::SamplerMinMagFilterLinear);
-    samplerDesc->setMagFilter(MTL::SamplerMinMagFilterLinear);
-    samplerDesc->setMipFilter(MTL::SamplerMipFilterLinear);
-    MTL::SamplerState *sampler = device->newSamplerState(samplerDesc);
-    encoder->setFragmentSamplerState(sampler, 0);
-    samplerDesc->release();
-    sampler->release();
+Mesh::~Mesh()
+{
+    if (geometry)
+        geometry->free(allocation);
+}
+
+void Mesh::draw(StateTracker &state, uint32_t materialId)
+{
+    state.setVertexBuffer(getVertexBuffer(), 0, 0);
 
-    encoder->drawIndexedPrimitives(MTL::PrimitiveType::PrimitiveTypeTriangle, indexCount, MTL::IndexType::IndexTypeUInt32, indexBuffer, 0);
+    // Transform data is already bound by the Renderer. The material id reaches the shaders as
+    // the instance id, so selecting a material costs no bind.
+    state.drawIndexedPrimitives(MTL::PrimitiveType::PrimitiveTypeTriangle, indexCount, MTL::IndexType::IndexTypeUInt32,
+                                geometry->getIndexBuffer(allocation), size_t(allocation.indices.offset) * sizeof(uint32_t),
+                                1, allocation.vertices.offset, materialId);
 }
 
 const VertexData *Mesh::getVertices() const
 {
-    return static_cast<const VertexData *>(vertexBuffer->contents());
+    return geometry->getVertices(allocation);
 }
 
 size_t Mesh::getVertexCount() const
 {
-    return vertexBuffer->length() / sizeof(VertexData);
+    return vertexCount;
 }
 
 const uint32_t *Mesh::getIndices() const
 {
-    return static_cast<const uint32_t *>(indexBuffer->contents());
+    return geometry->getIndices(allocation);
 }
 
 size_t Mesh::getIndexCount() const
 {
-    return indexBuffer->length() / sizeof(uint32_t);
+    return indexCount;
+}
+
+size_t Mesh::getAllocatedSize() const
+{
+    return size_t(allocation.vertices.size) * sizeof(VertexData) + size_t(allocation.indices.size) * sizeof(uint32_t);
 }
@@ -3,20 +3,41 @@
 #include <Metal/Metal.hpp>
 #include <vector>
 #include <memory>
+#include "GeometryBuffer.hpp"
 #include "Material.hpp"
+#include "StateTracker.hpp"
 #include "VertexData.hpp"
 #include <glm/glm.hpp>
 
+class Mesh;
+
+using MeshHandle = Handle<Mesh>;
+
 class Mesh
 {
 public:
-    Mesh(MTL::Device *device,
+    Mesh(GeometryBuffer &geometry,
          const std::vector<VertexData> &vertices,
          const std::vector<uint32_t> &indices,
-         std::shared_ptr<Material> material);
+         MaterialHandle material = {});
+    Mesh(Mesh &&other) noexcept;
+    Mesh &operator=(Mesh &&other) noexcept;
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
     ~Mesh();
 
-    void draw(MTL::RenderCommandEncoder *encoder);
+    // Binds the geometry page's vertex buffer, which the tracker skips when the previous mesh
+    // shared the page. The material table and textures are bound by the caller, materialId
+    // selects the record.
+    void draw(StateTracker &state, uint32_t materialId);
+    MTL::Buffer *getVertexBuffer() const { return geometry->getVertexBuffer(allocation); }
+
+    MaterialHandle getMaterial() const { return material; }
+    void setMaterial(MaterialHandle handle) { material = handle; }
+
+    // Moved by GeometryBuffer::defragment, which frees the old range itself
+    const GeometryAllocation &getGeometry() const { return allocation; }
+    void setGeometry(const GeometryAllocation &moved) { allocation = moved; }
 
     // Methods to access vertex and index data
     const VertexData *getVertices() const;
@@ -24,11 +45,13 @@ public:
     const uint32_t *getIndices() const;
     size_t getIndexCount() const;
 
+    // Geometry buffer memory held by the vertices and indices
+    size_t getAllocatedSize() const;
+
 private:
-    MTL::Buffer *vertexBuffer;
-    MTL::Buffer *indexBuffer;
+    GeometryBuffer *geometry;
+    GeometryAllocation allocation;
+    uint32_t vertexCount;
     uint32_t indexCount;
-    std::shared_ptr<Material> material;
-
-    MTL::Device *device;
+    MaterialHandle material;
 };
@@ -1,16 +1,244 @@
 #include "Model.hpp"
+#include "ResourceManager.hpp"
+#include "TextureAtlas.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <exception>
 #include <filesystem>
+#include <fstream>
+#include <istream>
+#include <streambuf>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
-Model::Model(MTL::Device *device, const std::string &objFilePath)
-    : device(device)
+namespace
 {
-    loadOBJ(objFilePath);
+    // Reads a file's bytes in place, tinyobj only parses from a stream
+    struct BufferStreamBuf : std::streambuf
+    {
+        BufferStreamBuf(char *data, size_t size) { setg(data, data, data + size); }
+    };
+
+    // whenAll rethrows the first failure and drops the other results, so each material load
+    // keeps its failure instead and the materials that were created can still be destroyed
+    struct MaterialLoad
+    {
+        MaterialHandle handle;
+        std::exception_ptr failure;
+    };
+
+    Task<MaterialLoad> settle(Task<MaterialHandle> load)
+    {
+        try
+        {
+            co_return MaterialLoad{co_await load, nullptr};
+        }
+        catch (...)
+        {
+            co_return MaterialLoad{{}, std::current_exception()};
+        }
+    }
+}
+
+Model::Model(MTL::Device *device, ResourceManager *resources)
+    : device(device), resources(resources)
+{
+}
+
+Model::Model(Model &&other) noexcept
+    : device(other.device), resources(other.resources),
+      meshes(std::move(other.meshes)), materials(std::move(other.materials)), bounds(other.bounds)
+{
+    other.meshes.clear();
+    other.materials.clear();
+}
+
+Model &Model::operator=(Model &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+
+        device = other.device;
+        resources = other.resources;
+        meshes = std::move(other.meshes);
+        materials = std::move(other.materials);
+        bounds = other.bounds;
+        other.meshes.clear();
+        other.materials.clear();
+    }
+    return *this;
 }
 
 Model::~Model()
 {
+    release();
+}
+
+void Model::release()
+{
+    for (MeshHandle mesh : meshes)
+    {
+        resources->destroy(mesh);
+    }
+
+    for (MaterialHandle handle : materials)
+    {
+        if (Material *material = resources->get(handle))
+        {
+            resources->destroy(material->getDiffuseMap());
+        }
+        resources->destroy(handle);
+    }
+
+    meshes.clear();
+    materials.clear();
+}
+
+size_t Model::getAllocatedSize() const
+{
+    size_t size = 0;
+    for (MeshHandle handle : meshes)
+    {
+        if (Mesh *mesh = resources->get(handle))
+            size += mesh->getAllocatedSize();
+    }
+
+    // Materials sharing an atlas share its texture
+    std::vector<uint32_t> counted;
+    for (MaterialHandle handle : materials)
+    {
+        Material *material = resources->get(handle);
+        TextureHandle diffuseMap = material ? material->getDiffuseMap() : TextureHandle{};
+        Texture *texture = resources->get(diffuseMap);
+        if (!texture || std::find(counted.begin(), counted.end(), diffuseMap.value) != counted.end())
+            continue;
+
+        counted.push_back(diffuseMap.value);
+        size += texture->getAllocatedSize();
+    }
+
+    return size;
+}
+
+Task<ModelHandle> Model::loadAsync(JobSystem &jobSystem, UploadStage &uploadStage, ResourceManager &resources, MTL::Device *device, std::string objFilePath)
+{
+    ModelData data;
+    {
+        auto bytes = co_await readFileAsync(jobSystem, objFilePath);
+        if (!bytes)
+        {
+            throw std::runtime_error("Failed to load OBJ file: " + objFilePath);
+        }
+
+        BufferStreamBuf buffer(bytes->data(), bytes->size());
+        std::istream stream(&buffer);
+        data = parseOBJ(objFilePath, stream);
+    }
+
+    std::vector<Task<std::optional<ImageData>>> decodes;
+    for (const auto &mat_data : data.materials)
+    {
+        decodes.push_back(Material::decodeDiffuseAsync(jobSystem, mat_data, data.baseDir));
+    }
+
+    std::vector<std::optional<ImageData>> diffuseImages = co_await whenAll(jobSystem, std::move(decodes));
+
+    TextureAtlas atlas;
+    std::vector<const ImageData *> atlasImages;
+    std::vector<int> atlasMaterials = packSmallTextures(data, diffuseImages, atlas, atlasImages);
+
+    std::vector<ImageData> atlasMips;
+    if (!atlasImages.empty())
+    {
+        atlas.buildMips(atlasImages, atlasMips);
+        printf("%s: %zu textures in a %dx%d atlas, %.0f%% used\n", objFilePath.c_str(), atlas.getPackedCount(),
+               atlas.getWidth(), atlas.getHeight(), atlas.getEfficiency() * 100.0f);
+    }
+
+    // Materials in the atlas are created below, once the atlas texture is
+    std::vector<Task<MaterialLoad>> materialLoads;
+    std::vector<size_t> loadedIndices;
+    for (size_t i = 0; i < data.materials.size(); ++i)
+    {
+        if (atlasMaterials[i] >= 0)
+            continue;
+
+        materialLoads.push_back(settle(Material::loadAsync(jobSystem, uploadStage, resources, device, data.materials[i], data.baseDir, std::move(diffuseImages[i]))));
+        loadedIndices.push_back(i);
+    }
+
+    std::vector<MaterialLoad> loaded = co_await whenAll(jobSystem, std::move(materialLoads));
+
+    std::exception_ptr failure;
+    std::vector<MaterialHandle> loadedMaterials(data.materials.size());
+    for (size_t i = 0; i < loaded.size(); ++i)
+    {
+        loadedMaterials[loadedIndices[i]] = loaded[i].handle;
+        if (loaded[i].failure && !failure)
+            failure = loaded[i].failure;
+    }
+
+    std::vector<Mesh> builtMeshes;
+    std::optional<Texture> atlasTexture;
+    if (!failure)
+    {
+        try
+        {
+            co_await resumeOnUploadStage(uploadStage);
+
+            builtMeshes.reserve(data.meshes.size());
+            for (const auto &meshData : data.meshes)
+            {
+                builtMeshes.emplace_back(resources.getGeometry(), meshData.vertices, meshData.indices);
+            }
+
+            if (!atlasMips.empty())
+            {
+                // Not streamed, it has no source file to read finer mips back from
+                atlasTexture.emplace(atlasMips, 0, std::string(), device);
+            }
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+    }
+
+    co_await resumeOnMainThread(jobSystem);
+
+    // Owns everything created from here on, so a failed load destroys it with the model, on
+    // the main thread like every other pool change
+    Model model(device, &resources);
+    for (MaterialHandle handle : loadedMaterials)
+    {
+        if (handle)
+            model.materials.push_back(handle);
+    }
+
+    if (failure)
+    {
+        std::rethrow_exception(failure);
+    }
+
+    TextureHandle atlasMap;
+    if (atlasTexture && atlasTexture->getMTLTexture())
+    {
+        atlasMap = resources.getTextures().create(std::move(*atlasTexture));
+    }
+
+    for (size_t i = 0; i < data.materials.size(); ++i)
+    {
+        if (atlasMaterials[i] == static_cast<int>(i))
+        {
+            loadedMaterials[i] = resources.getMaterials().create(data.materials[i], atlasMap);
+            model.materials.push_back(loadedMaterials[i]);
+        }
+    }
+
+    model.addMeshes(data, loadedMaterials, builtMeshes);
+
+    co_return resources.getModels().create(std::move(model));
 }
 
 std::string Model::getBaseDir(const std::string &filepath)
@@ -19,7 +247,7 @@ std::string Model::getBaseDir(const std::string &filepath)
     return path.parent_path().string() + "/";
 }
 
-void Model::loadOBJ(const std::string &filePath)
+ModelData Model::parseOBJ(const std::string &filePath, std::istream &stream)
 {
     tinyobj::attrib_t attrib;
     std::vector<tinyobj::shape_t> shapes;
@@ -27,7 +255,8 @@ void Model::loadOBJ(const std::string &filePath)
     std::string warn, err;
     std::string baseDir = getBaseDir(filePath);
 
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materialsData, &warn, &err, filePath.c_str(), baseDir.c_str(), true);
+    tinyobj::MaterialFileReader materialReader(baseDir);
+    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materialsData, &warn, &err, &stream, &materialReader, true);
 
     if (!warn.empty())
     {
@@ -44,15 +273,8 @@ void Model::loadOBJ(const std::string &filePath)
         throw std::runtime_error("Failed to load OBJ file: " + filePath);
     }
 
-    for (const auto &mat_data : materialsData)
-    {
-        auto material = std::make_shared<Material>(device, mat_data, baseDir);
-        materials[mat_data.name] = material;
-    }
-
     std::unordered_map<int, std::vector<VertexData>> perMaterialVertices;
     std::unordered_map<int, std::vector<uint32_t>> perMaterialIndices;
-    std::unordered_map<int, uint32_t> perMaterialIndexOffset;
     std::unordered_map<int, std::unordered_map<VertexData, uint32_t>> perMaterialVertexToIndexMap;
 
     for (const auto &shape : shapes)
@@ -124,25 +346,162 @@ void Model::loadOBJ(const std::string &filePath)
         }
     }
 
-    for (const auto &[material_id, vertices] : perMaterialVertices)
+    ModelData data;
+    data.baseDir = baseDir;
+    data.materials = std::move(materialsData);
+
+    for (auto &[material_id, vertices] : perMaterialVertices)
     {
-        const auto &indices = perMaterialIndices[material_id];
-        std::vector<VertexData> meshVertices = vertices;
+        MeshData mesh;
+        mesh.materialId = material_id;
+        mesh.vertices = std::move(vertices);
+        mesh.indices = std::move(perMaterialIndices[material_id]);
 
         if (attrib.normals.empty())
         {
-            calculateNormals(meshVertices, indices);
+            calculateNormals(mesh.vertices, mesh.indices);
         }
 
-        std::shared_ptr<Material> material;
-        if (material_id >= 0 && material_id < static_cast<int>(materialsData.size()))
+        for (const auto &vertex : mesh.vertices)
         {
-            const auto &mat_data = materialsData[material_id];
-            material = materials[mat_data.name];
+            data.bounds.add(glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]));
+        }
+
+        data.meshes.push_back(std::move(mesh));
+    }
+
+    return data;
+}
+
+static bool sameProperties(const tinyobj::material_t &a, const tinyobj::material_t &b)
+{
+    return std::equal(a.ambient, a.ambient + 3, b.ambient) && std::equal(a.diffuse, a.diffuse + 3, b.diffuse) &&
+           std::equal(a.specular, a.specular + 3, b.specular) && a.shininess == b.shininess;
+}
+
+std::vector<int> Model::packSmallTextures(ModelData &data, const std::vector<std::optional<ImageData>> &images,
+                                          TextureAtlas &atlas, std::vector<const ImageData *> &atlasImages)
+{
+    std::vector<int> atlasMaterials(data.materials.size(), -1);
+    if (!TextureAtlas::isEnabled())
+        return atlasMaterials;
+
+    // Only textures that are small and never repeat, an atlas cannot wrap
+    std::vector<bool> repeats(data.materials.size(), false);
+    for (const MeshData &mesh : data.meshes)
+    {
+        if (mesh.materialId < 0)
+            continue;
+
+        for (const VertexData &vertex : mesh.vertices)
+        {
+            if (vertex.texcoord.x < 0.0f || vertex.texcoord.x > 1.0f || vertex.texcoord.y < 0.0f || vertex.texcoord.y > 1.0f)
+            {
+                repeats[mesh.materialId] = true;
+                break;
+            }
+        }
+    }
+
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        if (images[i] && !repeats[i] && std::max(images[i]->width, images[i]->height) <= TextureAtlas::MaxImageSize)
+            candidates.push_back(i);
+    }
+
+    if (candidates.size() < 2)
+        return atlasMaterials;
+
+    std::vector<const ImageData *> candidateImages;
+    for (size_t i : candidates)
+    {
+        candidateImages.push_back(&*images[i]);
+    }
+
+    if (atlas.pack(candidateImages) < 2)
+        return atlasMaterials;
+
+    // Regions are indexed like the candidates, the atlas is composed from the same list
+    atlasImages = std::move(candidateImages);
+
+    // Packed materials with the same properties become one material, and their meshes one mesh
+    std::vector<size_t> representatives;
+    for (size_t c = 0; c < candidates.size(); ++c)
+    {
+        if (!atlas.getRegions()[c].packed)
+            continue;
+
+        size_t i = candidates[c];
+        auto same = std::find_if(representatives.begin(), representatives.end(), [&](size_t r)
+                                 { return sameProperties(data.materials[r], data.materials[i]); });
+        if (same == representatives.end())
+        {
+            representatives.push_back(i);
+            atlasMaterials[i] = static_cast<int>(i);
+        }
+        else
+        {
+            atlasMaterials[i] = static_cast<int>(*same);
+        }
+    }
+
+    std::vector<MeshData> merged;
+    std::unordered_map<int, size_t> mergedIndex;
+    for (MeshData &mesh : data.meshes)
+    {
+        int id = mesh.materialId;
+        if (id < 0 || atlasMaterials[id] < 0)
+        {
+            merged.push_back(std::move(mesh));
+            continue;
+        }
+
+        size_t candidate = std::find(candidates.begin(), candidates.end(), size_t(id)) - candidates.begin();
+        for (VertexData &vertex : mesh.vertices)
+        {
+            vertex.texcoord = atlas.remap(candidate, vertex.texcoord);
+        }
+
+        auto [it, inserted] = mergedIndex.try_emplace(atlasMaterials[id], merged.size());
+        if (inserted)
+        {
+            mesh.materialId = atlasMaterials[id];
+            merged.push_back(std::move(mesh));
+            continue;
+        }
+
+        MeshData &target = merged[it->second];
+        uint32_t base = static_cast<uint32_t>(target.vertices.size());
+        target.vertices.insert(target.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        for (uint32_t index : mesh.indices)
+        {
+            target.indices.push_back(base + index);
+        }
+    }
+
+    data.meshes = std::move(merged);
+    return atlasMaterials;
+}
+
+void Model::addMeshes(const ModelData &data, const std::vector<MaterialHandle> &loadedMaterials, std::vector<Mesh> &builtMeshes)
+{
+    bounds = data.bounds;
+
+    MaterialHandle defaultMaterial;
+
+    for (size_t i = 0; i < builtMeshes.size(); ++i)
+    {
+        int material_id = data.meshes[i].materialId;
+
+        MaterialHandle material;
+        if (material_id >= 0 && material_id < static_cast<int>(loadedMaterials.size()))
+        {
+            material = loadedMaterials[material_id];
         }
         else
         {
-            if (materials.find("default") == materials.end())
+            if (!defaultMaterial)
             {
                 tinyobj::material_t defaultMatData;
                 defaultMatData.name = "default";
@@ -150,17 +509,15 @@ void Model::loadOBJ(const std::string &filePath)
                 defaultMatData.diffuse[1] = 0.5f;
                 defaultMatData.diffuse[2] = 0.5f;
 
-                material = std::make_shared<Material>(device, defaultMatData, baseDir);
-                materials["default"] = material;
-            }
-            else
-            {
-                material = materials["default"];
+                defaultMaterial = resources->getMaterials().create(defaultMatData);
+                materials.push_back(defaultMaterial);
             }
+
+            material = defaultMaterial;
         }
 
-        auto mesh = std::make_shared<Mesh>(device, meshVertices, indices, material);
-        meshes.push_back(mesh);
+        builtMeshes[i].setMaterial(material);
+        meshes.push_back(resources->getMeshes().create(std::move(builtMeshes[i])));
     }
 }
 
@@ -234,8 +591,12 @@ std::optional<glm::vec3> Model::Intersect(const glm::vec3 &origin, const glm::ve
     glm::vec3 closestIntersection;
     bool hasIntersection = false;
 
-    for (const auto &mesh : meshes)
+    for (MeshHandle handle : meshes)
     {
+        const Mesh *mesh = resources->get(handle);
+        if (!mesh)
+            continue;
+
         const VertexData *vertices = mesh->getVertices();
         size_t vertexCount = mesh->getVertexCount();
         const uint32_t *indices = mesh->getIndices();
@@ -8,29 +8,79 @@
 #include "tiny_obj_loader.h"
 #include <unordered_map>
 #include <memory>
+#include <optional>
 #include "Mesh.hpp"
+#include "Task.hpp"
+#include "Bounds.hpp"
 #include <glm/glm.hpp>
 
+// CPU side result of parsing an OBJ, one entry per material used
+struct MeshData
+{
+    int materialId = -1;
+    std::vector<VertexData> vertices;
+    std::vector<uint32_t> indices;
+};
+
+struct ModelData
+{
+    std::string baseDir;
+    std::vector<tinyobj::material_t> materials;
+    std::vector<MeshData> meshes;
+    Bounds bounds;
+};
+
+class ResourceManager;
+class TextureAtlas;
+class Model;
+
+using ModelHandle = Handle<Model>;
+
+// Owns the pooled meshes, materials and textures it was loaded with and destroys
+// them (deferred until the GPU is done) when the model itself is destroyed
 class Model
 {
 public:
-    Model(MTL::Device *device, const std::string &objFilePath);
+    Model(Model &&other) noexcept;
+    Model &operator=(Model &&other) noexcept;
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
     ~Model();
 
-    const std::vector<std::shared_ptr<Mesh>> &getMeshes() const { return meshes; }
+    // Reads and parses on workers, loads materials concurrently, builds meshes on the upload stage
+    // and registers them in the resource pools on the main thread
+    static Task<ModelHandle> loadAsync(JobSystem &jobSystem, UploadStage &uploadStage, ResourceManager &resources, MTL::Device *device, std::string objFilePath);
+
+    const std::vector<MeshHandle> &getMeshes() const { return meshes; }
+    const std::vector<MaterialHandle> &getMaterials() const { return materials; }
+    const Bounds &getBounds() const { return bounds; }
+
+    // GPU memory of the meshes and textures this model owns. Main thread.
+    size_t getAllocatedSize() const;
 
     std::optional<glm::vec3> Intersect(const glm::vec3 &origin, const glm::vec3 &destination);
 
 private:
     MTL::Device *device;
-    std::vector<std::shared_ptr<Mesh>> meshes;
+    ResourceManager *resources;
+    std::vector<MeshHandle> meshes;
+    std::vector<MaterialHandle> materials;
+    Bounds bounds;
+
+    Model(MTL::Device *device, ResourceManager *resources);
+    void release();
 
-    void loadOBJ(const std::string &filePath);
-    void calculateNormals(std::vector<VertexData> &vertices, const std::vector<uint32_t> &indices);
+    static ModelData parseOBJ(const std::string &filePath, std::istream &stream);
 
-    std::unordered_map<std::string, std::shared_ptr<Material>> materials;
+    // Packs the small, non-repeating diffuse textures into atlas, remaps their meshes' texcoords
+    // and merges materials (and meshes) that then only differ by texture. Returns, per material,
+    // the material it was merged into or -1 when it keeps its own texture.
+    static std::vector<int> packSmallTextures(ModelData &data, const std::vector<std::optional<ImageData>> &images,
+                                              TextureAtlas &atlas, std::vector<const ImageData *> &atlasImages);
+    static void calculateNormals(std::vector<VertexData> &vertices, const std::vector<uint32_t> &indices);
+    void addMeshes(const ModelData &data, const std::vector<MaterialHandle> &loadedMaterials, std::vector<Mesh> &builtMeshes);
 
-    std::string getBaseDir(const std::string &filepath);
+    static std::string getBaseDir(const std::string &filepath);
 
 private:
     bool rayIntersectsTriangle(const glm::vec3 &orig, const glm::vec3 &dir,
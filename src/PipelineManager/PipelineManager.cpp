@@ -1,41 +1,266 @@
 #include "PipelineManager.hpp"
 #include "Engine.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <string>
 
-PipelineManager::PipelineManager(MTL::Device* device) : device(device), library(nullptr) {
+PipelineManager::PipelineManager(MTL::Device *device, JobSystem &jobSystem) : library(nullptr), device(device), jobSystem(jobSystem)
+{
     library = device->newDefaultLibrary();
-    if (!library) {
+    if (!library)
+    {
         std::cerr << "Failed to load default library." << std::endl;
     }
 
     printf("Loaded default library\n");
 }
 
-PipelineManager::~PipelineManager() {
-    for (auto& pair : pipelines) {
-        if (pair.second) {
-            pair.second->release();
-        }
+PipelineManager::~PipelineManager()
+{
+    // Workers still compiling write into the entries
+    jobSystem.wait(compileCounter);
+
+    for (auto &entry : entries)
+    {
+        if (MTL::RenderPipelineState *state = entry->state.load(std::memory_order_acquire))
+            state->release();
+        if (entry->descriptor)
+            entry->descriptor->release();
     }
-    if (library) {
+    if (library)
+    {
         library->release();
     }
 }
 
-void PipelineManager::createPipeline(const std::string& name, const MTL::RenderPipelineDescriptor* descriptor) {
-    NS::Error* error = nullptr;
-    MTL::RenderPipelineState* pipelineState = device->newRenderPipelineState(descriptor, &error);
-    if (!pipelineState) {
-        std::cerr << "Failed to create pipeline state '" << name << "': " << error->localizedDescription()->utf8String() << std::endl;
-    } else {
-        pipelines[name] = pipelineState;
+PipelineId PipelineManager::addEntry(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor, PipelineId fallback,
+                                     const std::string &fragmentFunction, uint32_t features)
+{
+    if (idByName.count(name))
+    {
+        std::cerr << "Pipeline '" << name << "' is already registered" << std::endl;
+        return idByName[name];
     }
+
+    PipelineId id = static_cast<PipelineId>(entries.size());
+    auto entry = std::make_unique<Entry>();
+    entry->name = name;
+    entry->descriptor = descriptor->copy();
+    entry->fallback = fallback;
+    entry->fragmentFunction = fragmentFunction;
+    entry->features = features;
+    entries.push_back(std::move(entry));
+    idByName[name] = id;
+    return id;
+}
+
+PipelineId PipelineManager::createPipeline(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor)
+{
+    PipelineId id = addEntry(name, descriptor, InvalidPipeline);
+    compileNow(id);
+    return id;
+}
+
+PipelineId PipelineManager::registerPipeline(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor, PipelineId fallback)
+{
+    return addEntry(name, descriptor, fallback);
 }
 
-MTL::RenderPipelineState* PipelineManager::getPipeline(const std::string& name) {
-    auto it = pipelines.find(name);
-    if (it != pipelines.end()) {
+PipelineId PipelineManager::createVariant(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor,
+                                          const std::string &fragmentFunction, uint32_t features)
+{
+    PipelineId id = addEntry(name, descriptor, InvalidPipeline, fragmentFunction, features);
+    compileNow(id);
+    return id;
+}
+
+PipelineId PipelineManager::registerVariant(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor,
+                                            const std::string &fragmentFunction, uint32_t features, PipelineId fallback)
+{
+    return addEntry(name, descriptor, fallback, fragmentFunction, features);
+}
+
+PipelineId PipelineManager::getVariant(PipelineId base, uint32_t materialFeatures)
+{
+    if (base >= entries.size())
+        return base;
+
+    const Entry &entry = *entries[base];
+    if (entry.fragmentFunction.empty() || (entry.features & FeatureDebugNormals))
+        return base;
+
+    uint32_t features = (entry.features & ~(FeatureGeneric | MaterialFeatureBits)) | (materialFeatures & MaterialFeatureBits);
+    uint64_t key = (uint64_t(base) << 32) | features;
+    auto it = variants.find(key);
+    if (it != variants.end())
         return it->second;
+
+    // The base draws it meanwhile, and the base's own fallback covers the base
+    PipelineId id = addEntry(entry.name + ":" + std::to_string(features), entry.descriptor, base, entry.fragmentFunction, features);
+    variants.emplace(key, id);
+    return id;
+}
+
+PipelineId PipelineManager::findPipeline(const std::string &name) const
+{
+    auto it = idByName.find(name);
+    return it != idByName.end() ? it->second : InvalidPipeline;
+}
+
+MTL::RenderPipelineState *PipelineManager::resolve(PipelineId id)
+{
+    if (id >= entries.size())
+        return nullptr;
+
+    Entry &entry = *entries[id];
+    entry.used = true;
+
+    if (MTL::RenderPipelineState *state = entry.state.load(std::memory_order_acquire))
+        return state;
+
+    compileAsync(entry);
+    return entry.fallback != InvalidPipeline ? resolve(entry.fallback) : nullptr;
+}
+
+MTL::RenderPipelineState *PipelineManager::getPipeline(const std::string &name)
+{
+    PipelineId id = findPipeline(name);
+    return id != InvalidPipeline ? entries[id]->state.load(std::memory_order_acquire) : nullptr;
+}
+
+void PipelineManager::compileNow(PipelineId id)
+{
+    Entry &entry = *entries[id];
+    Status expected = Status::Registered;
+    if (entry.status.compare_exchange_strong(expected, Status::Compiling))
+        compile(entry);
+}
+
+void PipelineManager::compileAsync(Entry &entry)
+{
+    // Only the first request for a registered pipeline schedules it
+    Status expected = Status::Registered;
+    if (!entry.status.compare_exchange_strong(expected, Status::Compiling))
+        return;
+
+    pendingCount.fetch_add(1, std::memory_order_relaxed);
+    jobSystem.schedule([this, &entry]()
+                       {
+        compile(entry);
+        pendingCount.fetch_sub(1, std::memory_order_relaxed); }, &compileCounter);
+}
+
+void PipelineManager::compile(Entry &entry)
+{
+    // Workers have no pool of their own for the error Metal autoreleases
+    NS::AutoreleasePool *pool = NS::AutoreleasePool::alloc()->init();
+    auto start = std::chrono::steady_clock::now();
+
+    // Other threads may copy the entry's descriptor for new variants, so it is never modified
+    MTL::RenderPipelineDescriptor *descriptor = entry.descriptor->copy();
+
+    NS::Error *error = nullptr;
+    MTL::RenderPipelineState *state = nullptr;
+    if (entry.fragmentFunction.empty())
+    {
+        state = device->newRenderPipelineState(descriptor, &error);
+    }
+    else if (MTL::Function *fragmentFunction = specialize(entry))
+    {
+        descriptor->setFragmentFunction(fragmentFunction);
+        state = device->newRenderPipelineState(descriptor, &error);
+        fragmentFunction->release();
+    }
+    descriptor->release();
+
+    compileMs.fetch_add(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+
+    if (!state)
+    {
+        std::cerr << "Failed to create pipeline state '" << entry.name << "': "
+                  << (error ? error->localizedDescription()->utf8String() : "unknown error") << std::endl;
+        entry.status.store(Status::Failed, std::memory_order_release);
+    }
+    else
+    {
+        entry.state.store(state, std::memory_order_release);
+        entry.status.store(Status::Ready, std::memory_order_release);
+        compiledCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    pool->release();
+}
+
+MTL::Function *PipelineManager::specialize(const Entry &entry)
+{
+    MTL::FunctionConstantValues *values = MTL::FunctionConstantValues::alloc()->init();
+    for (uint32_t bit = 0; bit < ShaderFeatureCount; ++bit)
+    {
+        bool enabled = (entry.features >> bit) & 1u;
+        values->setConstantValue(&enabled, MTL::DataTypeBool, bit);
+    }
+
+    NS::Error *error = nullptr;
+    MTL::Function *function = library->newFunction(NS::String::string(entry.fragmentFunction.c_str(), NS::UTF8StringEncoding), values, &error);
+    values->release();
+
+    if (!function)
+    {
+        std::cerr << "Failed to specialize " << entry.fragmentFunction << " for '" << entry.name << "': "
+                  << (error ? error->localizedDescription()->utf8String() : "unknown error") << std::endl;
+    }
+    return function;
+}
+
+void PipelineManager::loadWarmUpList(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return;
+
+    size_t started = 0;
+    std::string name;
+    while (std::getline(file, name))
+    {
+        if (name.empty() || name[0] == '#')
+            continue;
+
+        // Variants are named after their base and features, and registered here if need be
+        PipelineId id = findPipeline(name);
+        size_t separator = name.rfind(':');
+        if (id == InvalidPipeline && separator != std::string::npos)
+        {
+            PipelineId base = findPipeline(name.substr(0, separator));
+            uint32_t features = static_cast<uint32_t>(std::strtoul(name.c_str() + separator + 1, nullptr, 10));
+            if (base != InvalidPipeline)
+                id = getVariant(base, features);
+        }
+        if (id == InvalidPipeline)
+            continue;
+
+        compileAsync(*entries[id]);
+        started++;
+    }
+
+    printf("Warming up %zu pipelines from %s\n", started, path.c_str());
+}
+
+void PipelineManager::saveWarmUpList(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cerr << "Failed to write pipeline warm-up list " << path << std::endl;
+        return;
+    }
+
+    // Pipelines made with createPipeline are compiled at startup regardless
+    file << "# Pipelines drawn with last run, compiled in the background at startup\n";
+    for (const auto &entry : entries)
+    {
+        if (entry->used && entry->fallback != InvalidPipeline)
+            file << entry->name << "\n";
     }
-    return nullptr;
 }
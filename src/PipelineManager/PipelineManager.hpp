@@ -1,24 +1,144 @@
 #pragma once
 #include <Metal/Metal.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include "JobSystem.hpp"
 
 class Engine;
 
+// Index of a pipeline registered with the PipelineManager, stable for the manager's lifetime
+using PipelineId = uint32_t;
+constexpr PipelineId InvalidPipeline = ~0u;
+
+// Function constants geometry_FragmentShader is specialized on, one bool per bit at the bit's
+// index. The material features come from Material::getFeatures.
+enum ShaderFeatures : uint32_t
+{
+    FeatureDiffuseMap = 1 << 0,
+    FeatureNormalMap = 1 << 1,
+    FeatureUnlit = 1 << 2,
+    FeatureAlphaTest = 1 << 3,
+
+    // Shades the normal, materials are ignored
+    FeatureDebugNormals = 1 << 4,
+
+    // Decides every material feature per fragment from the material table, to draw anything
+    // while the specialized variants compile
+    FeatureGeneric = 1 << 5,
+
+    MaterialFeatureBits = FeatureDiffuseMap | FeatureNormalMap | FeatureUnlit | FeatureAlphaTest
+};
+
+constexpr uint32_t ShaderFeatureCount = 6;
+
+// Owns every render pipeline state. Pipelines needed before the first frame are compiled on
+// the spot with createPipeline. The rest are registered with a fallback and compiled on a worker
+// the first time a draw resolves them; until then resolve hands back the fallback, so a new
+// variant costs nothing at startup and never stalls a frame.
+//
+// Variants specialize a fragment function with ShaderFeatures function constants. A variant base is
+// what entities refer to; getVariant adds a material's features to it and caches the result, so a
+// shader only pays for the features of what it draws.
+//
+// Pipelines drawn with are recorded in a warm-up list, saved on exit and compiled on workers as
+// soon as the next launch registers them, so they are usually ready before anything asks.
+//
+// Registration and resolve are main thread only. Compiled states are published atomically and
+// never released before the manager, so the render thread can draw with what resolve returned.
 class PipelineManager
 {
 public:
-    PipelineManager(MTL::Device *device);
+    PipelineManager(MTL::Device *device, JobSystem &jobSystem);
     ~PipelineManager();
 
+    // Compiles now, blocking the caller
+    PipelineId createPipeline(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor);
+
+    // Keeps a copy of the descriptor, compiled in the background once resolved or warmed up
+    PipelineId registerPipeline(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor, PipelineId fallback);
+
+    // As above, with the fragment function specialized on the given ShaderFeatures
+    PipelineId createVariant(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor, const std::string &fragmentFunction,
+                             uint32_t features);
+    PipelineId registerVariant(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor, const std::string &fragmentFunction,
+                               uint32_t features, PipelineId fallback);
+
+    // The variant of base for a material's features, registered on first use and drawn with the
+    // base until compiled. Pipelines that are not variants, or ignore materials, are returned as is.
+    PipelineId getVariant(PipelineId base, uint32_t materialFeatures);
+
+    PipelineId findPipeline(const std::string &name) const;
+
+    // The compiled state, or while it compiles (or if it failed) its fallback's. Starts the compile
+    // and marks the pipeline used.
+    MTL::RenderPipelineState *resolve(PipelineId id);
+
+    // Compiled state by name, nullptr if unknown or not compiled yet
     MTL::RenderPipelineState *getPipeline(const std::string &name);
 
-    void createPipeline(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor);
+    // Names in the list that are registered, or variants of registered bases, start compiling
+    void loadWarmUpList(const std::string &path);
+    void saveWarmUpList(const std::string &path) const;
+
+    size_t getPipelineCount() const { return entries.size(); }
+    uint32_t getCompiledCount() const { return compiledCount.load(std::memory_order_relaxed); }
+    uint32_t getPendingCount() const { return pendingCount.load(std::memory_order_relaxed); }
+    float getCompileMs() const { return compileMs.load(std::memory_order_relaxed); }
 
     MTL::Library *library;
     Engine* engine;
 
 private:
+    enum class Status : uint32_t
+    {
+        Registered,
+        Compiling,
+        Ready,
+        Failed
+    };
+
+    struct Entry
+    {
+        std::string name;
+        MTL::RenderPipelineDescriptor *descriptor = nullptr;
+        PipelineId fallback = InvalidPipeline;
+
+        // Variants only, the descriptor's fragment function is made from these
+        std::string fragmentFunction;
+        uint32_t features = 0;
+
+        std::atomic<MTL::RenderPipelineState *> state{nullptr};
+        std::atomic<Status> status{Status::Registered};
+
+        // Main thread, for the warm-up list
+        bool used = false;
+    };
+
+    PipelineId addEntry(const std::string &name, const MTL::RenderPipelineDescriptor *descriptor, PipelineId fallback,
+                        const std::string &fragmentFunction = {}, uint32_t features = 0);
+    void compileNow(PipelineId id);
+    void compileAsync(Entry &entry);
+    void compile(Entry &entry);
+    MTL::Function *specialize(const Entry &entry);
+
     MTL::Device *device;
-    std::unordered_map<std::string, MTL::RenderPipelineState *> pipelines;
+    JobSystem &jobSystem;
+
+    // Owned one by one so workers can hold an entry while more are registered
+    std::vector<std::unique_ptr<Entry>> entries;
+    std::unordered_map<std::string, PipelineId> idByName;
+
+    // Base id in the high half, features in the low
+    std::unordered_map<uint64_t, PipelineId> variants;
+
+    JobCounter compileCounter;
+    std::atomic<uint32_t> compiledCount{0};
+    std::atomic<uint32_t> pendingCount{0};
+
+    // Summed over every compile, foreground and background
+    std::atomic<float> compileMs{0.0f};
 };
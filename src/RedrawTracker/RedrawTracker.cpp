@@ -0,0 +1,35 @@
+#include "RedrawTracker.hpp"
+
+bool RedrawTracker::changed(const FrameState &state) const
+{
+    return state.viewMatrix != lastDrawn.viewMatrix ||
+           state.fov != lastDrawn.fov ||
+           state.nearPlane != lastDrawn.nearPlane ||
+           state.farPlane != lastDrawn.farPlane ||
+           state.drawableSize != lastDrawn.drawableSize ||
+           state.sceneVersion != lastDrawn.sceneVersion ||
+           state.ambientColor != lastDrawn.ambientColor ||
+           state.lightColor != lastDrawn.lightColor ||
+           state.streaming != lastDrawn.streaming;
+}
+
+bool RedrawTracker::needsFrame(const FrameState &state)
+{
+    if (state.input)
+        inputFramesLeft = InputFrames;
+
+    bool draw = !enabled || !drawnOnce || state.streaming || inputFramesLeft > 0 || changed(state);
+    if (!draw)
+    {
+        idleFrames++;
+        return false;
+    }
+
+    if (inputFramesLeft > 0)
+        inputFramesLeft--;
+
+    lastDrawn = state;
+    drawnOnce = true;
+    activeFrames++;
+    return true;
+}
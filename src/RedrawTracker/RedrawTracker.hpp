@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Everything the engine checks each iteration to decide whether the screen would change
+struct FrameState
+{
+    glm::mat4 viewMatrix = glm::mat4(1.0f);
+    float fov = 0.0f;
+    float nearPlane = 0.0f;
+    float farPlane = 0.0f;
+    glm::vec2 drawableSize = glm::vec2(0.0f);
+
+    uint64_t sceneVersion = 0;
+    glm::vec3 ambientColor = glm::vec3(0.0f);
+    glm::vec3 lightColor = glm::vec3(0.0f);
+
+    // Loads, mip uploads or pipeline compiles in flight, their results show up in a later frame.
+    // The frame after the last one finishes is drawn too.
+    bool streaming = false;
+
+    // Events were handled this iteration
+    bool input = false;
+};
+
+// Render on demand. A frame is drawn when the camera, drawable size, scene or light colours
+// differ from the last drawn frame, or while streaming has work in flight. Input keeps
+// frames coming for InputFrames more iterations, so the UI can settle hover and edits that
+// only show up once it has run. Otherwise the engine waits for events instead of drawing.
+//
+// No SDL or GPU types, the engine fills in a FrameState each iteration.
+class RedrawTracker
+{
+public:
+    static constexpr uint32_t InputFrames = 3;
+
+    // Disabled, every iteration draws
+    void setEnabled(bool value) { enabled = value; }
+    bool isEnabled() const { return enabled; }
+
+    // Returns true when the frame should be drawn and counts it, false when it is idle
+    bool needsFrame(const FrameState &state);
+
+    // Time the engine spent waiting after an idle iteration
+    void addIdleTime(double seconds) { idleSeconds += seconds; }
+
+    uint64_t getActiveFrames() const { return activeFrames; }
+    uint64_t getIdleFrames() const { return idleFrames; }
+    double getIdleSeconds() const { return idleSeconds; }
+
+private:
+    bool changed(const FrameState &state) const;
+
+    bool enabled = true;
+    bool drawnOnce = false;
+    FrameState lastDrawn;
+    uint32_t inputFramesLeft = 0;
+
+    uint64_t activeFrames = 0;
+    uint64_t idleFrames = 0;
+    double idleSeconds = 0.0;
+};
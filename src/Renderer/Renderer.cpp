@@ -1,6 +1,11 @@
 #include "Renderer.hpp"
 #include "Engine.hpp"
 #include "ImGuiHandler.hpp"
+#include "FrameArena.hpp"
+#include "SceneFile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
 
 Renderer::Renderer(SDL_MetalView metalView, Engine *engine)
     : metalView(metalView),
@@ -10,21 +15,47 @@ Renderer::Renderer(SDL_MetalView metalView, Engine *engine)
                               { if(t) t->release(); }),
       depthTexture(nullptr, [](MTL::Texture *t)
                    { if(t) t->release(); }),
+      shadowMap(nullptr, [](MTL::Texture *t)
+                { if(t) t->release(); }),
+      sceneColorTexture(nullptr, [](MTL::Texture *t)
+                        { if(t) t->release(); }),
+      upscaledTexture(nullptr, [](MTL::Texture *t)
+                      { if(t) t->release(); }),
+      upscaler(nullptr, [](MTLFX::SpatialScaler *s)
+               { if(s) s->release(); }),
       renderPassDescriptor(nullptr, [](MTL::RenderPassDescriptor *r)
                            { if(r) r->release(); }),
-      lightBuffer(nullptr, [](MTL::Buffer *b)
-                  { if(b) b->release(); })
+      shadowPassDescriptor(nullptr, [](MTL::RenderPassDescriptor *r)
+                           { if(r) r->release(); }),
+      overlayPassDescriptor(nullptr, [](MTL::RenderPassDescriptor *r)
+                            { if(r) r->release(); })
 {
     this->engine = engine;
     initMetal();
+
+    renderThread = std::thread(&Renderer::renderLoop, this);
 }
 
 Renderer::~Renderer()
 {
+    stopRenderThread();
+
+    // Waits for mip requests in flight, which use the device and the resource pools
+    textureStreamer.reset();
+    materialTable.reset();
+    sceneBuffer.reset();
+    staticBatcher.reset();
+    lightList.reset();
+
     msaaRenderTargetTexture.reset();
     depthTexture.reset();
+    shadowMap.reset();
+    sceneColorTexture.reset();
+    upscaledTexture.reset();
+    upscaler.reset();
     renderPassDescriptor.reset();
-    lightBuffer.reset();
+    shadowPassDescriptor.reset();
+    overlayPassDescriptor.reset();
 
     if (metalCommandQueue)
         metalCommandQueue->release();
@@ -32,23 +63,49 @@ Renderer::~Renderer()
     if (depthStencilState)
         depthStencilState->release();
 
-    if (device)
-        device->release();
+    if (samplerState)
+        samplerState->release();
+
+    if (shadowDepthState)
+        shadowDepthState->release();
+
+    if (clearDepthState)
+        clearDepthState->release();
 
-    renderables.clear();
+    if (shadowSampler)
+        shadowSampler->release();
 
+    // What this run drew with compiles in the background next launch. Waits for compiles in flight.
+    pipelineManager->saveWarmUpList(warmUpListPath);
     delete pipelineManager;
+
+    if (device)
+        device->release();
+
+    resources.reset();
 }
 
 glm::vec3 Renderer::Intersect(const glm::vec3 &origin, const glm::vec3 &destination)
 {
     // Cast a ray between the origin and destination and test if it intersects with any objects in the scene (renderables) and return the intersection point if it does
-    for (const auto &renderable : renderables)
+    Scene &scene = *engine->getScene();
+    for (uint32_t i = 0; i < scene.size(); ++i)
     {
-        if (auto intersection = renderable->Intersect(origin, destination))
+        Model *model = resources->get(scene.getModels()[i]);
+        if (!model)
+            continue;
+
+        // Test in model space, then bring the hit back to world space
+        const glm::mat4 &modelMatrix = scene.getWorldMatrices()[i];
+        glm::mat4 inverseModelMatrix = glm::inverse(modelMatrix);
+        glm::vec3 localOrigin = glm::vec3(inverseModelMatrix * glm::vec4(origin, 1.0f));
+        glm::vec3 localDestination = glm::vec3(inverseModelMatrix * glm::vec4(destination, 1.0f));
+
+        if (auto localIntersection = model->Intersect(localOrigin, localDestination))
         {
-            printf("Intersection found at (%f, %f, %f)\n", intersection.value().x, intersection.value().y, intersection.value().z);
-            return intersection.value();
+            glm::vec3 intersection = glm::vec3(modelMatrix * glm::vec4(localIntersection.value(), 1.0f));
+            printf("Intersection found at (%f, %f, %f)\n", intersection.x, intersection.y, intersection.z);
+            return intersection;
         }
     }
 
@@ -143,57 +200,107 @@ void Renderer::initMetal()
 
     device = MTL::CreateSystemDefaultDevice();
 
-    pipelineManager = new PipelineManager(device);
+    resources = std::make_unique<ResourceManager>(device);
+    textureStreamer = std::make_unique<TextureStreamer>(*engine->getJobSystem(), *engine->getUploadStage(), *resources, device);
+    materialTable = std::make_unique<MaterialTable>(device, *resources);
+    sceneBuffer = std::make_unique<SceneBuffer>(device, *resources);
+    staticBatcher = std::make_unique<StaticBatcher>(device, *resources);
+    lightList = std::make_unique<LightBuffer>(device, *resources);
+
+    pipelineManager = new PipelineManager(device, *engine->getJobSystem());
     pipelineManager->engine = engine;
 
+    if (char *basePath = SDL_GetBasePath())
+    {
+        warmUpListPath = std::string(basePath) + "pipelines.warmup";
+        SDL_free(basePath);
+    }
+    else
+    {
+        warmUpListPath = "pipelines.warmup";
+    }
+
     metalLayer->setDevice(device);
     metalLayer->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
 
+    // Upscaled frames are copied into the drawable
+    metalLayer->setFramebufferOnly(false);
+
+    upscalerSupported = MTLFX::SpatialScalerDescriptor::supportsDevice(device);
+    if (!upscalerSupported)
+    {
+        std::cerr << "MetalFX spatial scaling is not supported, rendering at full resolution" << std::endl;
+        resolutionController.setEnabled(false);
+    }
+
     createRenderPipelines();
+    pipelineManager->loadWarmUpList(warmUpListPath);
     createDepthAndMSAATextures();
+    createShadowMap();
 
     lightData = {};
-    lightData.ambientColor = simd::float3{0.1f, 0.1f, 0.1f};
-    lightData.lightColor = simd::float3{1.f, 1.f, 1.f};
-
-    lightBuffer.reset(device->newBuffer(sizeof(LightData), MTL::ResourceStorageModeShared));
 
     renderPassDescriptor.reset(MTL::RenderPassDescriptor::alloc()->init());
 
-    auto teapotModel = std::make_shared<Model>(device, "bin/Release/assets/teapot.obj");
-    auto cowModel = std::make_shared<Model>(device, "bin/Release/assets/cow.obj");
-    auto teddyModel = std::make_shared<Model>(device, "bin/Release/assets/teddy.obj");
-    auto capsuleModel = std::make_shared<Model>(device, "bin/Release/assets/capsule/capsule.obj");
-    auto smgModel = std::make_shared<Model>(device, "bin/Release/assets/SMG/smg.obj");
-    auto backpackModel = std::make_shared<Model>(device, "bin/Release/assets/backpack/backpack.obj");
-    auto sunModel = std::make_shared<Model>(device, "bin/Release/assets/Beach_Ball_v2_L3.123cdf1ec704-c7ca-4faf-8f47-647b6e5df698/13517_Beach_Ball_v2_L3.obj");
-
-    renderables.push_back(std::make_unique<Renderable>(device, this->engine, pipelineManager, "standard", teapotModel, glm::vec3(0.0f, 0.0f, 0.0f)));
-    renderables.push_back(std::make_unique<Renderable>(device, this->engine, pipelineManager, "standard", teapotModel, glm::vec3(10.0f, 0.0f, 0.0f)));
-    renderables.push_back(std::make_unique<Renderable>(device, this->engine, pipelineManager, "standard", capsuleModel, glm::vec3(10.0f, 10.0f, 0.0f)));
-    renderables.push_back(std::make_unique<Renderable>(device, this->engine, pipelineManager, "standard", smgModel, glm::vec3(10.0f, 10.0f, 10.0f)));
-    renderables.push_back(std::make_unique<Renderable>(device, this->engine, pipelineManager, "standard", backpackModel, glm::vec3(0.0f, 20.0f, 10.0f)));
-    // renderables.push_back(std::make_unique<Renderable>(device, this->engine, pipelineManager, "debug", cowModel, glm::vec3(0.0f, 50.0f, 0.0f)));
-    // renderables.push_back(std::make_unique<Renderable>(device, this->engine, pipelineManager, "debug", teddyModel, glm::vec3(50.0f, 50.0f, 0.0f)));
-
-    auto sun = std::make_unique<Renderable>(
-        device, this->engine, pipelineManager, "standard", sunModel,
-        glm::vec3(30.0f, 30.0f, 0.0f), "Sun");
-
-    sunRenderable = sun.get();
-    renderables.push_back(std::move(sun));
+    // The UI draws over the finished frame at full resolution
+    overlayPassDescriptor.reset(MTL::RenderPassDescriptor::alloc()->init());
+    MTL::RenderPassColorAttachmentDescriptor *overlay = overlayPassDescriptor->colorAttachments()->object(0);
+    overlay->setLoadAction(MTL::LoadActionLoad);
+    overlay->setStoreAction(MTL::StoreActionStore);
+
+    loadScene(engine->getScenePath());
 
     setupEventHandlers();
 }
 
+void Renderer::loadScene(const std::string &path)
+{
+    Uint64 loadStart = SDL_GetPerformanceCounter();
+
+    SceneFile file = SceneFile::load(path);
+
+    // Every model loads concurrently on the job system, main thread only helps and waits
+    JobSystem &jobSystem = *engine->getJobSystem();
+    UploadStage &uploadStage = *engine->getUploadStage();
+
+    std::vector<Task<ModelHandle>> modelLoads;
+    for (size_t i = 0; i < file.getModelCount(); ++i)
+    {
+        modelLoads.push_back(Model::loadAsync(jobSystem, uploadStage, *resources, device, std::string(file.getModelPath(i))));
+    }
+
+    std::vector<ModelHandle> models = syncWait(jobSystem, whenAll(jobSystem, std::move(modelLoads)));
+
+    std::vector<Entity> entities = file.instantiate(*engine->getScene(), *resources, *pipelineManager, models);
+
+    if (file.getSunEntity() != SceneFile::InvalidIndex)
+        sunEntity = entities[file.getSunEntity()];
+
+    for (size_t i = 0; i < file.getPointLightCount(); ++i)
+    {
+        const ScenePointLight &source = file.getPointLights()[i];
+        bool attached = source.entity != SceneFile::InvalidIndex;
+        pointLightSources.push_back({{source.position, source.radius, source.color, 0.0f}, attached ? entities[source.entity] : Entity(), attached});
+    }
+
+    const SceneLight &light = file.getLight();
+    lightData.ambientColor = simd::float3{light.ambientColor.x, light.ambientColor.y, light.ambientColor.z};
+    lightData.lightColor = simd::float3{light.lightColor.x, light.lightColor.y, light.lightColor.z};
+
+    double loadSeconds = static_cast<double>(SDL_GetPerformanceCounter() - loadStart) / static_cast<double>(SDL_GetPerformanceFrequency());
+    printf("Loaded scene %s: %zu entities, %zu models, %zu point lights in %.2f ms\n", path.c_str(), entities.size(), models.size(),
+           pointLightSources.size(), loadSeconds * 1000.0);
+}
+
 void Renderer::setupEventHandlers()
 {
     SDL_AddEventWatch([](void *userdata, SDL_Event *event) -> int
                       {
         if (event->type == SDL_WINDOWEVENT && event->window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
         {
+            // Render targets belong to the render thread, it rebuilds them before its next frame
             Renderer* renderer = static_cast<Renderer*>(userdata);
-            renderer->resizeDrawable();
+            renderer->resizePending.store(true, std::memory_order_release);
         }
         return 1; }, this);
 }
@@ -208,11 +315,43 @@ void Renderer::resizeDrawable()
 
     createDepthAndMSAATextures();
 
-    if (metalDrawable)
+    // Taken before the resize, at the old size
+    if (heldDrawable)
+    {
+        heldDrawable->release();
+        heldDrawable = nullptr;
+    }
+}
+
+CA::MetalDrawable *Renderer::nextDrawable()
+{
+    CA::MetalLayer *metalLayer = static_cast<CA::MetalLayer *>(SDL_Metal_GetLayer(metalView));
+
+    // Fewer drawables means nextDrawable blocks sooner, so frames cannot queue up behind the display
+    NS::UInteger count = framePacer.getMaxFramesInFlight();
+    if (count != drawableCount)
     {
-        metalDrawable->release();
-        metalDrawable = nullptr;
+        metalLayer->setMaximumDrawableCount(count);
+        drawableCount = count;
     }
+
+    // Autoreleased, kept past the pool it was taken in
+    CA::MetalDrawable *drawable = metalLayer->nextDrawable();
+    if (drawable)
+        drawable->retain();
+    return drawable;
+}
+
+void Renderer::stopRenderThread()
+{
+    snapshots.close();
+
+    if (renderThread.joinable())
+        renderThread.join();
+
+    // Completion handlers call back into the resource manager, let the last one run first
+    if (metalCommandBuffer)
+        metalCommandBuffer->waitUntilCompleted();
 }
 
 void Renderer::createRenderPipelines()
@@ -238,25 +377,29 @@ void Renderer::createRenderPipelines()
     {
         printf("Creating standard pipeline\n");
         MTL::Function *vertexShader = pipelineManager->library->newFunction(NS::String::string("geometry_VertexShader", NS::ASCIIStringEncoding));
-        MTL::Function *fragmentShader = pipelineManager->library->newFunction(NS::String::string("geometry_FragmentShader", NS::ASCIIStringEncoding));
-
         renderPipelineDescriptor->setVertexFunction(vertexShader);
-        renderPipelineDescriptor->setFragmentFunction(fragmentShader);
+        renderPipelineDescriptor->setFragmentFunction(nullptr);
 
-        pipelineManager->createPipeline("standard", renderPipelineDescriptor);
+        // Compiled before anything else, every lazily compiled pipeline falls back to it. The
+        // generic variant reads material features at run time, so it can draw any material.
+        standardPipeline = pipelineManager->createVariant("standard", renderPipelineDescriptor, "geometry_FragmentShader", FeatureGeneric);
+
+        // Normals only, the same shader with everything but the debug output compiled out
+        pipelineManager->registerVariant("debug", renderPipelineDescriptor, "geometry_FragmentShader", FeatureDebugNormals, standardPipeline);
 
         vertexShader->release();
-        fragmentShader->release();
     }
 
     {
-        MTL::Function *vertexShader = pipelineManager->library->newFunction(NS::String::string("debug_geometry_VertexShader", NS::ASCIIStringEncoding));
-        MTL::Function *fragmentShader = pipelineManager->library->newFunction(NS::String::string("debug_geometry_FragmentShader", NS::ASCIIStringEncoding));
+        // Fills a view's rectangle part way through the main pass, same targets as the geometry
+        MTL::Function *vertexShader = pipelineManager->library->newFunction(NS::String::string("clear_VertexShader", NS::ASCIIStringEncoding));
+        MTL::Function *fragmentShader = pipelineManager->library->newFunction(NS::String::string("clear_FragmentShader", NS::ASCIIStringEncoding));
 
         renderPipelineDescriptor->setVertexFunction(vertexShader);
         renderPipelineDescriptor->setFragmentFunction(fragmentShader);
 
-        pipelineManager->createPipeline("debug", renderPipelineDescriptor);
+        pipelineManager->createPipeline("clear", renderPipelineDescriptor);
+        clearPipeline = pipelineManager->getPipeline("clear");
 
         vertexShader->release();
         fragmentShader->release();
@@ -264,22 +407,88 @@ void Renderer::createRenderPipelines()
 
     renderPipelineDescriptor->release();
 
+    {
+        // Depth only, no colour attachment and no fragment function
+        MTL::RenderPipelineDescriptor *shadowDescriptor = MTL::RenderPipelineDescriptor::alloc()->init();
+        shadowDescriptor->setLabel(NS::String::string("Shadow Pipeline", NS::ASCIIStringEncoding));
+        shadowDescriptor->setDepthAttachmentPixelFormat(MTL::PixelFormatDepth32Float);
+
+        MTL::Function *vertexShader = pipelineManager->library->newFunction(NS::String::string("shadow_VertexShader", NS::ASCIIStringEncoding));
+        shadowDescriptor->setVertexFunction(vertexShader);
+
+        pipelineManager->createPipeline("shadow", shadowDescriptor);
+        shadowPipeline = pipelineManager->getPipeline("shadow");
+
+        vertexShader->release();
+        shadowDescriptor->release();
+    }
+
     MTL::DepthStencilDescriptor *depthStencilDescriptor = MTL::DepthStencilDescriptor::alloc()->init();
     depthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionLess);
     depthStencilDescriptor->setDepthWriteEnabled(true);
     depthStencilState = device->newDepthStencilState(depthStencilDescriptor);
+    shadowDepthState = device->newDepthStencilState(depthStencilDescriptor);
+
+    // Writes the far plane over whatever is under a view's rectangle
+    depthStencilDescriptor->setDepthCompareFunction(MTL::CompareFunctionAlways);
+    clearDepthState = device->newDepthStencilState(depthStencilDescriptor);
     depthStencilDescriptor->release();
+
+    MTL::SamplerDescriptor *samplerDescriptor = MTL::SamplerDescriptor::alloc()->init();
+    samplerDescriptor->setMinFilter(MTL::SamplerMinMagFilterLinear);
+    samplerDescriptor->setMagFilter(MTL::SamplerMinMagFilterLinear);
+    samplerDescriptor->setMipFilter(MTL::SamplerMipFilterLinear);
+    samplerState = device->newSamplerState(samplerDescriptor);
+    samplerDescriptor->release();
+
+    // Linear filtering of the comparison gives 2x2 percentage closer filtering for free
+    MTL::SamplerDescriptor *shadowSamplerDescriptor = MTL::SamplerDescriptor::alloc()->init();
+    shadowSamplerDescriptor->setMinFilter(MTL::SamplerMinMagFilterLinear);
+    shadowSamplerDescriptor->setMagFilter(MTL::SamplerMinMagFilterLinear);
+    shadowSamplerDescriptor->setSAddressMode(MTL::SamplerAddressModeClampToEdge);
+    shadowSamplerDescriptor->setTAddressMode(MTL::SamplerAddressModeClampToEdge);
+    shadowSamplerDescriptor->setCompareFunction(MTL::CompareFunctionLessEqual);
+    shadowSampler = device->newSamplerState(shadowSamplerDescriptor);
+    shadowSamplerDescriptor->release();
+}
+
+void Renderer::createShadowMap()
+{
+    MTL::TextureDescriptor *shadowDescriptor = MTL::TextureDescriptor::alloc()->init();
+    shadowDescriptor->setTextureType(MTL::TextureType2DArray);
+    shadowDescriptor->setPixelFormat(MTL::PixelFormatDepth32Float);
+    shadowDescriptor->setWidth(ShadowCascades::Resolution);
+    shadowDescriptor->setHeight(ShadowCascades::Resolution);
+    shadowDescriptor->setArrayLength(ShadowCascades::CascadeCount);
+    shadowDescriptor->setUsage(MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead);
+    shadowDescriptor->setStorageMode(MTL::StorageModePrivate);
+
+    shadowMap.reset(device->newTexture(shadowDescriptor));
+    shadowDescriptor->release();
+
+    // One pass per cascade, each renders into its own slice
+    shadowPassDescriptor.reset(MTL::RenderPassDescriptor::alloc()->init());
+    MTL::RenderPassDepthAttachmentDescriptor *depth = shadowPassDescriptor->depthAttachment();
+    depth->setTexture(shadowMap.get());
+    depth->setClearDepth(1.0);
+    depth->setLoadAction(MTL::LoadActionClear);
+    depth->setStoreAction(MTL::StoreActionStore);
 }
 
 void Renderer::createDepthAndMSAATextures()
 {
     CA::MetalLayer *metalLayer = static_cast<CA::MetalLayer *>(SDL_Metal_GetLayer(metalView));
+    CGSize drawable = metalLayer->drawableSize();
+
+    // The main pass renders at the controller's scale, MetalFX brings it back up to the drawable
+    renderWidth = std::max<NS::UInteger>(1, static_cast<NS::UInteger>(drawable.width * renderScale + 0.5));
+    renderHeight = std::max<NS::UInteger>(1, static_cast<NS::UInteger>(drawable.height * renderScale + 0.5));
 
     MTL::TextureDescriptor *msaaTextureDescriptor = MTL::TextureDescriptor::alloc()->init();
     msaaTextureDescriptor->setTextureType(MTL::TextureType2DMultisample);
     msaaTextureDescriptor->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
-    msaaTextureDescriptor->setWidth(metalLayer->drawableSize().width);
-    msaaTextureDescriptor->setHeight(metalLayer->drawableSize().height);
+    msaaTextureDescriptor->setWidth(renderWidth);
+    msaaTextureDescriptor->setHeight(renderHeight);
     msaaTextureDescriptor->setSampleCount(sampleCount);
     msaaTextureDescriptor->setUsage(MTL::TextureUsageRenderTarget);
 
@@ -288,8 +497,8 @@ void Renderer::createDepthAndMSAATextures()
     MTL::TextureDescriptor *depthTextureDescriptor = MTL::TextureDescriptor::alloc()->init();
     depthTextureDescriptor->setTextureType(MTL::TextureType2DMultisample);
     depthTextureDescriptor->setPixelFormat(MTL::PixelFormatDepth32Float);
-    depthTextureDescriptor->setWidth(metalLayer->drawableSize().width);
-    depthTextureDescriptor->setHeight(metalLayer->drawableSize().height);
+    depthTextureDescriptor->setWidth(renderWidth);
+    depthTextureDescriptor->setHeight(renderHeight);
     depthTextureDescriptor->setUsage(MTL::TextureUsageRenderTarget);
     depthTextureDescriptor->setSampleCount(sampleCount);
 
@@ -297,26 +506,415 @@ void Renderer::createDepthAndMSAATextures()
 
     msaaTextureDescriptor->release();
     depthTextureDescriptor->release();
+
+    renderWidthShown.store(static_cast<uint32_t>(renderWidth), std::memory_order_relaxed);
+    renderHeightShown.store(static_cast<uint32_t>(renderHeight), std::memory_order_relaxed);
+
+    if (renderScale < 1.0f)
+    {
+        createUpscaler(static_cast<NS::UInteger>(drawable.width), static_cast<NS::UInteger>(drawable.height));
+    }
+    else
+    {
+        sceneColorTexture.reset();
+        upscaledTexture.reset();
+        upscaler.reset();
+    }
 }
 
-void Renderer::render(Camera &camera, ImGuiHandler &imguiHandler)
+void Renderer::createUpscaler(NS::UInteger outputWidth, NS::UInteger outputHeight)
 {
+    MTLFX::SpatialScalerDescriptor *scalerDescriptor = MTLFX::SpatialScalerDescriptor::alloc()->init();
+    scalerDescriptor->setInputWidth(renderWidth);
+    scalerDescriptor->setInputHeight(renderHeight);
+    scalerDescriptor->setOutputWidth(outputWidth);
+    scalerDescriptor->setOutputHeight(outputHeight);
+    scalerDescriptor->setColorTextureFormat(MTL::PixelFormatBGRA8Unorm);
+    scalerDescriptor->setOutputTextureFormat(MTL::PixelFormatBGRA8Unorm);
+    scalerDescriptor->setColorProcessingMode(MTLFX::SpatialScalerColorProcessingModePerceptual);
+
+    upscaler.reset(scalerDescriptor->newSpatialScaler(device));
+    scalerDescriptor->release();
+
+    if (!upscaler)
+    {
+        std::cerr << "Failed to create the MetalFX spatial scaler, rendering at full resolution" << std::endl;
+        renderScale = 1.0f;
+        {
+            std::lock_guard<std::mutex> lock(resolutionMutex);
+            resolutionController.setEnabled(false);
+        }
+        createDepthAndMSAATextures();
+        return;
+    }
+
+    // The multisampled main pass resolves into this, the scaler reads it
+    MTL::TextureDescriptor *colorDescriptor = MTL::TextureDescriptor::alloc()->init();
+    colorDescriptor->setPixelFormat(MTL::PixelFormatBGRA8Unorm);
+    colorDescriptor->setWidth(renderWidth);
+    colorDescriptor->setHeight(renderHeight);
+    colorDescriptor->setUsage(upscaler->colorTextureUsage() | MTL::TextureUsageRenderTarget);
+    colorDescriptor->setStorageMode(MTL::StorageModePrivate);
+    sceneColorTexture.reset(device->newTexture(colorDescriptor));
+
+    colorDescriptor->setWidth(outputWidth);
+    colorDescriptor->setHeight(outputHeight);
+    colorDescriptor->setUsage(upscaler->outputTextureUsage());
+    upscaledTexture.reset(device->newTexture(colorDescriptor));
+    colorDescriptor->release();
+}
+
+void Renderer::applyRenderScale()
+{
+    float scale;
+    {
+        std::lock_guard<std::mutex> lock(resolutionMutex);
+        scale = resolutionController.getScale();
+    }
+
+    if (scale == renderScale)
+        return;
+
+    renderScale = scale;
+    createDepthAndMSAATextures();
+}
+
+void Renderer::setDynamicResolution(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(resolutionMutex);
+    resolutionController.setEnabled(enabled && upscalerSupported);
+}
+
+bool Renderer::getDynamicResolution()
+{
+    std::lock_guard<std::mutex> lock(resolutionMutex);
+    return resolutionController.isEnabled();
+}
+
+float Renderer::getRenderScale()
+{
+    std::lock_guard<std::mutex> lock(resolutionMutex);
+    return resolutionController.getScale();
+}
+
+float Renderer::getGpuPercentileMs()
+{
+    std::lock_guard<std::mutex> lock(resolutionMutex);
+    return resolutionController.getPercentileMs();
+}
+
+void Renderer::submitFrame(Scene &scene, const std::vector<View> &views, ImGuiHandler &imguiHandler)
+{
+    if (views.empty())
+    {
+        std::cerr << "submitFrame: no views, nothing to draw" << std::endl;
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    JobSystem &jobSystem = *engine->getJobSystem();
+
     CA::MetalLayer *metalLayer = static_cast<CA::MetalLayer *>(SDL_Metal_GetLayer(metalView));
+    CGSize size = metalLayer->drawableSize();
+    if (size.width > 0 && size.height > 0)
+    {
+        drawableSize = glm::vec2(size.width, size.height);
+    }
+
+    // Releases pooled resources destroyed in frames the GPU has since completed
+    resources->beginFrame(++frameIndex);
+
+    SceneSnapshot &snapshot = snapshots.beginWrite();
+    snapshot.frameIndex = frameIndex;
+    snapshot.inputTime = framePacer.getInputTime();
+
+    // Everything derived from a view is worked out here, once, and shared by all of its draws
+    size_t viewCount = std::min<size_t>(views.size(), ViewCuller::MaxViews);
+    snapshot.views.resize(viewCount);
+    cullInputs.clear();
+    for (size_t v = 0; v < viewCount; ++v)
+    {
+        ViewData &view = snapshot.views[v].view;
+        view.viewMatrix = views[v].viewMatrix;
+        view.projectionMatrix = views[v].projection(drawableSize);
+        view.viewProjectionMatrix = view.projectionMatrix * view.viewMatrix;
+        view.cameraPosition = glm::vec4(views[v].position, 1.0f);
 
-    metalDrawable = metalLayer->nextDrawable();
+        Frustum frustum(view.viewProjectionMatrix);
+        std::copy(std::begin(frustum.planes), std::end(frustum.planes), std::begin(view.frustumPlanes));
+
+        snapshot.views[v].viewport = views[v].viewport;
+        cullInputs.push_back({view.viewProjectionMatrix, views[v].layerMask});
+    }
+    const View &mainView = views[0];
+    const ViewData &mainData = snapshot.views[0].view;
+
+    scene.updateTransforms(jobSystem);
+    staticBatcher->update(scene, jobSystem);
+    auto transformed = std::chrono::steady_clock::now();
+
+    // Every view in one pass; static entities are still culled one by one so texture streaming sees them
+    viewCuller.cull(cullInputs, scene.getWorldBounds(), scene.getFlags(), EntityVisible, jobSystem);
+    const std::vector<uint32_t> &visibleEntities = viewCuller.getVisibleInAny();
+
+    snapshot.staticBatches.clear();
+    for (size_t v = 0; v < viewCount; ++v)
+    {
+        ViewSnapshot &target = snapshot.views[v];
+        target.firstStaticBatch = static_cast<uint32_t>(snapshot.staticBatches.size());
+        staticBatcher->cull(Frustum(target.view.viewProjectionMatrix), views[v].layerMask, *pipelineManager, snapshot.staticBatches);
+        target.staticBatchCount = static_cast<uint32_t>(snapshot.staticBatches.size()) - target.firstStaticBatch;
+    }
+    visibleStaticBatches = snapshot.staticBatches.size();
+    auto culled = std::chrono::steady_clock::now();
+
+    // Pixels per unit of size over distance, from the main view's vertical field of view. Entities
+    // only other views see stream at the main view's rate, insets are small enough not to need more.
+    float projectionScale = mainData.projectionMatrix[1][1] * drawableSize.y * mainView.viewport.w * 0.5f;
+    textureStreamer->update(scene, visibleEntities, glm::vec3(mainData.cameraPosition), projectionScale, frameIndex);
+
+    materialTable->update(frameIndex);
+    snapshot.materialTable = materialTable->getMaterialBuffer(frameIndex);
+    snapshot.textureTable = materialTable->getTextureBuffer(frameIndex);
+    snapshot.residentTextures = materialTable->getResidentTextures();
+
+    sceneBuffer->update(scene, frameIndex);
+    snapshot.sceneBuffer = sceneBuffer->getBuffer(frameIndex);
+
+    if (scene.isValid(sunEntity))
+    {
+        glm::vec3 sunPos = scene.getWorldPosition(sunEntity);
+        lightData.lightPosition = simd::float3{sunPos.x, sunPos.y, sunPos.z};
+    }
+    snapshot.lightData = lightData;
+
+    updatePointLights(scene, mainView, snapshot);
+    updateShadows(scene, mainView, snapshot);
+
+    const std::vector<ModelHandle> &models = scene.getModels();
+    const std::vector<PipelineId> &pipelines = scene.getPipelines();
+    const std::vector<uint32_t> &denseToSlot = scene.getDenseToSlot();
+    const std::vector<uint32_t> &flags = scene.getFlags();
+
+    snapshot.meshDraws.clear();
+    for (size_t v = 0; v < viewCount; ++v)
+    {
+        ViewSnapshot &target = snapshot.views[v];
+        target.firstMeshDraw = static_cast<uint32_t>(snapshot.meshDraws.size());
+        for (uint32_t index : viewCuller.getVisible(static_cast<uint32_t>(v)))
+        {
+            // Drawn as part of a static batch
+            if (flags[index] & EntityStatic)
+                continue;
+
+            Model *model = resources->get(models[index]);
+            if (!model)
+                continue;
+
+            uint32_t objectIndex = SceneBuffer::recordOf(denseToSlot[index]);
+            for (MeshHandle handle : model->getMeshes())
+            {
+                Mesh *mesh = resources->get(handle);
+                Material *material = mesh ? resources->get(mesh->getMaterial()) : nullptr;
+                if (!material)
+                    continue;
+
+                // The entity's pipeline specialized for the material, the generic one until compiled
+                PipelineId variant = pipelineManager->getVariant(pipelines[index], material->getFeatures());
+                MTL::RenderPipelineState *pipeline = pipelineManager->resolve(variant);
+                snapshot.meshDraws.push_back({handle, pipeline, objectIndex, mesh->getMaterial().index()});
+            }
+        }
+        target.meshDrawCount = static_cast<uint32_t>(snapshot.meshDraws.size()) - target.firstMeshDraw;
+
+        // Neighbours with the same pipeline and geometry let the state tracker drop their binds
+        auto meshDraws = snapshot.meshDraws.begin() + target.firstMeshDraw;
+        std::sort(meshDraws, meshDraws + target.meshDrawCount, [](const MeshDrawSnapshot &a, const MeshDrawSnapshot &b)
+                  { return a.pipeline != b.pipeline ? a.pipeline < b.pipeline : a.mesh.value < b.mesh.value; });
+        auto batches = snapshot.staticBatches.begin() + target.firstStaticBatch;
+        std::sort(batches, batches + target.staticBatchCount, [](const StaticBatchSnapshot &a, const StaticBatchSnapshot &b)
+                  { return a.pipeline < b.pipeline; });
+    }
+
+    imguiHandler.buildFrame(snapshot.imguiFrame);
+
+    auto built = std::chrono::steady_clock::now();
+    framePacer.frameSubmitted();
+    snapshots.publish();
+    auto published = std::chrono::steady_clock::now();
+
+    transformMs = std::chrono::duration<float, std::milli>(transformed - start).count();
+    cullMs = std::chrono::duration<float, std::milli>(culled - transformed).count();
+    snapshotMs.store(std::chrono::duration<float, std::milli>(built - start).count(), std::memory_order_relaxed);
+    publishWaitMs.store(std::chrono::duration<float, std::milli>(published - built).count(), std::memory_order_relaxed);
+}
+
+void Renderer::updatePointLights(Scene &scene, const View &mainView, SceneSnapshot &snapshot)
+{
+    pointLights.clear();
+    for (const PointLightSource &source : pointLightSources)
+    {
+        PointLight light = source.light;
+        if (source.attached)
+        {
+            // Goes out with its entity
+            if (!scene.isValid(source.entity))
+                continue;
+            light.position = glm::vec3(scene.getWorldMatrix(source.entity) * glm::vec4(light.position, 1.0f));
+        }
+        pointLights.push_back(light);
+    }
+
+    LightClusters::Projection projection;
+    projection.fovY = mainView.fovY;
+    projection.aspect = mainView.aspect(drawableSize);
+    projection.nearPlane = mainView.nearPlane;
+    projection.farPlane = mainView.farPlane;
+    lightClusters.build(pointLights, mainView.viewMatrix, projection, *engine->getJobSystem());
+
+    snapshot.lightList = lightList->update(pointLights, lightClusters, frameIndex);
+
+    // Clusters are cut from the main view's frustum, other views shade with the sun and ambient only
+    for (size_t v = 0; v < snapshot.views.size(); ++v)
+    {
+        ClusterParams &params = snapshot.views[v].clusterParams;
+        params = lightClusters.getParams(drawableSize);
+        if (v > 0)
+            params.lightCount = 0;
+    }
+}
+
+void Renderer::updateShadows(Scene &scene, const View &mainView, SceneSnapshot &snapshot)
+{
+    // Far enough away to treat as directional, shining from its position towards the origin
+    glm::vec3 sunPosition(lightData.lightPosition.x, lightData.lightPosition.y, lightData.lightPosition.z);
+    glm::vec3 lightDirection = glm::length(sunPosition) > 0.0f ? glm::normalize(sunPosition) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+    ShadowCascades::View shadowView;
+    shadowView.viewMatrix = mainView.viewMatrix;
+    shadowView.fovY = mainView.fovY;
+    shadowView.aspect = mainView.aspect(drawableSize);
+    shadowView.nearPlane = mainView.nearPlane;
+    shadowView.farPlane = mainView.farPlane;
+
+    shadowCascades.fit(shadowView, lightDirection);
+    shadowCascades.cull(scene.getWorldBounds(), scene.getFlags(), EntityVisible, *engine->getJobSystem());
+
+    // The sun's own model sits at the light and would shadow everything
+    uint32_t sunIndex = scene.isValid(sunEntity) ? scene.indexOf(sunEntity) : ~0u;
+
+    const std::vector<ModelHandle> &models = scene.getModels();
+    const std::vector<uint32_t> &denseToSlot = scene.getDenseToSlot();
+    for (uint32_t c = 0; c < ShadowCascades::CascadeCount; ++c)
+    {
+        const ShadowCascade &cascade = shadowCascades.getCascade(c);
+        ShadowCascadeSnapshot &target = snapshot.shadowCascades[c];
+        target.viewProjection = cascade.viewProjection;
+
+        target.casters.clear();
+        for (uint32_t index : cascade.casters)
+        {
+            if (index != sunIndex)
+                target.casters.push_back({models[index], SceneBuffer::recordOf(denseToSlot[index])});
+        }
+        std::sort(target.casters.begin(), target.casters.end(), [](const RenderableSnapshot &a, const RenderableSnapshot &b)
+                  { return a.model.value < b.model.value; });
+
+        snapshot.shadowData.viewProjection[c] = cascade.viewProjection;
+        snapshot.shadowData.splitFar[c] = cascade.splitFar;
+        snapshot.shadowData.texelSize[c] = cascade.texelSize;
+    }
+
+    // Cascades are picked by depth in the main view, whichever view the fragment is drawn in
+    snapshot.shadowData.cascadeView = mainView.viewMatrix;
+}
+
+void Renderer::renderLoop()
+{
+    while (true)
+    {
+        // Low latency: the drawable comes first, the main thread reads input once it is held
+        if (framePacer.isLowLatency() && !heldDrawable)
+        {
+            NS::AutoreleasePool *pool = NS::AutoreleasePool::alloc()->init();
+            heldDrawable = nextDrawable();
+            pool->release();
+
+            if (heldDrawable)
+                framePacer.drawableReady();
+        }
+
+        SceneSnapshot *snapshot = snapshots.acquire();
+        if (!snapshot)
+            break;
+
+        NS::AutoreleasePool *pool = NS::AutoreleasePool::alloc()->init();
+        auto start = std::chrono::steady_clock::now();
+
+        renderSnapshot(*snapshot);
+
+        renderThreadMs.store(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+        FrameArena::local().reset();
+        pool->release();
+    }
+
+    if (heldDrawable)
+    {
+        heldDrawable->release();
+        heldDrawable = nullptr;
+    }
+}
+
+void Renderer::renderSnapshot(SceneSnapshot &snapshot)
+{
+    if (resizePending.exchange(false, std::memory_order_acq_rel))
+    {
+        resizeDrawable();
+    }
+    applyRenderScale();
+
+    metalDrawable = heldDrawable ? heldDrawable : nextDrawable();
+    heldDrawable = nullptr;
+
+    // commandBuffer() is autoreleased, retain to balance the holder's release
+    metalCommandBuffer.reset(metalCommandQueue->commandBuffer());
+    metalCommandBuffer->retain();
+
+    uint64_t frame = snapshot.frameIndex;
     if (!metalDrawable)
     {
+        // Earlier frames may still be on the GPU. The queue completes buffers in order, so an
+        // empty one retires this frame only once they are done.
         std::cerr << "Failed to get next drawable, skipping frame." << std::endl;
+        metalCommandBuffer->addCompletedHandler([this, frame](MTL::CommandBuffer *)
+                                                { resources->retireFrame(frame); });
+        metalCommandBuffer->commit();
         return;
     }
 
-    metalCommandBuffer.reset(metalCommandQueue->commandBuffer());
+    double inputTime = snapshot.inputTime;
+    metalDrawable->addPresentedHandler([this, inputTime](MTL::Drawable *drawable)
+                                       { framePacer.addPresented(inputTime, drawable->presentedTime()); });
+
+    metalCommandBuffer->addCompletedHandler([this, frame](MTL::CommandBuffer *commandBuffer)
+                                            {
+        resources->retireFrame(frame);
+
+        float gpuMs = static_cast<float>((commandBuffer->GPUEndTime() - commandBuffer->GPUStartTime()) * 1000.0);
+        std::lock_guard<std::mutex> lock(resolutionMutex);
+        resolutionController.addFrame(gpuMs); });
+
+    drawShadows(snapshot);
+
+    // Scaled frames resolve into an offscreen texture for the upscaler, full size ones straight into the drawable
+    bool upscaling = upscaler != nullptr;
 
     MTL::RenderPassColorAttachmentDescriptor *cd = renderPassDescriptor->colorAttachments()->object(0);
-    cd->setTexture(metalDrawable->texture());
+    cd->setTexture(msaaRenderTargetTexture.get());
+    cd->setResolveTexture(upscaling ? sceneColorTexture.get() : metalDrawable->texture());
     cd->setLoadAction(MTL::LoadActionClear);
-    cd->setClearColor(MTL::ClearColor(41.0f / 255.0f, 42.0f / 255.0f, 48.0f / 255.0f, 1.0f));
-    cd->setStoreAction(MTL::StoreActionStore);
+    cd->setClearColor(MTL::ClearColor(ClearColor.r, ClearColor.g, ClearColor.b, ClearColor.a));
+    cd->setStoreAction(MTL::StoreActionMultisampleResolve);
 
     renderPassDescriptor->depthAttachment()->setTexture(depthTexture.get());
     renderPassDescriptor->depthAttachment()->setClearDepth(1.0);
@@ -325,41 +923,179 @@ void Renderer::render(Camera &camera, ImGuiHandler &imguiHandler)
 
     MTL::RenderCommandEncoder *renderCommandEncoder = metalCommandBuffer->renderCommandEncoder(renderPassDescriptor.get());
 
-    renderCommandEncoder->setViewport(MTL::Viewport{0.0, 0.0,
-                                                    static_cast<double>(metalDrawable->texture()->width()),
-                                                    static_cast<double>(metalDrawable->texture()->height()),
-                                                    0.0, 1.0});
+    // Copied into the command buffer, so frames in flight keep the light they were recorded with
+    StateTracker state(renderCommandEncoder);
+    state.setFragmentBytes(&snapshot.lightData, sizeof(LightData), 1);
 
-    renderCommandEncoder->setDepthStencilState(depthStencilState);
+    drawRenderables(state, snapshot);
 
-    if (sunRenderable)
+    stateCallsIssued.store(state.getIssuedCount(), std::memory_order_relaxed);
+    stateCallsElided.store(state.getElidedCount(), std::memory_order_relaxed);
+    drawCalls.store(state.getDrawCount(), std::memory_order_relaxed);
+
+    renderCommandEncoder->endEncoding();
+
+    MTL::Texture *drawableTexture = metalDrawable->texture();
+    if (upscaling && upscaledTexture->width() == drawableTexture->width() && upscaledTexture->height() == drawableTexture->height())
     {
-        glm::vec3 sunPos = sunRenderable->getPosition();
-        lightData.lightPosition = simd::float3{sunPos.x, sunPos.y, sunPos.z};
+        upscaler->setColorTexture(sceneColorTexture.get());
+        upscaler->setOutputTexture(upscaledTexture.get());
+        upscaler->setInputContentWidth(renderWidth);
+        upscaler->setInputContentHeight(renderHeight);
+        upscaler->encodeToCommandBuffer(metalCommandBuffer.get());
+
+        MTL::BlitCommandEncoder *blit = metalCommandBuffer->blitCommandEncoder();
+        blit->copyFromTexture(upscaledTexture.get(), drawableTexture);
+        blit->endEncoding();
     }
 
-    memcpy(lightBuffer->contents(), &lightData, sizeof(LightData));
+    overlayPassDescriptor->colorAttachments()->object(0)->setTexture(drawableTexture);
+    engine->getImGuiHandler()->render(metalCommandBuffer.get(), overlayPassDescriptor.get(), snapshot.imguiFrame);
 
-    renderCommandEncoder->setFragmentBuffer(lightBuffer.get(), 0, 1);
+    metalCommandBuffer->presentDrawable(metalDrawable);
+    metalCommandBuffer->commit();
 
-    drawRenderables(renderCommandEncoder, camera);
+    metalDrawable->release();
+    metalDrawable = nullptr;
+}
 
-    renderCommandEncoder->endEncoding();
-    renderCommandEncoder->release();
+void Renderer::drawShadows(const SceneSnapshot &snapshot)
+{
+    auto lock = resources->lockShared();
 
-    MTL::RenderPassColorAttachmentDescriptor *nd = renderPassDescriptor->colorAttachments()->object(0);
-    nd->setLoadAction(MTL::LoadActionLoad);
+    uint32_t draws = 0;
+    for (uint32_t c = 0; c < ShadowCascades::CascadeCount; ++c)
+    {
+        const ShadowCascadeSnapshot &cascade = snapshot.shadowCascades[c];
 
-    imguiHandler.render(metalCommandBuffer.get(), renderPassDescriptor.get());
+        shadowPassDescriptor->depthAttachment()->setSlice(c);
+        MTL::RenderCommandEncoder *encoder = metalCommandBuffer->renderCommandEncoder(shadowPassDescriptor.get());
 
-    metalCommandBuffer->presentDrawable(metalDrawable);
-    metalCommandBuffer->commit();
+        StateTracker state(encoder);
+        state.setRenderPipelineState(shadowPipeline);
+        state.setDepthStencilState(shadowDepthState);
+        state.setFrontFacingWinding(MTL::WindingCounterClockwise);
+        state.setCullMode(MTL::CullModeNone);
+
+        // Slope scaled, steep surfaces need the most
+        encoder->setDepthBias(0.0f, 2.0f, 0.0f);
+
+        state.setVertexBytes(&cascade.viewProjection, sizeof(cascade.viewProjection), 1);
+        state.setVertexBuffer(snapshot.sceneBuffer, 0, 4);
+
+        for (const RenderableSnapshot &entry : cascade.casters)
+        {
+            Model *model = resources->get(entry.model);
+            if (!model)
+                continue;
+
+            state.setVertexBytes(&entry.objectIndex, sizeof(entry.objectIndex), 5);
+            for (MeshHandle handle : model->getMeshes())
+            {
+                if (Mesh *mesh = resources->get(handle))
+                    mesh->draw(state, 0);
+            }
+        }
+
+        draws += state.getDrawCount();
+        encoder->endEncoding();
+    }
+
+    shadowDrawCalls.store(draws, std::memory_order_relaxed);
 }
 
-void Renderer::drawRenderables(MTL::RenderCommandEncoder *renderCommandEncoder, Camera &camera)
+void Renderer::drawRenderables(StateTracker &state, SceneSnapshot &snapshot)
 {
-    for (const auto &renderable : renderables)
+    // Keeps the main thread from moving pooled objects while handles are resolved
+    auto lock = resources->lockShared();
+
+    state.setFrontFacingWinding(MTL::WindingCounterClockwise);
+    state.setDepthStencilState(depthStencilState);
+
+    // Materials and textures are looked up by id in the shaders, bound once for the pass
+    state.setFragmentBuffer(snapshot.materialTable, 0, 2);
+    state.setFragmentBuffer(snapshot.textureTable, 0, 3);
+    state.setFragmentSamplerState(samplerState, 0);
+    if (!snapshot.residentTextures.empty())
+    {
+        state.getEncoder()->useResources(snapshot.residentTextures.data(), snapshot.residentTextures.size(),
+                                         MTL::ResourceUsageRead, MTL::RenderStageFragment);
+    }
+
+    // Each fragment shades with the point lights listed for its cluster
+    const LightListView &lightList = snapshot.lightList;
+    state.setFragmentBuffer(lightList.buffer, lightList.lightsOffset, 5);
+    state.setFragmentBuffer(lightList.buffer, lightList.rangesOffset, 6);
+    state.setFragmentBuffer(lightList.buffer, lightList.indicesOffset, 7);
+
+    state.setFragmentBytes(&snapshot.shadowData, sizeof(snapshot.shadowData), 9);
+    state.setFragmentTexture(shadowMap.get(), 0);
+    state.setFragmentSamplerState(shadowSampler, 1);
+    state.setVertexBuffer(snapshot.sceneBuffer, 0, 4);
+
+    // In order, later views draw over earlier ones
+    for (size_t v = 0; v < snapshot.views.size(); ++v)
+    {
+        drawView(state, snapshot, snapshot.views[v], v > 0);
+    }
+}
+
+void Renderer::drawView(StateTracker &state, const SceneSnapshot &snapshot, ViewSnapshot &view, bool clear)
+{
+    MTL::RenderCommandEncoder *encoder = state.getEncoder();
+
+    // The view's rectangle in render target pixels, so it follows the dynamic resolution scale
+    glm::vec2 target(renderWidth, renderHeight);
+    glm::vec2 topLeft = glm::round(glm::clamp(glm::vec2(view.viewport.x, view.viewport.y), 0.0f, 1.0f) * target);
+    glm::vec2 bottomRight = glm::round(glm::clamp(glm::vec2(view.viewport.x + view.viewport.z, view.viewport.y + view.viewport.w), 0.0f, 1.0f) * target);
+    glm::vec2 size = bottomRight - topLeft;
+    if (size.x < 1.0f || size.y < 1.0f)
+        return;
+
+    encoder->setViewport(MTL::Viewport{topLeft.x, topLeft.y, size.x, size.y, 0.0, 1.0});
+    encoder->setScissorRect(MTL::ScissorRect{NS::UInteger(topLeft.x), NS::UInteger(topLeft.y), NS::UInteger(size.x), NS::UInteger(size.y)});
+
+    if (clear)
+    {
+        state.setRenderPipelineState(clearPipeline);
+        state.setDepthStencilState(clearDepthState);
+        state.setFragmentBytes(&ClearColor, sizeof(ClearColor), 0);
+        state.drawPrimitives(MTL::PrimitiveTypeTriangle, 0, 3);
+        state.setDepthStencilState(depthStencilState);
+    }
+
+    // Fragments find their light cluster from pixel coordinates within the view
+    view.clusterParams.screenOrigin = topLeft;
+    view.clusterParams.screenSize = size;
+
+    // View and projection once for the view, each draw picks its entity's record by index
+    state.setVertexBytes(&view.view, sizeof(view.view), 1);
+    state.setFragmentBytes(&view.view, sizeof(view.view), 4);
+    state.setFragmentBytes(&view.clusterParams, sizeof(view.clusterParams), 8);
+
+    // Static batches are already in world space
+    uint32_t objectIndex = SceneBuffer::IdentityRecord;
+    state.setVertexBytes(&objectIndex, sizeof(objectIndex), 5);
+
+    for (uint32_t i = 0; i < view.staticBatchCount; ++i)
+    {
+        const StaticBatchSnapshot &batch = snapshot.staticBatches[view.firstStaticBatch + i];
+        state.setRenderPipelineState(batch.pipeline);
+        state.setVertexBuffer(batch.vertexBuffer, 0, 0);
+        state.drawIndexedPrimitives(MTL::PrimitiveTypeTriangle, batch.indexCount, MTL::IndexTypeUInt32,
+                                    batch.indexBuffer, 0, 1, 0, batch.materialId);
+    }
+
+    // Sorted by pipeline and mesh on the main thread, so most of these are elided
+    for (uint32_t i = 0; i < view.meshDrawCount; ++i)
     {
-        renderable->draw(camera, renderCommandEncoder, depthStencilState);
+        const MeshDrawSnapshot &entry = snapshot.meshDraws[view.firstMeshDraw + i];
+        Mesh *mesh = resources->get(entry.mesh);
+        if (!mesh || !entry.pipeline || !resources->get(mesh->getMaterial()))
+            continue;
+
+        state.setRenderPipelineState(entry.pipeline);
+        state.setVertexBytes(&entry.objectIndex, sizeof(entry.objectIndex), 5);
+        mesh->draw(state, entry.materialId);
     }
 }
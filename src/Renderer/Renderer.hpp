@@ -3,40 +3,92 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_metal.h>
 #include <Metal/Metal.hpp>
+#include <MetalFX/MetalFX.hpp>
 #include <QuartzCore/QuartzCore.hpp>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
-#include "Renderable.hpp"
 #include "Camera.hpp"
 #include "PipelineManager.hpp"
+#include "SceneSnapshot.hpp"
+#include "ResourceManager.hpp"
+#include "Scene.hpp"
+#include "TextureStreamer.hpp"
+#include "MaterialTable.hpp"
+#include "SceneBuffer.hpp"
+#include "StaticBatcher.hpp"
+#include "StateTracker.hpp"
+#include "LightClusters.hpp"
+#include "LightBuffer.hpp"
+#include "ShadowCascades.hpp"
+#include "ResolutionController.hpp"
+#include "FramePacer.hpp"
+#include "View.hpp"
+#include "ViewCuller.hpp"
 
 class Engine;
 
-struct LightData
-{
-    simd::float3 ambientColor;
-    simd::float3 lightPosition;
-    simd::float3 lightColor;
-} __attribute__((aligned(16)));
-
 class Renderer
 {
 public:
     Renderer(SDL_MetalView metalView, Engine *engine);
     ~Renderer();
 
-    void render(Camera &camera, class ImGuiHandler &imguiHandler);
+    // Main thread: updates and culls the scene for every view, captures them with the light,
+    // visible entities and UI into a snapshot and hands it to the render thread. The first view
+    // is the main one.
+    void submitFrame(Scene &scene, const std::vector<View> &views, class ImGuiHandler &imguiHandler);
+    void stopRenderThread();
+
     MTL::Device *getDevice() const { return device; }
 
-    std::vector<std::unique_ptr<Renderable>> &getRenderables() { return renderables; }
-    float aspectRatio() const { return static_cast<float>(metalDrawable->texture()->width()) / static_cast<float>(metalDrawable->texture()->height()); }
-    glm::vec4 viewport() const { return glm::vec4(0, 0, metalDrawable->texture()->width(), metalDrawable->texture()->height()); }
-    glm::vec2 dimensions() const { return glm::vec2(metalDrawable->texture()->width(), metalDrawable->texture()->height()); }
+    ResourceManager &getResources() { return *resources; }
+    TextureStreamer &getTextureStreamer() { return *textureStreamer; }
+    MaterialTable &getMaterialTable() { return *materialTable; }
+    SceneBuffer &getSceneBuffer() { return *sceneBuffer; }
+    StaticBatcher &getStaticBatcher() { return *staticBatcher; }
+    const LightClusters &getLightClusters() const { return lightClusters; }
+    const ShadowCascades &getShadowCascades() const { return shadowCascades; }
+    PipelineManager &getPipelineManager() { return *pipelineManager; }
+    FramePacer &getFramePacer() { return framePacer; }
+
+    // Main thread view of the drawable, refreshed every submitFrame
+    float aspectRatio() const { return drawableSize.x / drawableSize.y; }
+    glm::vec4 viewport() const { return glm::vec4(0, 0, drawableSize.x, drawableSize.y); }
+    glm::vec2 dimensions() const { return drawableSize; }
+
+    float getSnapshotMs() const { return snapshotMs.load(std::memory_order_relaxed); }
+    float getPublishWaitMs() const { return publishWaitMs.load(std::memory_order_relaxed); }
+    float getRenderThreadMs() const { return renderThreadMs.load(std::memory_order_relaxed); }
+
+    // Encoder state calls of the last rendered frame's geometry pass
+    uint32_t getStateCallsIssued() const { return stateCallsIssued.load(std::memory_order_relaxed); }
+    uint32_t getStateCallsElided() const { return stateCallsElided.load(std::memory_order_relaxed); }
+    uint32_t getDrawCalls() const { return drawCalls.load(std::memory_order_relaxed); }
+    uint32_t getShadowDrawCalls() const { return shadowDrawCalls.load(std::memory_order_relaxed); }
+
+    // Dynamic resolution: the main pass renders at a scale the controller picks from GPU frame
+    // times and MetalFX upscales it. Any thread.
+    void setDynamicResolution(bool enabled);
+    bool getDynamicResolution();
+    float getRenderScale();
+    float getGpuPercentileMs();
+    uint32_t getRenderWidth() const { return renderWidthShown.load(std::memory_order_relaxed); }
+    uint32_t getRenderHeight() const { return renderHeightShown.load(std::memory_order_relaxed); }
+    float getTransformMs() const { return transformMs; }
+    float getCullMs() const { return cullMs; }
+    size_t getVisibleCount() const { return viewCuller.getVisibleInAny().size(); }
+    uint32_t getViewCount() const { return viewCuller.getViewCount(); }
+    size_t getViewVisibleCount(uint32_t view) const { return viewCuller.getVisible(view).size(); }
+    size_t getVisibleStaticBatchCount() const { return visibleStaticBatches; }
 
     Engine *engine;
     LightData lightData;
 
-    Renderable *sunRenderable = nullptr;
+    Entity sunEntity;
 
     glm::vec3 Intersect(const glm::vec3 &origin, const glm::vec3 &destination);
     glm::vec2 WorldToScreen(const glm::vec3 &worldPosition, const glm::mat4 &projection, const glm::mat4 &view, const glm::vec4 &viewport) const;
@@ -45,29 +97,114 @@ public:
 
 private:
     void initMetal();
+    void loadScene(const std::string &path);
     void createDepthAndMSAATextures();
     void createRenderPipelines();
     void resizeDrawable();
+    void renderLoop();
+    void renderSnapshot(SceneSnapshot &snapshot);
+    void updatePointLights(Scene &scene, const View &mainView, SceneSnapshot &snapshot);
+    void updateShadows(Scene &scene, const View &mainView, SceneSnapshot &snapshot);
+    void createShadowMap();
+    void createUpscaler(NS::UInteger outputWidth, NS::UInteger outputHeight);
+    void applyRenderScale();
+    void drawShadows(const SceneSnapshot &snapshot);
+    CA::MetalDrawable *nextDrawable();
 
     SDL_MetalView metalView = nullptr;
     MTL::Device *device = nullptr;
+    // Retained by the render thread from nextDrawable until the frame is committed
     CA::MetalDrawable *metalDrawable = nullptr;
+
+    // Low latency pacing: taken before the snapshot that will use it arrives
+    CA::MetalDrawable *heldDrawable = nullptr;
+    NS::UInteger drawableCount = 0;
     MTL::CommandQueue *metalCommandQueue = nullptr;
     MTL::DepthStencilState *depthStencilState = nullptr;
+    MTL::SamplerState *samplerState = nullptr;
+    MTL::RenderPipelineState *shadowPipeline = nullptr;
+    MTL::DepthStencilState *shadowDepthState = nullptr;
+    MTL::SamplerState *shadowSampler = nullptr;
+    MTL::RenderPipelineState *clearPipeline = nullptr;
+    MTL::DepthStencilState *clearDepthState = nullptr;
+    PipelineId standardPipeline = InvalidPipeline;
+
+    // Behind everything, and under each view after the first
+    static constexpr glm::vec4 ClearColor = glm::vec4(41.0f / 255.0f, 42.0f / 255.0f, 48.0f / 255.0f, 1.0f);
 
     std::unique_ptr<MTL::CommandBuffer, void (*)(MTL::CommandBuffer *)> metalCommandBuffer;
     std::unique_ptr<MTL::Texture, void (*)(MTL::Texture *)> msaaRenderTargetTexture;
     std::unique_ptr<MTL::Texture, void (*)(MTL::Texture *)> depthTexture;
+    std::unique_ptr<MTL::Texture, void (*)(MTL::Texture *)> shadowMap;
+    std::unique_ptr<MTL::Texture, void (*)(MTL::Texture *)> sceneColorTexture;
+    std::unique_ptr<MTL::Texture, void (*)(MTL::Texture *)> upscaledTexture;
+    std::unique_ptr<MTLFX::SpatialScaler, void (*)(MTLFX::SpatialScaler *)> upscaler;
 
     std::unique_ptr<MTL::RenderPassDescriptor, void (*)(MTL::RenderPassDescriptor *)> renderPassDescriptor;
-    std::unique_ptr<MTL::Buffer, void (*)(MTL::Buffer *)> lightBuffer;
+    std::unique_ptr<MTL::RenderPassDescriptor, void (*)(MTL::RenderPassDescriptor *)> shadowPassDescriptor;
+    std::unique_ptr<MTL::RenderPassDescriptor, void (*)(MTL::RenderPassDescriptor *)> overlayPassDescriptor;
 
     int sampleCount = 4;
-    std::vector<std::unique_ptr<Renderable>> renderables;
+
+    // Render thread: the scale the targets were last built for and their size
+    float renderScale = 1.0f;
+    NS::UInteger renderWidth = 1;
+    NS::UInteger renderHeight = 1;
+    std::atomic<uint32_t> renderWidthShown{0};
+    std::atomic<uint32_t> renderHeightShown{0};
+
+    // Fed from command buffer completion, read by the render thread and the UI
+    std::mutex resolutionMutex;
+    ResolutionController resolutionController;
+    bool upscalerSupported = false;
+
+    FramePacer framePacer;
+    std::unique_ptr<ResourceManager> resources;
+    std::unique_ptr<TextureStreamer> textureStreamer;
+    std::unique_ptr<MaterialTable> materialTable;
+    std::unique_ptr<SceneBuffer> sceneBuffer;
+    std::unique_ptr<StaticBatcher> staticBatcher;
+    std::unique_ptr<LightBuffer> lightList;
+
+    // Point lights as loaded, positioned relative to their entity when attached
+    struct PointLightSource
+    {
+        PointLight light;
+        Entity entity;
+        bool attached;
+    };
+    std::vector<PointLightSource> pointLightSources;
+    std::vector<PointLight> pointLights;
+    LightClusters lightClusters;
+    ShadowCascades shadowCascades;
 
     // Add a pointer to the PipelineManager
     PipelineManager *pipelineManager;
 
-    void drawRenderables(MTL::RenderCommandEncoder *renderEncoder, Camera &camera);
+    // Pipelines drawn with, saved on exit and compiled in the background at the next launch.
+    // Next to the executable, so each build configuration keeps its own.
+    std::string warmUpListPath;
+
+    SceneSnapshotBuffer snapshots;
+    std::thread renderThread;
+    std::atomic<bool> resizePending{false};
+    glm::vec2 drawableSize = glm::vec2(1.0f, 1.0f);
+    uint64_t frameIndex = 0;
+    ViewCuller viewCuller;
+    std::vector<ViewCuller::Input> cullInputs;
+    size_t visibleStaticBatches = 0;
+    float transformMs = 0.0f;
+    float cullMs = 0.0f;
+
+    std::atomic<float> snapshotMs{0.0f};
+    std::atomic<float> publishWaitMs{0.0f};
+    std::atomic<float> renderThreadMs{0.0f};
+    std::atomic<uint32_t> stateCallsIssued{0};
+    std::atomic<uint32_t> stateCallsElided{0};
+    std::atomic<uint32_t> drawCalls{0};
+    std::atomic<uint32_t> shadowDrawCalls{0};
+
+    void drawRenderables(StateTracker &state, SceneSnapshot &snapshot);
+    void drawView(StateTracker &state, const SceneSnapshot &snapshot, ViewSnapshot &view, bool clear);
     void setupEventHandlers();
 };
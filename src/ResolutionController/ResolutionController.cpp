@@ -0,0 +1,84 @@
+#include "ResolutionController.hpp"
+#include <algorithm>
+#include <cmath>
+
+ResolutionController::ResolutionController(float budgetMs)
+    : budgetMs(budgetMs)
+{
+    samples.reserve(HistorySize);
+}
+
+void ResolutionController::setEnabled(bool value)
+{
+    enabled = value;
+    if (!enabled)
+        setScale(MaxScale);
+}
+
+void ResolutionController::setBudgetMs(float value)
+{
+    budgetMs = std::max(value, 1.0f);
+    samples.clear();
+    comfortableWindows = 0;
+}
+
+bool ResolutionController::setScale(float value)
+{
+    // Snapped to a whole step, with a little slack so 0.75 does not round down to 0.70
+    value = std::floor(value / ScaleStep + 1e-3f) * ScaleStep;
+    value = std::clamp(value, MinScale, MaxScale);
+    if (value == scale)
+        return false;
+
+    scale = value;
+    changeCount++;
+    samples.clear();
+    comfortableWindows = 0;
+    settle = SettleFrames;
+    return true;
+}
+
+bool ResolutionController::addFrame(float gpuMs)
+{
+    if (!enabled || !(gpuMs > 0.0f))
+        return false;
+
+    if (settle > 0)
+    {
+        settle--;
+        return false;
+    }
+
+    samples.push_back(gpuMs);
+    if (samples.size() < HistorySize)
+        return false;
+
+    bool changed = evaluate();
+    samples.clear();
+    return changed;
+}
+
+bool ResolutionController::evaluate()
+{
+    sorted = samples;
+    size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(Percentile * float(sorted.size())));
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    percentileMs = sorted[rank];
+
+    if (percentileMs > budgetMs)
+    {
+        // At least one step, the estimate rounds towards keeping the current scale
+        float fit = scale * std::sqrt(budgetMs / percentileMs);
+        return setScale(std::min(fit, scale - ScaleStep));
+    }
+
+    if (percentileMs < budgetMs * Headroom && scale < MaxScale)
+    {
+        if (++comfortableWindows >= GrowWindows)
+            return setScale(scale + ScaleStep);
+        return false;
+    }
+
+    comfortableWindows = 0;
+    return false;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Picks the main pass's render scale from measured GPU frame times. Samples are gathered in
+// windows of HistorySize frames and each window is judged by its 90th percentile:
+//
+// - over budget, the scale drops straight to where the percentile should fit, assuming GPU
+//   cost follows the pixel count, so the square of the scale
+// - under Headroom of the budget for GrowWindows windows in a row, it grows by one step
+// - in between nothing changes
+//
+// After a change the first SettleFrames samples are ignored, they were rendered before it.
+// Scales are multiples of ScaleStep so that small swings do not reallocate render targets.
+//
+// No GPU types, the renderer feeds it samples and reads the scale back.
+class ResolutionController
+{
+public:
+    static constexpr float MinScale = 0.5f;
+    static constexpr float MaxScale = 1.0f;
+    static constexpr float ScaleStep = 0.05f;
+
+    static constexpr uint32_t HistorySize = 30;
+    static constexpr float Percentile = 0.9f;
+    static constexpr float Headroom = 0.8f;
+    static constexpr uint32_t GrowWindows = 3;
+    static constexpr uint32_t SettleFrames = 4;
+
+    explicit ResolutionController(float budgetMs = 1000.0f / 60.0f);
+
+    // Disabled, the scale returns to MaxScale and stays there
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return enabled; }
+
+    void setBudgetMs(float budgetMs);
+    float getBudgetMs() const { return budgetMs; }
+
+    // One frame's GPU time. Returns true when the scale changed.
+    bool addFrame(float gpuMs);
+
+    float getScale() const { return scale; }
+
+    // The percentile of the last complete window, and how often the scale has moved
+    float getPercentileMs() const { return percentileMs; }
+    uint32_t getChangeCount() const { return changeCount; }
+
+private:
+    bool setScale(float value);
+    bool evaluate();
+
+    bool enabled = true;
+    float budgetMs;
+    float scale = MaxScale;
+
+    std::vector<float> samples;
+    std::vector<float> sorted;
+    uint32_t settle = 0;
+    uint32_t comfortableWindows = 0;
+
+    float percentileMs = 0.0f;
+    uint32_t changeCount = 0;
+};
@@ -0,0 +1,49 @@
+#include "ResourceManager.hpp"
+#include <algorithm>
+
+ResourceManager::ResourceManager(MTL::Device *device)
+    : geometry(std::make_unique<GeometryBuffer>(device))
+{
+}
+
+ResourceManager::~ResourceManager()
+{
+    for (RetiredResource &retired : retiredResources)
+    {
+        retired.resource->release();
+    }
+}
+
+void ResourceManager::beginFrame(uint64_t frameIndex)
+{
+    currentFrame = frameIndex;
+
+    // Models first, releasing them destroys the meshes and materials they own
+    uint64_t completed = completedFrame.load(std::memory_order_acquire);
+    models.collect(completed);
+    meshes.collect(completed);
+    materials.collect(completed);
+    textures.collect(completed);
+
+    auto firstPending = std::partition(retiredResources.begin(), retiredResources.end(), [completed](const RetiredResource &retired)
+                                       { return retired.frame <= completed; });
+    for (auto it = retiredResources.begin(); it != firstPending; ++it)
+    {
+        it->resource->release();
+    }
+    retiredResources.erase(retiredResources.begin(), firstPending);
+
+    geometry->collect(completed);
+    if (geometry->needsDefragment())
+    {
+        // The render thread reads mesh ranges while it holds the lock shared
+        auto lock = lockExclusive();
+        geometry->defragment(meshes, currentFrame);
+    }
+}
+
+size_t ResourceManager::getRetiredCount() const
+{
+    return textures.getRetiredCount() + materials.getRetiredCount() + meshes.getRetiredCount() + models.getRetiredCount() +
+           retiredResources.size();
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include "GeometryBuffer.hpp"
+#include "ResourcePool.hpp"
+#include "Texture.hpp"
+#include "Material.hpp"
+#include "Mesh.hpp"
+#include "Model.hpp"
+
+// Owns every pooled GPU resource and tracks which frames the GPU has retired, so handles
+// destroyed on the main thread are released only once no command buffer can use them.
+class ResourceManager
+{
+public:
+    explicit ResourceManager(MTL::Device *device);
+    ResourceManager(const ResourceManager &) = delete;
+    ResourceManager &operator=(const ResourceManager &) = delete;
+    ~ResourceManager();
+
+    ResourcePool<Texture> &getTextures() { return textures; }
+    ResourcePool<Material> &getMaterials() { return materials; }
+    ResourcePool<Mesh> &getMeshes() { return meshes; }
+    ResourcePool<Model> &getModels() { return models; }
+
+    // Shared vertex and index storage every Mesh sub-allocates from
+    GeometryBuffer &getGeometry() { return *geometry; }
+
+    Texture *get(TextureHandle handle) { return textures.get(handle); }
+    Material *get(MaterialHandle handle) { return materials.get(handle); }
+    Mesh *get(MeshHandle handle) { return meshes.get(handle); }
+    Model *get(ModelHandle handle) { return models.get(handle); }
+
+    // Main thread, deferred until the frame being built has completed on the GPU
+    void destroy(TextureHandle handle) { textures.destroy(handle, currentFrame); }
+    void destroy(MaterialHandle handle) { materials.destroy(handle, currentFrame); }
+    void destroy(MeshHandle handle) { meshes.destroy(handle, currentFrame); }
+    void destroy(ModelHandle handle) { models.destroy(handle, currentFrame); }
+
+    // Main thread: releases a Metal object outside the pools (a texture streamed out, a table
+    // that was reallocated) once the frame being built has completed on the GPU
+    void releaseLater(MTL::Resource *resource) { retiredResources.push_back({resource, currentFrame}); }
+
+    // Main thread, at the start of building a frame: releases whatever the GPU has retired and
+    // moves some geometry out of sparse pages
+    void beginFrame(uint64_t frameIndex);
+    uint64_t getCompletedFrame() const { return completedFrame.load(std::memory_order_acquire); }
+
+    // Any thread, typically a command buffer completion handler. Never moves backwards, so a
+    // handler running late for an older frame cannot reopen newer ones.
+    void retireFrame(uint64_t frameIndex)
+    {
+        uint64_t completed = completedFrame.load(std::memory_order_relaxed);
+        while (completed < frameIndex && !completedFrame.compare_exchange_weak(completed, frameIndex, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Render thread, held while resolving handles for a frame
+    std::shared_lock<std::shared_mutex> lockShared() { return std::shared_lock<std::shared_mutex>(mutex); }
+
+    // Main thread, held while swapping what a pooled object points at
+    std::unique_lock<std::shared_mutex> lockExclusive() { return std::unique_lock<std::shared_mutex>(mutex); }
+
+    size_t getRetiredCount() const;
+
+private:
+    // Declared before the pools, which lock it while they are torn down
+    std::shared_mutex mutex;
+
+    uint64_t currentFrame = 0;
+    std::atomic<uint64_t> completedFrame{0};
+
+    struct RetiredResource
+    {
+        MTL::Resource *resource;
+        uint64_t frame;
+    };
+    std::vector<RetiredResource> retiredResources;
+
+    // Meshes free their ranges into it as they are torn down
+    std::unique_ptr<GeometryBuffer> geometry;
+
+    // Models destroy the meshes, materials and textures they own as they go,
+    // so they are declared last and torn down first
+    ResourcePool<Texture> textures{mutex};
+    ResourcePool<Material> materials{mutex};
+    ResourcePool<Mesh> meshes{mutex};
+    ResourcePool<Model> models{mutex};
+};
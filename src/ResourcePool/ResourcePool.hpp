@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// 32-bit reference into a ResourcePool: 20 bits of slot index and 12 bits of generation.
+// Generations start at 1 so a zero handle is always null, and a slot bumps its generation
+// when it is destroyed so stale copies stop resolving instead of aliasing the next occupant.
+template <typename T>
+struct Handle
+{
+    static constexpr uint32_t IndexBits = 20;
+    static constexpr uint32_t IndexMask = (1u << IndexBits) - 1;
+    static constexpr uint32_t GenerationMask = (1u << (32 - IndexBits)) - 1;
+
+    uint32_t value = 0;
+
+    static Handle make(uint32_t index, uint32_t generation) { return Handle{(generation << IndexBits) | index}; }
+
+    uint32_t index() const { return value & IndexMask; }
+    uint32_t generation() const { return value >> IndexBits; }
+    bool isValid() const { return value != 0; }
+    explicit operator bool() const { return isValid(); }
+
+    bool operator==(const Handle &other) const { return value == other.value; }
+    bool operator!=(const Handle &other) const { return value != other.value; }
+};
+
+// Owns objects of one type in a dense array, addressed through generational handles.
+// Live objects are always packed in [begin, end) so per-frame loops walk contiguous memory;
+// destroying swaps the last element into the hole, so dense order is not stable.
+//
+// Threading: only the main thread creates, destroys and collects. Those are the only calls
+// that move objects, and they take the shared mutex exclusively. The render thread holds it
+// shared while it resolves handles for a frame. Main thread reads need no lock.
+//
+// Destruction is deferred: destroy() invalidates the handle at once, but the object moves
+// to a retired list and lives until collect() is told the GPU has finished the frame it was
+// destroyed in, so command buffers in flight never reference released Metal resources.
+template <typename T>
+class ResourcePool
+{
+public:
+    explicit ResourcePool(std::shared_mutex &mutex) : mutex(mutex) {}
+    ResourcePool(const ResourcePool &) = delete;
+    ResourcePool &operator=(const ResourcePool &) = delete;
+
+    template <typename... Args>
+    Handle<T> create(Args &&...args)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+
+        uint32_t slotIndex;
+        if (!freeSlots.empty())
+        {
+            slotIndex = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            if (slots.size() > Handle<T>::IndexMask)
+            {
+                throw std::runtime_error("ResourcePool is out of handles");
+            }
+            slotIndex = static_cast<uint32_t>(slots.size());
+            slots.push_back({InvalidIndex, 1});
+        }
+
+        dense.emplace_back(std::forward<Args>(args)...);
+        denseToSlot.push_back(slotIndex);
+        slots[slotIndex].denseIndex = static_cast<uint32_t>(dense.size() - 1);
+
+        return Handle<T>::make(slotIndex, slots[slotIndex].generation);
+    }
+
+    // retireFrame is the last frame that may still reference the object on the GPU
+    void destroy(Handle<T> handle, uint64_t retireFrame)
+    {
+        if (!isValid(handle))
+            return;
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+
+        Slot &slot = slots[handle.index()];
+        uint32_t denseIndex = slot.denseIndex;
+        uint32_t lastIndex = static_cast<uint32_t>(dense.size() - 1);
+
+        retired.push_back({std::move(dense[denseIndex]), retireFrame});
+
+        if (denseIndex != lastIndex)
+        {
+            dense[denseIndex] = std::move(dense[lastIndex]);
+            denseToSlot[denseIndex] = denseToSlot[lastIndex];
+            slots[denseToSlot[denseIndex]].denseIndex = denseIndex;
+        }
+        dense.pop_back();
+        denseToSlot.pop_back();
+
+        slot.denseIndex = InvalidIndex;
+        slot.generation = (slot.generation + 1) & Handle<T>::GenerationMask;
+        if (slot.generation == 0)
+            slot.generation = 1;
+        freeSlots.push_back(handle.index());
+    }
+
+    // Releases retired objects whose frame the GPU has completed. Destructors run without
+    // the lock held, so they may destroy handles they own in other pools (or this one).
+    void collect(uint64_t completedFrame)
+    {
+        size_t count = 0;
+        while (count < retired.size() && retired[count].frame <= completedFrame)
+            ++count;
+
+        if (count == 0)
+            return;
+
+        std::vector<Retired> released(std::make_move_iterator(retired.begin()), std::make_move_iterator(retired.begin() + count));
+        retired.erase(retired.begin(), retired.begin() + count);
+    }
+
+    bool isValid(Handle<T> handle) const
+    {
+        return handle.isValid() && handle.index() < slots.size() &&
+               slots[handle.index()].generation == handle.generation() &&
+               slots[handle.index()].denseIndex != InvalidIndex;
+    }
+
+    // nullptr for null or stale handles
+    T *get(Handle<T> handle) { return isValid(handle) ? &dense[slots[handle.index()].denseIndex] : nullptr; }
+    const T *get(Handle<T> handle) const { return isValid(handle) ? &dense[slots[handle.index()].denseIndex] : nullptr; }
+
+    size_t size() const { return dense.size(); }
+
+    // Every handle's index() is below this
+    size_t getSlotCount() const { return slots.size(); }
+    size_t getRetiredCount() const { return retired.size(); }
+
+    T *begin() { return dense.data(); }
+    T *end() { return dense.data() + dense.size(); }
+    const T *begin() const { return dense.data(); }
+    const T *end() const { return dense.data() + dense.size(); }
+
+    Handle<T> handleAt(size_t denseIndex) const
+    {
+        uint32_t slotIndex = denseToSlot[denseIndex];
+        return Handle<T>::make(slotIndex, slots[slotIndex].generation);
+    }
+
+private:
+    static constexpr uint32_t InvalidIndex = ~0u;
+
+    struct Slot
+    {
+        uint32_t denseIndex;
+        uint32_t generation;
+    };
+
+    struct Retired
+    {
+        T resource;
+        uint64_t frame;
+    };
+
+    std::vector<T> dense;
+    std::vector<uint32_t> denseToSlot;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+    std::vector<Retired> retired;
+
+    std::shared_mutex &mutex;
+};
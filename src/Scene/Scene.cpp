@@ -0,0 +1,509 @@
+#include "Scene.hpp"
+#include "JobSystem.hpp"
+#if defined(__APPLE__)
+#include <simd/simd.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// Enough entities per range that scheduling cost disappears next to the memory traffic
+static constexpr size_t TransformGrain = 4096;
+
+template <typename T>
+static void swapRemove(std::vector<T> &array, uint32_t index)
+{
+    if (index != array.size() - 1)
+        array[index] = std::move(array.back());
+    array.pop_back();
+}
+
+static glm::mat4 composeTRS(const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale)
+{
+    glm::mat3 r = glm::mat3_cast(rotation);
+
+    glm::mat4 m;
+    m[0] = glm::vec4(r[0] * scale.x, 0.0f);
+    m[1] = glm::vec4(r[1] * scale.y, 0.0f);
+    m[2] = glm::vec4(r[2] * scale.z, 0.0f);
+    m[3] = glm::vec4(translation, 1.0f);
+    return m;
+}
+
+// glm::mat4 and simd_float4x4 share the column-major layout; the copies become vector
+// loads and stores, and simd_mul is four broadcast multiply-adds per column
+static void multiply(const glm::mat4 &parent, const glm::mat4 &local, glm::mat4 &out)
+{
+#if defined(__APPLE__)
+    simd_float4x4 a, b;
+    memcpy(&a, &parent, sizeof(a));
+    memcpy(&b, &local, sizeof(b));
+
+    simd_float4x4 result = simd_mul(a, b);
+    memcpy(&out, &result, sizeof(result));
+#else
+    out = parent * local;
+#endif
+}
+
+Entity Scene::create(ModelHandle model, PipelineId pipeline, const Bounds &bounds, const glm::vec3 &position, const std::string &name, Entity parent)
+{
+    if (parent && !isValid(parent))
+    {
+        std::cerr << "Scene::create: invalid parent for " << name << std::endl;
+        parent = {};
+    }
+
+    uint32_t slotIndex;
+    if (!freeSlots.empty())
+    {
+        slotIndex = freeSlots.back();
+        freeSlots.pop_back();
+    }
+    else
+    {
+        if (slots.size() > Entity::IndexMask)
+        {
+            throw std::runtime_error("Scene is out of entity handles");
+        }
+        slotIndex = static_cast<uint32_t>(slots.size());
+        slots.push_back({InvalidIndex, 1});
+    }
+
+    uint32_t parentIndex = parent ? indexOf(parent) : InvalidIndex;
+    uint32_t depth = parent ? depths[parentIndex] + 1 : 0;
+
+    // Appending keeps breadth-first order as long as it does not go back up a level
+    bool inOrder = !orderStale && (depths.empty() || depth >= depths.back());
+
+    glm::mat4 local = composeTRS(position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+
+    positions.push_back(position);
+    rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    scales.push_back(glm::vec3(1.0f));
+    worldMatrices.push_back(local);
+    localBounds.push_back(bounds);
+    worldBounds.push_back(bounds.transformed(local));
+    models.push_back(model);
+    pipelines.push_back(pipeline);
+    flags.push_back(EntityVisible);
+    parents.push_back(parent);
+    parentIndices.push_back(parentIndex);
+    depths.push_back(depth);
+    localDirty.push_back(0);
+    worldDirty.push_back(0);
+    names.push_back(name);
+    denseToSlot.push_back(slotIndex);
+
+    uint32_t index = static_cast<uint32_t>(positions.size() - 1);
+    slots[slotIndex].denseIndex = index;
+
+    if (inOrder)
+    {
+        if (depth + 1 == levelStarts.size())
+            levelStarts.push_back(index + 1);
+        else
+            levelStarts.back() = index + 1;
+    }
+    else
+    {
+        orderStale = true;
+    }
+
+    markDirty(index);
+    return Entity::make(slotIndex, slots[slotIndex].generation);
+}
+
+std::vector<Entity> Scene::createBatch(const EntityBatch &batch)
+{
+    size_t first = positions.size();
+    size_t count = batch.count;
+
+    if (slots.size() - freeSlots.size() + count > size_t(Entity::IndexMask) + 1)
+    {
+        throw std::runtime_error("Scene is out of entity handles");
+    }
+
+    std::vector<Entity> created(count);
+    denseToSlot.resize(first + count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t slotIndex;
+        if (!freeSlots.empty())
+        {
+            slotIndex = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            slotIndex = static_cast<uint32_t>(slots.size());
+            slots.push_back({InvalidIndex, 1});
+        }
+
+        slots[slotIndex].denseIndex = static_cast<uint32_t>(first + i);
+        denseToSlot[first + i] = slotIndex;
+        created[i] = Entity::make(slotIndex, slots[slotIndex].generation);
+    }
+
+    positions.insert(positions.end(), batch.positions, batch.positions + count);
+    rotations.insert(rotations.end(), batch.rotations, batch.rotations + count);
+    scales.insert(scales.end(), batch.scales, batch.scales + count);
+    worldMatrices.resize(first + count);
+    localBounds.insert(localBounds.end(), batch.localBounds, batch.localBounds + count);
+    worldBounds.insert(worldBounds.end(), batch.localBounds, batch.localBounds + count);
+    models.insert(models.end(), batch.models, batch.models + count);
+    pipelines.insert(pipelines.end(), batch.pipelines, batch.pipelines + count);
+    flags.insert(flags.end(), batch.flags, batch.flags + count);
+    names.insert(names.end(), batch.names, batch.names + count);
+
+    parents.resize(first + count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t parent = batch.parents[i];
+        if (parent < count)
+            parents[first + i] = created[parent];
+    }
+
+    // Depths and parent indices come from the sort, which then updates every level
+    parentIndices.resize(first + count, InvalidIndex);
+    depths.resize(first + count, 0);
+    localDirty.resize(first + count, 1);
+    worldDirty.resize(first + count, 0);
+
+    if (std::any_of(batch.flags, batch.flags + count, [](uint32_t value)
+                    { return (value & EntityStatic) != 0; }))
+        staticVersion++;
+
+    orderStale = true;
+    anyDirty = true;
+    version++;
+    return created;
+}
+
+void Scene::destroy(Entity entity)
+{
+    destroyBatch({entity});
+}
+
+void Scene::destroyBatch(const std::vector<Entity> &entities)
+{
+    if (orderStale)
+        sortHierarchy();
+
+    uint32_t first = static_cast<uint32_t>(positions.size());
+    std::vector<uint8_t> doomedFlags(positions.size(), 0);
+    for (Entity entity : entities)
+    {
+        if (isValid(entity))
+        {
+            doomedFlags[indexOf(entity)] = 1;
+            first = std::min(first, indexOf(entity));
+        }
+    }
+
+    // Descendants come after their parents in sorted order, so one forward pass finds them all
+    std::vector<Entity> doomed;
+    for (uint32_t i = first; i < positions.size(); ++i)
+    {
+        uint32_t parent = parentIndices[i];
+        if (!doomedFlags[i] && parent != InvalidIndex && doomedFlags[parent])
+            doomedFlags[i] = 1;
+
+        if (doomedFlags[i])
+            doomed.push_back(entityAt(i));
+    }
+
+    if (doomed.empty())
+        return;
+
+    for (Entity e : doomed)
+    {
+        removeAt(indexOf(e));
+    }
+
+    orderStale = true;
+    version++;
+}
+
+void Scene::removeAt(uint32_t index)
+{
+    uint32_t slotIndex = denseToSlot[index];
+    uint32_t last = static_cast<uint32_t>(positions.size() - 1);
+
+    if (flags[index] & EntityStatic)
+        staticVersion++;
+
+    swapRemove(positions, index);
+    swapRemove(rotations, index);
+    swapRemove(scales, index);
+    swapRemove(worldMatrices, index);
+    swapRemove(localBounds, index);
+    swapRemove(worldBounds, index);
+    swapRemove(models, index);
+    swapRemove(pipelines, index);
+    swapRemove(flags, index);
+    swapRemove(parents, index);
+    swapRemove(parentIndices, index);
+    swapRemove(depths, index);
+    swapRemove(localDirty, index);
+    swapRemove(worldDirty, index);
+    swapRemove(names, index);
+    swapRemove(denseToSlot, index);
+
+    if (index != last)
+        slots[denseToSlot[index]].denseIndex = index;
+
+    Slot &slot = slots[slotIndex];
+    slot.denseIndex = InvalidIndex;
+    slot.generation = (slot.generation + 1) & Entity::GenerationMask;
+    if (slot.generation == 0)
+        slot.generation = 1;
+    freeSlots.push_back(slotIndex);
+}
+
+bool Scene::setParent(Entity entity, Entity parent)
+{
+    if (!isValid(entity) || (parent && !isValid(parent)))
+        return false;
+
+    for (Entity ancestor = parent; ancestor; ancestor = parents[indexOf(ancestor)])
+    {
+        if (ancestor == entity)
+        {
+            std::cerr << "Scene::setParent: " << getName(entity) << " cannot be parented to its own descendant" << std::endl;
+            return false;
+        }
+    }
+
+    uint32_t index = indexOf(entity);
+    parents[index] = parent;
+    orderStale = true;
+    markDirty(index);
+    return true;
+}
+
+bool Scene::isValid(Entity entity) const
+{
+    return entity.isValid() && entity.index() < slots.size() &&
+           slots[entity.index()].generation == entity.generation() &&
+           slots[entity.index()].denseIndex != InvalidIndex;
+}
+
+Entity Scene::entityAt(uint32_t index) const
+{
+    uint32_t slotIndex = denseToSlot[index];
+    return Entity::make(slotIndex, slots[slotIndex].generation);
+}
+
+void Scene::setFlags(Entity entity, uint32_t value)
+{
+    uint32_t &current = flags[indexOf(entity)];
+    if (current == value)
+        return;
+
+    // Batches only change when an entity joins or leaves them, or a static one shows, hides or
+    // moves layer
+    uint32_t changed = current ^ value;
+    if ((changed & EntityStatic) || ((value & EntityStatic) && (changed & (EntityVisible | EntityLayers))))
+        staticVersion++;
+    version++;
+    current = value;
+    flagsChanged.push_back(entity);
+}
+
+void Scene::setPosition(Entity entity, const glm::vec3 &position)
+{
+    uint32_t index = indexOf(entity);
+    positions[index] = position;
+    markDirty(index);
+}
+
+void Scene::setRotation(Entity entity, const glm::quat &rotation)
+{
+    uint32_t index = indexOf(entity);
+    rotations[index] = rotation;
+    markDirty(index);
+}
+
+void Scene::setScale(Entity entity, const glm::vec3 &scale)
+{
+    uint32_t index = indexOf(entity);
+    scales[index] = scale;
+    markDirty(index);
+}
+
+void Scene::markDirty(uint32_t index)
+{
+    localDirty[index] = 1;
+    anyDirty = true;
+    version++;
+
+    // Depths are rebuilt with the order, which then restarts from the top
+    if (!orderStale)
+        minDirtyDepth = std::min(minDirtyDepth, depths[index]);
+}
+
+template <typename T>
+void Scene::permute(std::vector<T> &array)
+{
+    std::vector<T> sorted;
+    sorted.reserve(array.size());
+    for (uint32_t index : order)
+    {
+        sorted.push_back(std::move(array[index]));
+    }
+    array.swap(sorted);
+}
+
+void Scene::sortHierarchy()
+{
+    uint32_t count = static_cast<uint32_t>(positions.size());
+
+    // Resolve parents and depths in the current order, walking up through unknown ancestors
+    std::fill(depths.begin(), depths.end(), InvalidIndex);
+    uint32_t maxDepth = 0;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        order.clear();
+        uint32_t j = i;
+        while (j != InvalidIndex && depths[j] == InvalidIndex)
+        {
+            order.push_back(j);
+            parentIndices[j] = parents[j] ? indexOf(parents[j]) : InvalidIndex;
+            j = parentIndices[j];
+        }
+
+        uint32_t depth = j == InvalidIndex ? 0 : depths[j] + 1;
+        for (auto it = order.rbegin(); it != order.rend(); ++it, ++depth)
+        {
+            depths[*it] = depth;
+            maxDepth = std::max(maxDepth, depth);
+        }
+    }
+
+    // Stable counting sort by depth
+    levelCounts.assign(count > 0 ? maxDepth + 1 : 0, 0);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        levelCounts[depths[i]]++;
+    }
+
+    levelStarts.assign(levelCounts.size() + 1, 0);
+    for (size_t level = 0; level < levelCounts.size(); ++level)
+    {
+        levelStarts[level + 1] = levelStarts[level] + levelCounts[level];
+    }
+
+    std::vector<uint32_t> newIndexOf(count);
+    order.resize(count);
+    std::fill(levelCounts.begin(), levelCounts.end(), 0);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t position = levelStarts[depths[i]] + levelCounts[depths[i]]++;
+        order[position] = i;
+        newIndexOf[i] = position;
+    }
+
+    permute(positions);
+    permute(rotations);
+    permute(scales);
+    permute(worldMatrices);
+    permute(localBounds);
+    permute(worldBounds);
+    permute(models);
+    permute(pipelines);
+    permute(flags);
+    permute(parents);
+    permute(parentIndices);
+    permute(depths);
+    permute(localDirty);
+    permute(worldDirty);
+    permute(names);
+    permute(denseToSlot);
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (parentIndices[i] != InvalidIndex)
+            parentIndices[i] = newIndexOf[parentIndices[i]];
+        slots[denseToSlot[i]].denseIndex = i;
+    }
+
+    orderStale = false;
+    minDirtyDepth = 0;
+}
+
+void Scene::updateTransforms(JobSystem &jobSystem)
+{
+    if (orderStale)
+        sortHierarchy();
+
+    updatedIndices.clear();
+    if (anyDirty)
+        propagateTransforms(jobSystem);
+
+    // The records of entities that only changed flags, once each
+    if (!flagsChanged.empty())
+    {
+        for (Entity entity : flagsChanged)
+        {
+            if (isValid(entity))
+                updatedIndices.push_back(indexOf(entity));
+        }
+        flagsChanged.clear();
+
+        std::sort(updatedIndices.begin(), updatedIndices.end());
+        updatedIndices.erase(std::unique(updatedIndices.begin(), updatedIndices.end()), updatedIndices.end());
+    }
+}
+
+void Scene::propagateTransforms(JobSystem &jobSystem)
+{
+    std::atomic<bool> staticMoved{false};
+
+    // Levels above the shallowest change are untouched; each level only reads the one above it
+    for (size_t level = minDirtyDepth; level + 1 < levelStarts.size(); ++level)
+    {
+        uint32_t levelBegin = levelStarts[level];
+        uint32_t levelEnd = levelStarts[level + 1];
+
+        jobSystem.parallelFor(levelEnd - levelBegin, [this, levelBegin, &staticMoved](size_t begin, size_t end)
+                              {
+                                  bool movedStatic = false;
+                                  for (size_t i = levelBegin + begin; i < levelBegin + end; ++i)
+                                  {
+                                      uint32_t parent = parentIndices[i];
+                                      bool dirty = localDirty[i] || (parent != InvalidIndex && worldDirty[parent]);
+                                      worldDirty[i] = dirty;
+                                      if (!dirty)
+                                          continue;
+
+                                      glm::mat4 local = composeTRS(positions[i], rotations[i], scales[i]);
+                                      if (parent == InvalidIndex)
+                                          worldMatrices[i] = local;
+                                      else
+                                          multiply(worldMatrices[parent], local, worldMatrices[i]);
+
+                                      worldBounds[i] = localBounds[i].transformed(worldMatrices[i]);
+                                      movedStatic |= (flags[i] & EntityStatic) != 0;
+                                  }
+                                  if (movedStatic)
+                                      staticMoved.store(true, std::memory_order_relaxed); }, TransformGrain);
+    }
+
+    uint32_t firstTouched = levelStarts[std::min<size_t>(minDirtyDepth, levelStarts.size() - 1)];
+    for (uint32_t i = firstTouched; i < worldDirty.size(); ++i)
+    {
+        if (worldDirty[i])
+            updatedIndices.push_back(i);
+    }
+    std::fill(localDirty.begin() + firstTouched, localDirty.end(), 0);
+    std::fill(worldDirty.begin() + firstTouched, worldDirty.end(), 0);
+
+    if (staticMoved.load(std::memory_order_relaxed))
+        staticVersion++;
+    anyDirty = false;
+    minDirtyDepth = InvalidIndex;
+}
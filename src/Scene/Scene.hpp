@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "Bounds.hpp"
+#include "ResourcePool.hpp"
+#include "View.hpp"
+
+class JobSystem;
+class Model;
+struct EntityTag;
+
+// As declared by Model.hpp and PipelineManager.hpp, repeated so the scene store needs no Metal
+using ModelHandle = Handle<Model>;
+using PipelineId = uint32_t;
+
+using Entity = Handle<EntityTag>;
+
+enum EntityFlags : uint32_t
+{
+    EntityVisible = 1 << 0,
+
+    // Never moves once placed, drawn from the StaticBatcher's merged geometry
+    EntityStatic = 1 << 1,
+
+    // The layers views pick entities by, see entityLayers
+    EntityLayers = EntityLayerBits,
+};
+
+// A block of entities appended in one go. Every array spans count elements and parents index
+// into the block itself, with ~0u for roots.
+struct EntityBatch
+{
+    size_t count = 0;
+    const glm::vec3 *positions = nullptr;
+    const glm::quat *rotations = nullptr;
+    const glm::vec3 *scales = nullptr;
+    const uint32_t *flags = nullptr;
+    const uint32_t *parents = nullptr;
+    const ModelHandle *models = nullptr;
+    const PipelineId *pipelines = nullptr;
+    const Bounds *localBounds = nullptr;
+    const std::string_view *names = nullptr;
+};
+
+// Entities stored as parallel arrays, one element per live entity at the same dense index.
+// Per-frame systems walk the arrays they need linearly (and split them across workers), so
+// a transform pass never pulls names or model ids through the cache.
+//
+// Entities may have a parent. Position, rotation and scale are local to it, and the dense
+// arrays are kept sorted breadth-first so every parent precedes its children and each depth
+// level is a contiguous range. Structural changes (create, destroy, reparent) only mark the
+// order stale; it is re-sorted once, at the next updateTransforms. Dense indices are
+// therefore only stable between updates. Main thread only.
+class Scene
+{
+public:
+    Entity create(ModelHandle model, PipelineId pipeline, const Bounds &localBounds,
+                  const glm::vec3 &position = glm::vec3(0.0f), const std::string &name = "Entity",
+                  Entity parent = {});
+
+    // Appends the whole batch with range copies and returns the new entities in batch order.
+    // World transforms are computed by the next updateTransforms.
+    std::vector<Entity> createBatch(const EntityBatch &batch);
+
+    // Also destroys every descendant
+    void destroy(Entity entity);
+    void destroyBatch(const std::vector<Entity> &entities);
+
+    // Keeps the local transform, so the entity moves with its new parent. Fails on cycles.
+    bool setParent(Entity entity, Entity parent);
+    Entity getParent(Entity entity) const { return parents[indexOf(entity)]; }
+
+    bool isValid(Entity entity) const;
+    uint32_t indexOf(Entity entity) const { return slots[entity.index()].denseIndex; }
+    Entity entityAt(uint32_t index) const;
+    size_t size() const { return positions.size(); }
+
+    void setPosition(Entity entity, const glm::vec3 &position);
+    void setRotation(Entity entity, const glm::quat &rotation);
+    void setScale(Entity entity, const glm::vec3 &scale);
+    void setFlags(Entity entity, uint32_t value);
+
+    const glm::vec3 &getPosition(Entity entity) const { return positions[indexOf(entity)]; }
+    const glm::quat &getRotation(Entity entity) const { return rotations[indexOf(entity)]; }
+    const glm::vec3 &getScale(Entity entity) const { return scales[indexOf(entity)]; }
+    const glm::mat4 &getWorldMatrix(Entity entity) const { return worldMatrices[indexOf(entity)]; }
+    glm::vec3 getWorldPosition(Entity entity) const { return glm::vec3(worldMatrices[indexOf(entity)][3]); }
+    const std::string &getName(Entity entity) const { return names[indexOf(entity)]; }
+
+    // Recomputes world matrices and bounds of changed entities and their descendants, level by
+    // level with each level split across workers. Returns immediately when nothing changed.
+    void updateTransforms(JobSystem &jobSystem);
+
+    // Bumped whenever a static entity is created, destroyed, moved or changes flags
+    uint64_t getStaticVersion() const { return staticVersion; }
+
+    // Bumped by every edit that can change what the scene looks like
+    uint64_t getVersion() const { return version; }
+
+    size_t getLevelCount() const { return levelStarts.size() - 1; }
+    size_t getUpdatedCount() const { return updatedIndices.size(); }
+
+    // Dense indices whose world matrix and bounds the last updateTransforms changed, and those
+    // whose flags changed before it
+    const std::vector<uint32_t> &getUpdatedIndices() const { return updatedIndices; }
+
+    // Slot indices stay with an entity for its whole life, unlike dense indices
+    const std::vector<uint32_t> &getDenseToSlot() const { return denseToSlot; }
+    size_t getSlotCount() const { return slots.size(); }
+
+    // Arrays for systems, all indexed by dense entity index
+    const std::vector<glm::vec3> &getPositions() const { return positions; }
+    const std::vector<glm::quat> &getRotations() const { return rotations; }
+    const std::vector<glm::vec3> &getScales() const { return scales; }
+    const std::vector<glm::mat4> &getWorldMatrices() const { return worldMatrices; }
+    const std::vector<Bounds> &getWorldBounds() const { return worldBounds; }
+    const std::vector<ModelHandle> &getModels() const { return models; }
+    // Resolved through the PipelineManager as the frame is built, so a pipeline may compile late
+    const std::vector<PipelineId> &getPipelines() const { return pipelines; }
+    const std::vector<uint32_t> &getFlags() const { return flags; }
+
+private:
+    static constexpr uint32_t InvalidIndex = ~0u;
+
+    struct Slot
+    {
+        uint32_t denseIndex;
+        uint32_t generation;
+    };
+
+    void markDirty(uint32_t index);
+    void removeAt(uint32_t index);
+    void sortHierarchy();
+    void propagateTransforms(JobSystem &jobSystem);
+
+    template <typename T>
+    void permute(std::vector<T> &array);
+
+    // Hot, touched by per-frame systems
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> worldMatrices;
+    std::vector<Bounds> localBounds;
+    std::vector<Bounds> worldBounds;
+    std::vector<ModelHandle> models;
+    std::vector<PipelineId> pipelines;
+    std::vector<uint32_t> flags;
+
+    // Hierarchy, parentIndices and depths are only valid while the order is not stale
+    std::vector<Entity> parents;
+    std::vector<uint32_t> parentIndices;
+    std::vector<uint32_t> depths;
+    std::vector<uint8_t> localDirty;
+    std::vector<uint8_t> worldDirty;
+    std::vector<uint32_t> levelStarts = {0};
+
+    // Cold
+    std::vector<std::string> names;
+
+    std::vector<uint32_t> denseToSlot;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+    bool orderStale = false;
+    bool anyDirty = false;
+    uint32_t minDirtyDepth = InvalidIndex;
+    std::vector<uint32_t> updatedIndices;
+
+    // Entities whose flags changed since the last update; their records are rewritten but their
+    // transforms are not recomputed
+    std::vector<Entity> flagsChanged;
+    uint64_t staticVersion = 0;
+    uint64_t version = 0;
+
+    // Scratch reused between frames
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> levelCounts;
+};
@@ -0,0 +1,118 @@
+#include "SceneBuffer.hpp"
+#include "ResourceManager.hpp"
+#include "Scene.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+ObjectData ObjectData::make(const glm::mat4 &worldMatrix, const Bounds &bounds, uint32_t entity, uint32_t flags)
+{
+    glm::mat4 rows = glm::transpose(worldMatrix);
+
+    // The rows of the inverse transpose are the columns of the inverse
+    glm::mat3 inverse = glm::inverse(glm::mat3(worldMatrix));
+    return {{rows[0], rows[1], rows[2]},
+            {glm::vec4(inverse[0], 0.0f), glm::vec4(inverse[1], 0.0f), glm::vec4(inverse[2], 0.0f)},
+            bounds.min, entity, bounds.max, flags};
+}
+
+SceneBuffer::SceneBuffer(MTL::Device *device, ResourceManager &resources)
+    : device(device), resources(resources)
+{
+    grow(1);
+    shadow[IdentityRecord] = ObjectData::make(glm::mat4(1.0f), Bounds(), ~0u, 0);
+}
+
+SceneBuffer::~SceneBuffer()
+{
+    for (Copy &copy : copies)
+    {
+        copy.buffer->release();
+    }
+}
+
+void SceneBuffer::grow(size_t count)
+{
+    if (count <= shadow.size())
+        return;
+
+    size_t capacity = std::max<size_t>({count, shadow.size() * 2, 1024});
+    shadow.resize(capacity);
+
+    // Frames already built still bind the old copies
+    for (Copy &copy : copies)
+    {
+        if (copy.buffer)
+            resources.releaseLater(copy.buffer);
+
+        copy.buffer = device->newBuffer(capacity * sizeof(ObjectData), MTL::ResourceStorageModeShared);
+        copy.stale = true;
+    }
+}
+
+void SceneBuffer::copyRange(MTL::Buffer *target, uint32_t begin, uint32_t end)
+{
+    memcpy(static_cast<ObjectData *>(target->contents()) + begin, shadow.data() + begin, size_t(end - begin) * sizeof(ObjectData));
+    uploadedRecords += end - begin;
+    copyCount++;
+}
+
+void SceneBuffer::update(const Scene &scene, uint64_t frameIndex)
+{
+    // Same guard as MaterialTable: the copy written now was last bound FrameCount frames ago
+    while (resources.getCompletedFrame() + FrameCount < frameIndex)
+    {
+        std::this_thread::yield();
+    }
+
+    grow(recordOf(static_cast<uint32_t>(scene.getSlotCount())));
+
+    const std::vector<uint32_t> &denseToSlot = scene.getDenseToSlot();
+    const std::vector<glm::mat4> &worldMatrices = scene.getWorldMatrices();
+    const std::vector<Bounds> &worldBounds = scene.getWorldBounds();
+    const std::vector<uint32_t> &flags = scene.getFlags();
+
+    std::vector<uint32_t> &current = changed[frameIndex % FrameCount];
+    current.clear();
+    for (uint32_t index : scene.getUpdatedIndices())
+    {
+        uint32_t slot = denseToSlot[index];
+        uint32_t record = recordOf(slot);
+        shadow[record] = ObjectData::make(worldMatrices[index], worldBounds[index], slot, flags[index]);
+        current.push_back(record);
+    }
+
+    uploadedRecords = 0;
+    copyCount = 0;
+
+    Copy &copy = copies[frameIndex % FrameCount];
+    if (copy.stale)
+    {
+        copyRange(copy.buffer, 0, static_cast<uint32_t>(shadow.size()));
+        copy.stale = false;
+        return;
+    }
+
+    // Everything changed since this copy was written, FrameCount frames ago
+    pending.clear();
+    for (const std::vector<uint32_t> &records : changed)
+        pending.insert(pending.end(), records.begin(), records.end());
+
+    if (pending.empty())
+        return;
+
+    std::sort(pending.begin(), pending.end());
+
+    uint32_t begin = pending[0];
+    uint32_t end = begin + 1;
+    for (uint32_t record : pending)
+    {
+        if (record > end + CoalesceGap)
+        {
+            copyRange(copy.buffer, begin, end);
+            begin = record;
+        }
+        end = std::max(end, record + 1);
+    }
+    copyRange(copy.buffer, begin, end);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Metal/Metal.hpp>
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bounds.hpp"
+#include "MaterialTable.hpp"
+
+class ResourceManager;
+class Scene;
+
+// Matches ObjectData in geometry.metal. World matrices are affine, so only the top three rows
+// are kept, each as a float4. Normals take the inverse transpose of the upper 3x3, which keeps
+// them perpendicular under non-uniform scale.
+struct ObjectData
+{
+    glm::vec4 worldRows[3];
+    glm::vec4 normalRows[3];
+    glm::vec3 boundsMin;
+    uint32_t entity;
+    glm::vec3 boundsMax;
+    uint32_t flags;
+
+    static ObjectData make(const glm::mat4 &worldMatrix, const Bounds &bounds, uint32_t entity, uint32_t flags);
+} __attribute__((aligned(16)));
+
+// Per-entity records on the GPU, indexed by entity slot so a record stays put for the life of
+// its entity. Draws select theirs by index instead of uploading a matrix each.
+//
+// Each frame in flight has its own copy. update() writes the records the scene changed into a
+// CPU shadow and remembers them for FrameCount frames; a copy then gets only the records
+// changed since it was last written, with neighbouring records merged into one copy.
+class SceneBuffer
+{
+public:
+    static constexpr uint32_t FrameCount = MaterialTable::FrameCount;
+
+    // An identity record ahead of the entities, for geometry already in world space
+    static constexpr uint32_t IdentityRecord = 0;
+    static uint32_t recordOf(uint32_t slot) { return slot + 1; }
+
+    // Dirty records this close together are written with a single copy
+    static constexpr uint32_t CoalesceGap = 4;
+
+    SceneBuffer(MTL::Device *device, ResourceManager &resources);
+    SceneBuffer(const SceneBuffer &) = delete;
+    SceneBuffer &operator=(const SceneBuffer &) = delete;
+    ~SceneBuffer();
+
+    // Main thread, after Scene::updateTransforms
+    void update(const Scene &scene, uint64_t frameIndex);
+
+    MTL::Buffer *getBuffer(uint64_t frameIndex) const { return copies[frameIndex % FrameCount].buffer; }
+
+    size_t getRecordCount() const { return shadow.size(); }
+
+    // What the last update wrote into the frame's copy
+    size_t getUploadedRecords() const { return uploadedRecords; }
+    size_t getUploadedBytes() const { return uploadedRecords * sizeof(ObjectData); }
+    size_t getCopyCount() const { return copyCount; }
+
+private:
+    struct Copy
+    {
+        MTL::Buffer *buffer = nullptr;
+
+        // Reallocated, everything needs writing
+        bool stale = true;
+    };
+
+    void grow(size_t count);
+    void copyRange(MTL::Buffer *target, uint32_t begin, uint32_t end);
+
+    MTL::Device *device;
+    ResourceManager &resources;
+
+    std::vector<ObjectData> shadow;
+    std::array<Copy, FrameCount> copies;
+
+    // Records changed in each of the last FrameCount frames
+    std::array<std::vector<uint32_t>, FrameCount> changed;
+    std::vector<uint32_t> pending;
+
+    size_t uploadedRecords = 0;
+    size_t copyCount = 0;
+};
@@ -0,0 +1,625 @@
+#include "SceneFile.hpp"
+#include "ResourceManager.hpp"
+#include "PipelineManager.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+// The binary arrays are glm's own layout, written and read by the same build
+static_assert(sizeof(glm::vec3) == 12 && sizeof(glm::quat) == 16, "Unexpected glm layout");
+static_assert(sizeof(ScenePointLight) == 32, "Unexpected point light layout");
+
+static constexpr uint32_t BinaryMagic = 0x4E43534D; // "MSCN"
+static constexpr uint32_t BinaryVersion = 2;
+static constexpr uint64_t BinaryAlignment = 16;
+
+struct BinaryHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entityCount;
+    uint32_t modelCount;
+    uint32_t pipelineCount;
+    uint32_t sunEntity;
+    float ambientColor[3];
+    float lightColor[3];
+
+    // Byte offsets from the start of the file, each aligned to BinaryAlignment
+    uint64_t positions;
+    uint64_t rotations;
+    uint64_t scales;
+    uint64_t flags;
+    uint64_t parents;
+    uint64_t modelIndices;
+    uint64_t pipelineIndices;
+    uint64_t stringOffsets;
+    uint64_t strings;
+    uint64_t stringBytes;
+
+    // Version 2
+    uint64_t pointLightCount;
+    uint64_t pointLights;
+};
+
+SceneFile::SceneFile(SceneFile &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+SceneFile &SceneFile::operator=(SceneFile &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    if (mapping)
+        munmap(mapping, mappingSize);
+
+    storage = std::move(other.storage);
+    mapping = std::exchange(other.mapping, nullptr);
+    mappingSize = std::exchange(other.mappingSize, 0);
+    entityCount = std::exchange(other.entityCount, 0);
+    modelCount = std::exchange(other.modelCount, 0);
+    pipelineCount = std::exchange(other.pipelineCount, 0);
+    pointLightCount = std::exchange(other.pointLightCount, 0);
+    positions = other.positions;
+    rotations = other.rotations;
+    scales = other.scales;
+    flags = other.flags;
+    parents = other.parents;
+    modelIndices = other.modelIndices;
+    pipelineIndices = other.pipelineIndices;
+    pointLights = other.pointLights;
+    stringOffsets = other.stringOffsets;
+    strings = other.strings;
+    light = other.light;
+    sunEntity = std::exchange(other.sunEntity, InvalidIndex);
+
+    // A short string lives inside the object, so owned arrays are re-pointed after the move
+    if (!mapping)
+        pointAtStorage();
+
+    // The other file is left empty rather than pointing into storage or a mapping it gave away
+    other.storage = Storage();
+    other.pointAtStorage();
+
+    return *this;
+}
+
+SceneFile::~SceneFile()
+{
+    if (mapping)
+        munmap(mapping, mappingSize);
+}
+
+void SceneFile::pointAtStorage()
+{
+    positions = storage.positions.data();
+    rotations = storage.rotations.data();
+    scales = storage.scales.data();
+    flags = storage.flags.data();
+    parents = storage.parents.data();
+    modelIndices = storage.modelIndices.data();
+    pipelineIndices = storage.pipelineIndices.data();
+    pointLights = storage.pointLights.data();
+    stringOffsets = storage.stringOffsets.data();
+    strings = storage.strings.data();
+}
+
+SceneFile SceneFile::load(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open scene file: " + path);
+    }
+
+    uint32_t magic = 0;
+    file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+    file.close();
+
+    return magic == BinaryMagic ? loadBinary(path) : loadText(path);
+}
+
+SceneFile SceneFile::loadBinary(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open scene file: " + path);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(BinaryHeader))
+    {
+        close(fd);
+        throw std::runtime_error("Scene file is truncated: " + path);
+    }
+
+    void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map scene file: " + path);
+    }
+
+    SceneFile scene;
+    scene.mapping = mapping;
+    scene.mappingSize = info.st_size;
+
+    const char *base = static_cast<const char *>(mapping);
+    BinaryHeader header;
+    memcpy(&header, base, sizeof(header));
+
+    if (header.magic != BinaryMagic || header.version < 1 || header.version > BinaryVersion)
+    {
+        throw std::runtime_error("Unsupported scene file version: " + path);
+    }
+
+    // Version 1 headers end before the point lights, what was read past them is section data
+    if (header.version < 2)
+    {
+        header.pointLightCount = 0;
+        header.pointLights = 0;
+    }
+
+    uint64_t entities = header.entityCount;
+    uint64_t stringCount = uint64_t(header.modelCount) * 2 + header.pipelineCount + entities;
+    auto inBounds = [&](uint64_t offset, uint64_t bytes)
+    {
+        return offset % BinaryAlignment == 0 && offset <= scene.mappingSize && bytes <= scene.mappingSize - offset;
+    };
+
+    if (!inBounds(header.positions, entities * sizeof(glm::vec3)) ||
+        !inBounds(header.rotations, entities * sizeof(glm::quat)) ||
+        !inBounds(header.scales, entities * sizeof(glm::vec3)) ||
+        !inBounds(header.flags, entities * sizeof(uint32_t)) ||
+        !inBounds(header.parents, entities * sizeof(uint32_t)) ||
+        !inBounds(header.modelIndices, entities * sizeof(uint32_t)) ||
+        !inBounds(header.pipelineIndices, entities * sizeof(uint32_t)) ||
+        header.pointLightCount > scene.mappingSize / sizeof(ScenePointLight) ||
+        !inBounds(header.pointLights, header.pointLightCount * sizeof(ScenePointLight)) ||
+        !inBounds(header.stringOffsets, (stringCount + 1) * sizeof(uint32_t)) ||
+        !inBounds(header.strings, header.stringBytes))
+    {
+        throw std::runtime_error("Scene file is truncated: " + path);
+    }
+
+    scene.entityCount = header.entityCount;
+    scene.modelCount = header.modelCount;
+    scene.pipelineCount = header.pipelineCount;
+    scene.pointLightCount = header.pointLightCount;
+    scene.sunEntity = header.sunEntity;
+    scene.light.ambientColor = glm::vec3(header.ambientColor[0], header.ambientColor[1], header.ambientColor[2]);
+    scene.light.lightColor = glm::vec3(header.lightColor[0], header.lightColor[1], header.lightColor[2]);
+
+    scene.positions = reinterpret_cast<const glm::vec3 *>(base + header.positions);
+    scene.rotations = reinterpret_cast<const glm::quat *>(base + header.rotations);
+    scene.scales = reinterpret_cast<const glm::vec3 *>(base + header.scales);
+    scene.flags = reinterpret_cast<const uint32_t *>(base + header.flags);
+    scene.parents = reinterpret_cast<const uint32_t *>(base + header.parents);
+    scene.modelIndices = reinterpret_cast<const uint32_t *>(base + header.modelIndices);
+    scene.pipelineIndices = reinterpret_cast<const uint32_t *>(base + header.pipelineIndices);
+    scene.pointLights = reinterpret_cast<const ScenePointLight *>(base + header.pointLights);
+    scene.stringOffsets = reinterpret_cast<const uint32_t *>(base + header.stringOffsets);
+    scene.strings = base + header.strings;
+
+    for (uint64_t i = 0; i < stringCount; ++i)
+    {
+        uint32_t begin = scene.stringOffsets[i];
+        uint32_t end = scene.stringOffsets[i + 1];
+        if (begin >= end || end > header.stringBytes || scene.strings[end - 1] != '\0')
+        {
+            throw std::runtime_error("Scene file has a corrupt string table: " + path);
+        }
+    }
+
+    scene.validate();
+    return scene;
+}
+
+static void expect(bool condition, const std::string &path, size_t lineNumber, const std::string &message)
+{
+    if (!condition)
+    {
+        throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": " + message);
+    }
+}
+
+SceneFile SceneFile::loadText(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open scene file: " + path);
+    }
+
+    SceneFile scene;
+    Storage &s = scene.storage;
+
+    std::vector<std::string> modelAliases, modelPaths, pipelineNames, entityNames;
+    std::unordered_map<std::string, uint32_t> modelByAlias, pipelineByName, entityByName;
+    std::string sunName;
+    std::vector<std::pair<std::string, size_t>> pointLightEntities;
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream stream(line);
+        std::string keyword;
+        if (!(stream >> keyword))
+            continue;
+
+        if (keyword == "model")
+        {
+            std::string alias, modelPath;
+            expect(static_cast<bool>(stream >> alias >> modelPath), path, lineNumber, "expected model <alias> <path>");
+            modelByAlias[alias] = static_cast<uint32_t>(modelAliases.size());
+            modelAliases.push_back(alias);
+            modelPaths.push_back(modelPath);
+        }
+        else if (keyword == "pipeline")
+        {
+            std::string name;
+            expect(static_cast<bool>(stream >> name), path, lineNumber, "expected pipeline <name>");
+            pipelineByName[name] = static_cast<uint32_t>(pipelineNames.size());
+            pipelineNames.push_back(name);
+        }
+        else if (keyword == "ambient" || keyword == "light")
+        {
+            glm::vec3 &color = keyword == "ambient" ? scene.light.ambientColor : scene.light.lightColor;
+            expect(static_cast<bool>(stream >> color.x >> color.y >> color.z), path, lineNumber, "expected " + keyword + " <r> <g> <b>");
+        }
+        else if (keyword == "sun")
+        {
+            expect(static_cast<bool>(stream >> sunName), path, lineNumber, "expected sun <entity>");
+        }
+        else if (keyword == "pointlight")
+        {
+            std::string entity;
+            ScenePointLight pointLight;
+            expect(static_cast<bool>(stream >> entity >> pointLight.position.x >> pointLight.position.y >> pointLight.position.z >> pointLight.radius >>
+                                     pointLight.color.x >> pointLight.color.y >> pointLight.color.z),
+                   path, lineNumber, "expected pointlight <entity> <x> <y> <z> <radius> <r> <g> <b>");
+            expect(pointLight.radius > 0.0f, path, lineNumber, "point light radius must be positive");
+
+            pointLight.entity = InvalidIndex;
+            if (entity != "-")
+            {
+                // Resolved at the end, like the sun, so lights may come before their entity
+                pointLightEntities.emplace_back(entity, lineNumber);
+                pointLight.entity = static_cast<uint32_t>(pointLightEntities.size() - 1);
+            }
+            s.pointLights.push_back(pointLight);
+        }
+        else if (keyword == "entity")
+        {
+            std::string name, alias, pipeline, parent;
+            glm::vec3 position;
+            expect(static_cast<bool>(stream >> name >> alias >> pipeline >> parent >> position.x >> position.y >> position.z),
+                   path, lineNumber, "expected entity <name> <model> <pipeline> <parent> <x> <y> <z>");
+
+            auto model = modelByAlias.find(alias);
+            expect(model != modelByAlias.end(), path, lineNumber, "unknown model " + alias);
+            auto pipelineIt = pipelineByName.find(pipeline);
+            expect(pipelineIt != pipelineByName.end(), path, lineNumber, "unknown pipeline " + pipeline);
+
+            uint32_t parentIndex = InvalidIndex;
+            if (parent != "-")
+            {
+                auto parentIt = entityByName.find(parent);
+                expect(parentIt != entityByName.end(), path, lineNumber, "parent " + parent + " must be declared first");
+                parentIndex = parentIt->second;
+            }
+
+            glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+            glm::vec3 scale(1.0f);
+            uint32_t entityFlags = EntityVisible;
+
+            std::string option;
+            while (stream >> option)
+            {
+                if (option == "rotation")
+                    expect(static_cast<bool>(stream >> rotation.w >> rotation.x >> rotation.y >> rotation.z), path, lineNumber, "expected rotation <w> <x> <y> <z>");
+                else if (option == "scale")
+                    expect(static_cast<bool>(stream >> scale.x >> scale.y >> scale.z), path, lineNumber, "expected scale <x> <y> <z>");
+                else if (option == "hidden")
+                    entityFlags &= ~EntityVisible;
+                else if (option == "static")
+                    entityFlags |= EntityStatic;
+                else if (option == "layer")
+                {
+                    uint32_t layer = 0;
+                    expect(static_cast<bool>(stream >> layer) && layer < 8, path, lineNumber, "expected layer <0-7>");
+                    entityFlags |= (1u << layer) << EntityLayerShift;
+                }
+                else
+                    expect(false, path, lineNumber, "unknown entity option " + option);
+            }
+
+            entityByName[name] = static_cast<uint32_t>(entityNames.size());
+            entityNames.push_back(name);
+            s.positions.push_back(position);
+            s.rotations.push_back(rotation);
+            s.scales.push_back(scale);
+            s.flags.push_back(entityFlags);
+            s.parents.push_back(parentIndex);
+            s.modelIndices.push_back(model->second);
+            s.pipelineIndices.push_back(pipelineIt->second);
+        }
+        else
+        {
+            expect(false, path, lineNumber, "unknown keyword " + keyword);
+        }
+    }
+
+    if (!sunName.empty())
+    {
+        auto sun = entityByName.find(sunName);
+        expect(sun != entityByName.end(), path, lineNumber, "unknown sun entity " + sunName);
+        scene.sunEntity = sun->second;
+    }
+
+    for (ScenePointLight &pointLight : s.pointLights)
+    {
+        if (pointLight.entity == InvalidIndex)
+            continue;
+
+        const auto &[entity, entityLine] = pointLightEntities[pointLight.entity];
+        auto it = entityByName.find(entity);
+        expect(it != entityByName.end(), path, entityLine, "unknown point light entity " + entity);
+        pointLight.entity = it->second;
+    }
+
+    auto addString = [&s](const std::string &value)
+    {
+        s.strings.append(value);
+        s.strings.push_back('\0');
+        s.stringOffsets.push_back(static_cast<uint32_t>(s.strings.size()));
+    };
+
+    for (size_t i = 0; i < modelAliases.size(); ++i)
+    {
+        addString(modelAliases[i]);
+        addString(modelPaths[i]);
+    }
+    for (const auto &name : pipelineNames)
+    {
+        addString(name);
+    }
+    for (const auto &name : entityNames)
+    {
+        addString(name);
+    }
+
+    scene.entityCount = entityNames.size();
+    scene.modelCount = modelAliases.size();
+    scene.pipelineCount = pipelineNames.size();
+    scene.pointLightCount = s.pointLights.size();
+    scene.pointAtStorage();
+    scene.validate();
+    return scene;
+}
+
+void SceneFile::validate() const
+{
+    for (size_t i = 0; i < entityCount; ++i)
+    {
+        if (modelIndices[i] >= modelCount || pipelineIndices[i] >= pipelineCount ||
+            (parents[i] != InvalidIndex && parents[i] >= i))
+        {
+            throw std::runtime_error("Scene file entity " + std::string(getEntityName(i)) + " has an invalid reference");
+        }
+    }
+
+    if (sunEntity != InvalidIndex && sunEntity >= entityCount)
+    {
+        throw std::runtime_error("Scene file sun entity is out of range");
+    }
+
+    for (size_t i = 0; i < pointLightCount; ++i)
+    {
+        if (pointLights[i].entity != InvalidIndex && pointLights[i].entity >= entityCount)
+        {
+            throw std::runtime_error("Scene file point light " + std::to_string(i) + " has an invalid entity");
+        }
+    }
+}
+
+std::vector<Entity> SceneFile::instantiate(Scene &scene, ResourceManager &resources, PipelineManager &pipelineManager,
+                                           const std::vector<ModelHandle> &models) const
+{
+    std::vector<PipelineId> pipelines(pipelineCount);
+    for (size_t i = 0; i < pipelineCount; ++i)
+    {
+        pipelines[i] = pipelineManager.findPipeline(std::string(getPipelineName(i)));
+        if (pipelines[i] == InvalidPipeline)
+        {
+            std::cerr << "Scene uses unknown pipeline " << getPipelineName(i) << ", drawing with standard" << std::endl;
+            pipelines[i] = pipelineManager.findPipeline("standard");
+        }
+    }
+
+    std::vector<Bounds> modelBounds(models.size());
+    for (size_t i = 0; i < models.size(); ++i)
+    {
+        if (Model *model = resources.get(models[i]))
+            modelBounds[i] = model->getBounds();
+    }
+
+    // Expand the table indices, everything else is copied straight from the file
+    std::vector<ModelHandle> entityModels(entityCount);
+    std::vector<PipelineId> entityPipelines(entityCount);
+    std::vector<Bounds> entityBounds(entityCount);
+    std::vector<std::string_view> entityNames(entityCount);
+    for (size_t i = 0; i < entityCount; ++i)
+    {
+        entityModels[i] = models[modelIndices[i]];
+        entityBounds[i] = modelBounds[modelIndices[i]];
+        entityPipelines[i] = pipelines[pipelineIndices[i]];
+        entityNames[i] = getEntityName(i);
+    }
+
+    EntityBatch batch;
+    batch.count = entityCount;
+    batch.positions = positions;
+    batch.rotations = rotations;
+    batch.scales = scales;
+    batch.flags = flags;
+    batch.parents = parents;
+    batch.models = entityModels.data();
+    batch.pipelines = entityPipelines.data();
+    batch.localBounds = entityBounds.data();
+    batch.names = entityNames.data();
+
+    return scene.createBatch(batch);
+}
+
+void SceneFile::saveBinary(const std::string &path) const
+{
+    size_t stringCount = modelCount * 2 + pipelineCount + entityCount;
+
+    BinaryHeader header = {};
+    header.magic = BinaryMagic;
+    header.version = BinaryVersion;
+    header.entityCount = static_cast<uint32_t>(entityCount);
+    header.modelCount = static_cast<uint32_t>(modelCount);
+    header.pipelineCount = static_cast<uint32_t>(pipelineCount);
+    header.sunEntity = sunEntity;
+    memcpy(header.ambientColor, &light.ambientColor, sizeof(header.ambientColor));
+    memcpy(header.lightColor, &light.lightColor, sizeof(header.lightColor));
+    header.stringBytes = stringOffsets[stringCount];
+    header.pointLightCount = pointLightCount;
+
+    struct Section
+    {
+        uint64_t &offset;
+        const void *data;
+        uint64_t bytes;
+    };
+    Section sections[] = {
+        {header.positions, positions, entityCount * sizeof(glm::vec3)},
+        {header.rotations, rotations, entityCount * sizeof(glm::quat)},
+        {header.scales, scales, entityCount * sizeof(glm::vec3)},
+        {header.flags, flags, entityCount * sizeof(uint32_t)},
+        {header.parents, parents, entityCount * sizeof(uint32_t)},
+        {header.modelIndices, modelIndices, entityCount * sizeof(uint32_t)},
+        {header.pipelineIndices, pipelineIndices, entityCount * sizeof(uint32_t)},
+        {header.pointLights, pointLights, pointLightCount * sizeof(ScenePointLight)},
+        {header.stringOffsets, stringOffsets, (stringCount + 1) * sizeof(uint32_t)},
+        {header.strings, strings, header.stringBytes},
+    };
+
+    uint64_t offset = sizeof(BinaryHeader);
+    for (Section &section : sections)
+    {
+        offset = (offset + BinaryAlignment - 1) & ~(BinaryAlignment - 1);
+        section.offset = offset;
+        offset += section.bytes;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to create scene file: " + path);
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    const char padding[BinaryAlignment] = {};
+    uint64_t written = sizeof(header);
+    for (const Section &section : sections)
+    {
+        file.write(padding, section.offset - written);
+        if (section.bytes > 0)
+            file.write(static_cast<const char *>(section.data), section.bytes);
+        written = section.offset + section.bytes;
+    }
+
+    if (!file)
+    {
+        throw std::runtime_error("Failed to write scene file: " + path);
+    }
+}
+
+void SceneFile::saveText(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to create scene file: " + path);
+    }
+
+    // Round-trips floats exactly
+    file.precision(9);
+
+    for (size_t i = 0; i < modelCount; ++i)
+    {
+        file << "model " << getModelAlias(i) << " " << getModelPath(i) << "\n";
+    }
+    for (size_t i = 0; i < pipelineCount; ++i)
+    {
+        file << "pipeline " << getPipelineName(i) << "\n";
+    }
+
+    const glm::vec3 &ambient = light.ambientColor;
+    const glm::vec3 &color = light.lightColor;
+    file << "ambient " << ambient.x << " " << ambient.y << " " << ambient.z << "\n";
+    file << "light " << color.x << " " << color.y << " " << color.z << "\n";
+    if (sunEntity != InvalidIndex)
+    {
+        file << "sun " << getEntityName(sunEntity) << "\n";
+    }
+
+    for (size_t i = 0; i < entityCount; ++i)
+    {
+        const glm::vec3 &p = positions[i];
+        file << "entity " << getEntityName(i) << " " << getModelAlias(modelIndices[i]) << " " << getPipelineName(pipelineIndices[i]) << " "
+             << (parents[i] == InvalidIndex ? std::string_view("-") : getEntityName(parents[i]))
+             << " " << p.x << " " << p.y << " " << p.z;
+
+        const glm::quat &r = rotations[i];
+        if (r != glm::quat(1.0f, 0.0f, 0.0f, 0.0f))
+            file << " rotation " << r.w << " " << r.x << " " << r.y << " " << r.z;
+
+        const glm::vec3 &s = scales[i];
+        if (s != glm::vec3(1.0f))
+            file << " scale " << s.x << " " << s.y << " " << s.z;
+
+        if (!(flags[i] & EntityVisible))
+            file << " hidden";
+        if (flags[i] & EntityStatic)
+            file << " static";
+        for (uint32_t layer = 0; layer < 8; ++layer)
+        {
+            if (flags[i] & ((1u << layer) << EntityLayerShift))
+                file << " layer " << layer;
+        }
+
+        file << "\n";
+    }
+
+    for (size_t i = 0; i < pointLightCount; ++i)
+    {
+        const ScenePointLight &l = pointLights[i];
+        file << "pointlight " << (l.entity == InvalidIndex ? std::string_view("-") : getEntityName(l.entity))
+             << " " << l.position.x << " " << l.position.y << " " << l.position.z << " " << l.radius
+             << " " << l.color.x << " " << l.color.y << " " << l.color.z << "\n";
+    }
+
+    if (!file)
+    {
+        throw std::runtime_error("Failed to write scene file: " + path);
+    }
+}
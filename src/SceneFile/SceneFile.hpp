@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "Scene.hpp"
+
+class PipelineManager;
+class ResourceManager;
+
+struct SceneLight
+{
+    glm::vec3 ambientColor = glm::vec3(0.1f);
+    glm::vec3 lightColor = glm::vec3(1.0f);
+};
+
+// A point light. With an entity its position is relative to that entity and it moves with it.
+struct ScenePointLight
+{
+    glm::vec3 position;
+    float radius;
+    glm::vec3 color;
+    uint32_t entity;
+};
+
+// A scene on disk: an entity table plus the model paths and pipeline names it refers to.
+//
+// The binary form is the entity table laid out as it sits in memory, so loading it is an mmap
+// and a validation pass, and the arrays are handed straight to Scene::createBatch. The text
+// form is line based for editing by hand:
+//
+//   model <alias> <path>
+//   pipeline <name>
+//   ambient <r> <g> <b>
+//   light <r> <g> <b>
+//   sun <entity>
+//   pointlight <entity or -> <x> <y> <z> <radius> <r> <g> <b>
+//   entity <name> <model alias> <pipeline> <parent entity or -> <x> <y> <z>
+//          [rotation <w> <x> <y> <z>] [scale <x> <y> <z>] [hidden] [static] [layer <0-7>]...
+//
+// Static entities never move once placed and are drawn from merged batches. Each layer option
+// puts the entity on that layer, views draw the layers in their mask; without any it is on 0. Names contain no
+// spaces, '#' starts a comment and a parent must be declared before its children. Entity
+// references resolve to the most recent entity with that name.
+class SceneFile
+{
+public:
+    static constexpr uint32_t InvalidIndex = ~0u;
+
+    SceneFile() = default;
+    SceneFile(SceneFile &&other) noexcept;
+    SceneFile &operator=(SceneFile &&other) noexcept;
+    SceneFile(const SceneFile &) = delete;
+    SceneFile &operator=(const SceneFile &) = delete;
+    ~SceneFile();
+
+    // Picks the form from the file's first bytes. Throws on malformed files.
+    static SceneFile load(const std::string &path);
+    static SceneFile loadBinary(const std::string &path);
+    static SceneFile loadText(const std::string &path);
+
+    // Appends every entity to the scene in one batch. models is indexed like the file's model
+    // table, entity bounds come from the loaded models and unknown pipelines fall back to standard.
+    std::vector<Entity> instantiate(Scene &scene, ResourceManager &resources, PipelineManager &pipelineManager,
+                                    const std::vector<ModelHandle> &models) const;
+
+    void saveBinary(const std::string &path) const;
+    void saveText(const std::string &path) const;
+
+    size_t getEntityCount() const { return entityCount; }
+    size_t getModelCount() const { return modelCount; }
+    size_t getPipelineCount() const { return pipelineCount; }
+
+    // Entity arrays, entityCount elements each. Parents index into the same table.
+    const glm::vec3 *getPositions() const { return positions; }
+    const glm::quat *getRotations() const { return rotations; }
+    const glm::vec3 *getScales() const { return scales; }
+    const uint32_t *getFlags() const { return flags; }
+    const uint32_t *getParents() const { return parents; }
+    const uint32_t *getModelIndices() const { return modelIndices; }
+    const uint32_t *getPipelineIndices() const { return pipelineIndices; }
+
+    std::string_view getEntityName(size_t index) const { return string(modelCount * 2 + pipelineCount + index); }
+    std::string_view getModelAlias(size_t index) const { return string(index * 2); }
+    std::string_view getModelPath(size_t index) const { return string(index * 2 + 1); }
+    std::string_view getPipelineName(size_t index) const { return string(modelCount * 2 + index); }
+
+    size_t getPointLightCount() const { return pointLightCount; }
+    const ScenePointLight *getPointLights() const { return pointLights; }
+
+    const SceneLight &getLight() const { return light; }
+    uint32_t getSunEntity() const { return sunEntity; }
+
+private:
+    std::string_view string(size_t index) const { return std::string_view(strings + stringOffsets[index], stringOffsets[index + 1] - stringOffsets[index] - 1); }
+
+    void validate() const;
+    void pointAtStorage();
+
+    // Text files own their arrays, binary files point into the mapping
+    struct Storage
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> scales;
+        std::vector<uint32_t> flags;
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> modelIndices;
+        std::vector<uint32_t> pipelineIndices;
+        std::vector<ScenePointLight> pointLights;
+        std::vector<uint32_t> stringOffsets = {0};
+        std::string strings;
+    } storage;
+
+    void *mapping = nullptr;
+    size_t mappingSize = 0;
+
+    size_t entityCount = 0;
+    size_t modelCount = 0;
+    size_t pipelineCount = 0;
+    size_t pointLightCount = 0;
+    const glm::vec3 *positions = nullptr;
+    const glm::quat *rotations = nullptr;
+    const glm::vec3 *scales = nullptr;
+    const uint32_t *flags = nullptr;
+    const uint32_t *parents = nullptr;
+    const uint32_t *modelIndices = nullptr;
+    const uint32_t *pipelineIndices = nullptr;
+    const ScenePointLight *pointLights = nullptr;
+
+    // Model aliases and paths interleaved, then pipeline names, then entity names, each
+    // null terminated; stringOffsets has one extra entry for the end of the last string
+    const uint32_t *stringOffsets = nullptr;
+    const char *strings = nullptr;
+
+    SceneLight light;
+    uint32_t sunEntity = InvalidIndex;
+};
@@ -0,0 +1,58 @@
+#include "SceneSnapshot.hpp"
+
+void SceneSnapshotBuffer::publish()
+{
+    uint32_t state = mailbox.load(std::memory_order_acquire);
+
+    while (true)
+    {
+        if (state & ClosedBit)
+            return;
+
+        // The previous snapshot has not been picked up yet
+        if (state & FreshBit)
+        {
+            mailbox.wait(state, std::memory_order_acquire);
+            state = mailbox.load(std::memory_order_acquire);
+            continue;
+        }
+
+        if (mailbox.compare_exchange_weak(state, writeIndex | FreshBit, std::memory_order_acq_rel, std::memory_order_acquire))
+            break;
+    }
+
+    writeIndex = state & IndexMask;
+    mailbox.notify_all();
+}
+
+SceneSnapshot *SceneSnapshotBuffer::acquire()
+{
+    uint32_t state = mailbox.load(std::memory_order_acquire);
+
+    while (true)
+    {
+        if (state & ClosedBit)
+            return nullptr;
+
+        if (!(state & FreshBit))
+        {
+            mailbox.wait(state, std::memory_order_acquire);
+            state = mailbox.load(std::memory_order_acquire);
+            continue;
+        }
+
+        if (mailbox.compare_exchange_weak(state, readIndex, std::memory_order_acq_rel, std::memory_order_acquire))
+            break;
+    }
+
+    readIndex = state & IndexMask;
+    mailbox.notify_all();
+
+    return &slots[readIndex];
+}
+
+void SceneSnapshotBuffer::close()
+{
+    mailbox.fetch_or(ClosedBit, std::memory_order_acq_rel);
+    mailbox.notify_all();
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <Metal/Metal.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <simd/simd.h>
+#include "ImGuiHandler.hpp"
+#include "LightBuffer.hpp"
+#include "ShadowCascades.hpp"
+#include "ResourcePool.hpp"
+
+class Mesh;
+class Model;
+
+struct LightData
+{
+    simd::float3 ambientColor;
+    simd::float3 lightPosition;
+    simd::float3 lightColor;
+} __attribute__((aligned(16)));
+
+// Matches ViewData in geometry.metal. Computed once per frame and bound once per pass.
+struct ViewData
+{
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+    glm::mat4 viewProjectionMatrix;
+    glm::vec4 cameraPosition;
+
+    // Inward facing, as in Frustum
+    glm::vec4 frustumPlanes[6];
+} __attribute__((aligned(16)));
+
+// Matches ShadowData in geometry.metal, the cascades as the main pass samples them
+struct ShadowData
+{
+    glm::mat4 viewProjection[ShadowCascades::CascadeCount];
+
+    // Per cascade: the view depth it reaches to, and world units per shadow map texel
+    glm::vec4 splitFar;
+    glm::vec4 texelSize;
+
+    // The main view, whose depth picks the cascade in every view
+    glm::mat4 cascadeView;
+} __attribute__((aligned(16)));
+
+static_assert(ShadowCascades::CascadeCount == 4, "ShadowData packs one cascade per vector lane");
+
+// One shadow caster. The model handle is resolved on the render thread; it goes stale
+// rather than dangling if the model is destroyed after the snapshot was taken. The entity's
+// world matrix is its record in the scene buffer.
+struct RenderableSnapshot
+{
+    Handle<Model> model;
+    uint32_t objectIndex;
+};
+
+// One mesh of a visible entity, drawn with the shader variant for its material. The mesh
+// handle is resolved on the render thread like the model handles above.
+struct MeshDrawSnapshot
+{
+    Handle<Mesh> mesh;
+    MTL::RenderPipelineState *pipeline;
+    uint32_t objectIndex;
+    uint32_t materialId;
+};
+
+// One merged batch of static geometry, already in world space. The batcher defers releasing
+// the buffers until the frames that drew them have completed
+struct StaticBatchSnapshot
+{
+    MTL::Buffer *vertexBuffer;
+    MTL::Buffer *indexBuffer;
+    uint32_t indexCount;
+    MTL::RenderPipelineState *pipeline;
+    uint32_t materialId;
+};
+
+// What one shadow map cascade draws, depth only
+struct ShadowCascadeSnapshot
+{
+    glm::mat4 viewProjection;
+    std::vector<RenderableSnapshot> casters;
+};
+
+// One view of the frame. What it draws are ranges of the snapshot's mesh draw and static batch
+// lists, each range sorted on its own.
+struct ViewSnapshot
+{
+    ViewData view;
+    ClusterParams clusterParams;
+
+    // Fraction of the render target, as in View
+    glm::vec4 viewport;
+
+    uint32_t firstMeshDraw;
+    uint32_t meshDrawCount;
+    uint32_t firstStaticBatch;
+    uint32_t staticBatchCount;
+};
+
+// Everything the render thread needs for one frame, copied out on the main thread so
+// encoding never reads state the simulation is still mutating
+struct SceneSnapshot
+{
+    uint64_t frameIndex = 0;
+
+    // When the main thread read the input this frame shows, on the FramePacer's clock
+    double inputTime = 0.0;
+
+    // The main view first
+    std::vector<ViewSnapshot> views;
+
+    LightData lightData;
+    std::vector<MeshDrawSnapshot> meshDraws;
+    std::vector<StaticBatchSnapshot> staticBatches;
+
+    // This frame's copies of the material and texture tables, and the textures they reference
+    MTL::Buffer *materialTable = nullptr;
+    MTL::Buffer *textureTable = nullptr;
+
+    // This frame's copy of the per-entity records
+    MTL::Buffer *sceneBuffer = nullptr;
+
+    // This frame's point lights with their per-cluster lists, built for the main view
+    LightListView lightList;
+
+    std::array<ShadowCascadeSnapshot, ShadowCascades::CascadeCount> shadowCascades;
+    ShadowData shadowData;
+    std::vector<MTL::Resource *> residentTextures;
+
+    ImGuiFrame imguiFrame;
+};
+
+// Lock-free single producer / single consumer handoff over three slots: one being
+// written, one being rendered and one waiting in between. publish() blocks until the
+// waiting snapshot has been picked up, which keeps the render thread at most one frame behind.
+class SceneSnapshotBuffer
+{
+public:
+    // Producer side
+    SceneSnapshot &beginWrite() { return slots[writeIndex]; }
+    void publish();
+
+    // Consumer side, blocks until a new snapshot arrives; nullptr once closed
+    SceneSnapshot *acquire();
+
+    void close();
+
+private:
+    static constexpr uint32_t IndexMask = 0x3;
+    static constexpr uint32_t FreshBit = 0x4;
+    static constexpr uint32_t ClosedBit = 0x8;
+
+    std::array<SceneSnapshot, 3> slots;
+    uint32_t writeIndex = 0;
+    uint32_t readIndex = 1;
+    std::atomic<uint32_t> mailbox{2};
+};
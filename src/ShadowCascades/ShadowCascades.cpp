@@ -0,0 +1,155 @@
+#include "ShadowCascades.hpp"
+#include "JobSystem.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+
+static constexpr size_t CullGrain = 4096;
+
+std::array<float, ShadowCascades::CascadeCount + 1> ShadowCascades::computeSplits(float nearPlane, float farPlane, float lambda)
+{
+    std::array<float, CascadeCount + 1> splits;
+    for (uint32_t i = 0; i <= CascadeCount; ++i)
+    {
+        float t = float(i) / float(CascadeCount);
+        float logarithmic = nearPlane * std::pow(farPlane / nearPlane, t);
+        float uniform = nearPlane + (farPlane - nearPlane) * t;
+        splits[i] = lambda * logarithmic + (1.0f - lambda) * uniform;
+    }
+
+    // Exact at the ends, whatever rounding did in between
+    splits[0] = nearPlane;
+    splits[CascadeCount] = farPlane;
+    return splits;
+}
+
+void ShadowCascades::fit(const View &view, const glm::vec3 &lightDirection)
+{
+    std::array<float, CascadeCount + 1> splits = computeSplits(view.nearPlane, view.farPlane);
+
+    glm::mat4 inverseView = glm::inverse(view.viewMatrix);
+    float tanY = std::tan(view.fovY * 0.5f);
+    float tanX = tanY * view.aspect;
+
+    // Rotation only, the same for every cascade
+    glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), -lightDirection, up);
+    glm::mat4 inverseRotation = glm::transpose(lightRotation);
+
+    for (uint32_t i = 0; i < CascadeCount; ++i)
+    {
+        ShadowCascade &cascade = cascades[i];
+        cascade.splitNear = splits[i];
+        cascade.splitFar = splits[i + 1];
+
+        // The slice is symmetric about the view axis, so its sphere does not change as the camera turns
+        glm::vec3 corners[8];
+        glm::vec3 centre(0.0f);
+        for (uint32_t c = 0; c < 8; ++c)
+        {
+            float depth = c < 4 ? cascade.splitNear : cascade.splitFar;
+            float x = (c & 1 ? 1.0f : -1.0f) * depth * tanX;
+            float y = (c & 2 ? 1.0f : -1.0f) * depth * tanY;
+            corners[c] = glm::vec3(inverseView * glm::vec4(x, y, -depth, 1.0f));
+            centre += corners[c] * 0.125f;
+        }
+
+        float radius = 0.0f;
+        for (const glm::vec3 &corner : corners)
+        {
+            radius = std::max(radius, glm::length(corner - centre));
+        }
+
+        // Rounded up so float noise cannot change the texel size from frame to frame
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+        cascade.radius = radius;
+        cascade.texelSize = 2.0f * radius / float(Resolution);
+
+        // Move the centre in whole texels across the light's view, shadow edges then stay put
+        glm::vec3 lightCentre = glm::vec3(lightRotation * glm::vec4(centre, 1.0f));
+        lightCentre.x = std::floor(lightCentre.x / cascade.texelSize) * cascade.texelSize;
+        lightCentre.y = std::floor(lightCentre.y / cascade.texelSize) * cascade.texelSize;
+        glm::vec3 snappedCentre = glm::vec3(inverseRotation * glm::vec4(lightCentre, 1.0f));
+
+        cascade.lightView = glm::translate(lightRotation, -snappedCentre);
+        cascade.casters.clear();
+        updateProjection(cascade, radius);
+    }
+}
+
+void ShadowCascades::updateProjection(ShadowCascade &cascade, float nearestCaster)
+{
+    // Light space looks down -z, from the nearest caster to the far side of the receivers
+    float r = cascade.radius;
+    glm::mat4 projection = glm::orthoRH_ZO(-r, r, -r, r, -std::max(nearestCaster, r), r);
+    cascade.viewProjection = projection * cascade.lightView;
+}
+
+void ShadowCascades::cull(const std::vector<Bounds> &worldBounds, const std::vector<uint32_t> &flags, uint32_t casterFlags, JobSystem &jobSystem)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    casterMasks.resize(worldBounds.size());
+
+    std::mutex nearestMutex;
+    std::array<float, CascadeCount> nearest;
+    nearest.fill(-FLT_MAX);
+
+    jobSystem.parallelFor(worldBounds.size(), [&](size_t begin, size_t end)
+                          {
+        std::array<float, CascadeCount> localNearest;
+        localNearest.fill(-FLT_MAX);
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint8_t mask = 0;
+            if ((flags[i] & casterFlags) && !worldBounds[i].isEmpty())
+            {
+                for (uint32_t c = 0; c < CascadeCount; ++c)
+                {
+                    const ShadowCascade &cascade = cascades[c];
+                    Bounds bounds = worldBounds[i].transformed(cascade.lightView);
+
+                    // Open towards the light: only the far side and the four sides bound casters
+                    float r = cascade.radius;
+                    if (bounds.max.x < -r || bounds.min.x > r || bounds.max.y < -r || bounds.min.y > r || bounds.max.z < -r)
+                        continue;
+
+                    mask |= uint8_t(1u << c);
+                    localNearest[c] = std::max(localNearest[c], bounds.max.z);
+                }
+            }
+            casterMasks[i] = mask;
+        }
+
+        std::lock_guard<std::mutex> lock(nearestMutex);
+        for (uint32_t c = 0; c < CascadeCount; ++c)
+        {
+            nearest[c] = std::max(nearest[c], localNearest[c]);
+        } }, CullGrain);
+
+    for (ShadowCascade &cascade : cascades)
+    {
+        cascade.casters.clear();
+    }
+
+    for (uint32_t i = 0; i < casterMasks.size(); ++i)
+    {
+        uint8_t mask = casterMasks[i];
+        while (mask)
+        {
+            uint32_t c = __builtin_ctz(mask);
+            mask &= mask - 1;
+            cascades[c].casters.push_back(i);
+        }
+    }
+
+    for (uint32_t c = 0; c < CascadeCount; ++c)
+    {
+        updateProjection(cascades[c], nearest[c]);
+    }
+
+    cullMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
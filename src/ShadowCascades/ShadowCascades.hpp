@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bounds.hpp"
+
+class JobSystem;
+
+// One slice of the view's depth range and the light-space box that covers it
+struct ShadowCascade
+{
+    // View depths the cascade covers
+    float splitNear = 0.0f;
+    float splitFar = 0.0f;
+
+    // Light space centred on the cascade, looking along the light. Receivers fill
+    // [-radius, radius] on every axis; casters may sit anywhere towards the light.
+    glm::mat4 lightView = glm::mat4(1.0f);
+    float radius = 0.0f;
+    float texelSize = 0.0f;
+
+    // Orthographic, depth 0 to 1, deep enough for the nearest caster found by cull
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+
+    // Dense scene indices of the entities that cast into the cascade
+    std::vector<uint32_t> casters;
+};
+
+// Cascaded shadow maps for a directional light. fit() splits the view's depth range between
+// uniform and logarithmic spacing, and puts an orthographic light box around each slice. The
+// box is sized from the slice's bounding sphere and its centre snapped to whole shadow map
+// texels, so shadow edges hold still as the camera turns and moves.
+//
+// cull() then finds each cascade's casters: entities whose world bounds overlap the box
+// sideways and reach its far side or anything between it and the light. Each cascade's depth
+// range is pulled towards the light to the nearest of them.
+//
+// No GPU types, so fitting and culling can be checked with known cameras.
+class ShadowCascades
+{
+public:
+    static constexpr uint32_t CascadeCount = 4;
+    static constexpr uint32_t Resolution = 2048;
+
+    // 0 splits uniformly, 1 logarithmically
+    static constexpr float SplitLambda = 0.75f;
+
+    struct View
+    {
+        glm::mat4 viewMatrix = glm::mat4(1.0f);
+        float fovY = 0.0f;
+        float aspect = 0.0f;
+        float nearPlane = 0.0f;
+        float farPlane = 0.0f;
+    };
+
+    // Split distances from nearPlane to farPlane, CascadeCount + 1 of them
+    static std::array<float, CascadeCount + 1> computeSplits(float nearPlane, float farPlane, float lambda = SplitLambda);
+
+    // lightDirection points from the scene towards the light
+    void fit(const View &view, const glm::vec3 &lightDirection);
+
+    // Entities cast when their flags share a bit with casterFlags
+    void cull(const std::vector<Bounds> &worldBounds, const std::vector<uint32_t> &flags, uint32_t casterFlags, JobSystem &jobSystem);
+
+    const ShadowCascade &getCascade(uint32_t index) const { return cascades[index]; }
+    float getCullMs() const { return cullMs; }
+
+private:
+    void updateProjection(ShadowCascade &cascade, float nearestCaster);
+
+    std::array<ShadowCascade, CascadeCount> cascades;
+
+    // Entities the last cull found in each cascade, as one bit per cascade
+    std::vector<uint8_t> casterMasks;
+    float cullMs = 0.0f;
+};
@@ -0,0 +1,3 @@
+#include "StateTracker.hpp"
+
+template class BasicStateTracker<MTL::RenderCommandEncoder>;
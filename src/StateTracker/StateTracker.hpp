@@ -0,0 +1,343 @@
+#pragma once
+
+#include <Metal/Metal.hpp>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+// Sits in front of a render command encoder and shadows what is bound: pipeline, depth
+// stencil state, winding, cull mode, and per stage the buffers with their offsets, inline
+// bytes, textures and samplers. Calls that would bind what is already bound are dropped, and
+// rebinding the same buffer at another offset only moves the offset. Draws sorted by state
+// then cost one call per change instead of one per draw.
+//
+// Binding indices past the shadowed range go straight through. Anything else that touches
+// the encoder directly must be followed by reset(). One tracker per encoder, render thread.
+//
+// The encoder is a template parameter so a recording stand-in can take its place in tests;
+// the renderer uses StateTracker, built once in StateTracker.cpp.
+template <typename Encoder>
+class BasicStateTracker
+{
+public:
+    static constexpr uint32_t MaxBuffers = 8;
+    static constexpr uint32_t MaxTextures = 8;
+    static constexpr uint32_t MaxSamplers = 4;
+
+    // Inline bytes up to this size are compared, larger ones always go through
+    static constexpr uint32_t MaxShadowedBytes = 16;
+
+    explicit BasicStateTracker(Encoder *encoder);
+
+    Encoder *getEncoder() const { return encoder; }
+
+    void setRenderPipelineState(MTL::RenderPipelineState *pipeline);
+    void setDepthStencilState(MTL::DepthStencilState *depthStencil);
+    void setFrontFacingWinding(MTL::Winding winding);
+    void setCullMode(MTL::CullMode cullMode);
+
+    void setVertexBuffer(MTL::Buffer *buffer, NS::UInteger offset, NS::UInteger index);
+    void setVertexBytes(const void *bytes, NS::UInteger length, NS::UInteger index);
+    void setFragmentBuffer(MTL::Buffer *buffer, NS::UInteger offset, NS::UInteger index);
+    void setFragmentBytes(const void *bytes, NS::UInteger length, NS::UInteger index);
+    void setFragmentTexture(MTL::Texture *texture, NS::UInteger index);
+    void setFragmentSamplerState(MTL::SamplerState *sampler, NS::UInteger index);
+
+    void drawIndexedPrimitives(MTL::PrimitiveType primitiveType, NS::UInteger indexCount, MTL::IndexType indexType,
+                               MTL::Buffer *indexBuffer, NS::UInteger indexBufferOffset, NS::UInteger instanceCount,
+                               NS::Integer baseVertex, NS::UInteger baseInstance);
+    void drawPrimitives(MTL::PrimitiveType primitiveType, NS::UInteger vertexStart, NS::UInteger vertexCount);
+
+    // Forgets everything shadowed, the next call of each kind goes through
+    void reset();
+
+    // State calls passed to the encoder and dropped as redundant, draws are counted apart
+    uint32_t getIssuedCount() const { return issuedCount; }
+    uint32_t getElidedCount() const { return elidedCount; }
+    uint32_t getDrawCount() const { return drawCount; }
+
+private:
+    struct BufferBinding
+    {
+        bool known = false;
+
+        // Either a buffer at an offset, or inline bytes kept for comparison
+        MTL::Buffer *buffer = nullptr;
+        NS::UInteger offset = 0;
+        uint32_t length = 0;
+        std::array<uint8_t, MaxShadowedBytes> bytes;
+    };
+
+    struct Stage
+    {
+        std::array<BufferBinding, MaxBuffers> buffers;
+        std::array<MTL::Texture *, MaxTextures> textures;
+        std::array<bool, MaxTextures> texturesKnown;
+        std::array<MTL::SamplerState *, MaxSamplers> samplers;
+        std::array<bool, MaxSamplers> samplersKnown;
+    };
+
+    enum class BufferAction
+    {
+        Skip,
+        SetOffset,
+        Set,
+    };
+
+    // Updates the shadow and says what the encoder needs to hear
+    BufferAction bindBuffer(Stage &stage, MTL::Buffer *buffer, NS::UInteger offset, NS::UInteger index);
+    bool bindBytes(Stage &stage, const void *bytes, NS::UInteger length, NS::UInteger index);
+
+    bool changed(bool redundant);
+
+    Encoder *encoder;
+
+    MTL::RenderPipelineState *pipeline = nullptr;
+    MTL::DepthStencilState *depthStencil = nullptr;
+    MTL::Winding winding = MTL::WindingClockwise;
+    MTL::CullMode cullMode = MTL::CullModeNone;
+    bool pipelineKnown = false;
+    bool depthStencilKnown = false;
+    bool windingKnown = false;
+    bool cullModeKnown = false;
+
+    Stage vertexStage;
+    Stage fragmentStage;
+
+    uint32_t issuedCount = 0;
+    uint32_t elidedCount = 0;
+    uint32_t drawCount = 0;
+};
+
+template <typename Encoder>
+BasicStateTracker<Encoder>::BasicStateTracker(Encoder *encoder)
+    : encoder(encoder)
+{
+    reset();
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::reset()
+{
+    pipelineKnown = false;
+    depthStencilKnown = false;
+    windingKnown = false;
+    cullModeKnown = false;
+
+    for (Stage *stage : {&vertexStage, &fragmentStage})
+    {
+        stage->buffers.fill(BufferBinding());
+        stage->textures.fill(nullptr);
+        stage->texturesKnown.fill(false);
+        stage->samplers.fill(nullptr);
+        stage->samplersKnown.fill(false);
+    }
+}
+
+template <typename Encoder>
+bool BasicStateTracker<Encoder>::changed(bool redundant)
+{
+    if (redundant)
+        elidedCount++;
+    else
+        issuedCount++;
+    return !redundant;
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setRenderPipelineState(MTL::RenderPipelineState *value)
+{
+    if (changed(pipelineKnown && pipeline == value))
+    {
+        encoder->setRenderPipelineState(value);
+        pipeline = value;
+        pipelineKnown = true;
+    }
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setDepthStencilState(MTL::DepthStencilState *value)
+{
+    if (changed(depthStencilKnown && depthStencil == value))
+    {
+        encoder->setDepthStencilState(value);
+        depthStencil = value;
+        depthStencilKnown = true;
+    }
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setFrontFacingWinding(MTL::Winding value)
+{
+    if (changed(windingKnown && winding == value))
+    {
+        encoder->setFrontFacingWinding(value);
+        winding = value;
+        windingKnown = true;
+    }
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setCullMode(MTL::CullMode value)
+{
+    if (changed(cullModeKnown && cullMode == value))
+    {
+        encoder->setCullMode(value);
+        cullMode = value;
+        cullModeKnown = true;
+    }
+}
+
+template <typename Encoder>
+typename BasicStateTracker<Encoder>::BufferAction BasicStateTracker<Encoder>::bindBuffer(Stage &stage, MTL::Buffer *buffer, NS::UInteger offset, NS::UInteger index)
+{
+    if (index >= MaxBuffers)
+    {
+        issuedCount++;
+        return BufferAction::Set;
+    }
+
+    BufferBinding &binding = stage.buffers[index];
+    BufferAction action = BufferAction::Set;
+    if (binding.known && binding.length == 0 && binding.buffer == buffer)
+        action = binding.offset == offset ? BufferAction::Skip : BufferAction::SetOffset;
+
+    binding.known = true;
+    binding.buffer = buffer;
+    binding.offset = offset;
+    binding.length = 0;
+
+    changed(action == BufferAction::Skip);
+    return action;
+}
+
+template <typename Encoder>
+bool BasicStateTracker<Encoder>::bindBytes(Stage &stage, const void *bytes, NS::UInteger length, NS::UInteger index)
+{
+    if (index >= MaxBuffers)
+    {
+        issuedCount++;
+        return true;
+    }
+
+    BufferBinding &binding = stage.buffers[index];
+    if (length == 0 || length > MaxShadowedBytes)
+    {
+        // Too large to keep, whatever is bound next has to go through
+        binding.known = false;
+        issuedCount++;
+        return true;
+    }
+
+    bool redundant = binding.known && binding.length == length && memcmp(binding.bytes.data(), bytes, length) == 0;
+
+    binding.known = true;
+    binding.buffer = nullptr;
+    binding.offset = 0;
+    binding.length = static_cast<uint32_t>(length);
+    memcpy(binding.bytes.data(), bytes, length);
+
+    return changed(redundant);
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setVertexBuffer(MTL::Buffer *buffer, NS::UInteger offset, NS::UInteger index)
+{
+    switch (bindBuffer(vertexStage, buffer, offset, index))
+    {
+    case BufferAction::Set:
+        encoder->setVertexBuffer(buffer, offset, index);
+        break;
+    case BufferAction::SetOffset:
+        encoder->setVertexBufferOffset(offset, index);
+        break;
+    case BufferAction::Skip:
+        break;
+    }
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setVertexBytes(const void *bytes, NS::UInteger length, NS::UInteger index)
+{
+    if (bindBytes(vertexStage, bytes, length, index))
+        encoder->setVertexBytes(bytes, length, index);
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setFragmentBuffer(MTL::Buffer *buffer, NS::UInteger offset, NS::UInteger index)
+{
+    switch (bindBuffer(fragmentStage, buffer, offset, index))
+    {
+    case BufferAction::Set:
+        encoder->setFragmentBuffer(buffer, offset, index);
+        break;
+    case BufferAction::SetOffset:
+        encoder->setFragmentBufferOffset(offset, index);
+        break;
+    case BufferAction::Skip:
+        break;
+    }
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setFragmentBytes(const void *bytes, NS::UInteger length, NS::UInteger index)
+{
+    if (bindBytes(fragmentStage, bytes, length, index))
+        encoder->setFragmentBytes(bytes, length, index);
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setFragmentTexture(MTL::Texture *texture, NS::UInteger index)
+{
+    if (index < MaxTextures)
+    {
+        if (!changed(fragmentStage.texturesKnown[index] && fragmentStage.textures[index] == texture))
+            return;
+
+        fragmentStage.textures[index] = texture;
+        fragmentStage.texturesKnown[index] = true;
+    }
+    else
+    {
+        issuedCount++;
+    }
+    encoder->setFragmentTexture(texture, index);
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::setFragmentSamplerState(MTL::SamplerState *sampler, NS::UInteger index)
+{
+    if (index < MaxSamplers)
+    {
+        if (!changed(fragmentStage.samplersKnown[index] && fragmentStage.samplers[index] == sampler))
+            return;
+
+        fragmentStage.samplers[index] = sampler;
+        fragmentStage.samplersKnown[index] = true;
+    }
+    else
+    {
+        issuedCount++;
+    }
+    encoder->setFragmentSamplerState(sampler, index);
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::drawIndexedPrimitives(MTL::PrimitiveType primitiveType, NS::UInteger indexCount, MTL::IndexType indexType,
+                                                       MTL::Buffer *indexBuffer, NS::UInteger indexBufferOffset, NS::UInteger instanceCount,
+                                                       NS::Integer baseVertex, NS::UInteger baseInstance)
+{
+    encoder->drawIndexedPrimitives(primitiveType, indexCount, indexType, indexBuffer, indexBufferOffset, instanceCount,
+                                   baseVertex, baseInstance);
+    drawCount++;
+}
+
+template <typename Encoder>
+void BasicStateTracker<Encoder>::drawPrimitives(MTL::PrimitiveType primitiveType, NS::UInteger vertexStart, NS::UInteger vertexCount)
+{
+    encoder->drawPrimitives(primitiveType, vertexStart, vertexCount);
+    drawCount++;
+}
+
+using StateTracker = BasicStateTracker<MTL::RenderCommandEncoder>;
+extern template class BasicStateTracker<MTL::RenderCommandEncoder>;
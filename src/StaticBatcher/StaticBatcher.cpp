@@ -0,0 +1,209 @@
+#include "StaticBatcher.hpp"
+#include "JobSystem.hpp"
+#include "ResourceManager.hpp"
+#include "Scene.hpp"
+#include <chrono>
+#include <unordered_map>
+
+namespace
+{
+    struct BatchKey
+    {
+        glm::ivec3 cell;
+        PipelineId pipeline;
+        uint32_t material;
+        uint32_t layers;
+
+        bool operator==(const BatchKey &other) const
+        {
+            return cell == other.cell && pipeline == other.pipeline && material == other.material && layers == other.layers;
+        }
+    };
+
+    struct BatchKeyHash
+    {
+        size_t operator()(const BatchKey &key) const
+        {
+            size_t h = std::hash<uint32_t>{}(key.pipeline);
+            for (uint32_t value : {uint32_t(key.cell.x), uint32_t(key.cell.y), uint32_t(key.cell.z), key.material, key.layers})
+            {
+                h ^= std::hash<uint32_t>{}(value) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            }
+            return h;
+        }
+    };
+
+    // One mesh of one static entity
+    struct Source
+    {
+        const Mesh *mesh;
+        uint32_t entity;
+    };
+}
+
+StaticBatcher::StaticBatcher(MTL::Device *device, ResourceManager &resources)
+    : device(device), resources(resources)
+{
+}
+
+StaticBatcher::~StaticBatcher()
+{
+    for (Batch &batch : batches)
+    {
+        batch.vertexBuffer->release();
+        batch.indexBuffer->release();
+    }
+}
+
+void StaticBatcher::update(const Scene &scene, JobSystem &jobSystem)
+{
+    // A model destroyed under a batch frees its material slot for reuse
+    if (scene.getStaticVersion() == builtVersion && materialsValid())
+        return;
+
+    rebuild(scene, jobSystem);
+    builtVersion = scene.getStaticVersion();
+}
+
+bool StaticBatcher::materialsValid() const
+{
+    for (const Batch &batch : batches)
+    {
+        if (!resources.get(batch.material))
+            return false;
+    }
+    return true;
+}
+
+void StaticBatcher::releaseBatches()
+{
+    // Snapshots already built still draw them
+    for (Batch &batch : batches)
+    {
+        resources.releaseLater(batch.vertexBuffer);
+        resources.releaseLater(batch.indexBuffer);
+    }
+    batches.clear();
+}
+
+void StaticBatcher::rebuild(const Scene &scene, JobSystem &jobSystem)
+{
+    auto start = std::chrono::steady_clock::now();
+    releaseBatches();
+
+    const std::vector<uint32_t> &flags = scene.getFlags();
+    const std::vector<ModelHandle> &models = scene.getModels();
+    const std::vector<PipelineId> &pipelines = scene.getPipelines();
+    const std::vector<glm::mat4> &worldMatrices = scene.getWorldMatrices();
+    const std::vector<Bounds> &worldBounds = scene.getWorldBounds();
+
+    // Group every static mesh by cell, pipeline, material and layers
+    std::unordered_map<BatchKey, size_t, BatchKeyHash> groupOf;
+    std::vector<std::vector<Source>> sources;
+    std::vector<size_t> vertexCounts;
+    std::vector<size_t> indexCounts;
+
+    entityCount = 0;
+    for (uint32_t i = 0; i < flags.size(); ++i)
+    {
+        if ((flags[i] & (EntityStatic | EntityVisible)) != (EntityStatic | EntityVisible) || pipelines[i] == InvalidPipeline)
+            continue;
+
+        Model *model = resources.get(models[i]);
+        if (!model)
+            continue;
+
+        glm::vec3 center = (worldBounds[i].min + worldBounds[i].max) * 0.5f;
+        glm::ivec3 cell = glm::ivec3(glm::floor(center / CellSize));
+        entityCount++;
+
+        for (MeshHandle handle : model->getMeshes())
+        {
+            const Mesh *mesh = resources.get(handle);
+            if (!mesh || mesh->getIndexCount() == 0 || !resources.get(mesh->getMaterial()))
+                continue;
+
+            uint32_t layers = entityLayers(flags[i]);
+            auto [it, inserted] = groupOf.try_emplace(BatchKey{cell, pipelines[i], mesh->getMaterial().value, layers}, batches.size());
+            if (inserted)
+            {
+                Batch &batch = batches.emplace_back();
+                batch.pipeline = pipelines[i];
+                batch.material = mesh->getMaterial();
+                batch.features = resources.get(batch.material)->getFeatures();
+                batch.layers = layers;
+                sources.emplace_back();
+                vertexCounts.push_back(0);
+                indexCounts.push_back(0);
+            }
+
+            size_t group = it->second;
+            sources[group].push_back({mesh, i});
+            vertexCounts[group] += mesh->getVertexCount();
+            indexCounts[group] += mesh->getIndexCount();
+            batches[group].bounds.add(worldBounds[i]);
+        }
+    }
+
+    // Transform and merge straight into the new buffers, a batch per job
+    jobSystem.parallelFor(batches.size(), [&](size_t begin, size_t end)
+                          {
+                              for (size_t group = begin; group < end; ++group)
+                              {
+                                  Batch &batch = batches[group];
+                                  batch.vertexBuffer = device->newBuffer(vertexCounts[group] * sizeof(VertexData), MTL::ResourceStorageModeShared);
+                                  batch.indexBuffer = device->newBuffer(indexCounts[group] * sizeof(uint32_t), MTL::ResourceStorageModeShared);
+                                  batch.indexCount = static_cast<uint32_t>(indexCounts[group]);
+
+                                  VertexData *vertices = static_cast<VertexData *>(batch.vertexBuffer->contents());
+                                  uint32_t *indices = static_cast<uint32_t *>(batch.indexBuffer->contents());
+                                  uint32_t base = 0;
+
+                                  for (const Source &source : sources[group])
+                                  {
+                                      const glm::mat4 &world = worldMatrices[source.entity];
+                                      glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(world)));
+
+                                      const VertexData *meshVertices = source.mesh->getVertices();
+                                      size_t vertexCount = source.mesh->getVertexCount();
+                                      for (size_t v = 0; v < vertexCount; ++v)
+                                      {
+                                          const VertexData &in = meshVertices[v];
+                                          glm::vec4 position = world * glm::vec4(in.position[0], in.position[1], in.position[2], in.position[3]);
+                                          glm::vec3 normal = normalMatrix * glm::vec3(in.normal[0], in.normal[1], in.normal[2]);
+                                          float length = glm::length(normal);
+                                          if (length > 0.0f)
+                                              normal /= length;
+
+                                          VertexData &out = vertices[base + v];
+                                          out.position = simd::float4{position.x, position.y, position.z, position.w};
+                                          out.normal = simd::float3{normal.x, normal.y, normal.z};
+                                          out.texcoord = in.texcoord;
+                                      }
+
+                                      const uint32_t *meshIndices = source.mesh->getIndices();
+                                      size_t indexCount = source.mesh->getIndexCount();
+                                      for (size_t k = 0; k < indexCount; ++k)
+                                      {
+                                          *indices++ = base + meshIndices[k];
+                                      }
+
+                                      base += static_cast<uint32_t>(vertexCount);
+                                  }
+                              } });
+
+    buildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    buildCount++;
+}
+
+void StaticBatcher::cull(const Frustum &frustum, uint32_t layerMask, PipelineManager &pipelineManager, std::vector<StaticBatchSnapshot> &visible) const
+{
+    for (const Batch &batch : batches)
+    {
+        if (!(batch.layers & layerMask) || !frustum.intersects(batch.bounds))
+            continue;
+
+        PipelineId variant = pipelineManager.getVariant(batch.pipeline, batch.features);
+        visible.push_back({batch.vertexBuffer, batch.indexBuffer, batch.indexCount, pipelineManager.resolve(variant), batch.material.index()});
+    }
+}
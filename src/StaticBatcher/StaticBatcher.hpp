@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Metal/Metal.hpp>
+#include <cstdint>
+#include <vector>
+#include "Bounds.hpp"
+#include "Material.hpp"
+#include "PipelineManager.hpp"
+#include "SceneSnapshot.hpp"
+
+class JobSystem;
+class ResourceManager;
+class Scene;
+
+// Pre-transforms the meshes of static entities into world space and merges them into one
+// vertex and index buffer per grid cell, pipeline, material and layers, so thousands of props that
+// never move draw as a handful of large draws with no per-entity transform. Each batch keeps
+// the bounds of the entities in it for culling.
+//
+// Batches are rebuilt from scratch, on workers, whenever the scene reports a change to its
+// static entities. Main thread only.
+class StaticBatcher
+{
+public:
+    // Batches never span more than one cell, which keeps their bounds tight enough to cull
+    static constexpr float CellSize = 64.0f;
+
+    StaticBatcher(MTL::Device *device, ResourceManager &resources);
+    StaticBatcher(const StaticBatcher &) = delete;
+    StaticBatcher &operator=(const StaticBatcher &) = delete;
+    ~StaticBatcher();
+
+    // After Scene::updateTransforms
+    void update(const Scene &scene, JobSystem &jobSystem);
+
+    // Appends the batches on a layer in layerMask touching the frustum, with the variant of their
+    // pipeline for their material resolved
+    void cull(const Frustum &frustum, uint32_t layerMask, PipelineManager &pipelineManager, std::vector<StaticBatchSnapshot> &visible) const;
+
+    size_t getBatchCount() const { return batches.size(); }
+    size_t getEntityCount() const { return entityCount; }
+    float getBuildMs() const { return buildMs; }
+    size_t getBuildCount() const { return buildCount; }
+
+private:
+    struct Batch
+    {
+        MTL::Buffer *vertexBuffer = nullptr;
+        MTL::Buffer *indexBuffer = nullptr;
+        uint32_t indexCount = 0;
+        PipelineId pipeline = InvalidPipeline;
+        MaterialHandle material;
+        uint32_t features = 0;
+        uint32_t layers = 0;
+        Bounds bounds;
+    };
+
+    void rebuild(const Scene &scene, JobSystem &jobSystem);
+    void releaseBatches();
+    bool materialsValid() const;
+
+    MTL::Device *device;
+    ResourceManager &resources;
+
+    std::vector<Batch> batches;
+    uint64_t builtVersion = 0;
+    size_t entityCount = 0;
+    float buildMs = 0.0f;
+    size_t buildCount = 0;
+};
@@ -0,0 +1,221 @@
+#include "TLSFAllocator.hpp"
+#include <algorithm>
+
+static uint32_t highestBit(uint64_t value)
+{
+    return 63 - __builtin_clzll(value);
+}
+
+TLSFAllocator::TLSFAllocator(uint32_t capacity)
+    : capacity(capacity)
+{
+    for (auto &heads : freeHeads)
+        heads.fill(InvalidBlock);
+
+    if (capacity > 0)
+    {
+        uint32_t block = newBlock();
+        blocks[block].size = capacity;
+        insertFree(block);
+    }
+}
+
+void TLSFAllocator::mapping(uint32_t size, uint32_t &firstLevel, uint32_t &secondLevel)
+{
+    if (size < SecondLevelCount)
+    {
+        firstLevel = 0;
+        secondLevel = size;
+        return;
+    }
+
+    uint32_t bit = highestBit(size);
+    firstLevel = bit - SecondLevelBits + 1;
+    secondLevel = (size >> (bit - SecondLevelBits)) - SecondLevelCount;
+}
+
+uint64_t TLSFAllocator::roundUp(uint32_t size)
+{
+    // Round up to the next class boundary, so any block in the class found is large enough
+    uint64_t rounded = size;
+    if (rounded >= SecondLevelCount)
+        rounded += (uint64_t(1) << (highestBit(rounded) - SecondLevelBits)) - 1;
+    return rounded;
+}
+
+uint32_t TLSFAllocator::capacityFor(uint32_t size)
+{
+    // The first size in the class the rounded request maps to
+    uint64_t rounded = roundUp(size);
+    if (rounded >= SecondLevelCount)
+        rounded &= ~((uint64_t(1) << (highestBit(rounded) - SecondLevelBits)) - 1);
+    return static_cast<uint32_t>(std::min<uint64_t>(rounded, UINT32_MAX));
+}
+
+TLSFAllocator::Allocation TLSFAllocator::allocate(uint32_t size)
+{
+    if (size == 0 || size > capacity - used)
+        return {};
+
+    uint64_t rounded = roundUp(size);
+    if (rounded > UINT32_MAX)
+        return {};
+
+    uint32_t firstLevel;
+    uint32_t secondLevel;
+    mapping(static_cast<uint32_t>(rounded), firstLevel, secondLevel);
+
+    uint32_t secondMap = secondLevelMaps[firstLevel] & (~0u << secondLevel);
+    if (!secondMap)
+    {
+        uint32_t firstMap = firstLevel + 1 < 32 ? firstLevelMap & (~0u << (firstLevel + 1)) : 0;
+        if (!firstMap)
+            return {};
+
+        firstLevel = __builtin_ctz(firstMap);
+        secondMap = secondLevelMaps[firstLevel];
+    }
+    secondLevel = __builtin_ctz(secondMap);
+
+    uint32_t block = freeHeads[firstLevel][secondLevel];
+    removeFree(block);
+
+    // The remainder goes back as a free block right after it
+    if (blocks[block].size > size)
+    {
+        uint32_t rest = newBlock();
+        Block &head = blocks[block];
+        Block &tail = blocks[rest];
+        tail.offset = head.offset + size;
+        tail.size = head.size - size;
+        tail.prevPhysical = block;
+        tail.nextPhysical = head.nextPhysical;
+        if (head.nextPhysical != InvalidBlock)
+            blocks[head.nextPhysical].prevPhysical = rest;
+        head.nextPhysical = rest;
+        head.size = size;
+        insertFree(rest);
+    }
+
+    used += size;
+    allocationCount++;
+    return {blocks[block].offset, size, block};
+}
+
+void TLSFAllocator::free(const Allocation &allocation)
+{
+    if (!allocation.isValid())
+        return;
+
+    uint32_t block = allocation.block;
+    used -= blocks[block].size;
+    allocationCount--;
+
+    uint32_t prev = blocks[block].prevPhysical;
+    if (prev != InvalidBlock && blocks[prev].free)
+    {
+        removeFree(prev);
+        blocks[prev].size += blocks[block].size;
+        blocks[prev].nextPhysical = blocks[block].nextPhysical;
+        if (blocks[block].nextPhysical != InvalidBlock)
+            blocks[blocks[block].nextPhysical].prevPhysical = prev;
+        unusedBlocks.push_back(block);
+        block = prev;
+    }
+
+    uint32_t next = blocks[block].nextPhysical;
+    if (next != InvalidBlock && blocks[next].free)
+    {
+        removeFree(next);
+        blocks[block].size += blocks[next].size;
+        blocks[block].nextPhysical = blocks[next].nextPhysical;
+        if (blocks[next].nextPhysical != InvalidBlock)
+            blocks[blocks[next].nextPhysical].prevPhysical = block;
+        unusedBlocks.push_back(next);
+    }
+
+    insertFree(block);
+}
+
+uint32_t TLSFAllocator::getLargestFree() const
+{
+    if (!firstLevelMap)
+        return 0;
+
+    // Every block in the highest non-empty class is larger than any block below it
+    uint32_t firstLevel = 31 - __builtin_clz(firstLevelMap);
+    uint32_t secondLevel = 31 - __builtin_clz(secondLevelMaps[firstLevel]);
+
+    uint32_t largest = 0;
+    for (uint32_t block = freeHeads[firstLevel][secondLevel]; block != InvalidBlock; block = blocks[block].nextFree)
+        largest = std::max(largest, blocks[block].size);
+    return largest;
+}
+
+float TLSFAllocator::getFragmentation() const
+{
+    uint32_t free = getFree();
+    if (free == 0)
+        return 0.0f;
+    return 1.0f - static_cast<float>(getLargestFree()) / static_cast<float>(free);
+}
+
+uint32_t TLSFAllocator::newBlock()
+{
+    if (!unusedBlocks.empty())
+    {
+        uint32_t block = unusedBlocks.back();
+        unusedBlocks.pop_back();
+        blocks[block] = Block();
+        return block;
+    }
+
+    blocks.emplace_back();
+    return static_cast<uint32_t>(blocks.size() - 1);
+}
+
+void TLSFAllocator::insertFree(uint32_t block)
+{
+    uint32_t firstLevel;
+    uint32_t secondLevel;
+    mapping(blocks[block].size, firstLevel, secondLevel);
+
+    uint32_t &head = freeHeads[firstLevel][secondLevel];
+    blocks[block].free = true;
+    blocks[block].prevFree = InvalidBlock;
+    blocks[block].nextFree = head;
+    if (head != InvalidBlock)
+        blocks[head].prevFree = block;
+    head = block;
+
+    firstLevelMap |= 1u << firstLevel;
+    secondLevelMaps[firstLevel] |= 1u << secondLevel;
+    freeBlockCount++;
+}
+
+void TLSFAllocator::removeFree(uint32_t block)
+{
+    uint32_t firstLevel;
+    uint32_t secondLevel;
+    mapping(blocks[block].size, firstLevel, secondLevel);
+
+    Block &entry = blocks[block];
+    if (entry.prevFree != InvalidBlock)
+        blocks[entry.prevFree].nextFree = entry.nextFree;
+    else
+        freeHeads[firstLevel][secondLevel] = entry.nextFree;
+    if (entry.nextFree != InvalidBlock)
+        blocks[entry.nextFree].prevFree = entry.prevFree;
+
+    if (freeHeads[firstLevel][secondLevel] == InvalidBlock)
+    {
+        secondLevelMaps[firstLevel] &= ~(1u << secondLevel);
+        if (!secondLevelMaps[firstLevel])
+            firstLevelMap &= ~(1u << firstLevel);
+    }
+
+    entry.free = false;
+    entry.prevFree = InvalidBlock;
+    entry.nextFree = InvalidBlock;
+    freeBlockCount--;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Two-level segregated fit allocator over a range of abstract units. Free blocks are kept in
+// lists by size class: the first level is the power of two, the second splits it into
+// SecondLevelCount linear steps, and two bitmaps find the smallest non-empty class that fits
+// in constant time. Freed blocks merge with their free neighbours straight away.
+//
+// It only does the bookkeeping, the caller decides what a unit is and owns the memory.
+// Not thread safe.
+class TLSFAllocator
+{
+public:
+    static constexpr uint32_t InvalidBlock = ~0u;
+
+    struct Allocation
+    {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        uint32_t block = InvalidBlock;
+
+        bool isValid() const { return block != InvalidBlock; }
+    };
+
+    explicit TLSFAllocator(uint32_t capacity = 0);
+
+    // Smallest capacity an empty allocator can serve allocate(size) from. Requests are rounded up
+    // to the next size class, so a pool of exactly size units is too small unless size starts one.
+    static uint32_t capacityFor(uint32_t size);
+
+    // Invalid when no free block is large enough, or for a size of zero
+    Allocation allocate(uint32_t size);
+    void free(const Allocation &allocation);
+
+    uint32_t getCapacity() const { return capacity; }
+    uint32_t getUsed() const { return used; }
+    uint32_t getFree() const { return capacity - used; }
+    uint32_t getAllocationCount() const { return allocationCount; }
+    uint32_t getFreeBlockCount() const { return freeBlockCount; }
+    uint32_t getLargestFree() const;
+
+    // 0 when all free space is one block, towards 1 as it splinters into small ones
+    float getFragmentation() const;
+
+private:
+    static constexpr uint32_t SecondLevelBits = 4;
+    static constexpr uint32_t SecondLevelCount = 1u << SecondLevelBits;
+
+    // Sizes below SecondLevelCount share the first list linearly, the rest start at 1
+    static constexpr uint32_t FirstLevelCount = 32 - SecondLevelBits + 1;
+
+    struct Block
+    {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        uint32_t prevPhysical = InvalidBlock;
+        uint32_t nextPhysical = InvalidBlock;
+        uint32_t prevFree = InvalidBlock;
+        uint32_t nextFree = InvalidBlock;
+        bool free = false;
+    };
+
+    static void mapping(uint32_t size, uint32_t &firstLevel, uint32_t &secondLevel);
+    static uint64_t roundUp(uint32_t size);
+
+    uint32_t newBlock();
+    void insertFree(uint32_t block);
+    void removeFree(uint32_t block);
+
+    uint32_t capacity;
+    uint32_t used = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeBlockCount = 0;
+
+    std::vector<Block> blocks;
+    std::vector<uint32_t> unusedBlocks;
+
+    uint32_t firstLevelMap = 0;
+    std::array<uint32_t, FirstLevelCount> secondLevelMaps{};
+    std::array<std::array<uint32_t, SecondLevelCount>, FirstLevelCount> freeHeads;
+};
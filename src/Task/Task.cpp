@@ -0,0 +1,52 @@
+#include "Task.hpp"
+#include <fstream>
+
+void UploadStage::submit(JobFunction function)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(function));
+        if (active)
+            return;
+        active = true;
+    }
+
+    jobSystem.schedule([this]()
+                       { drain(); }, &drainCounter);
+}
+
+void UploadStage::drain()
+{
+    while (true)
+    {
+        JobFunction function;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending.empty())
+            {
+                active = false;
+                return;
+            }
+            function = std::move(pending.front());
+            pending.pop_front();
+        }
+
+        function();
+    }
+}
+
+std::optional<std::vector<char>> readFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return std::nullopt;
+
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::vector<char> data(static_cast<size_t>(size));
+    if (size > 0 && !file.read(data.data(), size))
+        return std::nullopt;
+
+    return data;
+}
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "JobSystem.hpp"
+
+template <typename T = void>
+class Task;
+
+namespace detail
+{
+    struct TaskPromiseBase
+    {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        // Tasks are lazy, nothing runs until they are awaited or spawned
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                std::coroutine_handle<> next = handle.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    template <typename T>
+    struct TaskPromise : TaskPromiseBase
+    {
+        std::optional<T> value;
+
+        Task<T> get_return_object() noexcept;
+
+        template <typename U>
+        void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+
+        T result()
+        {
+            if (exception)
+                std::rethrow_exception(exception);
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase
+    {
+        Task<void> get_return_object() noexcept;
+
+        void return_void() noexcept {}
+
+        void result()
+        {
+            if (exception)
+                std::rethrow_exception(exception);
+        }
+    };
+
+    // Eagerly started, self-destroying coroutine used to drive a Task from outside
+    struct DetachedTask
+    {
+        struct promise_type
+        {
+            DetachedTask get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+}
+
+template <typename T>
+class Task
+{
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task() = default;
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool isReady() const { return !handle || handle.done(); }
+
+    // Only valid once isReady(), rethrows whatever the coroutine threw
+    T result() { return handle.promise().result(); }
+
+    auto operator co_await() noexcept
+    {
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return handle.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            T await_resume() { return handle.promise().result(); }
+        };
+
+        return Awaiter{handle};
+    }
+
+    // Awaits completion without consuming the result or rethrowing
+    auto whenReady() noexcept
+    {
+        struct Awaiter
+        {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return handle.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        return Awaiter{handle};
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail
+{
+    template <typename T>
+    Task<T> TaskPromise<T>::get_return_object() noexcept
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() noexcept
+    {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+}
+
+// Serial stage for GPU resource creation and uploads. Work runs on the job system one
+// item at a time in submission order, which bounds staging memory and keeps uploads off
+// the main thread. Coroutines resumed here should hop back to a worker before heavy CPU work.
+class UploadStage
+{
+public:
+    explicit UploadStage(JobSystem &jobSystem) : jobSystem(jobSystem) {}
+
+    // The drain job in flight points at the stage, wait for it to return
+    ~UploadStage() { jobSystem.wait(drainCounter); }
+
+    void submit(JobFunction function);
+
+private:
+    void drain();
+
+    JobSystem &jobSystem;
+    JobCounter drainCounter;
+    std::mutex mutex;
+    std::deque<JobFunction> pending;
+    bool active = false;
+};
+
+struct ResumeOnWorker
+{
+    JobSystem &jobSystem;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { jobSystem.schedule([handle]() { handle.resume(); }); }
+    void await_resume() noexcept {}
+};
+
+struct ResumeOnMainThread
+{
+    JobSystem &jobSystem;
+
+    bool await_ready() const noexcept { return jobSystem.isMainThread(); }
+    void await_suspend(std::coroutine_handle<> handle) { jobSystem.runOnMainThread([handle]() { handle.resume(); }); }
+    void await_resume() noexcept {}
+};
+
+struct ResumeOnUploadStage
+{
+    UploadStage &uploadStage;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { uploadStage.submit([handle]() { handle.resume(); }); }
+    void await_resume() noexcept {}
+};
+
+// Resumes once every job tracked by the counter has finished. Always goes through
+// scheduleAfter so the counter is never touched after its last release.
+struct CounterAwaiter
+{
+    JobSystem &jobSystem;
+    JobCounter &counter;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { jobSystem.scheduleAfter(counter, [handle]() { handle.resume(); }); }
+    void await_resume() noexcept {}
+};
+
+std::optional<std::vector<char>> readFile(const std::string &path);
+
+// Reads the whole file on a worker and resumes there with its contents
+struct FileReadAwaiter
+{
+    JobSystem &jobSystem;
+    std::string path;
+    std::optional<std::vector<char>> data;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        jobSystem.schedule([this, handle]()
+                           {
+                               data = readFile(path);
+                               handle.resume(); });
+    }
+
+    std::optional<std::vector<char>> await_resume() { return std::move(data); }
+};
+
+inline ResumeOnWorker resumeOnWorker(JobSystem &jobSystem) { return {jobSystem}; }
+inline ResumeOnMainThread resumeOnMainThread(JobSystem &jobSystem) { return {jobSystem}; }
+inline ResumeOnUploadStage resumeOnUploadStage(UploadStage &uploadStage) { return {uploadStage}; }
+inline FileReadAwaiter readFileAsync(JobSystem &jobSystem, std::string path) { return {jobSystem, std::move(path), std::nullopt}; }
+
+// Starts the task on a worker; the counter stays open until it completes
+template <typename T>
+void spawn(JobSystem &jobSystem, Task<T> &task, JobCounter &counter)
+{
+    jobSystem.retain(counter);
+
+    [](JobSystem &jobSystem, Task<T> &task, JobCounter &counter) -> detail::DetachedTask
+    {
+        co_await resumeOnWorker(jobSystem);
+        co_await task.whenReady();
+        jobSystem.release(counter);
+    }(jobSystem, task, counter);
+}
+
+template <typename T>
+Task<std::vector<T>> whenAll(JobSystem &jobSystem, std::vector<Task<T>> tasks)
+{
+    JobCounter counter;
+    for (auto &task : tasks)
+        spawn(jobSystem, task, counter);
+
+    co_await CounterAwaiter{jobSystem, counter};
+
+    std::vector<T> results;
+    results.reserve(tasks.size());
+    for (auto &task : tasks)
+        results.push_back(task.result());
+
+    co_return results;
+}
+
+// Blocks the calling thread, helping with jobs (and main thread work) until the task is done
+template <typename T>
+T syncWait(JobSystem &jobSystem, Task<T> task)
+{
+    JobCounter counter;
+    spawn(jobSystem, task, counter);
+    jobSystem.wait(counter);
+    return task.result();
+}
@@ -1,36 +1,127 @@
 #include "Texture.hpp"
+#include <algorithm>
+#include <utility>
 
-Texture::Texture(const char *filepath, MTL::Device *metalDevice)
-    : device(metalDevice)
+static bool convertSurface(SDL_Surface *image, ImageData &imageData)
+{
+    SDL_Surface *convertedImage = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ABGR8888, 0);
+    if (!convertedImage)
+    {
+        std::cerr << "SDL_ConvertSurfaceFormat Error: " << SDL_GetError() << std::endl;
+        SDL_FreeSurface(image);
+        return false;
+    }
+
+    imageData.width = convertedImage->w;
+    imageData.height = convertedImage->h;
+
+    size_t dataSize = imageData.width * imageData.height * 4;
+    imageData.pixels.resize(dataSize);
+    for (int y = 0; y < imageData.height; ++y)
+    {
+        memcpy(imageData.pixels.data() + (imageData.height - 1 - y) * imageData.width * 4,
+               static_cast<unsigned char *>(convertedImage->pixels) + y * convertedImage->pitch,
+               imageData.width * 4);
+    }
+
+    SDL_FreeSurface(convertedImage);
+    SDL_FreeSurface(image);
+    return true;
+}
+
+bool Texture::decode(const void *data, size_t size, const std::string &name, ImageData &imageData)
+{
+    SDL_RWops *stream = SDL_RWFromConstMem(data, static_cast<int>(size));
+    SDL_Surface *image = stream ? IMG_Load_RW(stream, 1) : nullptr;
+
+    if (!image)
+    {
+        std::cerr << "IMG_Load Error (" << name << "): " << IMG_GetError() << std::endl;
+        return false;
+    }
+
+    return convertSurface(image, imageData);
+}
+
+bool Texture::decodeFile(const char *filepath, ImageData &imageData)
 {
     SDL_Surface *image = IMG_Load(filepath);
 
     if (!image)
     {
         std::cerr << "IMG_Load Error: " << IMG_GetError() << std::endl;
-        return;
+        return false;
     }
 
-    SDL_Surface *convertedImage = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ABGR8888, 0);
-    if (!convertedImage)
-    {
-        std::cerr << "SDL_ConvertSurfaceFormat Error: " << SDL_GetError() << std::endl;
-        SDL_FreeSurface(image);
+    return convertSurface(image, imageData);
+}
+
+Texture::Texture(const char *filepath, MTL::Device *metalDevice)
+    : device(metalDevice)
+{
+    ImageData image;
+    if (!decodeFile(filepath, image))
         return;
-    }
 
-    width = convertedImage->w;
-    height = convertedImage->h;
-    channels = convertedImage->format->BytesPerPixel;
+    upload(image);
+
+    if (texture)
+        std::cout << "Texture loaded successfully: " << filepath << std::endl;
+}
+
+Texture::Texture(const ImageData &image, MTL::Device *metalDevice)
+    : device(metalDevice)
+{
+    upload(image);
+}
+
+Texture::Texture(const std::vector<ImageData> &mips, uint32_t residentMip, const std::string &path, MTL::Device *metalDevice)
+    : device(metalDevice), width(mips[0].width), height(mips[0].height), channels(4),
+      mipCount(static_cast<uint32_t>(mips.size())), residentMip(residentMip), path(path)
+{
+    texture = createMTLTexture(device, mips, residentMip);
+}
+
+Texture::Texture(Texture &&other) noexcept
+    : device(other.device), texture(std::exchange(other.texture, nullptr)),
+      width(other.width), height(other.height), channels(other.channels),
+      mipCount(other.mipCount), residentMip(other.residentMip), path(std::move(other.path))
+{
+}
 
-    size_t dataSize = width * height * 4;
-    unsigned char *flippedPixels = new unsigned char[dataSize];
-    for (int y = 0; y < height; ++y)
+Texture &Texture::operator=(Texture &&other) noexcept
+{
+    if (this != &other)
     {
-        memcpy(flippedPixels + (height - 1 - y) * width * 4,
-               static_cast<unsigned char *>(convertedImage->pixels) + y * convertedImage->pitch,
-               width * 4);
+        if (texture)
+            texture->release();
+
+        device = other.device;
+        texture = std::exchange(other.texture, nullptr);
+        width = other.width;
+        height = other.height;
+        channels = other.channels;
+        mipCount = other.mipCount;
+        residentMip = other.residentMip;
+        path = std::move(other.path);
     }
+    return *this;
+}
+
+Texture::~Texture()
+{
+    if (texture)
+    {
+        texture->release();
+        texture = nullptr;
+    }
+}
+
+void Texture::upload(const ImageData &image)
+{
+    width = image.width;
+    height = image.height;
+    channels = 4;
 
     MTL::TextureDescriptor *textureDescriptor = MTL::TextureDescriptor::alloc()->init();
     textureDescriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
@@ -40,34 +131,90 @@ Texture::Texture(const char *filepath, MTL::Device *metalDevice)
     textureDescriptor->setUsage(MTL::TextureUsageShaderRead);
 
     texture = device->newTexture(textureDescriptor);
+    textureDescriptor->release();
+
     if (!texture)
     {
         std::cerr << "Failed to create Metal texture." << std::endl;
-        delete[] flippedPixels;
-        SDL_FreeSurface(convertedImage);
-        SDL_FreeSurface(image);
-        textureDescriptor->release();
         return;
     }
 
     MTL::Region region = MTL::Region::Make2D(0, 0, width, height);
     NS::UInteger bytesPerRow = 4 * width;
 
-    texture->replaceRegion(region, 0, flippedPixels, bytesPerRow);
+    texture->replaceRegion(region, 0, image.pixels.data(), bytesPerRow);
+}
 
-    delete[] flippedPixels;
-    SDL_FreeSurface(convertedImage);
-    SDL_FreeSurface(image);
-    textureDescriptor->release();
+void Texture::generateMips(ImageData image, std::vector<ImageData> &mips)
+{
+    mips.clear();
+    mips.push_back(std::move(image));
 
-    std::cout << "Texture loaded successfully: " << filepath << std::endl;
+    while (mips.back().width > 1 || mips.back().height > 1)
+    {
+        const ImageData &source = mips.back();
+        ImageData mip;
+        mip.width = std::max(source.width / 2, 1);
+        mip.height = std::max(source.height / 2, 1);
+        mip.pixels.resize(size_t(mip.width) * mip.height * 4);
+
+        // Odd sizes drop their last row or column, clamped so 1 pixel wide levels still read in bounds
+        for (int y = 0; y < mip.height; ++y)
+        {
+            int y0 = std::min(y * 2, source.height - 1);
+            int y1 = std::min(y * 2 + 1, source.height - 1);
+            for (int x = 0; x < mip.width; ++x)
+            {
+                int x0 = std::min(x * 2, source.width - 1);
+                int x1 = std::min(x * 2 + 1, source.width - 1);
+                for (int c = 0; c < 4; ++c)
+                {
+                    int sum = source.pixels[(size_t(y0) * source.width + x0) * 4 + c] +
+                              source.pixels[(size_t(y0) * source.width + x1) * 4 + c] +
+                              source.pixels[(size_t(y1) * source.width + x0) * 4 + c] +
+                              source.pixels[(size_t(y1) * source.width + x1) * 4 + c];
+                    mip.pixels[(size_t(y) * mip.width + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+
+        mips.push_back(std::move(mip));
+    }
 }
 
-Texture::~Texture()
+MTL::Texture *Texture::createMTLTexture(MTL::Device *device, const std::vector<ImageData> &mips, uint32_t firstMip)
 {
-    if (texture)
+    const ImageData &top = mips[firstMip];
+
+    MTL::TextureDescriptor *textureDescriptor = MTL::TextureDescriptor::alloc()->init();
+    textureDescriptor->setPixelFormat(MTL::PixelFormatRGBA8Unorm);
+    textureDescriptor->setWidth(top.width);
+    textureDescriptor->setHeight(top.height);
+    textureDescriptor->setMipmapLevelCount(mips.size() - firstMip);
+    textureDescriptor->setTextureType(MTL::TextureType2D);
+    textureDescriptor->setUsage(MTL::TextureUsageShaderRead);
+
+    MTL::Texture *texture = device->newTexture(textureDescriptor);
+    textureDescriptor->release();
+
+    if (!texture)
     {
-        texture->release();
-        texture = nullptr;
+        std::cerr << "Failed to create Metal texture." << std::endl;
+        return nullptr;
+    }
+
+    for (uint32_t mip = firstMip; mip < mips.size(); ++mip)
+    {
+        const ImageData &level = mips[mip];
+        MTL::Region region = MTL::Region::Make2D(0, 0, level.width, level.height);
+        texture->replaceRegion(region, mip - firstMip, level.pixels.data(), 4 * level.width);
     }
+
+    return texture;
+}
+
+MTL::Texture *Texture::replace(MTL::Texture *newTexture, uint32_t newResidentMip)
+{
+    residentMip = newResidentMip;
+    return std::exchange(texture, newTexture);
 }
@@ -2,17 +2,71 @@
 #include <Metal/Metal.hpp>
 #include <SDL2/SDL_image.h>
 #include <iostream>
+#include <string>
+#include <vector>
+#include "ResourcePool.hpp"
+
+// Decoded RGBA8 pixels, flipped so row 0 is the bottom of the image
+struct ImageData
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+class Texture;
+
+using TextureHandle = Handle<Texture>;
 
 class Texture
 {
 public:
+    // Streamable textures are created with only the mips up to this size resident
+    static constexpr int StreamingBaseSize = 64;
+
     Texture(const char *filepath, MTL::Device *metalDevice);
+    Texture(const ImageData &image, MTL::Device *metalDevice);
+
+    // Streamable texture: mips holds the full chain, only levels from residentMip down are
+    // uploaded. path is where the finer levels are read back from when they are needed.
+    Texture(const std::vector<ImageData> &mips, uint32_t residentMip, const std::string &path, MTL::Device *metalDevice);
+    Texture(Texture &&other) noexcept;
+    Texture &operator=(Texture &&other) noexcept;
+    Texture(const Texture &) = delete;
+    Texture &operator=(const Texture &) = delete;
     ~Texture();
 
+    // CPU only, safe to call from any thread
+    static bool decode(const void *data, size_t size, const std::string &name, ImageData &image);
+    static bool decodeFile(const char *filepath, ImageData &image);
+
+    // Box filtered chain down to 1x1, mips[0] is the image itself. CPU only.
+    static void generateMips(ImageData image, std::vector<ImageData> &mips);
+
+    // A texture holding mips[firstMip] onwards, or nullptr. Any thread.
+    static MTL::Texture *createMTLTexture(MTL::Device *device, const std::vector<ImageData> &mips, uint32_t firstMip);
+
     MTL::Texture* getMTLTexture() const { return texture; }
+    size_t getAllocatedSize() const { return texture ? texture->allocatedSize() : 0; }
+
+    // Full resolution size and mip count, whatever is resident
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    uint32_t getMipCount() const { return mipCount; }
+    uint32_t getResidentMip() const { return residentMip; }
+    const std::string &getPath() const { return path; }
+
+    // Swaps in a texture holding the chain from residentMip and returns the previous one for
+    // the caller to release. Main thread, with the resource manager locked exclusively.
+    MTL::Texture *replace(MTL::Texture *newTexture, uint32_t newResidentMip);
 
 private:
+    void upload(const ImageData &image);
+
     MTL::Device *device;
     MTL::Texture *texture = nullptr;
     int width = 0, height = 0, channels = 0;
+    uint32_t mipCount = 1;
+    uint32_t residentMip = 0;
+    std::string path;
 };
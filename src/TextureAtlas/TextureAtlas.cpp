@@ -0,0 +1,134 @@
+#include "TextureAtlas.hpp"
+#include <algorithm>
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+
+static bool atlasEnabled = true;
+
+static int alignUp(int value, int alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void TextureAtlas::setEnabled(bool enabled)
+{
+    atlasEnabled = enabled;
+}
+
+bool TextureAtlas::isEnabled()
+{
+    return atlasEnabled;
+}
+
+size_t TextureAtlas::pack(const std::vector<const ImageData *> &images)
+{
+    std::vector<stbrp_rect> rects(images.size());
+    size_t area = 0;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        rects[i].id = static_cast<int>(i);
+        rects[i].w = alignUp(images[i]->width, Padding) + 2 * Padding;
+        rects[i].h = alignUp(images[i]->height, Padding) + 2 * Padding;
+        area += size_t(rects[i].w) * rects[i].h;
+    }
+
+    // Smallest power of two page that could hold the area, doubled until everything fits
+    int pageSize = Padding;
+    while (pageSize < MaxPageSize && size_t(pageSize) * pageSize < area)
+        pageSize *= 2;
+
+    std::vector<stbrp_node> nodes(MaxPageSize);
+    for (;; pageSize *= 2)
+    {
+        stbrp_context context;
+        stbrp_init_target(&context, pageSize, pageSize, nodes.data(), pageSize);
+        if (stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size())) || pageSize >= MaxPageSize)
+            break;
+    }
+
+    regions.assign(images.size(), AtlasRegion());
+    width = 0;
+    height = 0;
+
+    packedCount = 0;
+    for (const stbrp_rect &rect : rects)
+    {
+        if (!rect.was_packed)
+            continue;
+
+        AtlasRegion &region = regions[rect.id];
+        region.x = rect.x + Padding;
+        region.y = rect.y + Padding;
+        region.width = images[rect.id]->width;
+        region.height = images[rect.id]->height;
+        region.packed = true;
+
+        width = std::max(width, rect.x + rect.w);
+        height = std::max(height, rect.y + rect.h);
+        packedCount++;
+    }
+
+    return packedCount;
+}
+
+float TextureAtlas::getEfficiency() const
+{
+    if (width == 0 || height == 0)
+        return 0.0f;
+
+    size_t used = 0;
+    for (const AtlasRegion &region : regions)
+    {
+        if (region.packed)
+            used += size_t(region.width) * region.height;
+    }
+    return static_cast<float>(used) / (float(width) * float(height));
+}
+
+simd::float2 TextureAtlas::remap(size_t index, simd::float2 texcoord) const
+{
+    const AtlasRegion &region = regions[index];
+    return simd::float2{(region.x + texcoord.x * region.width) / width,
+                        (region.y + texcoord.y * region.height) / height};
+}
+
+void TextureAtlas::buildMips(const std::vector<const ImageData *> &images, std::vector<ImageData> &mips) const
+{
+    ImageData page;
+    page.width = width;
+    page.height = height;
+    page.pixels.assign(size_t(width) * height * 4, 0);
+
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        const AtlasRegion &region = regions[i];
+        if (!region.packed)
+            continue;
+
+        // The gutter repeats the nearest edge pixel, as clamp to edge would
+        const ImageData &image = *images[i];
+        int right = region.x + alignUp(region.width, Padding) + Padding;
+        int top = region.y + alignUp(region.height, Padding) + Padding;
+        for (int y = region.y - Padding; y < top; ++y)
+        {
+            int sourceY = std::clamp(y - region.y, 0, image.height - 1);
+            for (int x = region.x - Padding; x < right; ++x)
+            {
+                int sourceX = std::clamp(x - region.x, 0, image.width - 1);
+                std::copy_n(&image.pixels[(size_t(sourceY) * image.width + sourceX) * 4], 4,
+                            &page.pixels[(size_t(y) * width + x) * 4]);
+            }
+        }
+    }
+
+    Texture::generateMips(std::move(page), mips);
+
+    // Below this level one texel spans an image and its neighbour's gutter
+    size_t levels = 1;
+    for (int gutter = Padding; gutter > 1; gutter /= 2)
+        levels++;
+    if (mips.size() > levels)
+        mips.resize(levels);
+}
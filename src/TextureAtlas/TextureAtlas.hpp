@@ -0,0 +1,59 @@
+#pragma once
+
+#include <simd/simd.h>
+#include <vector>
+#include "Texture.hpp"
+
+// Where one source image landed in the atlas, in pixels
+struct AtlasRegion
+{
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    bool packed = false;
+};
+
+// Packs small images into a single RGBA8 page with imstb_rectpack, so materials that only
+// differ by their diffuse texture can share one bind and one draw. Every image sits in a
+// gutter of its own edge pixels, aligned so the first few mips never bleed into neighbours.
+// CPU only, safe on any thread.
+class TextureAtlas
+{
+public:
+    // Images larger than this keep their own (streamed) texture
+    static constexpr int MaxImageSize = 256;
+    static constexpr int MaxPageSize = 2048;
+
+    // Gutter around each image, and the alignment of every image and of the page. Mips are
+    // kept down to the level where the gutter is one texel wide.
+    static constexpr int Padding = 8;
+
+    // Off with --no-atlas, set before any model loads
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    // Packs images into the smallest square page that holds them all, or a MaxPageSize page
+    // holding as many as fit. Returns the number of images packed.
+    size_t pack(const std::vector<const ImageData *> &images);
+
+    const std::vector<AtlasRegion> &getRegions() const { return regions; }
+    size_t getPackedCount() const { return packedCount; }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // Fraction of the page covered by packed images, gutters not counted
+    float getEfficiency() const;
+
+    // Maps a texcoord in [0, 1] on image index into the page
+    simd::float2 remap(size_t index, simd::float2 texcoord) const;
+
+    // Page and its mips, composed from the images given to pack
+    void buildMips(const std::vector<const ImageData *> &images, std::vector<ImageData> &mips) const;
+
+private:
+    std::vector<AtlasRegion> regions;
+    size_t packedCount = 0;
+    int width = 0;
+    int height = 0;
+};
@@ -0,0 +1,296 @@
+#include "TextureStreamer.hpp"
+#include "ResourceManager.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Reads the source again and creates a texture holding the chain from targetMip
+static Task<MTL::Texture *> streamIn(JobSystem &jobSystem, UploadStage &uploadStage, MTL::Device *device, std::string path, uint32_t targetMip)
+{
+    auto bytes = co_await readFileAsync(jobSystem, path);
+
+    ImageData image;
+    if (!bytes || !Texture::decode(bytes->data(), bytes->size(), path, image))
+        co_return nullptr;
+
+    std::vector<ImageData> mips;
+    Texture::generateMips(std::move(image), mips);
+    if (targetMip >= mips.size())
+        co_return nullptr;
+
+    co_await resumeOnUploadStage(uploadStage);
+    co_return Texture::createMTLTexture(device, mips, targetMip);
+}
+
+// Copies the coarser levels of a resident texture into a smaller one. Takes over the
+// reference the caller retained on source.
+static Task<MTL::Texture *> evict(UploadStage &uploadStage, MTL::Device *device, MTL::Texture *source, uint32_t droppedLevels)
+{
+    co_await resumeOnUploadStage(uploadStage);
+
+    std::vector<ImageData> mips(source->mipmapLevelCount() - droppedLevels);
+    for (uint32_t level = 0; level < mips.size(); ++level)
+    {
+        ImageData &mip = mips[level];
+        mip.width = std::max<int>(source->width() >> (level + droppedLevels), 1);
+        mip.height = std::max<int>(source->height() >> (level + droppedLevels), 1);
+        mip.pixels.resize(size_t(mip.width) * mip.height * 4);
+        source->getBytes(mip.pixels.data(), 4 * mip.width, MTL::Region::Make2D(0, 0, mip.width, mip.height), level + droppedLevels);
+    }
+
+    source->release();
+    co_return Texture::createMTLTexture(device, mips, 0);
+}
+
+// Size of an RGBA8 chain from mip down to 1x1
+static int64_t chainBytes(int width, int height, uint32_t mip, uint32_t mipCount)
+{
+    int64_t bytes = 0;
+    for (uint32_t level = mip; level < mipCount; ++level)
+    {
+        bytes += int64_t(std::max(width >> level, 1)) * std::max(height >> level, 1) * 4;
+    }
+    return bytes;
+}
+
+// Finest mip that still keeps the texture no larger than StreamingBaseSize, never evicted past
+static uint32_t baseMip(const Texture &texture)
+{
+    uint32_t mip = 0;
+    while (mip + 1 < texture.getMipCount() && std::max(texture.getWidth() >> mip, texture.getHeight() >> mip) > Texture::StreamingBaseSize)
+        mip++;
+    return mip;
+}
+
+TextureStreamer::TextureStreamer(JobSystem &jobSystem, UploadStage &uploadStage, ResourceManager &resources, MTL::Device *device)
+    : jobSystem(jobSystem), uploadStage(uploadStage), resources(resources), device(device)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    for (auto &request : requests)
+    {
+        jobSystem.wait(request->counter);
+        if (MTL::Texture *texture = request->task.result())
+            texture->release();
+    }
+}
+
+void TextureStreamer::update(const Scene &scene, const std::vector<uint32_t> &visible, const glm::vec3 &cameraPosition,
+                             float projectionScale, uint64_t frameIndex)
+{
+    finishRequests();
+    collectRequiredMips(scene, visible, cameraPosition, projectionScale, frameIndex);
+
+    // Resident sizes, and states of textures that have since been destroyed
+    ResourcePool<Texture> &textures = resources.getTextures();
+    residentBytes = 0;
+    for (const Texture &texture : textures)
+    {
+        residentBytes += texture.getAllocatedSize();
+    }
+
+    for (auto it = states.begin(); it != states.end();)
+    {
+        if (!it->second.pending && !textures.isValid(TextureHandle{it->first}))
+            it = states.erase(it);
+        else
+            ++it;
+    }
+
+    // Textures on screen below the resolution they need, largest on screen first
+    candidates.clear();
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        TextureHandle handle = textures.handleAt(i);
+        Texture *texture = textures.get(handle);
+        auto it = states.find(handle.value);
+        if (texture->getPath().empty() || it == states.end())
+            continue;
+
+        const TextureState &state = it->second;
+        if (state.lastUsedFrame == frameIndex && state.requiredMip < texture->getResidentMip())
+            candidates.push_back({handle, texture});
+    }
+
+    waitingCount = candidates.size();
+
+    std::sort(candidates.begin(), candidates.end(), [this](const auto &a, const auto &b)
+              { return states[a.first.value].pixels > states[b.first.value].pixels; });
+
+    // Growth of the first texture the budget holds back, eviction makes room for it
+    int64_t blockedGrowth = 0;
+    for (auto &[handle, texture] : candidates)
+    {
+        TextureState &state = states[handle.value];
+        if (state.pending || state.failed || requests.size() >= maxPendingRequests)
+            continue;
+
+        int64_t growth = chainBytes(texture->getWidth(), texture->getHeight(), state.requiredMip, texture->getMipCount()) -
+                         int64_t(texture->getAllocatedSize());
+        if (int64_t(residentBytes) + pendingBytes + growth > int64_t(budget))
+        {
+            blockedGrowth = growth;
+            break;
+        }
+
+        startRequest(handle, *texture, state.requiredMip);
+    }
+
+    // Over budget: least recently used first, down to what their last visible use needed
+    int64_t target = int64_t(budget) - blockedGrowth;
+    if (int64_t(residentBytes) + pendingBytes <= target)
+        return;
+
+    candidates.clear();
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        TextureHandle handle = textures.handleAt(i);
+        Texture *texture = textures.get(handle);
+        if (!texture->getPath().empty() && !states[handle.value].pending && texture->getResidentMip() < baseMip(*texture))
+            candidates.push_back({handle, texture});
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [this](const auto &a, const auto &b)
+              { return states[a.first.value].lastUsedFrame < states[b.first.value].lastUsedFrame; });
+
+    for (auto &[handle, texture] : candidates)
+    {
+        if (int64_t(residentBytes) + pendingBytes <= target || requests.size() >= maxPendingRequests)
+            break;
+
+        // Visible textures only give up detail they do not need this frame
+        const TextureState &state = states[handle.value];
+        uint32_t targetMip = state.lastUsedFrame == frameIndex ? std::min(state.requiredMip, baseMip(*texture)) : baseMip(*texture);
+        if (targetMip > texture->getResidentMip())
+            startRequest(handle, *texture, targetMip);
+    }
+}
+
+void TextureStreamer::collectRequiredMips(const Scene &scene, const std::vector<uint32_t> &visible, const glm::vec3 &cameraPosition,
+                                          float projectionScale, uint64_t frameIndex)
+{
+    const std::vector<ModelHandle> &models = scene.getModels();
+    const std::vector<Bounds> &worldBounds = scene.getWorldBounds();
+
+    // Largest on-screen size of each visible model, in pixels across its bounds
+    modelPixels.clear();
+    for (uint32_t index : visible)
+    {
+        const Bounds &bounds = worldBounds[index];
+        glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        float diameter = glm::length(bounds.max - bounds.min);
+        float distance = glm::length(center - cameraPosition);
+
+        float pixels = distance > diameter * 0.5f ? diameter * projectionScale / distance : INFINITY;
+        float &largest = modelPixels[models[index].value];
+        largest = std::max(largest, pixels);
+    }
+
+    for (const auto &[modelValue, pixels] : modelPixels)
+    {
+        Model *model = resources.get(ModelHandle{modelValue});
+        if (!model)
+            continue;
+
+        for (MaterialHandle materialHandle : model->getMaterials())
+        {
+            Material *material = resources.get(materialHandle);
+            Texture *texture = material ? resources.get(material->getDiffuseMap()) : nullptr;
+            if (!texture)
+                continue;
+
+            // One texel per pixel, assuming the texture spans the model once
+            float texels = static_cast<float>(std::max(texture->getWidth(), texture->getHeight()));
+            uint32_t mip = pixels >= texels ? 0 : static_cast<uint32_t>(std::floor(std::log2(texels / std::max(pixels, 1.0f))));
+            mip = std::min(mip, texture->getMipCount() - 1);
+
+            TextureState &state = states[material->getDiffuseMap().value];
+            if (state.lastUsedFrame != frameIndex)
+            {
+                state.lastUsedFrame = frameIndex;
+                state.requiredMip = mip;
+                state.pixels = pixels;
+            }
+            else
+            {
+                state.requiredMip = std::min(state.requiredMip, mip);
+                state.pixels = std::max(state.pixels, pixels);
+            }
+        }
+    }
+}
+
+void TextureStreamer::startRequest(TextureHandle handle, Texture &texture, uint32_t targetMip)
+{
+    auto request = std::make_unique<Request>();
+    request->texture = handle;
+    request->targetMip = targetMip;
+    request->byteDelta = chainBytes(texture.getWidth(), texture.getHeight(), targetMip, texture.getMipCount()) -
+                         int64_t(texture.getAllocatedSize());
+
+    if (targetMip < texture.getResidentMip())
+    {
+        request->task = streamIn(jobSystem, uploadStage, device, texture.getPath(), targetMip);
+    }
+    else
+    {
+        MTL::Texture *source = texture.getMTLTexture();
+        source->retain();
+        request->task = evict(uploadStage, device, source, targetMip - texture.getResidentMip());
+    }
+
+    spawn(jobSystem, request->task, request->counter);
+
+    states[handle.value].pending = true;
+    pendingBytes += request->byteDelta;
+    requests.push_back(std::move(request));
+}
+
+void TextureStreamer::finishRequests()
+{
+    for (size_t i = 0; i < requests.size();)
+    {
+        Request &request = *requests[i];
+        if (!request.counter.isDone())
+        {
+            ++i;
+            continue;
+        }
+
+        // Returns at once, but only after the spawning job has let go of the counter
+        jobSystem.wait(request.counter);
+
+        MTL::Texture *newTexture = request.task.result();
+        Texture *texture = resources.get(request.texture);
+        if (newTexture && texture)
+        {
+            MTL::Texture *previous;
+            {
+                auto lock = resources.lockExclusive();
+                previous = texture->replace(newTexture, request.targetMip);
+            }
+
+            // Material tables of frames still in flight reference it by resource id
+            if (previous)
+                resources.releaseLater(previous);
+        }
+        else if (newTexture)
+        {
+            newTexture->release();
+        }
+        else if (texture)
+        {
+            // Not retried, the texture keeps the mips it has
+            std::cerr << "Texture streaming failed for " << texture->getPath() << std::endl;
+            states[request.texture.value].failed = true;
+        }
+
+        states[request.texture.value].pending = false;
+        pendingBytes -= request.byteDelta;
+
+        requests[i] = std::move(requests.back());
+        requests.pop_back();
+    }
+}
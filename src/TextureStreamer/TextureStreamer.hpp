@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Metal/Metal.hpp>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Scene.hpp"
+#include "Task.hpp"
+#include "Texture.hpp"
+
+class ResourceManager;
+
+// Keeps texture memory under a byte budget by streaming mips. Textures start with only their
+// low mips; every frame the mip each one needs is worked out from the screen size of the
+// visible entities using it. Finer mips are read back from the source file and swapped in
+// on the job system, largest on screen first. When the budget is exceeded the least recently
+// used textures lose their finer mips, never going below what a visible use needs.
+class TextureStreamer
+{
+public:
+    TextureStreamer(JobSystem &jobSystem, UploadStage &uploadStage, ResourceManager &resources, MTL::Device *device);
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+    ~TextureStreamer();
+
+    // Main thread, after culling. projectionScale turns size over distance into pixels.
+    void update(const Scene &scene, const std::vector<uint32_t> &visible, const glm::vec3 &cameraPosition,
+                float projectionScale, uint64_t frameIndex);
+
+    void setBudget(size_t bytes) { budget = bytes; }
+    size_t getBudget() const { return budget; }
+    size_t getResidentBytes() const { return residentBytes; }
+    size_t getPendingCount() const { return requests.size(); }
+
+    // Visible textures still below the resolution they need
+    size_t getWaitingCount() const { return waitingCount; }
+
+private:
+    struct TextureState
+    {
+        uint32_t requiredMip = ~0u;
+        float pixels = 0.0f;
+        uint64_t lastUsedFrame = 0;
+        bool pending = false;
+        bool failed = false;
+    };
+
+    struct Request
+    {
+        TextureHandle texture;
+        uint32_t targetMip;
+        int64_t byteDelta;
+        Task<MTL::Texture *> task;
+        JobCounter counter;
+    };
+
+    void collectRequiredMips(const Scene &scene, const std::vector<uint32_t> &visible, const glm::vec3 &cameraPosition,
+                             float projectionScale, uint64_t frameIndex);
+    void finishRequests();
+    void startRequest(TextureHandle handle, Texture &texture, uint32_t targetMip);
+
+    JobSystem &jobSystem;
+    UploadStage &uploadStage;
+    ResourceManager &resources;
+    MTL::Device *device;
+
+    size_t budget = size_t(256) << 20;
+    size_t maxPendingRequests = 4;
+
+    std::unordered_map<uint32_t, TextureState> states;
+    std::vector<std::unique_ptr<Request>> requests;
+
+    size_t residentBytes = 0;
+    int64_t pendingBytes = 0;
+    size_t waitingCount = 0;
+
+    // Scratch reused between frames
+    std::unordered_map<uint32_t, float> modelPixels;
+    std::vector<std::pair<TextureHandle, Texture *>> candidates;
+};
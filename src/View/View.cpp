@@ -0,0 +1,14 @@
+#include "View.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+
+float View::aspect(glm::vec2 targetSize) const
+{
+    float width = viewport.z * targetSize.x;
+    float height = viewport.w * targetSize.y;
+    return height > 0.0f ? width / height : 1.0f;
+}
+
+glm::mat4 View::projection(glm::vec2 targetSize) const
+{
+    return glm::perspective(fovY, aspect(targetSize), nearPlane, farPlane);
+}
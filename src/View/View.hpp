@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Entities carry the layers they are on in bits 8 to 15 of their flags. One with none of
+// them set is on layer 0 only, so scenes that never mention layers show in every view.
+constexpr uint32_t EntityLayerShift = 8;
+constexpr uint32_t EntityLayerBits = 0xffu << EntityLayerShift;
+
+inline uint32_t entityLayers(uint32_t flags)
+{
+    uint32_t layers = (flags & EntityLayerBits) >> EntityLayerShift;
+    return layers ? layers : 1u;
+}
+
+// A camera's picture of the scene, drawn into a rectangle of the frame's render target. The
+// first view of a frame is the main one: light clusters, shadow cascades and texture streaming
+// follow it, and the others reuse what it set up.
+struct View
+{
+    glm::mat4 viewMatrix = glm::mat4(1.0f);
+    glm::vec3 position = glm::vec3(0.0f);
+
+    // Vertical, in radians
+    float fovY = glm::radians(45.0f);
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
+
+    // Fraction of the target, x and y of the top left corner, then width and height
+    glm::vec4 viewport = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+
+    // Layers the view draws
+    uint32_t layerMask = ~0u;
+
+    // Aspect of the view's rectangle in a target of the given size
+    float aspect(glm::vec2 targetSize) const;
+    glm::mat4 projection(glm::vec2 targetSize) const;
+};
@@ -0,0 +1,86 @@
+#include "ViewCuller.hpp"
+#include "JobSystem.hpp"
+#include "View.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+static constexpr size_t CullGrain = 8192;
+
+void ViewCuller::cull(const std::vector<Input> &views, const std::vector<Bounds> &worldBounds, const std::vector<uint32_t> &flags,
+                      uint32_t visibleFlags, JobSystem &jobSystem)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (views.size() > MaxViews)
+        std::cerr << "ViewCuller: " << views.size() << " views, only the first " << MaxViews << " are culled" << std::endl;
+    viewCount = static_cast<uint32_t>(std::min<size_t>(views.size(), MaxViews));
+
+    planes.resize(viewCount);
+    for (uint32_t v = 0; v < viewCount; ++v)
+    {
+        Frustum frustum(views[v].viewProjection);
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            planes[v].planes[p] = frustum.planes[p];
+            planes[v].absNormals[p] = glm::abs(glm::vec3(frustum.planes[p]));
+        }
+        planes[v].layerMask = views[v].layerMask;
+    }
+
+    masks.resize(worldBounds.size());
+
+    jobSystem.parallelFor(worldBounds.size(), [&](size_t begin, size_t end)
+                          {
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint8_t mask = 0;
+            if ((flags[i] & visibleFlags) && !worldBounds[i].isEmpty())
+            {
+                glm::vec3 centre = (worldBounds[i].min + worldBounds[i].max) * 0.5f;
+                glm::vec3 extent = (worldBounds[i].max - worldBounds[i].min) * 0.5f;
+                uint32_t layers = entityLayers(flags[i]);
+
+                for (uint32_t v = 0; v < viewCount; ++v)
+                {
+                    const Planes &view = planes[v];
+                    if (!(layers & view.layerMask))
+                        continue;
+
+                    // The same test as Frustum::intersects, the box's furthest corner along each normal
+                    bool inside = true;
+                    for (uint32_t p = 0; p < 6 && inside; ++p)
+                    {
+                        inside = glm::dot(glm::vec3(view.planes[p]), centre) + glm::dot(view.absNormals[p], extent) + view.planes[p].w >= 0.0f;
+                    }
+
+                    if (inside)
+                        mask |= uint8_t(1u << v);
+                }
+            }
+            masks[i] = mask;
+        } }, CullGrain);
+
+    for (uint32_t v = 0; v < MaxViews; ++v)
+    {
+        visible[v].clear();
+    }
+    visibleInAny.clear();
+
+    for (uint32_t i = 0; i < masks.size(); ++i)
+    {
+        uint8_t mask = masks[i];
+        if (!mask)
+            continue;
+
+        visibleInAny.push_back(i);
+        while (mask)
+        {
+            uint32_t v = __builtin_ctz(mask);
+            mask &= mask - 1;
+            visible[v].push_back(i);
+        }
+    }
+
+    cullMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bounds.hpp"
+
+class JobSystem;
+
+// Culls every view of a frame in one pass over the scene. Each entity's bounds and flags are
+// read once and tested against every view's frustum as centre and extent, leaving one bit per
+// view; the per-view lists and their union are then gathered from those bits. An entity shows
+// in a view when its flags share a bit with visibleFlags, its layers meet the view's layer
+// mask and its bounds touch the frustum.
+//
+// No GPU types, so a set of views can be checked against known bounds anywhere glm builds.
+class ViewCuller
+{
+public:
+    static constexpr uint32_t MaxViews = 8;
+
+    struct Input
+    {
+        glm::mat4 viewProjection;
+        uint32_t layerMask;
+    };
+
+    void cull(const std::vector<Input> &views, const std::vector<Bounds> &worldBounds, const std::vector<uint32_t> &flags,
+              uint32_t visibleFlags, JobSystem &jobSystem);
+
+    uint32_t getViewCount() const { return viewCount; }
+
+    // Dense indices, in dense order
+    const std::vector<uint32_t> &getVisible(uint32_t view) const { return visible[view]; }
+    const std::vector<uint32_t> &getVisibleInAny() const { return visibleInAny; }
+
+    // Bit v is set when the entity at that dense index shows in view v
+    const std::vector<uint8_t> &getMasks() const { return masks; }
+
+    float getCullMs() const { return cullMs; }
+
+private:
+    // Planes facing inwards, with their normals' absolute values for the extent term
+    struct Planes
+    {
+        glm::vec4 planes[6];
+        glm::vec3 absNormals[6];
+        uint32_t layerMask;
+    };
+
+    std::vector<Planes> planes;
+    std::vector<uint8_t> masks;
+    std::vector<uint32_t> visible[MaxViews];
+    std::vector<uint32_t> visibleInAny;
+    uint32_t viewCount = 0;
+    float cullMs = 0.0f;
+};
@@ -0,0 +1,363 @@
+#include "WorldStreamer.hpp"
+#include "ResourceManager.hpp"
+#include "PipelineManager.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+static float distanceToBounds(const glm::vec3 &point, const Bounds &bounds)
+{
+    glm::vec3 closest = glm::clamp(point, bounds.min, bounds.max);
+    return glm::length(point - closest);
+}
+
+static Task<SceneFile> readManifest(std::string path)
+{
+    co_return SceneFile::load(path);
+}
+
+WorldStreamer::WorldStreamer(const std::string &worldPath, JobSystem &jobSystem, UploadStage &uploadStage, ResourceManager &resources,
+                             Scene &scene, PipelineManager &pipelineManager, MTL::Device *device)
+    : jobSystem(jobSystem), uploadStage(uploadStage), resources(resources), scene(scene), pipelineManager(pipelineManager), device(device)
+{
+    loadWorld(worldPath);
+}
+
+WorldStreamer::~WorldStreamer()
+{
+    // Loads in flight still reference the resource manager and this object's counters
+    for (auto &cell : cells)
+    {
+        if (cell->state == CellState::ReadingManifest)
+            jobSystem.wait(cell->manifestCounter);
+    }
+
+    for (auto &[path, entry] : models)
+    {
+        if (entry->loading)
+            jobSystem.wait(entry->counter);
+    }
+}
+
+void WorldStreamer::loadWorld(const std::string &worldPath)
+{
+    std::ifstream file(worldPath);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open world file: " + worldPath);
+    }
+
+    std::vector<std::pair<glm::ivec3, std::string>> cellEntries;
+    float budgetMegabytes = static_cast<float>(settings.memoryBudget >> 20);
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream stream(line);
+        std::string keyword;
+        if (!(stream >> keyword))
+            continue;
+
+        bool ok = true;
+        if (keyword == "cellsize")
+            ok = static_cast<bool>(stream >> settings.cellSize) && settings.cellSize > 0.0f;
+        else if (keyword == "loadradius")
+            ok = static_cast<bool>(stream >> settings.loadRadius);
+        else if (keyword == "hysteresis")
+            ok = static_cast<bool>(stream >> settings.hysteresis);
+        else if (keyword == "prefetch")
+            ok = static_cast<bool>(stream >> settings.prefetchSeconds);
+        else if (keyword == "budget")
+            ok = static_cast<bool>(stream >> budgetMegabytes);
+        else if (keyword == "cell")
+        {
+            glm::ivec3 coordinate;
+            std::string path;
+            ok = static_cast<bool>(stream >> coordinate.x >> coordinate.y >> coordinate.z >> path);
+            cellEntries.emplace_back(coordinate, path);
+        }
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            throw std::runtime_error(worldPath + ":" + std::to_string(lineNumber) + ": cannot parse " + keyword);
+        }
+    }
+
+    settings.memoryBudget = static_cast<size_t>(budgetMegabytes * 1024.0f * 1024.0f);
+
+    // Cell size may be declared after the cells, so bounds are computed once the file is read
+    for (const auto &[coordinate, path] : cellEntries)
+    {
+        auto cell = std::make_unique<Cell>();
+        cell->path = path;
+        cell->bounds.add(glm::vec3(coordinate) * settings.cellSize);
+        cell->bounds.add(glm::vec3(coordinate + 1) * settings.cellSize);
+        cells.push_back(std::move(cell));
+    }
+
+    printf("World %s: %zu cells of %.0f units, budget %zu MB\n", worldPath.c_str(), cells.size(), settings.cellSize, settings.memoryBudget >> 20);
+}
+
+void WorldStreamer::update(const glm::vec3 &cameraPosition, float deltaTime)
+{
+    // Smoothed camera velocity; a jump of more than a cell is a teleport, not movement
+    glm::vec3 moved = hasCameraPosition ? cameraPosition - lastCameraPosition : glm::vec3(0.0f);
+    lastCameraPosition = cameraPosition;
+    hasCameraPosition = true;
+
+    if (deltaTime > 0.0f && glm::length(moved) < settings.cellSize)
+        cameraVelocity = glm::mix(cameraVelocity, moved / deltaTime, 0.1f);
+    else
+        cameraVelocity = glm::vec3(0.0f);
+
+    glm::vec3 predictedPosition = cameraPosition + cameraVelocity * settings.prefetchSeconds;
+
+    // Models whose cells went away while they were loading are dropped as soon as they land
+    for (auto it = models.begin(); it != models.end();)
+    {
+        ModelEntry &entry = *it->second;
+        if (entry.loading && entry.counter.isDone())
+            finishModel(entry);
+
+        if (!entry.loading && entry.references == 0)
+        {
+            if (entry.handle)
+                resources.destroy(entry.handle);
+            residentBytes -= entry.bytes;
+            it = models.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    bool stalled = false;
+    candidates.clear();
+
+    for (auto &cellPointer : cells)
+    {
+        Cell &cell = *cellPointer;
+        cell.distance = std::min(distanceToBounds(cameraPosition, cell.bounds), distanceToBounds(predictedPosition, cell.bounds));
+        cell.wanted = cell.distance <= settings.loadRadius;
+
+        bool keep = cell.distance <= settings.loadRadius + settings.hysteresis;
+        if (!keep && (cell.state == CellState::LoadingModels || cell.state == CellState::Resident))
+            unload(cell);
+
+        if (cell.state == CellState::ReadingManifest || cell.state == CellState::LoadingModels)
+            advance(cell);
+
+        if (cell.wanted && cell.state == CellState::Unloaded)
+            candidates.push_back(&cell);
+
+        if (cell.state != CellState::Resident && cell.state != CellState::Failed &&
+            distanceToBounds(cameraPosition, cell.bounds) == 0.0f)
+            stalled = true;
+    }
+
+    if (stalled)
+        stallCount++;
+
+    // Over budget: give up cells inside the hysteresis band, farthest first
+    if (residentBytes > settings.memoryBudget)
+    {
+        std::vector<Cell *> evictable;
+        for (auto &cell : cells)
+        {
+            if (cell->state == CellState::Resident && !cell->wanted)
+                evictable.push_back(cell.get());
+        }
+
+        std::sort(evictable.begin(), evictable.end(), [](const Cell *a, const Cell *b)
+                  { return a->distance > b->distance; });
+
+        for (Cell *cell : evictable)
+        {
+            if (residentBytes <= settings.memoryBudget)
+                break;
+            unload(*cell);
+        }
+    }
+
+    // Nearest first. A cell's size is only known once it is loaded, so new loads stop at the budget.
+    std::sort(candidates.begin(), candidates.end(), [](const Cell *a, const Cell *b)
+              { return a->distance < b->distance; });
+
+    for (Cell *cell : candidates)
+    {
+        if (loadingCount >= settings.maxConcurrentLoads || residentBytes >= settings.memoryBudget)
+            break;
+        startLoad(*cell);
+    }
+}
+
+void WorldStreamer::startLoad(Cell &cell)
+{
+    cell.state = CellState::ReadingManifest;
+    cell.manifestLoad = readManifest(cell.path);
+    spawn(jobSystem, cell.manifestLoad, cell.manifestCounter);
+    loadingCount++;
+}
+
+void WorldStreamer::advance(Cell &cell)
+{
+    if (cell.state == CellState::ReadingManifest)
+    {
+        if (!cell.manifestCounter.isDone())
+            return;
+
+        // Returns at once, but only after the spawning job has let go of the counter
+        jobSystem.wait(cell.manifestCounter);
+
+        try
+        {
+            cell.manifest = cell.manifestLoad.result();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "World cell " << cell.path << " failed to load: " << e.what() << std::endl;
+            cell.state = CellState::Failed;
+            loadingCount--;
+            return;
+        }
+
+        cell.manifestLoad = {};
+        cell.state = CellState::LoadingModels;
+
+        // The camera may have moved on while the manifest was read
+        if (cell.distance > settings.loadRadius + settings.hysteresis)
+        {
+            unload(cell);
+            return;
+        }
+
+        for (size_t i = 0; i < cell.manifest.getModelCount(); ++i)
+        {
+            std::string path(cell.manifest.getModelPath(i));
+            acquireModel(path);
+            cell.modelPaths.push_back(path);
+        }
+    }
+
+    if (cell.state == CellState::LoadingModels && modelsReady(cell))
+    {
+        instantiate(cell);
+    }
+}
+
+void WorldStreamer::instantiate(Cell &cell)
+{
+    std::vector<ModelHandle> cellModels;
+    cellModels.reserve(cell.modelPaths.size());
+    for (const auto &path : cell.modelPaths)
+    {
+        cellModels.push_back(models[path]->handle);
+    }
+
+    cell.entities = cell.manifest.instantiate(scene, resources, pipelineManager, cellModels);
+
+    // Only the entity table was needed, the mapping can go
+    cell.manifest = SceneFile();
+    cell.state = CellState::Resident;
+    loadingCount--;
+    residentCount++;
+}
+
+void WorldStreamer::unload(Cell &cell)
+{
+    if (cell.state == CellState::Resident)
+    {
+        scene.destroyBatch(cell.entities);
+        cell.entities.clear();
+        residentCount--;
+    }
+    else if (cell.state == CellState::LoadingModels)
+    {
+        loadingCount--;
+    }
+
+    for (const auto &path : cell.modelPaths)
+    {
+        releaseModel(path);
+    }
+
+    cell.modelPaths.clear();
+    cell.manifest = SceneFile();
+    cell.state = CellState::Unloaded;
+}
+
+void WorldStreamer::acquireModel(const std::string &path)
+{
+    auto &entry = models[path];
+    if (!entry)
+    {
+        entry = std::make_unique<ModelEntry>();
+        entry->load = Model::loadAsync(jobSystem, uploadStage, resources, device, path);
+        spawn(jobSystem, entry->load, entry->counter);
+    }
+
+    entry->references++;
+}
+
+void WorldStreamer::releaseModel(const std::string &path)
+{
+    auto it = models.find(path);
+    if (it == models.end())
+        return;
+
+    ModelEntry &entry = *it->second;
+    entry.references--;
+
+    // Still loading models are dropped by update once they land
+    if (entry.references == 0 && !entry.loading)
+    {
+        if (entry.handle)
+            resources.destroy(entry.handle);
+        residentBytes -= entry.bytes;
+        models.erase(it);
+    }
+}
+
+void WorldStreamer::finishModel(ModelEntry &entry)
+{
+    jobSystem.wait(entry.counter);
+
+    try
+    {
+        entry.handle = entry.load.result();
+        entry.bytes = resources.get(entry.handle)->getAllocatedSize();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "World model failed to load: " << e.what() << std::endl;
+    }
+
+    entry.load = {};
+    entry.loading = false;
+    residentBytes += entry.bytes;
+    peakResidentBytes = std::max(peakResidentBytes, residentBytes);
+}
+
+bool WorldStreamer::modelsReady(const Cell &cell)
+{
+    bool ready = true;
+    for (const auto &path : cell.modelPaths)
+    {
+        ModelEntry &entry = *models[path];
+        if (entry.loading && entry.counter.isDone())
+            finishModel(entry);
+        ready = ready && !entry.loading;
+    }
+    return ready;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Metal/Metal.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Bounds.hpp"
+#include "Model.hpp"
+#include "Scene.hpp"
+#include "SceneFile.hpp"
+#include "Task.hpp"
+
+class PipelineManager;
+class ResourceManager;
+
+struct WorldStreamingSettings
+{
+    float cellSize = 512.0f;
+
+    // Cells whose bounds come within loadRadius of the camera (or of where it will be in
+    // prefetchSeconds at its current velocity) are loaded. Resident cells unload once they
+    // are further than loadRadius + hysteresis, or sooner when over the memory budget.
+    float loadRadius = 768.0f;
+    float hysteresis = 256.0f;
+    float prefetchSeconds = 2.0f;
+    size_t memoryBudget = size_t(512) << 20;
+    size_t maxConcurrentLoads = 4;
+};
+
+// Splits the world into a grid of cells, each a scene file with its own models, and keeps the
+// cells near the camera resident. Manifests are parsed and models loaded on the job system;
+// models shared between cells are loaded once and reference counted. Main thread only.
+//
+// World files are text:
+//
+//   cellsize <size>
+//   loadradius <distance>
+//   hysteresis <distance>
+//   prefetch <seconds>
+//   budget <megabytes>
+//   cell <x> <y> <z> <scene file>
+//
+// Cell entities are in world space, cell <x> <y> <z> covers [x, x + 1) * cellsize on each axis.
+class WorldStreamer
+{
+public:
+    WorldStreamer(const std::string &worldPath, JobSystem &jobSystem, UploadStage &uploadStage, ResourceManager &resources,
+                  Scene &scene, PipelineManager &pipelineManager, MTL::Device *device);
+    WorldStreamer(const WorldStreamer &) = delete;
+    WorldStreamer &operator=(const WorldStreamer &) = delete;
+
+    // Waits for loads still in flight, resident entities and models are left to their owners
+    ~WorldStreamer();
+
+    // Once per frame, before the scene is updated
+    void update(const glm::vec3 &cameraPosition, float deltaTime);
+
+    size_t getCellCount() const { return cells.size(); }
+    size_t getResidentCount() const { return residentCount; }
+    size_t getLoadingCount() const { return loadingCount; }
+    size_t getResidentBytes() const { return residentBytes; }
+    size_t getPeakResidentBytes() const { return peakResidentBytes; }
+    size_t getMemoryBudget() const { return settings.memoryBudget; }
+
+    // Frames where the camera was inside a cell that was not resident yet
+    size_t getStallCount() const { return stallCount; }
+
+private:
+    enum class CellState
+    {
+        Unloaded,
+        ReadingManifest,
+        LoadingModels,
+        Resident,
+        Failed,
+    };
+
+    struct Cell
+    {
+        std::string path;
+        Bounds bounds;
+        CellState state = CellState::Unloaded;
+        float distance = 0.0f;
+        bool wanted = false;
+
+        Task<SceneFile> manifestLoad;
+        JobCounter manifestCounter;
+        SceneFile manifest;
+        std::vector<std::string> modelPaths;
+        std::vector<Entity> entities;
+    };
+
+    struct ModelEntry
+    {
+        Task<ModelHandle> load;
+        JobCounter counter;
+        bool loading = true;
+        ModelHandle handle;
+        size_t bytes = 0;
+        uint32_t references = 0;
+    };
+
+    void loadWorld(const std::string &worldPath);
+
+    void startLoad(Cell &cell);
+    void advance(Cell &cell);
+    void instantiate(Cell &cell);
+    void unload(Cell &cell);
+
+    void acquireModel(const std::string &path);
+    void releaseModel(const std::string &path);
+    void finishModel(ModelEntry &entry);
+    bool modelsReady(const Cell &cell);
+
+    JobSystem &jobSystem;
+    UploadStage &uploadStage;
+    ResourceManager &resources;
+    Scene &scene;
+    PipelineManager &pipelineManager;
+    MTL::Device *device;
+
+    WorldStreamingSettings settings;
+    std::vector<std::unique_ptr<Cell>> cells;
+    std::unordered_map<std::string, std::unique_ptr<ModelEntry>> models;
+
+    glm::vec3 lastCameraPosition = glm::vec3(0.0f);
+    glm::vec3 cameraVelocity = glm::vec3(0.0f);
+    bool hasCameraPosition = false;
+
+    size_t residentCount = 0;
+    size_t loadingCount = 0;
+    size_t residentBytes = 0;
+    size_t peakResidentBytes = 0;
+    size_t stallCount = 0;
+
+    // Scratch reused between frames
+    std::vector<Cell *> candidates;
+};
@@ -1,18 +1,27 @@
 #define NS_PRIVATE_IMPLEMENTATION
 #define CA_PRIVATE_IMPLEMENTATION
 #define MTL_PRIVATE_IMPLEMENTATION
+#define MTLFX_PRIVATE_IMPLEMENTATION
 
 #include <Foundation/Foundation.hpp>
 #include <Metal/Metal.hpp>
+#include <MetalFX/MetalFX.hpp>
 #include <QuartzCore/QuartzCore.hpp>
 #include <mach/mach.h>
 #include <mach/thread_act.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <random>
 #include <signal.h>
 #include <execinfo.h>
 #include <unistd.h>
 
 #include "Engine/Engine.hpp"
+#include "SceneFile/SceneFile.hpp"
+#include "TextureAtlas/TextureAtlas.hpp"
 
 void printRegisterState(mach_port_t thread)
 {
@@ -95,15 +104,141 @@ void signalHandler(int signum, siginfo_t *info, void *context)
     raise(signum);
 }
 
-int main()
+// Converts between the text and binary scene forms without opening a window, the output form
+// follows the extension (.scnb for binary), and reports how long the source took to load
+int convertScene(const std::string &inputPath, const std::string &outputPath)
 {
+    try
+    {
+        auto loadStart = std::chrono::steady_clock::now();
+        SceneFile scene = SceneFile::load(inputPath);
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+        printf("Loaded %s: %zu entities in %.2f ms\n", inputPath.c_str(), scene.getEntityCount(), loadMs);
+
+        if (outputPath.size() > 5 && outputPath.compare(outputPath.size() - 5, 5, ".scnb") == 0)
+            scene.saveBinary(outputPath);
+        else
+            scene.saveText(outputPath);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Writes a text scene of static props on a grid, with random rotation and scale, for measuring
+// static batching against a realistic number of entities
+int generateProps(int count, const std::string &outputPath)
+{
+    std::ofstream file(outputPath);
+    if (count <= 0 || !file)
+    {
+        std::cerr << "Failed to write " << outputPath << std::endl;
+        return 1;
+    }
+
+    file << "# " << count << " generated static props\n";
+    file << "model teapot bin/Release/assets/teapot.obj\n";
+    file << "model capsule bin/Release/assets/capsule/capsule.obj\n";
+    file << "model sun bin/Release/assets/Beach_Ball_v2_L3.123cdf1ec704-c7ca-4faf-8f47-647b6e5df698/13517_Beach_Ball_v2_L3.obj\n\n";
+    file << "pipeline standard\n\n";
+    file << "ambient 0.1 0.1 0.1\nlight 1 1 1\nsun Sun\n\n";
+    file << "entity Sun sun standard - 30 60 0\n";
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> angle(0.0f, 3.14159265f);
+    std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+
+    const float spacing = 6.0f;
+    int side = static_cast<int>(std::ceil(std::sqrt(float(count))));
+    for (int i = 0; i < count; ++i)
+    {
+        float x = (i % side - side / 2) * spacing;
+        float z = (i / side - side / 2) * spacing;
+        float half = angle(random);
+        float s = scale(random);
+
+        // Rotation about the vertical axis only, so props stay upright
+        file << "entity Prop" << i << (i % 2 ? " capsule" : " teapot") << " standard - " << x << " 0 " << z
+             << " rotation " << std::cos(half) << " 0 " << std::sin(half) << " 0"
+             << " scale " << s << " " << s << " " << s << " static\n";
+    }
+
+    // A coloured point light over every tenth prop
+    std::uniform_real_distribution<float> hue(0.2f, 1.0f);
+    std::uniform_real_distribution<float> radius(4.0f, 12.0f);
+    int lights = 0;
+    for (int i = 0; i < count; i += 10, ++lights)
+    {
+        float x = (i % side - side / 2) * spacing;
+        float z = (i / side - side / 2) * spacing;
+        file << "pointlight - " << x << " 3 " << z << " " << radius(random) << " " << hue(random) << " " << hue(random) << " " << hue(random) << "\n";
+    }
+
+    printf("Wrote %d static props and %d point lights to %s\n", count, lights, outputPath.c_str());
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    std::string scenePath = "bin/Release/assets/scenes/default.scene";
+    std::string worldPath;
+    bool lowLatency = false;
+    float targetFps = 0.0f;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--scene" && i + 1 < argc)
+        {
+            scenePath = argv[++i];
+        }
+        else if (arg == "--world" && i + 1 < argc)
+        {
+            worldPath = argv[++i];
+        }
+        else if (arg == "--no-atlas")
+        {
+            TextureAtlas::setEnabled(false);
+        }
+        else if (arg == "--low-latency")
+        {
+            lowLatency = true;
+        }
+        else if (arg == "--target-fps" && i + 1 < argc)
+        {
+            targetFps = static_cast<float>(atof(argv[++i]));
+        }
+        else if (arg == "--convert-scene" && i + 2 < argc)
+        {
+            return convertScene(argv[i + 1], argv[i + 2]);
+        }
+        else if (arg == "--generate-props" && i + 2 < argc)
+        {
+            return generateProps(atoi(argv[i + 1]), argv[i + 2]);
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--scene <path>] [--world <path>] [--no-atlas] [--low-latency] [--target-fps <fps>] [--convert-scene <input> <output>] [--generate-props <count> <output>]" << std::endl;
+            return 1;
+        }
+    }
+
     // Register signal handler
     struct sigaction action;
     action.sa_sigaction = signalHandler;
     action.sa_flags = SA_SIGINFO;
     sigaction(SIGSEGV, &action, NULL);
 
-    Engine engine("Hello, Metal!");
+    Engine engine("Hello, Metal!", scenePath, worldPath);
+
+    if (Renderer *renderer = engine.getRenderer())
+    {
+        renderer->getFramePacer().setLowLatency(lowLatency);
+        renderer->getFramePacer().setTargetFps(targetFps);
+    }
 
     engine.Run();
 
@@ -0,0 +1,140 @@
+#include "Test.hpp"
+#include "AllocationCounter.hpp"
+#include "FrameArena.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+TEST(arenaAllocationsAreAlignedAndDisjoint)
+{
+    FrameArena arena(4096);
+
+    char *previousEnd = nullptr;
+    for (size_t alignment : {size_t(1), size_t(4), size_t(16), size_t(64), size_t(8), size_t(2)})
+    {
+        char *pointer = static_cast<char *>(arena.allocate(100, alignment));
+        CHECK(reinterpret_cast<uintptr_t>(pointer) % alignment == 0);
+        if (previousEnd)
+            CHECK(pointer >= previousEnd);
+        memset(pointer, 0xab, 100);
+        previousEnd = pointer + 100;
+    }
+    CHECK(arena.getBytesUsed() >= 600);
+}
+
+TEST(arenaResetMergesOverflowIntoOneBlock)
+{
+    FrameArena arena(1024);
+
+    // A frame larger than a block spills into more, including one larger than the block size
+    for (int i = 0; i < 20; ++i)
+        arena.allocate(300);
+    arena.allocate(5000);
+    CHECK(arena.getBlockCount() > 1);
+    size_t used = arena.getBytesUsed();
+
+    arena.reset();
+    CHECK(arena.getBytesUsed() == 0);
+    CHECK(arena.getBlockCount() == 1);
+    CHECK(arena.getCapacity() >= used);
+    CHECK(arena.getPeakBytesUsed() >= used);
+
+    // The same frame again fits without a new block
+    for (int i = 0; i < 20; ++i)
+        arena.allocate(300);
+    arena.allocate(5000);
+    CHECK(arena.getBlockCount() == 1);
+}
+
+TEST(arenaScopeRewinds)
+{
+    FrameArena arena(1024);
+    arena.allocate(100);
+    size_t before = arena.getBytesUsed();
+
+    void *scratch = nullptr;
+    {
+        FrameArena::Scope scope(arena);
+        scratch = arena.allocate(2000);
+        CHECK(arena.getBytesUsed() > before);
+    }
+    CHECK(arena.getBytesUsed() == before);
+
+    // Rewound memory is handed out again
+    CHECK(arena.allocate(2000) == scratch);
+}
+
+TEST(arenaFormatsStrings)
+{
+    FrameArena arena(64);
+
+    const char *name = arena.format("%s (%u)", "teapot", 42u);
+    CHECK(strcmp(name, "teapot (42)") == 0);
+
+    // Longer than a block
+    const char *wide = arena.format("%0200d", 7);
+    CHECK(strlen(wide) == 200);
+    CHECK(wide[199] == '7');
+
+    // Earlier results stay valid until the reset
+    CHECK(strcmp(name, "teapot (42)") == 0);
+}
+
+TEST(arenaContainersUseTheArena)
+{
+    FrameArena arena(1 << 16);
+
+    ArenaVector<uint32_t> values{ArenaAllocator<uint32_t>(arena)};
+    for (uint32_t i = 0; i < 1000; ++i)
+        values.push_back(999 - i);
+    std::sort(values.begin(), values.end());
+    CHECK(values.front() == 0 && values.back() == 999);
+
+    ArenaString label{ArenaAllocator<char>(arena)};
+    label += "entity ";
+    label += "with a name too long for the small string buffer";
+    CHECK(label.size() == 55);
+    CHECK(arena.getBytesUsed() >= 1000 * sizeof(uint32_t));
+}
+
+// The per-frame work the arena replaced: a label per entity, scratch index lists and sorting.
+// Once the first frame has sized the arena, later frames make no heap allocations at all.
+TEST(arenaFramesMakeNoHeapAllocations)
+{
+    REQUIRE(AllocationCounter::isEnabled());
+
+    FrameArena &arena = FrameArena::local();
+    arena.reset();
+
+    auto frame = [&]()
+    {
+        ArenaVector<uint32_t> visible;
+        for (uint32_t i = 0; i < 5000; ++i)
+        {
+            if (i % 3 != 0)
+                visible.push_back(i);
+        }
+        std::sort(visible.begin(), visible.end(), [](uint32_t a, uint32_t b)
+                  { return (a * 2654435761u) < (b * 2654435761u); });
+
+        size_t length = 0;
+        for (uint32_t index : visible)
+        {
+            const char *label = arenaFormat("Entity %u##%u", index, index);
+            length += strlen(label);
+        }
+
+        arena.reset();
+        return length;
+    };
+
+    frame();
+
+    uint64_t before = AllocationCounter::getCount();
+    for (int i = 0; i < 10; ++i)
+        frame();
+    uint64_t allocations = AllocationCounter::getCount() - before;
+
+    CHECK(allocations == 0);
+    CHECK(arena.getBlockCount() == 1);
+}
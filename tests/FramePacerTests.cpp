@@ -0,0 +1,130 @@
+#include "Test.hpp"
+#include "FramePacer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    double secondsSince(FramePacer::Clock::time_point start)
+    {
+        return std::chrono::duration<double>(FramePacer::Clock::now() - start).count();
+    }
+}
+
+TEST(framePacerLimiterHoldsTheTargetRate)
+{
+    FramePacer pacer;
+    pacer.setTargetFps(120.0f);
+    const double period = 1.0 / 120.0;
+
+    // Frame starts keep to the schedule: never early, and on average on time
+    std::vector<double> intervals;
+    auto start = FramePacer::Clock::now();
+    auto previous = start;
+    for (int i = 0; i < 61; ++i)
+    {
+        pacer.beginFrame();
+        auto now = FramePacer::Clock::now();
+        if (i > 0)
+            intervals.push_back(std::chrono::duration<double>(now - previous).count());
+        previous = now;
+    }
+    double elapsed = std::chrono::duration<double>(previous - start).count();
+    CHECK(elapsed >= 60 * period * 0.999);
+    CHECK(elapsed < 60 * period * 1.15);
+
+    std::sort(intervals.begin(), intervals.end());
+    double median = intervals[intervals.size() / 2];
+    CHECK(median > period * 0.9 && median < period * 1.1);
+
+    // A hitch restarts the schedule instead of rushing the next frames through to catch up
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    pacer.beginFrame();
+    auto resumed = FramePacer::Clock::now();
+    for (int i = 0; i < 5; ++i)
+        pacer.beginFrame();
+    CHECK(secondsSince(resumed) >= 5 * period * 0.999);
+
+    // Without a target nothing waits
+    pacer.setTargetFps(0.0f);
+    start = FramePacer::Clock::now();
+    for (int i = 0; i < 1000; ++i)
+        pacer.beginFrame();
+    CHECK(secondsSince(start) < 0.1);
+    CHECK(pacer.getLimiterMs() < 1.0f);
+}
+
+TEST(framePacerLowLatencyWaitsForADrawable)
+{
+    FramePacer pacer;
+
+    // Throughput mode builds the frame without a drawable
+    auto start = FramePacer::Clock::now();
+    pacer.beginFrame();
+    CHECK(secondsSince(start) < 0.01);
+
+    // Low latency mode holds the main thread until the render thread has one
+    pacer.setLowLatency(true);
+    std::thread renderThread([&pacer]()
+                             {
+        for (int i = 0; i < 5; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            pacer.drawableReady();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        } });
+
+    size_t early = 0;
+    for (int i = 0; i < 5; ++i)
+    {
+        pacer.beginFrame();
+        early += pacer.getDrawableWaitMs() < 10.0f ? 1 : 0;
+        pacer.markInputSampled();
+        pacer.frameSubmitted();
+    }
+    renderThread.join();
+    CHECK(early == 0);
+
+    // With no drawable coming it gives up after the timeout rather than hanging
+    start = FramePacer::Clock::now();
+    pacer.beginFrame();
+    double waited = secondsSince(start);
+    CHECK(waited >= 0.099);
+    CHECK(waited < 0.5);
+
+    // A drawable already held lets the frame start at once
+    pacer.drawableReady();
+    start = FramePacer::Clock::now();
+    pacer.beginFrame();
+    CHECK(secondsSince(start) < 0.05);
+}
+
+TEST(framePacerAveragesLatencyOverItsWindow)
+{
+    FramePacer pacer;
+    CHECK(pacer.getLatencyMs() == 0.0f && pacer.getMaxLatencyMs() == 0.0f);
+
+    // Dropped frames and frames without input report nothing
+    pacer.addPresented(10.0, 0.0);
+    pacer.addPresented(0.0, 10.0);
+    CHECK(pacer.getLatencyMs() == 0.0f);
+
+    pacer.addPresented(10.0, 10.050);
+    for (uint32_t i = 0; i < FramePacer::LatencyWindow - 1; ++i)
+        pacer.addPresented(20.0, 20.020);
+    CHECK(std::abs(pacer.getMaxLatencyMs() - 50.0f) < 0.01f);
+    CHECK(pacer.getLatencyMs() > 20.0f);
+
+    // One more and the 50 ms frame has left the window
+    pacer.addPresented(30.0, 30.020);
+    CHECK(std::abs(pacer.getLatencyMs() - 20.0f) < 0.01f);
+    CHECK(std::abs(pacer.getMaxLatencyMs() - 20.0f) < 0.01f);
+
+    pacer.setMaxFramesInFlight(7);
+    CHECK(pacer.getMaxFramesInFlight() == 3);
+    pacer.setMaxFramesInFlight(1);
+    CHECK(pacer.getMaxFramesInFlight() == 2);
+}
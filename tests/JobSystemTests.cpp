@@ -0,0 +1,268 @@
+#include "Test.hpp"
+#include "JobSystem.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+TEST(workStealingQueuePopsNewestAndStealsOldest)
+{
+    WorkStealingQueue queue(4);
+    std::vector<Job> jobs(10);
+    for (Job &job : jobs)
+        queue.push(&job);
+
+    // Pushing past the initial capacity grows the deque without losing jobs
+    CHECK(queue.steal() == &jobs[0]);
+    CHECK(queue.pop() == &jobs[9]);
+    CHECK(queue.steal() == &jobs[1]);
+
+    size_t remaining = 0;
+    while (queue.pop())
+        remaining++;
+    CHECK(remaining == 7);
+    CHECK(queue.empty());
+    CHECK(queue.steal() == nullptr);
+}
+
+TEST(workStealingQueueHandsOutEachJobOnceUnderContention)
+{
+    constexpr size_t JobCount = 200000;
+    constexpr unsigned ThiefCount = 3;
+
+    WorkStealingQueue queue(64);
+    std::vector<Job> jobs(JobCount);
+    std::vector<std::atomic<int>> taken(JobCount);
+    std::atomic<bool> done{false};
+
+    auto take = [&](Job *job)
+    {
+        taken[job - jobs.data()].fetch_add(1, std::memory_order_relaxed);
+    };
+
+    std::vector<std::thread> thieves;
+    for (unsigned t = 0; t < ThiefCount; ++t)
+    {
+        thieves.emplace_back([&]()
+                             {
+            while (!done.load(std::memory_order_acquire))
+            {
+                if (Job *job = queue.steal())
+                    take(job);
+            } });
+    }
+
+    // The owner pushes in bursts and pops some back, racing the thieves for the last job
+    for (size_t i = 0; i < JobCount; ++i)
+    {
+        queue.push(&jobs[i]);
+        if (i % 3 == 0)
+        {
+            if (Job *job = queue.pop())
+                take(job);
+        }
+    }
+    while (Job *job = queue.pop())
+        take(job);
+
+    // Thieves may still hold a job they stole just before the queue emptied
+    done.store(true, std::memory_order_release);
+    for (std::thread &thief : thieves)
+        thief.join();
+    while (Job *job = queue.steal())
+        take(job);
+
+    size_t wrong = 0;
+    for (const std::atomic<int> &count : taken)
+    {
+        if (count.load() != 1)
+            wrong++;
+    }
+    CHECK(wrong == 0);
+}
+
+TEST(parallelForCoversEveryIndexOnce)
+{
+    JobSystem jobSystem(4);
+
+    for (size_t count : {size_t(0), size_t(1), size_t(7), size_t(1000), size_t(100003)})
+    {
+        for (size_t grain : {size_t(1), size_t(64), size_t(100000)})
+        {
+            std::vector<std::atomic<int>> visits(count);
+            jobSystem.parallelFor(count, [&](size_t begin, size_t end)
+                                  {
+                for (size_t i = begin; i < end; ++i)
+                    visits[i].fetch_add(1, std::memory_order_relaxed); }, grain);
+
+            size_t wrong = 0;
+            for (const std::atomic<int> &visit : visits)
+            {
+                if (visit.load() != 1)
+                    wrong++;
+            }
+            CHECK(wrong == 0);
+        }
+    }
+}
+
+TEST(scheduleAfterWaitsForTheWholeDependency)
+{
+    JobSystem jobSystem(4);
+
+    for (int round = 0; round < 50; ++round)
+    {
+        JobCounter first;
+        JobCounter second;
+        std::atomic<int> finished{0};
+        int seen = -1;
+
+        for (int i = 0; i < 100; ++i)
+            jobSystem.schedule([&]()
+                               { finished.fetch_add(1, std::memory_order_relaxed); }, &first);
+        jobSystem.scheduleAfter(first, [&]()
+                                { seen = finished.load(std::memory_order_relaxed); }, &second);
+
+        jobSystem.wait(second);
+        CHECK(seen == 100);
+        CHECK(first.isDone());
+    }
+}
+
+TEST(jobsCanScheduleAndWaitOnNestedJobs)
+{
+    JobSystem jobSystem(4);
+    JobCounter outer;
+    std::atomic<int> leaves{0};
+
+    for (int i = 0; i < 16; ++i)
+    {
+        jobSystem.schedule([&]()
+                           {
+            JobCounter inner;
+            for (int j = 0; j < 16; ++j)
+                jobSystem.schedule([&]()
+                                   { leaves.fetch_add(1, std::memory_order_relaxed); }, &inner);
+
+            // Waiting inside a job helps with other work instead of blocking the worker
+            jobSystem.wait(inner); }, &outer);
+    }
+
+    jobSystem.wait(outer);
+    CHECK(leaves.load() == 16 * 16);
+}
+
+TEST(mainThreadWorkRunsOnTheMainThread)
+{
+    JobSystem jobSystem(2);
+    JobCounter counter;
+    std::atomic<int> ranOnMain{0};
+    std::atomic<int> ranElsewhere{0};
+
+    for (int i = 0; i < 32; ++i)
+    {
+        jobSystem.schedule([&]()
+                           { jobSystem.runOnMainThread([&]()
+                                                       { (jobSystem.isMainThread() ? ranOnMain : ranElsewhere).fetch_add(1); }, &counter); }, &counter);
+    }
+
+    // wait pumps main thread work when called there
+    jobSystem.wait(counter);
+    CHECK(ranOnMain.load() == 32);
+    CHECK(ranElsewhere.load() == 0);
+
+    JobSystemStats stats = jobSystem.getStats();
+    CHECK(stats.mainThreadJobs == 32);
+}
+
+TEST(statsCountEveryJob)
+{
+    JobSystem jobSystem(3);
+    jobSystem.resetStats();
+
+    JobCounter counter;
+    for (int i = 0; i < 1000; ++i)
+        jobSystem.schedule([]() {}, &counter);
+    jobSystem.wait(counter);
+
+    JobSystemStats stats = jobSystem.getStats();
+    CHECK(stats.workerCount == 3);
+    CHECK(stats.jobsExecuted == 1000);
+}
+
+TEST(idleWorkersSleepUntilWorkArrives)
+{
+    std::atomic<int> ran{0};
+    JobSystem jobSystem(3);
+
+    // Asleep, the workers cost no CPU time
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::clock_t cpuStart = std::clock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    double cpuMs = 1000.0 * double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    CHECK(cpuMs < 15.0);
+
+    // A job submitted from outside, with nobody waiting on it to help, still wakes a worker,
+    // whether the workers have just gone to sleep or have been asleep for a while
+    int late = 0;
+    for (int round = 0; round < 200; ++round)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(round % 4 == 0 ? 2000 : 50));
+        jobSystem.schedule([&ran]()
+                           { ran.fetch_add(1); });
+
+        auto start = std::chrono::steady_clock::now();
+        while (ran.load() != round + 1 && std::chrono::steady_clock::now() - start < std::chrono::seconds(1))
+            std::this_thread::yield();
+        if (ran.load() != round + 1)
+            late++;
+    }
+    CHECK(late == 0);
+}
+
+// Each element costs the same, so any speedup short of the worker count is scheduling overhead
+// or imbalance rather than memory bandwidth
+BENCHMARK(jobSystemScaling)
+{
+    constexpr size_t Count = 1 << 22;
+    std::vector<float> output(Count);
+
+    auto work = [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            float x = static_cast<float>(i);
+            for (int k = 0; k < 16; ++k)
+                x = std::sqrt(x * 1.0001f + 1.0f);
+            output[i] = x;
+        }
+    };
+
+    constexpr int Rounds = 5;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < Rounds; ++round)
+        work(0, Count);
+    double serial = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / Rounds;
+    printf("  serial:    %7.2f ms\n", serial);
+
+    // The main thread helps while it waits, so n workers run on n + 1 threads
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned workers = 1; workers < hardware * 2; workers *= 2)
+    {
+        JobSystem jobSystem(workers);
+        jobSystem.parallelFor(Count, work);
+        jobSystem.resetStats();
+
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < Rounds; ++round)
+            jobSystem.parallelFor(Count, work);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / Rounds;
+
+        JobSystemStats stats = jobSystem.getStats();
+        printf("  %2u workers: %7.2f ms, %.2fx, %llu jobs, %llu steals, %.1f ms idle\n", workers, ms, serial / ms,
+               (unsigned long long)stats.jobsExecuted / Rounds, (unsigned long long)stats.steals / Rounds, stats.idleSeconds * 1000.0 / Rounds);
+    }
+}
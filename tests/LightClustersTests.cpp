@@ -0,0 +1,174 @@
+#include "Test.hpp"
+#include "JobSystem.hpp"
+#include "LightClusters.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const LightClusters::Projection TestProjection{glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f};
+
+    // Scattered around the camera, flattened so many of them crowd the same clusters
+    std::vector<PointLight> makeLights(size_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> spread(-60.0f, 60.0f);
+        std::uniform_real_distribution<float> radius(0.5f, 8.0f);
+
+        std::vector<PointLight> lights(count);
+        for (PointLight &light : lights)
+        {
+            light.position = glm::vec3(spread(random), spread(random) * 0.2f, spread(random));
+            light.radius = radius(random);
+            light.color = glm::vec3(1.0f);
+            light.padding = 0.0f;
+        }
+        return lights;
+    }
+
+    std::vector<uint32_t> clusterLights(const LightClusters &clusters, uint32_t cluster)
+    {
+        ClusterRange range = clusters.getRanges()[cluster];
+        const std::vector<uint32_t> &indices = clusters.getIndices();
+        return std::vector<uint32_t>(indices.begin() + range.offset, indices.begin() + range.offset + range.count);
+    }
+}
+
+// Every cluster against every light, sphere against box in view space, lowest indices kept
+TEST(lightClustersMatchABruteForceReference)
+{
+    JobSystem jobSystem(2);
+    std::vector<PointLight> lights = makeLights(2000, 1);
+
+    // A hundred more in one spot ahead of the camera, more than a cluster keeps
+    std::vector<PointLight> crowd = makeLights(100, 4);
+    for (PointLight &light : crowd)
+    {
+        light.position = glm::vec3(-2.5f, 1.5f, -5.0f) + light.position * 0.01f;
+        light.radius = 2.0f;
+    }
+    lights.insert(lights.end(), crowd.begin(), crowd.end());
+    glm::mat4 view = glm::lookAt(glm::vec3(5.0f, 3.0f, 10.0f), glm::vec3(-10.0f, 0.0f, -20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    LightClusters clusters;
+    clusters.build(lights, view, TestProjection, jobSystem);
+    REQUIRE(clusters.getRanges().size() == LightClusters::ClusterCount);
+    CHECK(clusters.getLightCount() == lights.size());
+
+    size_t wrong = 0;
+    size_t dropped = 0;
+    uint32_t most = 0;
+    for (uint32_t cluster = 0; cluster < LightClusters::ClusterCount; ++cluster)
+    {
+        glm::vec3 boxMin = clusters.getClusterMin(cluster);
+        glm::vec3 boxMax = clusters.getClusterMax(cluster);
+
+        std::vector<uint32_t> expected;
+        for (uint32_t i = 0; i < lights.size(); ++i)
+        {
+            glm::vec3 centre(view * glm::vec4(lights[i].position, 1.0f));
+            glm::vec3 nearest = glm::clamp(centre, boxMin, boxMax);
+            glm::vec3 offset = centre - nearest;
+            if (glm::dot(offset, offset) <= lights[i].radius * lights[i].radius)
+                expected.push_back(i);
+        }
+        if (expected.size() > LightClusters::MaxLightsPerCluster)
+        {
+            dropped += expected.size() - LightClusters::MaxLightsPerCluster;
+            expected.resize(LightClusters::MaxLightsPerCluster);
+        }
+        most = std::max(most, uint32_t(expected.size()));
+
+        if (clusterLights(clusters, cluster) != expected)
+            wrong++;
+    }
+
+    CHECK(wrong == 0);
+    CHECK(dropped > 0);
+    CHECK(clusters.getDroppedCount() == dropped);
+    CHECK(clusters.getMaxClusterLights() == most);
+    CHECK(clusters.getIndices().size() > lights.size());
+}
+
+TEST(lightClustersFindEachLightInItsOwnCluster)
+{
+    JobSystem jobSystem(2);
+    std::vector<PointLight> lights = makeLights(500, 2);
+    glm::mat4 view(1.0f);
+
+    LightClusters clusters;
+    clusters.build(lights, view, TestProjection, jobSystem);
+
+    // A centre inside the frustum lies in exactly one cluster, which must list it
+    float tanY = std::tan(TestProjection.fovY * 0.5f);
+    float tanX = tanY * TestProjection.aspect;
+    size_t inside = 0;
+    size_t missing = 0;
+    for (uint32_t i = 0; i < lights.size(); ++i)
+    {
+        glm::vec3 centre = lights[i].position;
+        float depth = -centre.z;
+        float x = centre.x / (depth * tanX);
+        float y = centre.y / (depth * tanY);
+        if (depth <= TestProjection.nearPlane || depth >= TestProjection.farPlane || std::abs(x) >= 1.0f || std::abs(y) >= 1.0f)
+            continue;
+
+        uint32_t tileX = uint32_t((x + 1.0f) * 0.5f * LightClusters::TilesX);
+        uint32_t tileY = uint32_t((1.0f - y) * 0.5f * LightClusters::TilesY);
+        uint32_t slice = LightClusters::sliceOf(depth, TestProjection.nearPlane, TestProjection.farPlane);
+        std::vector<uint32_t> listed = clusterLights(clusters, LightClusters::clusterIndex(tileX, tileY, slice));
+        if (std::find(listed.begin(), listed.end(), i) == listed.end() && listed.size() < LightClusters::MaxLightsPerCluster)
+            missing++;
+        inside++;
+    }
+    CHECK(inside > 50);
+    CHECK(missing == 0);
+
+    // The shaders find the slice from the parameters, which must agree with sliceOf
+    ClusterParams params = clusters.getParams(glm::vec2(1920.0f, 1080.0f));
+    CHECK(params.lightCount == lights.size());
+    size_t disagree = 0;
+    for (float depth = 0.15f; depth < TestProjection.farPlane; depth *= 1.07f)
+    {
+        int slice = int(std::log(depth) * params.sliceScale - params.sliceBias);
+        if (slice != int(LightClusters::sliceOf(depth, TestProjection.nearPlane, TestProjection.farPlane)))
+            disagree++;
+    }
+    CHECK(disagree == 0);
+
+    // Slices tile the depth range from the near plane to the far one without gaps
+    CHECK(clusters.getClusterMax(LightClusters::clusterIndex(0, 0, 0)).z == -TestProjection.nearPlane);
+    CHECK(std::abs(clusters.getClusterMin(LightClusters::clusterIndex(0, 0, LightClusters::Slices - 1)).z + TestProjection.farPlane) < 1e-3f);
+    for (uint32_t slice = 1; slice < LightClusters::Slices; ++slice)
+    {
+        CHECK(clusters.getClusterMax(LightClusters::clusterIndex(3, 4, slice)).z ==
+              clusters.getClusterMin(LightClusters::clusterIndex(3, 4, slice - 1)).z);
+    }
+}
+
+// A full rebuild for a moving camera, as every frame does
+BENCHMARK(lightClustersBuildTwoThousand)
+{
+    JobSystem jobSystem(std::max(2u, std::thread::hardware_concurrency()) - 1);
+    std::vector<PointLight> lights = makeLights(2000, 3);
+    LightClusters clusters;
+
+    constexpr int Rounds = 200;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < Rounds; ++round)
+    {
+        float angle = float(round) * 0.01f;
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(std::sin(angle), 0.0f, -std::cos(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+        clusters.build(lights, view, TestProjection, jobSystem);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / Rounds;
+
+    printf("  %.3f ms per build, %zu references, at most %u per cluster, %zu dropped\n", ms, clusters.getIndices().size(),
+           clusters.getMaxClusterLights(), clusters.getDroppedCount());
+}
@@ -0,0 +1,10 @@
+// The metal-cpp definitions main.cpp provides for the app
+#define NS_PRIVATE_IMPLEMENTATION
+#define CA_PRIVATE_IMPLEMENTATION
+#define MTL_PRIVATE_IMPLEMENTATION
+#define MTLFX_PRIVATE_IMPLEMENTATION
+
+#include <Foundation/Foundation.hpp>
+#include <Metal/Metal.hpp>
+#include <MetalFX/MetalFX.hpp>
+#include <QuartzCore/QuartzCore.hpp>
@@ -0,0 +1,54 @@
+#include "Test.hpp"
+#include "JobSystem.hpp"
+#include "Model.hpp"
+#include "ResourceManager.hpp"
+#include "Task.hpp"
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    void writeFile(const std::filesystem::path &path, const std::string &contents)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << contents;
+    }
+}
+
+// Without a device the materials, which have no textures, still load, and the load only
+// fails once the meshes need a geometry page. What it created by then has to go with it.
+TEST(failedModelLoadsDestroyWhatTheyCreated)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "ModelTests";
+    std::filesystem::create_directories(directory);
+    writeFile(directory / "quad.mtl", "newmtl red\nKd 1 0 0\n\nnewmtl blue\nKd 0 0 1\n");
+    writeFile(directory / "quad.obj",
+              "mtllib quad.mtl\n"
+              "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+              "usemtl red\nf 1 2 3\n"
+              "usemtl blue\nf 1 3 4\n");
+
+    JobSystem jobSystem(2);
+    UploadStage uploadStage(jobSystem);
+    ResourceManager resources(nullptr);
+
+    bool failed = false;
+    try
+    {
+        syncWait(jobSystem, Model::loadAsync(jobSystem, uploadStage, resources, nullptr, (directory / "quad.obj").string()));
+    }
+    catch (const std::runtime_error &)
+    {
+        failed = true;
+    }
+
+    CHECK(failed);
+    CHECK(resources.getMaterials().getRetiredCount() == 2);
+    CHECK(resources.getMaterials().size() == 0);
+    CHECK(resources.getMeshes().size() == 0);
+    CHECK(resources.getModels().size() == 0);
+
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,31 @@
+#include "Test.hpp"
+#include "SceneBuffer.hpp"
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+TEST(objectNormalsStayPerpendicularUnderNonUniformScale)
+{
+    glm::mat4 world = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f, -2.0f, 5.0f));
+    world = glm::rotate(world, 0.7f, glm::normalize(glm::vec3(1.0f, 2.0f, 0.5f)));
+    world = glm::scale(world, glm::vec3(4.0f, 0.5f, 1.0f));
+
+    ObjectData object = ObjectData::make(world, Bounds(), 0, 0);
+
+    // A slope in the xy plane; the world matrix carries its tangent, the normal rows its normal
+    glm::vec3 tangent = glm::normalize(glm::vec3(1.0f, 1.0f, 0.0f));
+    glm::vec3 normal = glm::normalize(glm::vec3(-1.0f, 1.0f, 0.0f));
+
+    glm::vec4 tangent4(tangent, 0.0f);
+    glm::vec3 worldTangent(glm::dot(object.worldRows[0], tangent4), glm::dot(object.worldRows[1], tangent4),
+                           glm::dot(object.worldRows[2], tangent4));
+    glm::vec3 worldNormal(glm::dot(glm::vec3(object.normalRows[0]), normal), glm::dot(glm::vec3(object.normalRows[1]), normal),
+                          glm::dot(glm::vec3(object.normalRows[2]), normal));
+
+    CHECK(std::abs(glm::dot(glm::normalize(worldTangent), glm::normalize(worldNormal))) < 1e-5f);
+
+    // The world matrix alone bends the normal off the surface
+    glm::vec4 normal4(normal, 0.0f);
+    glm::vec3 skewed(glm::dot(object.worldRows[0], normal4), glm::dot(object.worldRows[1], normal4),
+                     glm::dot(object.worldRows[2], normal4));
+    CHECK(std::abs(glm::dot(glm::normalize(worldTangent), glm::normalize(skewed))) > 0.1f);
+}
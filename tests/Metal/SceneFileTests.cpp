@@ -0,0 +1,233 @@
+#include "Test.hpp"
+#include "SceneFile.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::string temporaryPath(const char *name)
+    {
+        return (std::filesystem::temp_directory_path() / name).string();
+    }
+
+    void writeFile(const std::string &path, const std::string &contents)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << contents;
+    }
+
+    template <typename T>
+    bool sameArray(const T *a, const T *b, size_t count)
+    {
+        return count == 0 || memcmp(a, b, count * sizeof(T)) == 0;
+    }
+
+    bool sameScene(const SceneFile &a, const SceneFile &b)
+    {
+        if (a.getEntityCount() != b.getEntityCount() || a.getModelCount() != b.getModelCount() ||
+            a.getPipelineCount() != b.getPipelineCount() || a.getPointLightCount() != b.getPointLightCount())
+            return false;
+
+        size_t count = a.getEntityCount();
+        if (!sameArray(a.getPositions(), b.getPositions(), count) || !sameArray(a.getRotations(), b.getRotations(), count) ||
+            !sameArray(a.getScales(), b.getScales(), count) || !sameArray(a.getFlags(), b.getFlags(), count) ||
+            !sameArray(a.getParents(), b.getParents(), count) || !sameArray(a.getModelIndices(), b.getModelIndices(), count) ||
+            !sameArray(a.getPipelineIndices(), b.getPipelineIndices(), count) ||
+            !sameArray(a.getPointLights(), b.getPointLights(), a.getPointLightCount()))
+            return false;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (a.getEntityName(i) != b.getEntityName(i))
+                return false;
+        }
+        for (size_t i = 0; i < a.getModelCount(); ++i)
+        {
+            if (a.getModelAlias(i) != b.getModelAlias(i) || a.getModelPath(i) != b.getModelPath(i))
+                return false;
+        }
+        for (size_t i = 0; i < a.getPipelineCount(); ++i)
+        {
+            if (a.getPipelineName(i) != b.getPipelineName(i))
+                return false;
+        }
+
+        return a.getSunEntity() == b.getSunEntity() && a.getLight().ambientColor == b.getLight().ambientColor &&
+               a.getLight().lightColor == b.getLight().lightColor;
+    }
+
+    bool loadFails(const std::string &path)
+    {
+        try
+        {
+            SceneFile::load(path);
+        }
+        catch (const std::runtime_error &)
+        {
+            return true;
+        }
+        return false;
+    }
+}
+
+TEST(sceneFileRoundTripsThroughTextAndBinary)
+{
+    std::string textPath = temporaryPath("SceneFileTests.txt");
+    std::string binaryPath = temporaryPath("SceneFileTests.scene");
+    std::string resavedPath = temporaryPath("SceneFileTests.resaved.txt");
+
+    writeFile(textPath, "# every feature of the text form\n"
+                        "model teapot assets/teapot.obj\n"
+                        "model ball assets/ball.obj\n"
+                        "pipeline standard\n"
+                        "pipeline glass\n"
+                        "ambient 0.2 0.3 0.4\n"
+                        "light 1 0.9 0.8\n"
+                        "sun Sun\n"
+                        "pointlight Arm 0 1 0 4.5 1 0.5 0.25\n"
+                        "entity Sun ball standard - 30 60 0\n"
+                        "entity Body teapot standard - 0.1 0.2 0.3 rotation 0.70710677 0 0.70710677 0 scale 2 2 2\n"
+                        "entity Arm ball glass Body 1 0 0 hidden layer 2 layer 5\n"
+                        "entity Rock teapot standard - -5 0 5 static # trailing comment\n"
+                        "pointlight - 3 3 3 10 0.1 0.2 0.3\n");
+
+    SceneFile text = SceneFile::load(textPath);
+    REQUIRE(text.getEntityCount() == 4);
+    CHECK(text.getModelCount() == 2 && text.getPipelineCount() == 2 && text.getPointLightCount() == 2);
+    CHECK(text.getSunEntity() == 0);
+    CHECK(text.getParents()[2] == 1 && text.getParents()[1] == SceneFile::InvalidIndex);
+    CHECK(text.getModelIndices()[2] == 1 && text.getPipelineIndices()[2] == 1);
+    CHECK(text.getFlags()[2] == ((1u << 2 | 1u << 5) << EntityLayerShift));
+    CHECK(text.getFlags()[3] == (EntityVisible | EntityStatic));
+    CHECK(text.getScales()[1] == glm::vec3(2.0f));
+    CHECK(text.getPointLights()[0].entity == 2 && text.getPointLights()[1].entity == SceneFile::InvalidIndex);
+    CHECK(text.getEntityName(3) == "Rock" && text.getModelPath(1) == "assets/ball.obj");
+
+    // Text to binary and back, both ways must be lossless
+    text.saveBinary(binaryPath);
+    SceneFile binary = SceneFile::load(binaryPath);
+    CHECK(sameScene(text, binary));
+
+    binary.saveText(resavedPath);
+    SceneFile resaved = SceneFile::load(resavedPath);
+    CHECK(sameScene(text, resaved));
+
+    // A moved-from file keeps nothing, the moved-to one still reads the mapping
+    SceneFile moved = std::move(binary);
+    CHECK(sameScene(text, moved));
+    CHECK(binary.getEntityCount() == 0);
+
+    std::filesystem::remove(textPath);
+    std::filesystem::remove(binaryPath);
+    std::filesystem::remove(resavedPath);
+}
+
+TEST(sceneFileRejectsMalformedFiles)
+{
+    std::string path = temporaryPath("SceneFileTests.bad");
+    const char *header = "model teapot assets/teapot.obj\npipeline standard\n";
+
+    writeFile(path, std::string(header) + "entity A sphere standard - 0 0 0\n");
+    CHECK(loadFails(path));
+    writeFile(path, std::string(header) + "entity A teapot standard B 0 0 0\nentity B teapot standard - 0 0 0\n");
+    CHECK(loadFails(path));
+    writeFile(path, std::string(header) + "entity A teapot standard - 0 0\n");
+    CHECK(loadFails(path));
+    writeFile(path, std::string(header) + "sun Nobody\nentity A teapot standard - 0 0 0\n");
+    CHECK(loadFails(path));
+    writeFile(path, std::string(header) + "pointlight - 0 0 0 -1 1 1 1\n");
+    CHECK(loadFails(path));
+    CHECK(loadFails(temporaryPath("SceneFileTests.missing")));
+
+    // Every truncation of a valid binary file is caught before anything reads past the end
+    writeFile(path, std::string(header) + "entity A teapot standard - 0 0 0\nentity B teapot standard A 1 2 3\n");
+    SceneFile::load(path).saveBinary(path);
+    std::string bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    REQUIRE(bytes.size() > 64);
+    for (size_t size : {size_t(8), size_t(64), bytes.size() / 2, bytes.size() - 1})
+    {
+        writeFile(path, bytes.substr(0, size));
+        CHECK(loadFails(path));
+    }
+
+    std::filesystem::remove(path);
+}
+
+// Loading and instantiating a large scene: the text parse for comparison, then the binary map,
+// validation and the bulk copy into the scene store that SceneFile::instantiate makes
+BENCHMARK(sceneFileLoadHundredThousand)
+{
+    constexpr int Count = 100000;
+    std::string textPath = temporaryPath("SceneFileBenchmark.txt");
+    std::string binaryPath = temporaryPath("SceneFileBenchmark.scene");
+    {
+        std::ofstream file(textPath);
+        file << "model teapot assets/teapot.obj\nmodel capsule assets/capsule.obj\npipeline standard\n";
+        for (int i = 0; i < Count; ++i)
+        {
+            file << "entity Prop" << i << (i % 2 ? " capsule" : " teapot") << " standard " << (i % 10 ? "Prop" + std::to_string(i - i % 10) : "-")
+                 << " " << i % 300 << " 0 " << i / 300 << " rotation 0.70710677 0 0.70710677 0 scale 1.5 1.5 1.5 static\n";
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    SceneFile text = SceneFile::load(textPath);
+    double textMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    text.saveBinary(binaryPath);
+
+    constexpr int Rounds = 10;
+    double loadMs = 0.0;
+    double createMs = 0.0;
+    for (int round = 0; round < Rounds; ++round)
+    {
+        start = std::chrono::steady_clock::now();
+        SceneFile file = SceneFile::load(binaryPath);
+        auto loaded = std::chrono::steady_clock::now();
+
+        // What instantiate does once the models and pipelines are resolved
+        size_t count = file.getEntityCount();
+        std::vector<ModelHandle> models(count);
+        std::vector<PipelineId> pipelines(count, 0);
+        std::vector<Bounds> bounds(count);
+        std::vector<std::string_view> names(count);
+        for (size_t i = 0; i < count; ++i)
+            names[i] = file.getEntityName(i);
+
+        EntityBatch batch;
+        batch.count = count;
+        batch.positions = file.getPositions();
+        batch.rotations = file.getRotations();
+        batch.scales = file.getScales();
+        batch.flags = file.getFlags();
+        batch.parents = file.getParents();
+        batch.models = models.data();
+        batch.pipelines = pipelines.data();
+        batch.localBounds = bounds.data();
+        batch.names = names.data();
+
+        Scene scene;
+        scene.createBatch(batch);
+        auto created = std::chrono::steady_clock::now();
+
+        loadMs += std::chrono::duration<double, std::milli>(loaded - start).count();
+        createMs += std::chrono::duration<double, std::milli>(created - loaded).count();
+    }
+
+    printf("  text parse:   %8.2f ms\n", textMs);
+    printf("  binary load:  %8.2f ms, %.1f MB\n", loadMs / Rounds, std::filesystem::file_size(binaryPath) / 1e6);
+    printf("  create batch: %8.2f ms\n", createMs / Rounds);
+
+    std::filesystem::remove(textPath);
+    std::filesystem::remove(binaryPath);
+}
@@ -0,0 +1,164 @@
+#include "Test.hpp"
+#include "StateTracker.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Stands in for the render command encoder and counts what reaches it
+    struct RecordingEncoder
+    {
+        uint32_t stateCalls = 0;
+        uint32_t offsetCalls = 0;
+        uint32_t draws = 0;
+
+        void setRenderPipelineState(MTL::RenderPipelineState *) { stateCalls++; }
+        void setDepthStencilState(MTL::DepthStencilState *) { stateCalls++; }
+        void setFrontFacingWinding(MTL::Winding) { stateCalls++; }
+        void setCullMode(MTL::CullMode) { stateCalls++; }
+        void setVertexBuffer(MTL::Buffer *, NS::UInteger, NS::UInteger) { stateCalls++; }
+        void setVertexBufferOffset(NS::UInteger, NS::UInteger) { stateCalls++; offsetCalls++; }
+        void setVertexBytes(const void *, NS::UInteger, NS::UInteger) { stateCalls++; }
+        void setFragmentBuffer(MTL::Buffer *, NS::UInteger, NS::UInteger) { stateCalls++; }
+        void setFragmentBufferOffset(NS::UInteger, NS::UInteger) { stateCalls++; offsetCalls++; }
+        void setFragmentBytes(const void *, NS::UInteger, NS::UInteger) { stateCalls++; }
+        void setFragmentTexture(MTL::Texture *, NS::UInteger) { stateCalls++; }
+        void setFragmentSamplerState(MTL::SamplerState *, NS::UInteger) { stateCalls++; }
+
+        void drawIndexedPrimitives(MTL::PrimitiveType, NS::UInteger, MTL::IndexType, MTL::Buffer *, NS::UInteger, NS::UInteger,
+                                   NS::Integer, NS::UInteger)
+        {
+            draws++;
+        }
+        void drawPrimitives(MTL::PrimitiveType, NS::UInteger, NS::UInteger) { draws++; }
+    };
+
+    // Objects are only compared by address, so distinct fake ones will do
+    template <typename T>
+    T *fake(uintptr_t id)
+    {
+        return reinterpret_cast<T *>(0x1000 + id * 16);
+    }
+
+    struct Draw
+    {
+        uint32_t pipeline;
+        uint32_t mesh;
+        uint32_t objectIndex;
+    };
+
+    // What Renderer::drawView issues per mesh draw, meshes sharing one geometry buffer
+    void encode(BasicStateTracker<RecordingEncoder> &state, const std::vector<Draw> &draws)
+    {
+        MTL::Buffer *geometry = fake<MTL::Buffer>(100);
+        for (const Draw &draw : draws)
+        {
+            state.setRenderPipelineState(fake<MTL::RenderPipelineState>(draw.pipeline));
+            state.setVertexBytes(&draw.objectIndex, sizeof(draw.objectIndex), 5);
+            state.setVertexBuffer(geometry, 0, 0);
+            state.drawIndexedPrimitives(MTL::PrimitiveTypeTriangle, 36, MTL::IndexTypeUInt32, geometry, draw.mesh * 36 * sizeof(uint32_t),
+                                        1, 0, 0);
+        }
+    }
+}
+
+TEST(stateTrackerElidesRepeatsInASortedDrawStream)
+{
+    constexpr uint32_t Pipelines = 4;
+    constexpr uint32_t Meshes = 8;
+    constexpr uint32_t Instances = 16;
+    constexpr uint32_t Draws = Pipelines * Meshes * Instances;
+
+    std::vector<Draw> draws;
+    for (uint32_t p = 0; p < Pipelines; ++p)
+    {
+        for (uint32_t m = 0; m < Meshes; ++m)
+        {
+            for (uint32_t i = 0; i < Instances; ++i)
+                draws.push_back({p, m, uint32_t(draws.size())});
+        }
+    }
+
+    RecordingEncoder encoder;
+    BasicStateTracker<RecordingEncoder> state(&encoder);
+    encode(state, draws);
+
+    // One pipeline change per pipeline, the object index every draw, the geometry buffer once
+    CHECK(state.getDrawCount() == Draws);
+    CHECK(state.getIssuedCount() == Pipelines + Draws + 1);
+    CHECK(state.getElidedCount() == (Draws - Pipelines) + (Draws - 1));
+    CHECK(encoder.stateCalls == state.getIssuedCount());
+    CHECK(encoder.draws == Draws);
+
+    // The same draws shuffled switch pipelines far more often, and still only what changed goes through
+    std::mt19937 random(9);
+    std::shuffle(draws.begin(), draws.end(), random);
+    uint32_t switches = 1;
+    for (size_t i = 1; i < draws.size(); ++i)
+        switches += draws[i].pipeline != draws[i - 1].pipeline ? 1 : 0;
+
+    RecordingEncoder shuffledEncoder;
+    BasicStateTracker<RecordingEncoder> shuffled(&shuffledEncoder);
+    encode(shuffled, draws);
+    CHECK(shuffled.getIssuedCount() == switches + Draws + 1);
+    CHECK(shuffledEncoder.stateCalls == shuffled.getIssuedCount());
+    CHECK(switches > Pipelines * 10);
+}
+
+TEST(stateTrackerShadowsEachKindOfBinding)
+{
+    RecordingEncoder encoder;
+    BasicStateTracker<RecordingEncoder> state(&encoder);
+    MTL::Buffer *buffer = fake<MTL::Buffer>(1);
+    MTL::Texture *texture = fake<MTL::Texture>(2);
+    MTL::SamplerState *sampler = fake<MTL::SamplerState>(3);
+
+    // The same buffer at another offset only moves the offset
+    state.setFragmentBuffer(buffer, 0, 5);
+    state.setFragmentBuffer(buffer, 0, 5);
+    state.setFragmentBuffer(buffer, 256, 6);
+    state.setFragmentBuffer(buffer, 512, 6);
+    CHECK(encoder.offsetCalls == 1);
+    CHECK(state.getIssuedCount() == 3 && state.getElidedCount() == 1);
+
+    // Small inline bytes are compared by value, large ones always go through
+    uint32_t value = 7;
+    state.setVertexBytes(&value, sizeof(value), 1);
+    state.setVertexBytes(&value, sizeof(value), 1);
+    value = 8;
+    state.setVertexBytes(&value, sizeof(value), 1);
+    float matrix[16] = {};
+    state.setVertexBytes(matrix, sizeof(matrix), 2);
+    state.setVertexBytes(matrix, sizeof(matrix), 2);
+    CHECK(state.getIssuedCount() == 3 + 4 && state.getElidedCount() == 1 + 1);
+
+    // Bytes and a buffer at the same index replace one another
+    state.setVertexBuffer(buffer, 0, 1);
+    state.setVertexBytes(&value, sizeof(value), 1);
+    CHECK(state.getIssuedCount() == 7 + 2);
+
+    state.setFragmentTexture(texture, 0);
+    state.setFragmentTexture(texture, 0);
+    state.setFragmentSamplerState(sampler, 0);
+    state.setFragmentSamplerState(sampler, 0);
+    state.setCullMode(MTL::CullModeBack);
+    state.setCullMode(MTL::CullModeBack);
+    state.setFrontFacingWinding(MTL::WindingCounterClockwise);
+    state.setFrontFacingWinding(MTL::WindingCounterClockwise);
+    CHECK(state.getIssuedCount() == 9 + 4 && state.getElidedCount() == 2 + 4);
+
+    // Past the shadowed range every call goes through
+    state.setFragmentTexture(texture, BasicStateTracker<RecordingEncoder>::MaxTextures);
+    state.setFragmentTexture(texture, BasicStateTracker<RecordingEncoder>::MaxTextures);
+    CHECK(state.getIssuedCount() == 13 + 2);
+
+    // After a reset nothing is assumed bound
+    state.reset();
+    state.setFragmentTexture(texture, 0);
+    state.setCullMode(MTL::CullModeBack);
+    state.setFragmentBuffer(buffer, 512, 6);
+    CHECK(state.getIssuedCount() == 15 + 3 && state.getElidedCount() == 6);
+    CHECK(encoder.stateCalls == state.getIssuedCount());
+}
@@ -0,0 +1,165 @@
+#include "Test.hpp"
+#include "TextureAtlas.hpp"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Every pixel of image i holds i in red and its own coordinates in green and blue
+    std::vector<ImageData> makeImages(size_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<ImageData> images(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            ImageData &image = images[i];
+            image.width = 16 << (random() % 5);
+            image.height = 16 << (random() % 5);
+            if (i % 7 == 0)
+            {
+                // Not a multiple of the padding, the gutter has to round it up
+                image.width = 37;
+                image.height = 90;
+            }
+
+            image.pixels.resize(size_t(image.width) * image.height * 4);
+            for (int y = 0; y < image.height; ++y)
+            {
+                for (int x = 0; x < image.width; ++x)
+                {
+                    unsigned char *pixel = &image.pixels[(size_t(y) * image.width + x) * 4];
+                    pixel[0] = static_cast<unsigned char>(i);
+                    pixel[1] = static_cast<unsigned char>(x);
+                    pixel[2] = static_cast<unsigned char>(y);
+                    pixel[3] = 255;
+                }
+            }
+        }
+        return images;
+    }
+
+    std::vector<const ImageData *> pointers(const std::vector<ImageData> &images)
+    {
+        std::vector<const ImageData *> result;
+        for (const ImageData &image : images)
+            result.push_back(&image);
+        return result;
+    }
+
+    // Regions with their gutters, which must not overlap one another
+    bool guttersOverlap(const AtlasRegion &a, const AtlasRegion &b)
+    {
+        int p = TextureAtlas::Padding;
+        return a.x - p < b.x + b.width + p && b.x - p < a.x + a.width + p &&
+               a.y - p < b.y + b.height + p && b.y - p < a.y + a.height + p;
+    }
+}
+
+TEST(atlasPacksMixedImagesTightly)
+{
+    std::vector<ImageData> images = makeImages(60, 1);
+    TextureAtlas atlas;
+    REQUIRE(atlas.pack(pointers(images)) == images.size());
+
+    CHECK(atlas.getWidth() % TextureAtlas::Padding == 0 && atlas.getHeight() % TextureAtlas::Padding == 0);
+    CHECK(atlas.getWidth() <= TextureAtlas::MaxPageSize && atlas.getHeight() <= TextureAtlas::MaxPageSize);
+
+    const std::vector<AtlasRegion> &regions = atlas.getRegions();
+    size_t overlaps = 0;
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        const AtlasRegion &region = regions[i];
+        CHECK(region.packed);
+        CHECK(region.width == images[i].width && region.height == images[i].height);
+        CHECK(region.x % TextureAtlas::Padding == 0 && region.y % TextureAtlas::Padding == 0);
+        CHECK(region.x >= TextureAtlas::Padding && region.y >= TextureAtlas::Padding);
+        CHECK(region.x + region.width + TextureAtlas::Padding <= atlas.getWidth());
+        CHECK(region.y + region.height + TextureAtlas::Padding <= atlas.getHeight());
+
+        for (size_t j = i + 1; j < regions.size(); ++j)
+        {
+            if (guttersOverlap(region, regions[j]))
+                overlaps++;
+        }
+    }
+    CHECK(overlaps == 0);
+
+    // Gutters and alignment cost some space, but most of the page is image
+    CHECK(atlas.getEfficiency() >= 0.6f);
+    printf("  %zu images in a %dx%d page, %.0f%% covered\n", images.size(), atlas.getWidth(), atlas.getHeight(), atlas.getEfficiency() * 100.0f);
+}
+
+TEST(atlasPageHoldsImagesAndTheirGutters)
+{
+    std::vector<ImageData> images = makeImages(20, 2);
+    std::vector<const ImageData *> sources = pointers(images);
+    TextureAtlas atlas;
+    REQUIRE(atlas.pack(sources) == images.size());
+
+    std::vector<ImageData> mips;
+    atlas.buildMips(sources, mips);
+
+    // Mips stop where the gutter is one texel wide: 8, 4, 2, 1
+    REQUIRE(mips.size() == 4);
+    const ImageData &page = mips[0];
+    REQUIRE(page.width == atlas.getWidth() && page.height == atlas.getHeight());
+
+    auto pixel = [&](int x, int y)
+    { return &page.pixels[(size_t(y) * page.width + x) * 4]; };
+
+    size_t wrong = 0;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const AtlasRegion &region = atlas.getRegions()[i];
+        int right = region.width - 1;
+        int top = region.height - 1;
+
+        // Corners of the image itself, then the gutter repeating the nearest edge texel
+        const int probes[][4] = {
+            {0, 0, 0, 0},
+            {right, top, right, top},
+            {-TextureAtlas::Padding, -TextureAtlas::Padding, 0, 0},
+            {right + TextureAtlas::Padding, top / 2, right, top / 2},
+            {right / 2, -1, right / 2, 0},
+        };
+        for (const int *probe : probes)
+        {
+            const unsigned char *value = pixel(region.x + probe[0], region.y + probe[1]);
+            if (value[0] != i || value[1] != (unsigned char)probe[2] || value[2] != (unsigned char)probe[3])
+                wrong++;
+        }
+
+        // Texcoords map onto the region
+        simd::float2 low = atlas.remap(i, simd::float2{0.0f, 0.0f});
+        simd::float2 high = atlas.remap(i, simd::float2{1.0f, 1.0f});
+        CHECK(std::abs(low.x * page.width - region.x) < 1e-3f && std::abs(low.y * page.height - region.y) < 1e-3f);
+        CHECK(std::abs(high.x * page.width - (region.x + region.width)) < 1e-3f &&
+              std::abs(high.y * page.height - (region.y + region.height)) < 1e-3f);
+    }
+    CHECK(wrong == 0);
+}
+
+TEST(atlasFillsOneMaximumPageAndLeavesTheRest)
+{
+    // 272 pixels with gutters, seven to a row of a 2048 page
+    std::vector<ImageData> images(60);
+    for (ImageData &image : images)
+    {
+        image.width = TextureAtlas::MaxImageSize;
+        image.height = TextureAtlas::MaxImageSize;
+        image.pixels.assign(size_t(image.width) * image.height * 4, 0);
+    }
+
+    TextureAtlas atlas;
+    size_t packed = atlas.pack(pointers(images));
+    CHECK(packed == 49);
+    CHECK(atlas.getPackedCount() == packed);
+    CHECK(atlas.getWidth() <= TextureAtlas::MaxPageSize && atlas.getHeight() <= TextureAtlas::MaxPageSize);
+
+    size_t marked = 0;
+    for (const AtlasRegion &region : atlas.getRegions())
+        marked += region.packed ? 1 : 0;
+    CHECK(marked == packed);
+}
@@ -0,0 +1,133 @@
+#include "Test.hpp"
+#include "JobSystem.hpp"
+#include "PipelineManager.hpp"
+#include "ResourceManager.hpp"
+#include "Scene.hpp"
+#include "Task.hpp"
+#include "WorldStreamer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+
+namespace
+{
+    // Everything the streamer needs, on the system GPU but without a window or a renderer.
+    // Frames retire as soon as they are built, as nothing is ever submitted.
+    struct HeadlessWorld
+    {
+        MTL::Device *device;
+        JobSystem jobSystem{3};
+        UploadStage uploadStage{jobSystem};
+        ResourceManager resources{device};
+        PipelineManager pipelineManager{device, jobSystem};
+        Scene scene;
+        uint64_t frame = 0;
+
+        explicit HeadlessWorld(MTL::Device *device) : device(device) {}
+
+        void step(WorldStreamer &streamer, const glm::vec3 &cameraPosition, float deltaTime)
+        {
+            frame++;
+            resources.beginFrame(frame);
+            jobSystem.pumpMainThread();
+            streamer.update(cameraPosition, deltaTime);
+            scene.updateTransforms(jobSystem);
+            resources.retireFrame(frame);
+        }
+
+        // Frames at the same spot until nothing is loading any more
+        void settle(WorldStreamer &streamer, const glm::vec3 &cameraPosition)
+        {
+            for (int i = 0; i < 1000 && (i == 0 || streamer.getLoadingCount() > 0); ++i)
+            {
+                step(streamer, cameraPosition, 1.0f / 60.0f);
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+    };
+
+    const char *SampleWorld = "bin/Release/assets/worlds/sample.world";
+}
+
+// Flies through the sample world at 600 units a second in real time, from the origin to the
+// Teleport Coordinates default, the way the camera would. Run from the repository root.
+TEST(worldStreamerFlythroughTracksTheCamera)
+{
+    REQUIRE(std::filesystem::exists(SampleWorld));
+    MTL::Device *device = MTL::CreateSystemDefaultDevice();
+    REQUIRE(device);
+
+    NS::AutoreleasePool *pool = NS::AutoreleasePool::alloc()->init();
+    {
+        HeadlessWorld world(device);
+        WorldStreamer streamer(SampleWorld, world.jobSystem, world.uploadStage, world.resources, world.scene, world.pipelineManager, world.device);
+        CHECK(streamer.getCellCount() == 3);
+
+        const glm::vec3 start(0.0f);
+        const glm::vec3 end(490.0f, -281.0f, -4387.0f);
+        const float speed = 600.0f;
+        const float deltaTime = 1.0f / 60.0f;
+        const int frames = static_cast<int>(glm::length(end - start) / speed / deltaTime);
+
+        size_t mostResident = 0;
+        auto frameStart = std::chrono::steady_clock::now();
+        for (int i = 0; i <= frames; ++i)
+        {
+            glm::vec3 position = start + (end - start) * (float(i) / float(frames));
+            world.step(streamer, position, deltaTime);
+            mostResident = std::max(mostResident, streamer.getResidentCount());
+
+            frameStart += std::chrono::microseconds(16667);
+            std::this_thread::sleep_until(frameStart);
+        }
+        world.settle(streamer, end);
+
+        // Only the destination cell is left, the two behind are beyond the hysteresis band
+        CHECK(streamer.getResidentCount() == 1);
+        CHECK(mostResident >= 2);
+        CHECK(streamer.getPeakResidentBytes() > 0);
+        CHECK(streamer.getPeakResidentBytes() <= streamer.getMemoryBudget());
+        CHECK(world.scene.size() > 0);
+
+        printf("  %d frames, peak %.1f MB resident of %zu MB, %zu stalled frames\n", frames,
+               streamer.getPeakResidentBytes() / (1024.0 * 1024.0), streamer.getMemoryBudget() >> 20, streamer.getStallCount());
+    }
+    pool->release();
+    device->release();
+}
+
+// A teleport lands inside a cell nobody prefetched: the frames until it is resident count as
+// stalls, and everything left behind unloads
+TEST(worldStreamerTeleportStallsThenUnloadsBehind)
+{
+    REQUIRE(std::filesystem::exists(SampleWorld));
+    MTL::Device *device = MTL::CreateSystemDefaultDevice();
+    REQUIRE(device);
+
+    NS::AutoreleasePool *pool = NS::AutoreleasePool::alloc()->init();
+    {
+        HeadlessWorld world(device);
+        WorldStreamer streamer(SampleWorld, world.jobSystem, world.uploadStage, world.resources, world.scene, world.pipelineManager, world.device);
+
+        const glm::vec3 first(256.0f, -256.0f, -1280.0f);
+        world.settle(streamer, first);
+        CHECK(streamer.getResidentCount() == 1);
+        size_t entitiesInFirst = world.scene.size();
+        CHECK(entitiesInFirst > 0);
+
+        const glm::vec3 second(256.0f, -256.0f, -4352.0f);
+        size_t stallsBefore = streamer.getStallCount();
+        world.settle(streamer, second);
+        CHECK(streamer.getStallCount() > stallsBefore);
+        CHECK(streamer.getResidentCount() == 1);
+
+        // Still at the destination: no more stalls
+        size_t stallsAfter = streamer.getStallCount();
+        world.step(streamer, second, 1.0f / 60.0f);
+        CHECK(streamer.getStallCount() == stallsAfter);
+    }
+    pool->release();
+    device->release();
+}
@@ -0,0 +1,104 @@
+#include "Test.hpp"
+#include "RedrawTracker.hpp"
+#include "JobSystem.hpp"
+#include "Scene.hpp"
+
+namespace
+{
+    Bounds unitBounds()
+    {
+        Bounds bounds;
+        bounds.add(glm::vec3(-1.0f));
+        bounds.add(glm::vec3(1.0f));
+        return bounds;
+    }
+
+    // Feeds the same state until the tracker goes idle, returns how many frames it drew first
+    int drawsUntilIdle(RedrawTracker &tracker, const FrameState &state)
+    {
+        int draws = 0;
+        while (tracker.needsFrame(state) && draws < 100)
+            draws++;
+        return draws;
+    }
+}
+
+TEST(redrawTrackerDrawsOnlyWhatChanged)
+{
+    RedrawTracker tracker;
+    FrameState state;
+
+    // The first frame always draws, the same state again does not
+    CHECK(drawsUntilIdle(tracker, state) == 1);
+    CHECK(!tracker.needsFrame(state));
+    CHECK(tracker.getActiveFrames() == 1 && tracker.getIdleFrames() == 2);
+
+    // Each watched value draws one frame when it changes
+    FrameState moved = state;
+    moved.viewMatrix[3] = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+    CHECK(drawsUntilIdle(tracker, moved) == 1);
+
+    moved.fov = 60.0f;
+    CHECK(drawsUntilIdle(tracker, moved) == 1);
+    moved.drawableSize = glm::vec2(800.0f, 600.0f);
+    CHECK(drawsUntilIdle(tracker, moved) == 1);
+    moved.sceneVersion++;
+    CHECK(drawsUntilIdle(tracker, moved) == 1);
+    moved.lightColor = glm::vec3(0.5f);
+    CHECK(drawsUntilIdle(tracker, moved) == 1);
+
+    // Streaming keeps drawing for as long as it lasts, and once more when it stops so what it
+    // finished reaches the screen
+    moved.streaming = true;
+    for (int i = 0; i < 10; ++i)
+        CHECK(tracker.needsFrame(moved));
+    moved.streaming = false;
+    CHECK(drawsUntilIdle(tracker, moved) == 1);
+
+    // Input keeps frames coming for InputFrames iterations, its own included, so the UI can settle
+    moved.input = true;
+    CHECK(tracker.needsFrame(moved));
+    moved.input = false;
+    CHECK(drawsUntilIdle(tracker, moved) == int(RedrawTracker::InputFrames) - 1);
+
+    // Disabled, every iteration draws
+    tracker.setEnabled(false);
+    for (int i = 0; i < 10; ++i)
+        CHECK(tracker.needsFrame(moved));
+}
+
+TEST(sceneVersionFollowsEveryVisibleEdit)
+{
+    JobSystem jobSystem(1);
+    Scene scene;
+    Entity entity = scene.create({}, 0, unitBounds());
+    Entity other = scene.create({}, 0, unitBounds());
+    scene.updateTransforms(jobSystem);
+
+    // Updating transforms with nothing edited is not a change
+    uint64_t version = scene.getVersion();
+    scene.updateTransforms(jobSystem);
+    CHECK(scene.getVersion() == version);
+
+    auto bumped = [&]()
+    {
+        bool changed = scene.getVersion() != version;
+        version = scene.getVersion();
+        return changed;
+    };
+
+    scene.setPosition(entity, glm::vec3(1.0f));
+    CHECK(bumped());
+    scene.setRotation(entity, glm::angleAxis(1.0f, glm::vec3(0.0f, 1.0f, 0.0f)));
+    CHECK(bumped());
+    scene.setScale(entity, glm::vec3(2.0f));
+    CHECK(bumped());
+    scene.setFlags(entity, 0);
+    CHECK(bumped());
+    CHECK(scene.setParent(other, entity));
+    CHECK(bumped());
+    scene.create({}, 0, unitBounds());
+    CHECK(bumped());
+    scene.destroy(entity);
+    CHECK(bumped());
+}
@@ -0,0 +1,109 @@
+#include "Test.hpp"
+#include "ResolutionController.hpp"
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // A GPU whose frame time is a fixed part plus a part that follows the pixel count, with noise
+    struct SimulatedGpu
+    {
+        float fixedMs = 2.0f;
+        float fullScaleMs = 30.0f;
+        std::mt19937 random{2};
+        std::normal_distribution<float> noise{0.0f, 0.8f};
+
+        float frame(float scale) { return fixedMs + fullScaleMs * scale * scale + noise(random); }
+        float mean(float scale) const { return fixedMs + fullScaleMs * scale * scale; }
+    };
+
+    // Runs frames and records every scale the controller moves to
+    std::vector<float> run(ResolutionController &controller, SimulatedGpu &gpu, int frames)
+    {
+        std::vector<float> scales;
+        for (int i = 0; i < frames; ++i)
+        {
+            if (controller.addFrame(gpu.frame(controller.getScale())))
+                scales.push_back(controller.getScale());
+        }
+        return scales;
+    }
+
+    bool onStep(float scale)
+    {
+        float steps = scale / ResolutionController::ScaleStep;
+        return std::abs(steps - std::round(steps)) < 1e-3f;
+    }
+}
+
+TEST(resolutionControllerSettlesInBothDirections)
+{
+    constexpr float Budget = 16.7f;
+    ResolutionController controller(Budget);
+    SimulatedGpu gpu;
+
+    // Far over budget at full resolution: it drops, only downwards, and then stays put
+    std::vector<float> down = run(controller, gpu, 1500);
+    REQUIRE(!down.empty());
+    CHECK(down.size() <= 3);
+    for (size_t i = 0; i < down.size(); ++i)
+    {
+        CHECK(onStep(down[i]));
+        CHECK(i == 0 ? down[i] < ResolutionController::MaxScale : down[i] < down[i - 1]);
+    }
+    float settled = controller.getScale();
+    CHECK(settled > ResolutionController::MinScale && settled < ResolutionController::MaxScale);
+    CHECK(gpu.mean(settled) < Budget);
+
+    // One step up leaves no headroom, so it does not sit lower than it needs to either
+    CHECK(gpu.mean(settled + ResolutionController::ScaleStep) > Budget * ResolutionController::Headroom);
+    CHECK(run(controller, gpu, 1500).empty());
+
+    // The load lightens: it climbs a step at a time, only upwards, back to full resolution
+    gpu.fullScaleMs = 10.0f;
+    std::vector<float> up = run(controller, gpu, 3000);
+    REQUIRE(!up.empty());
+    for (size_t i = 0; i < up.size(); ++i)
+    {
+        float previous = i == 0 ? settled : up[i - 1];
+        CHECK(std::abs(up[i] - previous - ResolutionController::ScaleStep) < 1e-4f);
+    }
+    CHECK(controller.getScale() == ResolutionController::MaxScale);
+    CHECK(run(controller, gpu, 1500).empty());
+}
+
+TEST(resolutionControllerIgnoresSpikesAndResets)
+{
+    ResolutionController controller(16.7f);
+
+    // Two long frames a window are under the tenth that the percentile looks past
+    for (int i = 0; i < 30 * 20; ++i)
+        controller.addFrame(i % 30 < 2 ? 40.0f : 10.0f);
+    CHECK(controller.getScale() == ResolutionController::MaxScale);
+    CHECK(controller.getChangeCount() == 0);
+
+    // Sustained overload drops at least one step, and never below the minimum
+    for (int i = 0; i < 30 * 20; ++i)
+        controller.addFrame(1000.0f);
+    CHECK(controller.getScale() == ResolutionController::MinScale);
+
+    // Nonsense samples are ignored
+    uint32_t changes = controller.getChangeCount();
+    for (int i = 0; i < 100; ++i)
+    {
+        controller.addFrame(0.0f);
+        controller.addFrame(-1.0f);
+        controller.addFrame(NAN);
+    }
+    CHECK(controller.getChangeCount() == changes);
+
+    // Disabled, it goes back to full resolution and stays there whatever it is fed
+    controller.setEnabled(false);
+    CHECK(controller.getScale() == ResolutionController::MaxScale);
+    for (int i = 0; i < 100; ++i)
+        CHECK(!controller.addFrame(1000.0f));
+
+    controller.setBudgetMs(0.0f);
+    CHECK(controller.getBudgetMs() == 1.0f);
+}
@@ -0,0 +1,159 @@
+#include "Test.hpp"
+#include "ResourcePool.hpp"
+#include <shared_mutex>
+#include <vector>
+
+namespace
+{
+    // Counts destructor calls of moved-to objects, moved-from shells do not count
+    struct Tracked
+    {
+        int value = 0;
+        int *destroyed = nullptr;
+
+        Tracked(int value, int *destroyed) : value(value), destroyed(destroyed) {}
+        Tracked(Tracked &&other) noexcept : value(other.value), destroyed(std::exchange(other.destroyed, nullptr)) {}
+        Tracked &operator=(Tracked &&other) noexcept
+        {
+            value = other.value;
+            destroyed = std::exchange(other.destroyed, nullptr);
+            return *this;
+        }
+        ~Tracked()
+        {
+            if (destroyed)
+                (*destroyed)++;
+        }
+    };
+}
+
+TEST(poolHandlesGoStaleWhenDestroyed)
+{
+    std::shared_mutex mutex;
+    ResourcePool<int> pool(mutex);
+
+    CHECK(!Handle<int>().isValid());
+    CHECK(pool.get(Handle<int>()) == nullptr);
+
+    Handle<int> first = pool.create(1);
+    Handle<int> second = pool.create(2);
+    REQUIRE(pool.get(first) && pool.get(second));
+    CHECK(*pool.get(first) == 1 && *pool.get(second) == 2);
+
+    pool.destroy(first, 0);
+    CHECK(!pool.isValid(first));
+    CHECK(pool.get(first) == nullptr);
+
+    // The slot is reused under a new generation, the old handle does not alias the new object
+    Handle<int> third = pool.create(3);
+    CHECK(third.index() == first.index());
+    CHECK(third.generation() != first.generation());
+    CHECK(pool.get(first) == nullptr);
+    CHECK(*pool.get(third) == 3);
+
+    // Destroying twice, or through a stale handle, does nothing
+    pool.destroy(first, 0);
+    CHECK(pool.size() == 2);
+}
+
+TEST(poolStaysDenseAfterDestroy)
+{
+    std::shared_mutex mutex;
+    ResourcePool<int> pool(mutex);
+
+    std::vector<Handle<int>> handles;
+    for (int i = 0; i < 100; ++i)
+        handles.push_back(pool.create(i));
+    for (int i = 0; i < 100; i += 3)
+        pool.destroy(handles[i], 0);
+
+    CHECK(pool.size() == 66);
+    for (int i = 0; i < 100; ++i)
+    {
+        if (i % 3 == 0)
+            CHECK(pool.get(handles[i]) == nullptr);
+        else
+            CHECK(pool.get(handles[i]) && *pool.get(handles[i]) == i);
+    }
+
+    // handleAt maps every dense position back to the handle that resolves to it
+    for (size_t d = 0; d < pool.size(); ++d)
+        CHECK(pool.get(pool.handleAt(d)) == pool.begin() + d);
+}
+
+TEST(poolGenerationsSkipZeroWhenTheyWrap)
+{
+    std::shared_mutex mutex;
+    ResourcePool<int> pool(mutex);
+
+    Handle<int> handle = pool.create(0);
+    for (uint32_t i = 0; i < Handle<int>::GenerationMask + 2; ++i)
+    {
+        pool.destroy(handle, 0);
+        handle = pool.create(0);
+        CHECK(handle.isValid());
+        CHECK(handle.generation() != 0);
+    }
+    CHECK(pool.getSlotCount() == 1);
+}
+
+TEST(poolDefersDestructionUntilTheFrameCompletes)
+{
+    std::shared_mutex mutex;
+    ResourcePool<Tracked> pool(mutex);
+    int destroyed = 0;
+
+    Handle<Tracked> early = pool.create(1, &destroyed);
+    Handle<Tracked> late = pool.create(2, &destroyed);
+    pool.destroy(early, 5);
+    pool.destroy(late, 7);
+
+    // The handles stop resolving at once, the objects live on until the GPU is done
+    CHECK(!pool.isValid(early) && !pool.isValid(late));
+    CHECK(destroyed == 0);
+    CHECK(pool.getRetiredCount() == 2);
+
+    pool.collect(4);
+    CHECK(destroyed == 0);
+    pool.collect(6);
+    CHECK(destroyed == 1);
+    pool.collect(7);
+    CHECK(destroyed == 2);
+    CHECK(pool.getRetiredCount() == 0);
+}
+
+TEST(poolCollectLetsDestructorsDestroyOtherHandles)
+{
+    std::shared_mutex mutex;
+    ResourcePool<int> children(mutex);
+
+    // A parent that owns a handle into another pool sharing the same mutex, like a Model its meshes
+    struct Parent
+    {
+        ResourcePool<int> *children;
+        Handle<int> child;
+
+        Parent(ResourcePool<int> *children, Handle<int> child) : children(children), child(child) {}
+        Parent(Parent &&other) noexcept : children(other.children), child(std::exchange(other.child, {})) {}
+        Parent &operator=(Parent &&other) noexcept
+        {
+            children = other.children;
+            child = std::exchange(other.child, {});
+            return *this;
+        }
+        ~Parent()
+        {
+            if (child)
+                children->destroy(child, 10);
+        }
+    };
+
+    ResourcePool<Parent> parents(mutex);
+    Handle<int> child = children.create(42);
+    Handle<Parent> parent = parents.create(&children, child);
+
+    parents.destroy(parent, 3);
+    parents.collect(3);
+    CHECK(!children.isValid(child));
+    CHECK(children.getRetiredCount() == 1);
+}
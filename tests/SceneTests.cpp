@@ -0,0 +1,299 @@
+#include "Test.hpp"
+#include "JobSystem.hpp"
+#include "Scene.hpp"
+#include "ViewCuller.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    Bounds unitBounds()
+    {
+        Bounds bounds;
+        bounds.add(glm::vec3(-1.0f));
+        bounds.add(glm::vec3(1.0f));
+        return bounds;
+    }
+
+    bool near(const glm::vec3 &a, const glm::vec3 &b, float tolerance = 1e-4f)
+    {
+        return std::abs(a.x - b.x) <= tolerance && std::abs(a.y - b.y) <= tolerance && std::abs(a.z - b.z) <= tolerance;
+    }
+
+    glm::mat4 localMatrix(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale)
+    {
+        glm::mat3 r = glm::mat3_cast(rotation);
+        glm::mat4 m(1.0f);
+        m[0] = glm::vec4(r[0] * scale.x, 0.0f);
+        m[1] = glm::vec4(r[1] * scale.y, 0.0f);
+        m[2] = glm::vec4(r[2] * scale.z, 0.0f);
+        m[3] = glm::vec4(position, 1.0f);
+        return m;
+    }
+
+    // Every parent precedes its children in dense order
+    bool parentsPrecedeChildren(const Scene &scene)
+    {
+        for (uint32_t i = 0; i < scene.size(); ++i)
+        {
+            Entity parent = scene.getParent(scene.entityAt(i));
+            if (parent && scene.indexOf(parent) >= i)
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST(sceneStaysDenseAndHandlesGoStale)
+{
+    Scene scene;
+    std::vector<Entity> entities;
+    for (int i = 0; i < 100; ++i)
+        entities.push_back(scene.create({}, 0, unitBounds(), glm::vec3(float(i), 0.0f, 0.0f), "entity " + std::to_string(i)));
+
+    for (int i = 0; i < 100; i += 4)
+        scene.destroy(entities[i]);
+    CHECK(scene.size() == 75);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        if (i % 4 == 0)
+        {
+            CHECK(!scene.isValid(entities[i]));
+            continue;
+        }
+        REQUIRE(scene.isValid(entities[i]));
+        CHECK(scene.getPosition(entities[i]).x == float(i));
+        CHECK(scene.getName(entities[i]) == "entity " + std::to_string(i));
+    }
+
+    // Dense indices and handles map onto each other
+    for (uint32_t d = 0; d < scene.size(); ++d)
+        CHECK(scene.indexOf(scene.entityAt(d)) == d);
+
+    // Freed slots are reused without reviving the old handles
+    for (int i = 0; i < 25; ++i)
+        scene.create({}, 0, unitBounds());
+    CHECK(scene.getSlotCount() == 100);
+    for (int i = 0; i < 100; i += 4)
+        CHECK(!scene.isValid(entities[i]));
+}
+
+TEST(sceneWorldTransformsFollowTheHierarchy)
+{
+    JobSystem jobSystem(2);
+    Scene scene;
+
+    Entity root = scene.create({}, 0, unitBounds(), glm::vec3(10.0f, 0.0f, 0.0f), "root");
+    Entity child = scene.create({}, 0, unitBounds(), glm::vec3(0.0f, 5.0f, 0.0f), "child", root);
+    Entity other = scene.create({}, 0, unitBounds(), glm::vec3(0.0f, 0.0f, 1.0f), "other");
+    Entity grandchild = scene.create({}, 0, unitBounds(), glm::vec3(1.0f, 0.0f, 0.0f), "grandchild", child);
+
+    scene.updateTransforms(jobSystem);
+    CHECK(scene.getLevelCount() == 3);
+    CHECK(scene.getUpdatedCount() == 4);
+    CHECK(parentsPrecedeChildren(scene));
+    CHECK(near(scene.getWorldPosition(grandchild), glm::vec3(11.0f, 5.0f, 0.0f)));
+    CHECK(near(scene.getWorldPosition(other), glm::vec3(0.0f, 0.0f, 1.0f)));
+
+    // World bounds are the local bounds carried by the world matrix
+    const Bounds &bounds = scene.getWorldBounds()[scene.indexOf(grandchild)];
+    CHECK(near(bounds.min, glm::vec3(10.0f, 4.0f, -1.0f)));
+    CHECK(near(bounds.max, glm::vec3(12.0f, 6.0f, 1.0f)));
+
+    // Nothing changed, nothing recomputed
+    scene.updateTransforms(jobSystem);
+    CHECK(scene.getUpdatedCount() == 0);
+
+    // Moving a parent recomputes its subtree only
+    scene.setPosition(child, glm::vec3(0.0f, 6.0f, 0.0f));
+    scene.updateTransforms(jobSystem);
+    CHECK(scene.getUpdatedCount() == 2);
+    CHECK(near(scene.getWorldPosition(grandchild), glm::vec3(11.0f, 6.0f, 0.0f)));
+
+    // Rotation and scale compose parent first
+    glm::quat turn = glm::angleAxis(glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    scene.setRotation(root, turn);
+    scene.setScale(root, glm::vec3(2.0f));
+    scene.updateTransforms(jobSystem);
+    glm::mat4 expected = localMatrix(glm::vec3(10.0f, 0.0f, 0.0f), turn, glm::vec3(2.0f)) *
+                         localMatrix(glm::vec3(0.0f, 6.0f, 0.0f), glm::quat(), glm::vec3(1.0f)) *
+                         localMatrix(glm::vec3(1.0f, 0.0f, 0.0f), glm::quat(), glm::vec3(1.0f));
+    glm::mat4 world = scene.getWorldMatrix(grandchild);
+    for (int column = 0; column < 4; ++column)
+        CHECK(near(glm::vec3(world[column]), glm::vec3(expected[column])));
+
+    // Reparenting keeps the local transform, so the entity moves with its new parent
+    CHECK(scene.setParent(root, grandchild) == false);
+    CHECK(scene.setParent(other, grandchild));
+    scene.updateTransforms(jobSystem);
+    CHECK(scene.getLevelCount() == 4);
+    CHECK(parentsPrecedeChildren(scene));
+    CHECK(near(scene.getWorldPosition(other), glm::vec3(world * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f))));
+
+    // Destroying a parent takes its descendants with it
+    scene.destroy(child);
+    CHECK(!scene.isValid(child) && !scene.isValid(grandchild) && !scene.isValid(other));
+    CHECK(scene.isValid(root));
+    CHECK(scene.size() == 1);
+}
+
+TEST(sceneBatchesKeepTheirParents)
+{
+    JobSystem jobSystem(2);
+    Scene scene;
+
+    // A chain: every entity is one unit above its parent
+    constexpr size_t Count = 1000;
+    std::vector<glm::vec3> positions(Count, glm::vec3(0.0f, 1.0f, 0.0f));
+    std::vector<glm::quat> rotations(Count);
+    std::vector<glm::vec3> scales(Count, glm::vec3(1.0f));
+    std::vector<uint32_t> flags(Count, EntityVisible);
+    std::vector<uint32_t> parents(Count);
+    std::vector<ModelHandle> models(Count);
+    std::vector<PipelineId> pipelines(Count, 0);
+    std::vector<Bounds> bounds(Count, unitBounds());
+    std::vector<std::string_view> names(Count, "link");
+    for (size_t i = 0; i < Count; ++i)
+        parents[i] = i == 0 ? ~0u : uint32_t(i - 1);
+
+    EntityBatch batch;
+    batch.count = Count;
+    batch.positions = positions.data();
+    batch.rotations = rotations.data();
+    batch.scales = scales.data();
+    batch.flags = flags.data();
+    batch.parents = parents.data();
+    batch.models = models.data();
+    batch.pipelines = pipelines.data();
+    batch.localBounds = bounds.data();
+    batch.names = names.data();
+
+    std::vector<Entity> entities = scene.createBatch(batch);
+    REQUIRE(entities.size() == Count);
+    scene.updateTransforms(jobSystem);
+
+    CHECK(scene.getLevelCount() == Count);
+    CHECK(parentsPrecedeChildren(scene));
+    for (size_t i = 0; i < Count; i += 97)
+        CHECK(near(scene.getWorldPosition(entities[i]), glm::vec3(0.0f, float(i + 1), 0.0f)));
+}
+
+TEST(sceneStaticVersionOnlyMovesForStaticChanges)
+{
+    JobSystem jobSystem(1);
+    Scene scene;
+    Entity moving = scene.create({}, 0, unitBounds());
+    Entity fixed = scene.create({}, 0, unitBounds());
+    scene.setFlags(fixed, EntityVisible | EntityStatic);
+    scene.updateTransforms(jobSystem);
+
+    uint64_t staticVersion = scene.getStaticVersion();
+    uint64_t version = scene.getVersion();
+
+    // Dynamic entities can do anything without touching the static batches
+    scene.setPosition(moving, glm::vec3(1.0f));
+    scene.setFlags(moving, 0);
+    scene.setFlags(moving, EntityVisible | (1u << EntityLayerShift));
+    scene.updateTransforms(jobSystem);
+    CHECK(scene.getStaticVersion() == staticVersion);
+    CHECK(scene.getVersion() > version);
+
+    // Setting the flags a static entity already has changes nothing
+    version = scene.getVersion();
+    scene.setFlags(fixed, EntityVisible | EntityStatic);
+    CHECK(scene.getStaticVersion() == staticVersion);
+    CHECK(scene.getVersion() == version);
+
+    // Hiding or moving a static entity does
+    scene.setFlags(fixed, EntityStatic);
+    CHECK(scene.getStaticVersion() > staticVersion);
+    staticVersion = scene.getStaticVersion();
+    scene.setPosition(fixed, glm::vec3(2.0f));
+    scene.updateTransforms(jobSystem);
+    CHECK(scene.getStaticVersion() > staticVersion);
+}
+
+TEST(sceneFlagChangesUpdateOnlyTheirOwnRecord)
+{
+    JobSystem jobSystem(1);
+    Scene scene;
+    Entity parent = scene.create({}, 0, unitBounds(), glm::vec3(0.0f), "parent");
+    Entity child = scene.create({}, 0, unitBounds(), glm::vec3(0.0f, 1.0f, 0.0f), "child", parent);
+    scene.setFlags(child, EntityVisible | EntityStatic);
+    scene.updateTransforms(jobSystem);
+    uint64_t staticVersion = scene.getStaticVersion();
+
+    // The scene buffer rewrites the records listed here, flags included
+    scene.setFlags(parent, 0);
+    scene.setFlags(parent, EntityVisible | (1u << EntityLayerShift));
+    scene.updateTransforms(jobSystem);
+    REQUIRE(scene.getUpdatedCount() == 1);
+    CHECK(scene.getUpdatedIndices()[0] == scene.indexOf(parent));
+    CHECK(scene.getFlags()[scene.indexOf(parent)] == (EntityVisible | (1u << EntityLayerShift)));
+
+    // Nothing moved, so the static child below it was not recomputed
+    CHECK(scene.getStaticVersion() == staticVersion);
+
+    // A flag change on an entity that also moved is listed once
+    scene.setFlags(child, EntityStatic);
+    scene.setPosition(child, glm::vec3(1.0f));
+    scene.updateTransforms(jobSystem);
+    CHECK(scene.getUpdatedCount() == 1);
+
+    scene.updateTransforms(jobSystem);
+    CHECK(scene.getUpdatedCount() == 0);
+}
+
+// The two per-frame passes over a million entities, every one of them animated. Both stream
+// their arrays once, so the bandwidth figure is the one to compare against the machine's.
+BENCHMARK(sceneTransformAndCullMillion)
+{
+    constexpr size_t Count = 1 << 20;
+    JobSystem jobSystem(std::max(2u, std::thread::hardware_concurrency()) - 1);
+    Scene scene;
+
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> spread(-500.0f, 500.0f);
+    std::vector<Entity> entities;
+    entities.reserve(Count);
+    for (size_t i = 0; i < Count; ++i)
+        entities.push_back(scene.create({}, 0, unitBounds(), glm::vec3(spread(random), spread(random), spread(random))));
+    scene.updateTransforms(jobSystem);
+
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    std::vector<ViewCuller::Input> views = {{projection, ~0u}};
+    ViewCuller culler;
+
+    constexpr int Rounds = 10;
+    double transformMs = 0.0;
+    double cullMs = 0.0;
+    for (int round = 0; round < Rounds; ++round)
+    {
+        for (size_t i = 0; i < Count; ++i)
+            scene.setRotation(entities[i], glm::angleAxis(float(round) * 0.1f, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+        auto start = std::chrono::steady_clock::now();
+        scene.updateTransforms(jobSystem);
+        auto transformed = std::chrono::steady_clock::now();
+        culler.cull(views, scene.getWorldBounds(), scene.getFlags(), EntityVisible, jobSystem);
+        auto culled = std::chrono::steady_clock::now();
+
+        transformMs += std::chrono::duration<double, std::milli>(transformed - start).count();
+        cullMs += std::chrono::duration<double, std::milli>(culled - transformed).count();
+    }
+    transformMs /= Rounds;
+    cullMs /= Rounds;
+
+    // Read position, rotation, scale and local bounds, write the world matrix and bounds
+    double transformBytes = double(Count) * (sizeof(glm::vec3) * 2 + sizeof(glm::quat) + sizeof(Bounds) * 2 + sizeof(glm::mat4));
+    double cullBytes = double(Count) * (sizeof(Bounds) + sizeof(uint32_t) + sizeof(uint8_t));
+    printf("  transforms: %7.2f ms, %5.1f GB/s\n", transformMs, transformBytes / (transformMs * 1e6));
+    printf("  cull:       %7.2f ms, %5.1f GB/s, %zu visible\n", cullMs, cullBytes / (cullMs * 1e6), culler.getVisible(0).size());
+}
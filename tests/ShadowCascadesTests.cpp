@@ -0,0 +1,231 @@
+#include "Test.hpp"
+#include "JobSystem.hpp"
+#include "ShadowCascades.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const glm::vec3 LightDirection = glm::normalize(glm::vec3(0.4f, 1.0f, 0.3f));
+
+    ShadowCascades::View makeView(const glm::vec3 &eye, const glm::vec3 &target)
+    {
+        ShadowCascades::View view;
+        view.viewMatrix = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+        view.fovY = glm::radians(60.0f);
+        view.aspect = 16.0f / 9.0f;
+        view.nearPlane = 0.1f;
+        view.farPlane = 200.0f;
+        return view;
+    }
+
+    // The eight world-space corners of the view frustum between two depths
+    std::vector<glm::vec3> sliceCorners(const ShadowCascades::View &view, float nearDepth, float farDepth)
+    {
+        glm::mat4 inverseView = glm::inverse(view.viewMatrix);
+        float tanY = std::tan(view.fovY * 0.5f);
+        float tanX = tanY * view.aspect;
+
+        std::vector<glm::vec3> corners;
+        for (float depth : {nearDepth, farDepth})
+        {
+            for (float x : {-1.0f, 1.0f})
+            {
+                for (float y : {-1.0f, 1.0f})
+                    corners.push_back(glm::vec3(inverseView * glm::vec4(x * depth * tanX, y * depth * tanY, -depth, 1.0f)));
+            }
+        }
+        return corners;
+    }
+
+    std::vector<glm::vec3> boxCorners(const Bounds &bounds)
+    {
+        std::vector<glm::vec3> corners;
+        for (int c = 0; c < 8; ++c)
+            corners.push_back(glm::vec3(c & 1 ? bounds.max.x : bounds.min.x, c & 2 ? bounds.max.y : bounds.min.y, c & 4 ? bounds.max.z : bounds.min.z));
+        return corners;
+    }
+
+    glm::vec3 project(const glm::mat4 &viewProjection, const glm::vec3 &point)
+    {
+        glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+        return glm::vec3(clip) / clip.w;
+    }
+
+    Bounds box(const glm::vec3 &centre, float halfSize)
+    {
+        Bounds bounds;
+        bounds.add(centre - glm::vec3(halfSize));
+        bounds.add(centre + glm::vec3(halfSize));
+        return bounds;
+    }
+}
+
+TEST(shadowCascadesSplitTheDepthRange)
+{
+    auto splits = ShadowCascades::computeSplits(0.1f, 200.0f);
+    CHECK(splits[0] == 0.1f && splits[ShadowCascades::CascadeCount] == 200.0f);
+    for (uint32_t i = 1; i <= ShadowCascades::CascadeCount; ++i)
+        CHECK(splits[i] > splits[i - 1]);
+
+    // The two ends of the blend: equal steps, and equal ratios
+    auto uniform = ShadowCascades::computeSplits(1.0f, 101.0f, 0.0f);
+    auto logarithmic = ShadowCascades::computeSplits(1.0f, 10000.0f, 1.0f);
+    for (uint32_t i = 1; i <= ShadowCascades::CascadeCount; ++i)
+    {
+        CHECK(std::abs(uniform[i] - uniform[i - 1] - 25.0f) < 1e-3f);
+        CHECK(std::abs(logarithmic[i] / logarithmic[i - 1] - 10.0f) < 1e-3f);
+    }
+}
+
+TEST(shadowCascadesCoverTheirSliceAndHoldStill)
+{
+    ShadowCascades::View view = makeView(glm::vec3(10.0f, 5.0f, 20.0f), glm::vec3(-30.0f, 0.0f, -40.0f));
+    ShadowCascades cascades;
+    cascades.fit(view, LightDirection);
+
+    for (uint32_t i = 0; i < ShadowCascades::CascadeCount; ++i)
+    {
+        const ShadowCascade &cascade = cascades.getCascade(i);
+        CHECK(i == 0 || cascade.splitNear == cascades.getCascade(i - 1).splitFar);
+        CHECK(cascade.texelSize == 2.0f * cascade.radius / float(ShadowCascades::Resolution));
+
+        // Every corner of the slice lands inside the shadow map and its depth range
+        size_t outside = 0;
+        for (const glm::vec3 &corner : sliceCorners(view, cascade.splitNear, cascade.splitFar))
+        {
+            glm::vec3 p = project(cascade.viewProjection, corner);
+            if (std::abs(p.x) > 1.0f || std::abs(p.y) > 1.0f || p.z < 0.0f || p.z > 1.0f)
+                outside++;
+        }
+        CHECK(outside == 0);
+
+        // The light looks along its direction: a point towards the light is nearer
+        glm::vec3 centre(glm::inverse(cascade.lightView) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        CHECK(project(cascade.viewProjection, centre + LightDirection).z < project(cascade.viewProjection, centre).z);
+    }
+    CHECK(cascades.getCascade(0).radius < cascades.getCascade(ShadowCascades::CascadeCount - 1).radius);
+
+    // Turning and moving keep every radius, so the texel size never changes
+    std::vector<float> radii;
+    for (uint32_t i = 0; i < ShadowCascades::CascadeCount; ++i)
+        radii.push_back(cascades.getCascade(i).radius);
+
+    size_t changed = 0;
+    size_t unsnapped = 0;
+    for (int step = 1; step <= 50; ++step)
+    {
+        float angle = float(step) * 0.13f;
+        glm::vec3 eye = glm::vec3(10.0f, 5.0f, 20.0f) + glm::vec3(0.037f * float(step), 0.0f, -0.021f * float(step));
+        cascades.fit(makeView(eye, eye + glm::vec3(std::sin(angle), -0.2f, -std::cos(angle))), LightDirection);
+
+        for (uint32_t i = 0; i < ShadowCascades::CascadeCount; ++i)
+        {
+            const ShadowCascade &cascade = cascades.getCascade(i);
+            changed += cascade.radius == radii[i] ? 0 : 1;
+
+            // The box only moves across the light in whole texels
+            for (float offset : {cascade.lightView[3].x, cascade.lightView[3].y})
+            {
+                float texels = offset / cascade.texelSize;
+                if (std::abs(texels - std::round(texels)) > 1e-2f)
+                    unsnapped++;
+            }
+        }
+    }
+    CHECK(changed == 0);
+    CHECK(unsnapped == 0);
+}
+
+TEST(shadowCascadesCullCastersTowardsTheLight)
+{
+    JobSystem jobSystem(2);
+    ShadowCascades::View view = makeView(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -10.0f));
+    ShadowCascades cascades;
+    cascades.fit(view, LightDirection);
+
+    const ShadowCascade &first = cascades.getCascade(0);
+    glm::vec3 firstCentre(glm::inverse(first.lightView) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    float reach = first.radius;
+
+    // Inside the first slice; far up towards the light above it; below its far side; off to one side
+    std::vector<Bounds> bounds = {
+        box(firstCentre, 0.01f),
+        box(firstCentre + LightDirection * reach * 20.0f, 0.01f),
+        box(firstCentre - LightDirection * reach * 3.0f, 0.01f),
+        box(firstCentre + glm::vec3(first.lightView[0].x, first.lightView[1].x, first.lightView[2].x) * reach * 3.0f, 0.01f),
+        box(firstCentre, 0.01f),
+        Bounds(),
+    };
+    std::vector<uint32_t> flags = {1, 1, 1, 1, 2, 1};
+    cascades.cull(bounds, flags, 1, jobSystem);
+
+    auto casts = [&](uint32_t cascade, uint32_t entity)
+    {
+        const std::vector<uint32_t> &casters = cascades.getCascade(cascade).casters;
+        return std::find(casters.begin(), casters.end(), entity) != casters.end();
+    };
+    CHECK(casts(0, 0));
+    CHECK(casts(0, 1));
+    CHECK(!casts(0, 2));
+    CHECK(!casts(0, 3));
+    CHECK(!casts(0, 4));
+    CHECK(!casts(0, 5));
+
+    // The first cascade's depth range now reaches back to the caster high above it
+    glm::vec3 high = project(first.viewProjection, firstCentre + LightDirection * reach * 20.0f);
+    CHECK(high.z >= 0.0f && high.z <= 1.0f);
+
+    // Random boxes against a reference that transforms each corner into light space. Boxes
+    // within float noise of a boundary may go either way.
+    std::mt19937 random(6);
+    std::uniform_real_distribution<float> spread(-150.0f, 150.0f);
+    std::uniform_real_distribution<float> size(0.1f, 5.0f);
+    bounds.clear();
+    flags.clear();
+    for (int i = 0; i < 20000; ++i)
+    {
+        bounds.push_back(box(glm::vec3(spread(random), spread(random) * 0.3f, spread(random)), size(random)));
+        flags.push_back(random() % 8 ? 1u : 2u);
+    }
+    cascades.cull(bounds, flags, 1, jobSystem);
+
+    auto overlaps = [](const Bounds &light, float r)
+    { return light.max.x >= -r && light.min.x <= r && light.max.y >= -r && light.min.y <= r && light.max.z >= -r; };
+
+    size_t wrong = 0;
+    size_t clipped = 0;
+    for (uint32_t c = 0; c < ShadowCascades::CascadeCount; ++c)
+    {
+        const ShadowCascade &cascade = cascades.getCascade(c);
+        std::vector<bool> found(bounds.size(), false);
+        for (uint32_t i : cascade.casters)
+            found[i] = true;
+
+        for (uint32_t i = 0; i < bounds.size(); ++i)
+        {
+            Bounds light;
+            for (const glm::vec3 &corner : boxCorners(bounds[i]))
+                light.add(glm::vec3(cascade.lightView * glm::vec4(corner, 1.0f)));
+
+            bool surelyIn = (flags[i] & 1) && overlaps(light, cascade.radius - 1e-3f);
+            bool surelyOut = !(flags[i] & 1) || !overlaps(light, cascade.radius + 1e-3f);
+            if ((surelyIn && !found[i]) || (surelyOut && found[i]))
+                wrong++;
+        }
+
+        // No caster is clipped on the side towards the light
+        for (uint32_t i : cascade.casters)
+        {
+            for (const glm::vec3 &corner : boxCorners(bounds[i]))
+                clipped += project(cascade.viewProjection, corner).z < -1e-4f ? 1 : 0;
+        }
+        CHECK(!cascade.casters.empty());
+        CHECK(std::is_sorted(cascade.casters.begin(), cascade.casters.end()));
+    }
+    CHECK(wrong == 0);
+    CHECK(clipped == 0);
+}
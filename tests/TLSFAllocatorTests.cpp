@@ -0,0 +1,191 @@
+#include "Test.hpp"
+#include "TLSFAllocator.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Records live ranges by offset and reports any allocation that lands on another
+    class Shadow
+    {
+    public:
+        bool add(const TLSFAllocator::Allocation &allocation)
+        {
+            auto next = ranges.lower_bound(allocation.offset);
+            if (next != ranges.end() && next->first < allocation.offset + allocation.size)
+                return false;
+            if (next != ranges.begin() && std::prev(next)->second > allocation.offset)
+                return false;
+            ranges[allocation.offset] = allocation.offset + allocation.size;
+            return true;
+        }
+
+        void remove(const TLSFAllocator::Allocation &allocation) { ranges.erase(allocation.offset); }
+
+    private:
+        std::map<uint32_t, uint32_t> ranges;
+    };
+}
+
+TEST(tlsfRoundsRequestsUpToASizeClass)
+{
+    // Small sizes are exact, so a pool of them fills to the last unit
+    TLSFAllocator small(1000);
+    uint32_t count = 0;
+    while (small.allocate(10).isValid())
+        count++;
+    CHECK(count == 100);
+    CHECK(small.getFree() == 0);
+
+    // A larger request only takes a block from a class it is sure to fit, so a pool of exactly
+    // its size is not enough unless the size starts a class
+    CHECK(!TLSFAllocator(1000).allocate(1000).isValid());
+    CHECK(TLSFAllocator(1024).allocate(1024).isValid());
+
+    // capacityFor is the smallest pool that is
+    for (uint32_t size : {1u, 15u, 16u, 17u, 100u, 1000u, 4097u, 65535u, 1000000u, 123456789u})
+    {
+        uint32_t capacity = TLSFAllocator::capacityFor(size);
+        CHECK(capacity >= size);
+        CHECK(TLSFAllocator(capacity).allocate(size).isValid());
+        if (capacity > size)
+            CHECK(!TLSFAllocator(capacity - 1).allocate(size).isValid());
+    }
+}
+
+TEST(tlsfFillsAWholePoolAndCoalescesBack)
+{
+    constexpr uint32_t Capacity = 1 << 20;
+    TLSFAllocator allocator(Capacity);
+    Shadow shadow;
+    std::mt19937 random(3);
+    std::uniform_int_distribution<uint32_t> sizes(1, 5000);
+
+    // Random sizes until one no longer fits, then single units, which never round, for the rest
+    std::vector<TLSFAllocator::Allocation> allocations;
+    size_t overlaps = 0;
+    for (;;)
+    {
+        TLSFAllocator::Allocation allocation = allocator.allocate(sizes(random));
+        if (!allocation.isValid())
+            break;
+        overlaps += shadow.add(allocation) ? 0 : 1;
+        allocations.push_back(allocation);
+    }
+    while (allocator.getFree() > 0)
+    {
+        TLSFAllocator::Allocation allocation = allocator.allocate(1);
+        REQUIRE(allocation.isValid());
+        overlaps += shadow.add(allocation) ? 0 : 1;
+        allocations.push_back(allocation);
+    }
+
+    CHECK(overlaps == 0);
+    CHECK(allocator.getUsed() == Capacity);
+    CHECK(allocator.getFreeBlockCount() == 0);
+    CHECK(!allocator.allocate(1).isValid());
+
+    // Freed in any order, everything merges back into the single block it started as
+    std::shuffle(allocations.begin(), allocations.end(), random);
+    for (const TLSFAllocator::Allocation &allocation : allocations)
+        allocator.free(allocation);
+
+    CHECK(allocator.getUsed() == 0);
+    CHECK(allocator.getAllocationCount() == 0);
+    CHECK(allocator.getFreeBlockCount() == 1);
+    CHECK(allocator.getLargestFree() == Capacity);
+    CHECK(allocator.getFragmentation() == 0.0f);
+
+    // A power of two starts a class, so the whole pool goes out in one piece again
+    CHECK(allocator.allocate(Capacity).isValid());
+}
+
+// A million mixed allocations and frees, the way mesh geometry comes and goes while streaming
+TEST(tlsfRandomWorkloadNeverOverlaps)
+{
+    constexpr uint32_t Capacity = 1 << 24;
+    TLSFAllocator allocator(Capacity);
+    Shadow shadow;
+    std::mt19937 random(11);
+    std::uniform_int_distribution<uint32_t> smallSizes(1, 64);
+    std::uniform_int_distribution<uint32_t> largeSizes(1, 1 << 16);
+
+    std::vector<TLSFAllocator::Allocation> live;
+    uint64_t liveUnits = 0;
+    size_t overlaps = 0;
+    size_t wrongSize = 0;
+    size_t wrongUsage = 0;
+
+    for (int i = 0; i < 1000000; ++i)
+    {
+        // Grows to about half full, then hovers there
+        bool allocating = live.empty() || (random() % 100) < (liveUnits < Capacity / 2 ? 60u : 45u);
+        if (allocating)
+        {
+            uint32_t size = random() % 4 ? smallSizes(random) : largeSizes(random);
+            TLSFAllocator::Allocation allocation = allocator.allocate(size);
+            if (!allocation.isValid())
+                continue;
+            wrongSize += allocation.size == size && allocation.offset + size <= Capacity ? 0 : 1;
+            overlaps += shadow.add(allocation) ? 0 : 1;
+            live.push_back(allocation);
+            liveUnits += size;
+        }
+        else
+        {
+            size_t index = random() % live.size();
+            allocator.free(live[index]);
+            shadow.remove(live[index]);
+            liveUnits -= live[index].size;
+            live[index] = live.back();
+            live.pop_back();
+        }
+
+        if (allocator.getUsed() != liveUnits || allocator.getAllocationCount() != live.size())
+            wrongUsage++;
+    }
+
+    CHECK(overlaps == 0);
+    CHECK(wrongSize == 0);
+    CHECK(wrongUsage == 0);
+
+    for (const TLSFAllocator::Allocation &allocation : live)
+        allocator.free(allocation);
+    CHECK(allocator.getFreeBlockCount() == 1);
+    CHECK(allocator.getLargestFree() == Capacity);
+}
+
+// Allocate and free pairs against a pool kept half full of mixed sizes, so the free lists are
+// long and fragmented rather than one block that every request splits
+BENCHMARK(tlsfAllocateFree)
+{
+    constexpr uint32_t Capacity = 1 << 26;
+    TLSFAllocator allocator(Capacity);
+    std::mt19937 random(5);
+
+    std::vector<TLSFAllocator::Allocation> live;
+    while (allocator.getUsed() < Capacity / 2)
+        live.push_back(allocator.allocate(1 + random() % 4096));
+    for (size_t i = 0; i < live.size(); i += 2)
+        allocator.free(live[i]);
+
+    std::vector<uint32_t> sizes(1 << 20);
+    for (uint32_t &size : sizes)
+        size = 1 + random() % 4096;
+
+    constexpr int Rounds = 5;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < Rounds; ++round)
+    {
+        for (uint32_t size : sizes)
+            allocator.free(allocator.allocate(size));
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (double(Rounds) * sizes.size());
+
+    printf("  %.1f ns per allocate and free, %u free blocks, %.2f fragmentation\n", ns, allocator.getFreeBlockCount(), allocator.getFragmentation());
+}
@@ -0,0 +1,176 @@
+#include "Test.hpp"
+#include "Task.hpp"
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static Task<int> square(JobSystem &jobSystem, int value)
+{
+    co_await resumeOnWorker(jobSystem);
+    co_return value * value;
+}
+
+static Task<int> failing(JobSystem &jobSystem)
+{
+    co_await resumeOnWorker(jobSystem);
+    throw std::runtime_error("load failed");
+    co_return 0;
+}
+
+TEST(tasksDoNotStartUntilAwaited)
+{
+    JobSystem jobSystem(2);
+    bool started = false;
+
+    auto lazy = [&]() -> Task<int>
+    {
+        started = true;
+        co_return 1;
+    };
+
+    Task<int> task = lazy();
+    CHECK(!started);
+    CHECK(syncWait(jobSystem, std::move(task)) == 1);
+    CHECK(started);
+}
+
+TEST(whenAllKeepsResultsInOrder)
+{
+    JobSystem jobSystem(4);
+
+    std::vector<Task<int>> tasks;
+    for (int i = 0; i < 100; ++i)
+        tasks.push_back(square(jobSystem, i));
+
+    std::vector<int> results = syncWait(jobSystem, whenAll(jobSystem, std::move(tasks)));
+    REQUIRE(results.size() == 100);
+    for (int i = 0; i < 100; ++i)
+        CHECK(results[i] == i * i);
+}
+
+TEST(exceptionsReachTheAwaiter)
+{
+    JobSystem jobSystem(2);
+
+    bool caught = false;
+    try
+    {
+        syncWait(jobSystem, failing(jobSystem));
+    }
+    catch (const std::runtime_error &)
+    {
+        caught = true;
+    }
+    CHECK(caught);
+}
+
+TEST(resumeOnMainThreadLandsOnTheMainThread)
+{
+    JobSystem jobSystem(2);
+
+    auto hop = [](JobSystem &jobSystem) -> Task<bool>
+    {
+        co_await resumeOnWorker(jobSystem);
+        co_await resumeOnMainThread(jobSystem);
+        co_return jobSystem.isMainThread();
+    };
+
+    for (int i = 0; i < 20; ++i)
+        CHECK(syncWait(jobSystem, hop(jobSystem)));
+}
+
+TEST(uploadStageRunsOneItemAtATimeInOrder)
+{
+    JobSystem jobSystem(4);
+    UploadStage uploadStage(jobSystem);
+
+    std::mutex mutex;
+    std::vector<int> order;
+    std::atomic<int> inside{0};
+    std::atomic<int> overlapped{0};
+
+    JobCounter counter;
+    for (int i = 0; i < 200; ++i)
+    {
+        jobSystem.retain(counter);
+        uploadStage.submit([&, i]()
+                           {
+            if (inside.fetch_add(1) != 0)
+                overlapped++;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(i);
+            }
+            inside.fetch_sub(1);
+            jobSystem.release(counter); });
+    }
+    jobSystem.wait(counter);
+
+    CHECK(overlapped.load() == 0);
+    REQUIRE(order.size() == 200);
+    for (int i = 0; i < 200; ++i)
+        CHECK(order[i] == i);
+}
+
+// Every bundled asset at once through the stages a model load chains, without the GPU work: read
+// on a worker, pass through the serial upload stage, then back to a worker. Model::loadAsync itself
+// is checked in Metal/ModelTests.cpp. Run from the repository root.
+TEST(bundledAssetsLoadConcurrently)
+{
+    const std::filesystem::path assets = "bin/Release/assets";
+    REQUIRE(std::filesystem::is_directory(assets));
+
+    std::vector<std::string> paths;
+    for (const auto &entry : std::filesystem::recursive_directory_iterator(assets))
+    {
+        if (entry.is_regular_file())
+            paths.push_back(entry.path().string());
+    }
+    REQUIRE(!paths.empty());
+
+    constexpr unsigned WorkerCount = 4;
+    JobSystem jobSystem(WorkerCount);
+    UploadStage uploadStage(jobSystem);
+
+    std::mutex threadMutex;
+    std::set<std::thread::id> threads;
+    std::atomic<int> uploading{0};
+    std::atomic<int> overlappedUploads{0};
+
+    auto load = [&](std::string path) -> Task<size_t>
+    {
+        std::optional<std::vector<char>> bytes = co_await readFileAsync(jobSystem, path);
+        {
+            std::lock_guard<std::mutex> lock(threadMutex);
+            threads.insert(std::this_thread::get_id());
+        }
+
+        co_await resumeOnUploadStage(uploadStage);
+        if (uploading.fetch_add(1) != 0)
+            overlappedUploads++;
+        uploading.fetch_sub(1);
+
+        co_await resumeOnWorker(jobSystem);
+        co_return bytes ? bytes->size() : ~size_t(0);
+    };
+
+    std::vector<Task<size_t>> loads;
+    for (const std::string &path : paths)
+        loads.push_back(load(path));
+
+    std::vector<size_t> sizes = syncWait(jobSystem, whenAll(jobSystem, std::move(loads)));
+    REQUIRE(sizes.size() == paths.size());
+    for (size_t i = 0; i < paths.size(); ++i)
+        CHECK(sizes[i] == std::filesystem::file_size(paths[i]));
+
+    // However many loads are in flight, they share the workers and the waiting thread
+    CHECK(threads.size() <= WorkerCount + 1);
+    CHECK(overlappedUploads.load() == 0);
+    printf("  %zu assets on %zu threads\n", paths.size(), threads.size());
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Just enough of a test framework for the engine's GPU-free parts. TEST and BENCHMARK register
+// a function at static initialization; the runner calls tests in registration order and
+// benchmarks only when asked. CHECK records a failure and carries on, REQUIRE also returns.
+class TestRegistry
+{
+public:
+    struct Case
+    {
+        const char *name;
+        void (*function)();
+        bool benchmark;
+    };
+
+    struct Registrar
+    {
+        Registrar(const char *name, void (*function)(), bool benchmark) { cases().push_back({name, function, benchmark}); }
+    };
+
+    static std::vector<Case> &cases();
+
+    static void fail(const char *file, int line, const char *expression);
+    static uint32_t getFailureCount() { return failureCount; }
+
+private:
+    static uint32_t failureCount;
+};
+
+#define TEST_REGISTER(name, benchmark)                                       \
+    static void name();                                                      \
+    static TestRegistry::Registrar name##Registrar(#name, name, benchmark);  \
+    static void name()
+
+#define TEST(name) TEST_REGISTER(name, false)
+#define BENCHMARK(name) TEST_REGISTER(name, true)
+
+#define CHECK(expression)                                                    \
+    do                                                                       \
+    {                                                                        \
+        if (!(expression))                                                   \
+            TestRegistry::fail(__FILE__, __LINE__, #expression);             \
+    } while (0)
+
+#define REQUIRE(expression)                                                  \
+    do                                                                       \
+    {                                                                        \
+        if (!(expression))                                                   \
+        {                                                                    \
+            TestRegistry::fail(__FILE__, __LINE__, #expression);             \
+            return;                                                          \
+        }                                                                    \
+    } while (0)
@@ -0,0 +1,56 @@
+#include "Test.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+uint32_t TestRegistry::failureCount = 0;
+
+std::vector<TestRegistry::Case> &TestRegistry::cases()
+{
+    static std::vector<Case> registered;
+    return registered;
+}
+
+void TestRegistry::fail(const char *file, int line, const char *expression)
+{
+    failureCount++;
+    printf("  %s:%d: CHECK(%s) failed\n", file, line, expression);
+}
+
+// Tests [--bench] [filter]: runs every test whose name contains the filter, and the matching
+// benchmarks too with --bench. Exits non-zero if any check failed.
+int main(int argc, char **argv)
+{
+    bool benchmarks = false;
+    std::string filter;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--bench") == 0)
+            benchmarks = true;
+        else
+            filter = argv[i];
+    }
+
+    uint32_t run = 0;
+    uint32_t failed = 0;
+    for (const TestRegistry::Case &test : TestRegistry::cases())
+    {
+        if ((test.benchmark && !benchmarks) || std::string(test.name).find(filter) == std::string::npos)
+            continue;
+
+        uint32_t failuresBefore = TestRegistry::getFailureCount();
+        auto start = std::chrono::steady_clock::now();
+        test.function();
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        bool passed = TestRegistry::getFailureCount() == failuresBefore;
+        printf("%s %s (%.1f ms)\n", passed ? "[pass]" : "[FAIL]", test.name, ms);
+        run++;
+        if (!passed)
+            failed++;
+    }
+
+    printf("%u run, %u failed\n", run, failed);
+    return failed == 0 ? 0 : 1;
+}
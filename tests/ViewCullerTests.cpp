@@ -0,0 +1,156 @@
+#include "Test.hpp"
+#include "JobSystem.hpp"
+#include "View.hpp"
+#include "ViewCuller.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const glm::mat4 Projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+
+    Bounds box(const glm::vec3 &centre, float halfSize)
+    {
+        Bounds bounds;
+        bounds.add(centre - glm::vec3(halfSize));
+        bounds.add(centre + glm::vec3(halfSize));
+        return bounds;
+    }
+
+    // How far the box's furthest corner is inside the frustum's nearest plane, as
+    // Frustum::intersects measures it. Negative when the box is entirely outside one plane.
+    float frustumMargin(const Frustum &frustum, const Bounds &bounds)
+    {
+        float margin = FLT_MAX;
+        for (const glm::vec4 &plane : frustum.planes)
+        {
+            glm::vec3 positive(plane.x >= 0.0f ? bounds.max.x : bounds.min.x,
+                               plane.y >= 0.0f ? bounds.max.y : bounds.min.y,
+                               plane.z >= 0.0f ? bounds.max.z : bounds.min.z);
+            margin = std::min(margin, (glm::dot(glm::vec3(plane), positive) + plane.w) / glm::length(glm::vec3(plane)));
+        }
+        return margin;
+    }
+}
+
+TEST(viewCullerPlacesKnownBoxes)
+{
+    JobSystem jobSystem(1);
+    std::vector<ViewCuller::Input> views = {
+        {Projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)), ~0u},
+        {Projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f)), ~0u},
+    };
+
+    // Ahead, behind, past the far plane, straddling the near plane, and off to the side
+    std::vector<Bounds> bounds = {
+        box(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f),
+        box(glm::vec3(0.0f, 0.0f, 10.0f), 1.0f),
+        box(glm::vec3(0.0f, 0.0f, -150.0f), 1.0f),
+        box(glm::vec3(0.0f), 0.5f),
+        box(glm::vec3(50.0f, 0.0f, 0.0f), 1.0f),
+        Bounds(),
+    };
+    std::vector<uint32_t> flags(bounds.size(), 1u);
+
+    ViewCuller culler;
+    culler.cull(views, bounds, flags, 1u, jobSystem);
+    REQUIRE(culler.getViewCount() == 2);
+    CHECK(culler.getVisible(0) == std::vector<uint32_t>({0, 3}));
+    CHECK(culler.getVisible(1) == std::vector<uint32_t>({1, 3}));
+    CHECK(culler.getVisibleInAny() == std::vector<uint32_t>({0, 1, 3}));
+    CHECK(culler.getMasks() == std::vector<uint8_t>({1, 2, 0, 3, 0, 0}));
+
+    // Flags that miss visibleFlags hide an entity from every view
+    flags[3] = 2u;
+    culler.cull(views, bounds, flags, 1u, jobSystem);
+    CHECK(culler.getVisibleInAny() == std::vector<uint32_t>({0, 1}));
+}
+
+// Several views of one scattered scene, some restricted to layers, against Frustum per view
+TEST(viewCullerMatchesABruteForceFrustumPerView)
+{
+    JobSystem jobSystem(2);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> spread(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> size(0.1f, 3.0f);
+
+    std::vector<Bounds> bounds;
+    std::vector<uint32_t> flags;
+    for (int i = 0; i < 50000; ++i)
+    {
+        bounds.push_back(box(glm::vec3(spread(random), spread(random) * 0.2f, spread(random)), size(random)));
+
+        // Mostly layer 0, some on layer 1 or on both 1 and 2, a few hidden
+        uint32_t entity = 1u;
+        if (i % 7 == 0)
+            entity |= 2u << EntityLayerShift;
+        if (i % 13 == 0)
+            entity |= 6u << EntityLayerShift;
+        if (i % 11 == 0)
+            entity = 0u;
+        flags.push_back(entity);
+    }
+    bounds.push_back(Bounds());
+    flags.push_back(1u);
+
+    std::vector<ViewCuller::Input> views = {
+        {Projection * glm::lookAt(glm::vec3(0.0f, 2.0f, 0.0f), glm::vec3(0.0f, 2.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)), ~0u},
+        {Projection * glm::lookAt(glm::vec3(0.0f, 40.0f, 0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f)), 1u},
+        {Projection * glm::lookAt(glm::vec3(10.0f, 5.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), 2u},
+        {Projection * glm::lookAt(glm::vec3(-20.0f, 3.0f, 5.0f), glm::vec3(30.0f, 0.0f, -5.0f), glm::vec3(0.0f, 1.0f, 0.0f)), 4u | 1u},
+        {glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, 0.0f, 80.0f) * glm::lookAt(glm::vec3(0.0f, 40.0f, 0.0f), glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f)), ~0u},
+        {Projection, 0u},
+    };
+
+    ViewCuller culler;
+    culler.cull(views, bounds, flags, 1u, jobSystem);
+    REQUIRE(culler.getViewCount() == views.size());
+
+    // Boxes within float noise of a plane may go either way
+    size_t wrong = 0;
+    std::vector<uint8_t> expectedAny(bounds.size(), 0);
+    for (uint32_t v = 0; v < views.size(); ++v)
+    {
+        Frustum frustum(views[v].viewProjection);
+        const std::vector<uint32_t> &visible = culler.getVisible(v);
+        CHECK(std::is_sorted(visible.begin(), visible.end()));
+
+        std::vector<bool> found(bounds.size(), false);
+        for (uint32_t i : visible)
+            found[i] = true;
+
+        size_t expected = 0;
+        for (uint32_t i = 0; i < bounds.size(); ++i)
+        {
+            bool candidate = (flags[i] & 1u) && !bounds[i].isEmpty() && (entityLayers(flags[i]) & views[v].layerMask);
+            float margin = candidate ? frustumMargin(frustum, bounds[i]) : -1.0f;
+            if ((margin > 1e-3f && !found[i]) || (margin < -1e-3f && found[i]))
+                wrong++;
+            if (found[i])
+            {
+                expected++;
+                expectedAny[i] = 1;
+                CHECK(culler.getMasks()[i] & (1u << v));
+            }
+        }
+        CHECK(v == views.size() - 1 ? expected == 0 : expected > 0);
+    }
+    CHECK(wrong == 0);
+
+    // The union lists each entity seen by any view once
+    std::vector<uint32_t> any;
+    for (uint32_t i = 0; i < bounds.size(); ++i)
+    {
+        if (expectedAny[i])
+            any.push_back(i);
+    }
+    CHECK(culler.getVisibleInAny() == any);
+
+    // Views past the limit are dropped, the rest still culled
+    std::vector<ViewCuller::Input> many(ViewCuller::MaxViews + 2, views[0]);
+    culler.cull(many, bounds, flags, 1u, jobSystem);
+    CHECK(culler.getViewCount() == ViewCuller::MaxViews);
+    CHECK(culler.getVisible(ViewCuller::MaxViews - 1) == culler.getVisible(0));
+}